@@ -0,0 +1,64 @@
+/**
+ * @file audio_bench.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Benchmark of the audio processing stages.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef AUDIO_BENCH_H
+#define AUDIO_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Cada etapa se corre AUDIO_BENCH_RUNS veces sobre un bloque sintetico del
+ * tamaño de un periodo (medio buffer de DMA) y se guarda el promedio. En la
+ * placa se mide con el DWT, fuera de ella con el reloj del sistema
+ * convertido a ciclos de un core de AUDIO_BENCH_CPU_HZ.
+ */
+#define AUDIO_BENCH_RUNS			64
+#define AUDIO_BENCH_MAX_SAMPLES		256			//<--- Largest block, interleaved samples
+#define AUDIO_BENCH_CHANNELS		2
+#define AUDIO_BENCH_CPU_HZ			168000000UL		//<--- Core clock the loads are projected to
+#define AUDIO_BENCH_MAX_STAGES		24
+
+typedef struct
+{
+	const char *name;
+	uint32_t cycles;			//<--- Average cycles per block
+	uint32_t samples;			//<--- Samples per block
+} audio_bench_result_t;
+
+/**
+ * @brief Run every stage.
+ *
+ * @param block_samples interleaved samples per block, usually BUFFER_LENGHT / 2
+ * @return number of results written.
+ */
+uint32_t audio_bench_run(audio_bench_result_t *results, uint32_t max, uint32_t block_samples);
+
+/**
+ * @brief Load of one stage at a sample rate, in hundredths of percent.
+ */
+uint32_t audio_bench_load(const audio_bench_result_t *result, uint32_t cpu_hz, uint32_t sample_rate);
+
+/**
+ * @brief Samples per second the stage alone could process at cpu_hz.
+ *
+ * @return 0 if the stage was too fast to measure.
+ */
+uint64_t audio_bench_throughput(const audio_bench_result_t *result, uint32_t cpu_hz);
+
+/**
+ * @brief Write the results as JSON: ns per sample, samples per second and load at each rate.
+ *
+ * @return characters that the complete JSON needs (like snprintf).
+ */
+int audio_bench_json(const audio_bench_result_t *results, uint32_t count, char *buf, size_t len);
+
+#endif /* AUDIO_BENCH_H */
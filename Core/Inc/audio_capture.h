@@ -0,0 +1,90 @@
+/**
+ * @file audio_capture.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Framed capture of the ADC stream for the host (Tools/capture_wav.c).
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef AUDIO_CAPTURE_H
+#define AUDIO_CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define AUDIO_CAPTURE_FRAME_SAMPLES	128		//<--- Samples per frame (even), 14 bytes of framing each
+#define AUDIO_CAPTURE_CHANNEL		0		//<--- I2S slot sent, the ES8311 ADC is on the left one
+#define AUDIO_CAPTURE_SYNC			0x5AA5	//<--- "A5 5A" on the wire
+#define AUDIO_CAPTURE_HEADER_BYTES	12
+#define AUDIO_CAPTURE_CRC_BYTES		2
+
+/**
+ * Formato de cada frame, todo little endian:
+ *
+ *   0  u16  sync        AUDIO_CAPTURE_SYNC
+ *   2  u8   format      audio_capture_format_t
+ *   3  u8   channels    1
+ *   4  u16  sequence    +1 por frame generado, tambien si se descarta
+ *   6  u16  rate_hz
+ *   8  u16  samples     muestras por canal en el payload
+ *  10  u16  bytes       largo del payload
+ *  12       payload
+ *   n  u16  crc         CRC-16/CCITT-FALSE de todo lo anterior, sync incluido
+ *
+ * El host se sincroniza con sync + crc, asi que el texto de printf puede
+ * ir mezclado en la misma UART. Un hueco en sequence es un frame perdido.
+ *
+ * Comprimido (audio_codec.h) el payload de ADPCM es un bloque con su
+ * header, cada frame se decodifica solo aunque se pierda el anterior.
+ */
+typedef enum
+{
+	AUDIO_CAPTURE_PCM16,			//<--- Signed 16 bit, the high halfword in 24/32 bit streams
+	AUDIO_CAPTURE_ADPCM,			//<--- IMA-ADPCM block, 4 + samples / 2 bytes
+	AUDIO_CAPTURE_ALAW,				//<--- G.711 A-law, 1 byte per sample
+	AUDIO_CAPTURE_ULAW,				//<--- G.711 u-law, 1 byte per sample
+	AUDIO_CAPTURE_FORMATS
+} audio_capture_format_t;
+
+/**
+ * Sale el frame entero o nada, false si no hubo lugar (log_uart_write).
+ */
+typedef bool (*audio_capture_write_t)(const char *data, uint32_t len);
+
+typedef struct
+{
+	uint32_t frames;			//<--- Frames accepted by the sink
+	uint32_t dropped;			//<--- Frames the sink had no room for
+	uint32_t samples;			//<--- Samples captured
+} audio_capture_stats_t;
+
+/**
+ * @brief Start a capture.
+ *
+ * @param rate_hz stream sampling rate, goes in every header
+ * @param sample_halfwords 1 for 16 bit streams, 2 for 24/32 bit
+ * @param format payload encoding
+ * @param write sink for the frames, called from audio_capture_period
+ */
+void audio_capture_init(uint32_t rate_hz, uint32_t sample_halfwords, audio_capture_format_t format,
+		audio_capture_write_t write);
+
+/**
+ * @brief Add one RX period (interleaved wire format) to the capture.
+ *
+ * Takes AUDIO_CAPTURE_CHANNEL of each frame and sends a frame every
+ * AUDIO_CAPTURE_FRAME_SAMPLES samples.
+ */
+void audio_capture_period(const uint16_t *rx, uint32_t frames);
+
+const audio_capture_stats_t * audio_capture_stats(void);
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), same as the host tool.
+ */
+uint16_t audio_capture_crc16(uint16_t crc, const uint8_t *data, uint32_t len);
+
+#endif /* AUDIO_CAPTURE_H */
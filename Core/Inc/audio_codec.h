@@ -0,0 +1,93 @@
+/**
+ * @file audio_codec.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief IMA-ADPCM (4:1) and G.711 A-law / u-law (2:1) codecs for 16 bit audio.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef AUDIO_CODEC_H
+#define AUDIO_CODEC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Los encoders leen una muestra cada "stride", asi se comprime un canal
+ * directamente del periodo intercalado del DMA (stride 2) o todo el bloque
+ * (stride 1). Los decoders escriben muestras contiguas.
+ *
+ * G.711 sigue a la referencia de la ITU (G.191, el g711.c de Sun): las
+ * versiones _ref buscan el segmento con un loop y decodifican con la
+ * formula, las rapidas usan CLZ y tablas de 256 entradas que arma
+ * audio_codec_init(). Dan el mismo resultado byte a byte.
+ *
+ * IMA-ADPCM es el algoritmo de la IMA / DVI, 4 bits por muestra, el primer
+ * nibble en la mitad baja del byte como en los WAV.
+ */
+#define AUDIO_CODEC_ADPCM_HEADER		4	//<--- Block header: predictor (s16 LE), index, 0
+
+/**
+ * @brief Bytes of an ADPCM block with its header.
+ */
+#define AUDIO_CODEC_ADPCM_BLOCK_BYTES(samples)	(AUDIO_CODEC_ADPCM_HEADER + ((samples) + 1) / 2)
+
+typedef struct
+{
+	int16_t predictor;			//<--- Last reconstructed sample
+	uint8_t index;				//<--- Step table index, 0..88
+} audio_codec_adpcm_t;
+
+/**
+ * @brief Build the G.711 decode tables. Call once before the fast decoders.
+ */
+void audio_codec_init(void);
+
+/**
+ * @brief Start an ADPCM stream from silence.
+ */
+void audio_codec_adpcm_init(audio_codec_adpcm_t *state);
+
+/**
+ * @brief Encode samples to nibbles, the state goes on to the next call.
+ *
+ * @return bytes written, (samples + 1) / 2. An odd count leaves the high
+ * nibble of the last byte at 0.
+ */
+uint32_t audio_codec_adpcm_encode(audio_codec_adpcm_t *state, uint8_t *dst, const int16_t *src,
+		uint32_t samples, uint32_t stride);
+
+void audio_codec_adpcm_decode(audio_codec_adpcm_t *state, int16_t *dst, const uint8_t *src, uint32_t samples);
+
+/**
+ * @brief Encode a self contained block: the state as header, then the nibbles.
+ *
+ * A block decodes without the previous ones, so a lost block does not
+ * corrupt what follows.
+ *
+ * @return AUDIO_CODEC_ADPCM_BLOCK_BYTES(samples)
+ */
+uint32_t audio_codec_adpcm_encode_block(audio_codec_adpcm_t *state, uint8_t *dst, const int16_t *src,
+		uint32_t samples, uint32_t stride);
+
+/**
+ * @brief Decode a block from audio_codec_adpcm_encode_block.
+ *
+ * @return false if the header is not valid.
+ */
+bool audio_codec_adpcm_decode_block(int16_t *dst, const uint8_t *src, uint32_t samples);
+
+void audio_codec_alaw_encode(uint8_t *dst, const int16_t *src, uint32_t samples, uint32_t stride);
+void audio_codec_alaw_encode_ref(uint8_t *dst, const int16_t *src, uint32_t samples, uint32_t stride);
+void audio_codec_alaw_decode(int16_t *dst, const uint8_t *src, uint32_t samples);
+void audio_codec_alaw_decode_ref(int16_t *dst, const uint8_t *src, uint32_t samples);
+
+void audio_codec_ulaw_encode(uint8_t *dst, const int16_t *src, uint32_t samples, uint32_t stride);
+void audio_codec_ulaw_encode_ref(uint8_t *dst, const int16_t *src, uint32_t samples, uint32_t stride);
+void audio_codec_ulaw_decode(int16_t *dst, const uint8_t *src, uint32_t samples);
+void audio_codec_ulaw_decode_ref(int16_t *dst, const uint8_t *src, uint32_t samples);
+
+#endif /* AUDIO_CODEC_H */
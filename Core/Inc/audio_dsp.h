@@ -0,0 +1,264 @@
+/**
+ * @file audio_dsp.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Fixed point DSP kernels for 16 bit interleaved audio.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Los kernels usan las instrucciones SIMD del Cortex-M4 (__SMLAD, __QADD16,
+ * __SSAT...) cuando el compilador las tiene (__ARM_FEATURE_DSP). Cada kernel
+ * tiene ademas una version _ref en C portable que da exactamente el mismo
+ * resultado, para poder comparar y medir fuera de la placa. En el host,
+ * AUDIO_DSP_SIMD_HOST compila el camino SIMD con las instrucciones
+ * escritas en C (Tests/sim/stm32f4xx.h).
+ *
+ * Los buffers son int16_t intercalados (L, R, L, R...) como los del DMA.
+ */
+#define AUDIO_DSP_USE_SIMD			1
+
+#define AUDIO_DSP_CHANNELS			2
+#define AUDIO_DSP_MAX_FRAMES		64		//<--- FIR work buffer, longer blocks are done in chunks
+#define AUDIO_DSP_BIQUAD_MAX_STAGES	8
+#define AUDIO_DSP_FIR_MAX_TAPS		32
+
+#define AUDIO_DSP_Q16_ONE			65536	//<--- Gain 1.0 (0 dB) in Q16.16
+#define AUDIO_DSP_Q15_MAX			32767	//<--- Gain ~1.0 in Q15
+#define AUDIO_DSP_Q14_ONE			16384	//<--- Biquad coefficient 1.0
+
+/**
+ * Biquad en forma directa I, coeficientes en Q14 (rango -2 .. 2):
+ * y = b0 x0 + b1 x1 + b2 x2 - a1 y1 - a2 y2
+ */
+typedef struct
+{
+	int16_t b0;
+	int16_t b1;
+	int16_t b2;
+	int16_t a1;
+	int16_t a2;
+} audio_dsp_biquad_coef_t;
+
+/**
+ * Coeficientes y estado se guardan de a pares empaquetados en 32 bits
+ * (primero en la mitad baja) para cargarlos con una sola instruccion.
+ */
+typedef struct
+{
+	int16_t b0;
+	uint32_t b12;						//<--- b1 | b2 << 16
+	uint32_t a12;						//<--- -a1 | -a2 << 16
+} audio_dsp_biquad_stage_t;
+
+typedef struct
+{
+	uint8_t stages;
+	audio_dsp_biquad_stage_t stage[AUDIO_DSP_BIQUAD_MAX_STAGES];
+	uint32_t x12[AUDIO_DSP_BIQUAD_MAX_STAGES][AUDIO_DSP_CHANNELS];	//<--- x1 | x2 << 16
+	uint32_t y12[AUDIO_DSP_BIQUAD_MAX_STAGES][AUDIO_DSP_CHANNELS];	//<--- y1 | y2 << 16
+} audio_dsp_biquad_t;
+
+typedef struct
+{
+	uint16_t taps;										//<--- Always even, padded with a zero tap
+	int16_t coef[AUDIO_DSP_FIR_MAX_TAPS];				//<--- Q15, reversed order
+	int16_t delay[AUDIO_DSP_CHANNELS][AUDIO_DSP_FIR_MAX_TAPS];	//<--- Last taps - 1 inputs, oldest first
+} audio_dsp_fir_t;
+
+/**
+ * Rampa de ganancia lineal, cambia una vez por frame (igual en todos los canales).
+ */
+typedef struct
+{
+	int32_t gain_q16;					//<--- Current gain
+	int32_t target_q16;
+	int32_t step_q16;					//<--- Added every frame until target is reached
+} audio_dsp_ramp_t;
+
+/**
+ * Compresor / limitador con deteccion de pico, estereo enlazado (la misma
+ * ganancia para todos los canales). La curva se calcula en log2 con una
+ * aproximacion lineal por octava (error < 0.6 dB), solo cuando la
+ * envolvente pasa el umbral.
+ */
+typedef struct
+{
+	int32_t threshold_q15;				//<--- Knee, linear peak level (32767 is 0 dBFS)
+	int32_t slope_q16;					//<--- 1 - 1/ratio, AUDIO_DSP_Q16_ONE is a limiter
+	int32_t attack_q15;					//<--- Envelope coefficient when the level rises
+	int32_t release_q15;				//<--- Envelope coefficient when the level falls
+	int32_t makeup_q16;					//<--- Gain after the compressor
+	int32_t env_q15;					//<--- Peak envelope
+	int32_t gain_q16;					//<--- Last gain applied, for metering
+} audio_dsp_comp_t;
+
+typedef struct
+{
+	int16_t r;							//<--- Pole, Q15 (0.995 -> 32604), -32767 .. 32767
+	int16_t x1[AUDIO_DSP_CHANNELS];
+	int16_t y1[AUDIO_DSP_CHANNELS];
+} audio_dsp_dc_t;
+
+/**
+ * @brief dst = sat(src * gain). Can work in place.
+ *
+ * @param gain_q16 gain in Q16.16, AUDIO_DSP_Q16_ONE is 0 dB
+ */
+void audio_dsp_gain(int16_t *dst, const int16_t *src, uint32_t samples, int32_t gain_q16);
+void audio_dsp_gain_ref(int16_t *dst, const int16_t *src, uint32_t samples, int32_t gain_q16);
+
+/**
+ * @brief Start a ramp already at gain_q16.
+ */
+void audio_dsp_ramp_init(audio_dsp_ramp_t *ramp, int32_t gain_q16);
+
+/**
+ * @brief Go from the current gain to target_q16 in frames frames (0 jumps).
+ */
+void audio_dsp_ramp_set(audio_dsp_ramp_t *ramp, int32_t target_q16, uint32_t frames);
+
+/**
+ * @brief dst = sat(src * gain), gain moving one step per frame. Can work in place.
+ */
+void audio_dsp_ramp(audio_dsp_ramp_t *ramp, int16_t *dst, const int16_t *src, uint32_t frames);
+void audio_dsp_ramp_ref(audio_dsp_ramp_t *ramp, int16_t *dst, const int16_t *src, uint32_t frames);
+
+/**
+ * @brief Envelope coefficient (Q15) for a time constant, 1/(time * fs).
+ */
+int32_t audio_dsp_comp_coef(uint32_t time_ms, uint32_t sample_rate);
+
+/**
+ * @brief Init a compressor.
+ *
+ * @param threshold_q15 knee as a linear peak level
+ * @param ratio 1 (no compression) and up, 0 is a limiter
+ */
+void audio_dsp_comp_init(audio_dsp_comp_t *comp, int16_t threshold_q15, uint16_t ratio,
+		int32_t attack_q15, int32_t release_q15, int32_t makeup_q16);
+
+/**
+ * @brief Run the compressor on one block. Can work in place.
+ */
+void audio_dsp_comp(audio_dsp_comp_t *comp, int16_t *dst, const int16_t *src, uint32_t frames);
+void audio_dsp_comp_ref(audio_dsp_comp_t *comp, int16_t *dst, const int16_t *src, uint32_t frames);
+
+/**
+ * @brief dst = sat(a + b). Can work in place.
+ */
+void audio_dsp_add_sat(int16_t *dst, const int16_t *a, const int16_t *b, uint32_t samples);
+void audio_dsp_add_sat_ref(int16_t *dst, const int16_t *a, const int16_t *b, uint32_t samples);
+
+/**
+ * @brief dst = sat(a * gain_a + b * gain_b), gains in Q15 (-32767 .. 32767).
+ */
+void audio_dsp_mix(int16_t *dst, const int16_t *a, const int16_t *b, uint32_t samples,
+		int16_t gain_a_q15, int16_t gain_b_q15);
+void audio_dsp_mix_ref(int16_t *dst, const int16_t *a, const int16_t *b, uint32_t samples,
+		int16_t gain_a_q15, int16_t gain_b_q15);
+
+/**
+ * @brief DC blocker, y = sat(sat(x - x1) + r * y1), one state per channel.
+ */
+void audio_dsp_dc_init(audio_dsp_dc_t *dc, int16_t r_q15);
+void audio_dsp_dc_remove(audio_dsp_dc_t *dc, int16_t *dst, const int16_t *src, uint32_t frames);
+void audio_dsp_dc_remove_ref(audio_dsp_dc_t *dc, int16_t *dst, const int16_t *src, uint32_t frames);
+
+/**
+ * @brief Load a biquad cascade and clear its state.
+ *
+ * @return false if stages is 0 or more than AUDIO_DSP_BIQUAD_MAX_STAGES.
+ */
+bool audio_dsp_biquad_init(audio_dsp_biquad_t *bq, const audio_dsp_biquad_coef_t *coef, uint8_t stages);
+
+/**
+ * @brief Replace the coefficients of one stage keeping the state.
+ */
+void audio_dsp_biquad_set(audio_dsp_biquad_t *bq, uint8_t stage, const audio_dsp_biquad_coef_t *coef);
+
+/**
+ * @brief Run the cascade, stage by stage. Can work in place.
+ */
+void audio_dsp_biquad(audio_dsp_biquad_t *bq, int16_t *dst, const int16_t *src, uint32_t frames);
+void audio_dsp_biquad_ref(audio_dsp_biquad_t *bq, int16_t *dst, const int16_t *src, uint32_t frames);
+
+/**
+ * @brief Load a FIR (Q15 taps, in normal order) and clear its state.
+ *
+ * @return false if there are too many taps.
+ */
+bool audio_dsp_fir_init(audio_dsp_fir_t *fir, const int16_t *coef_q15, uint16_t taps);
+
+/**
+ * @brief Run the FIR on every channel. Can work in place.
+ */
+void audio_dsp_fir(audio_dsp_fir_t *fir, int16_t *dst, const int16_t *src, uint32_t frames);
+void audio_dsp_fir_ref(audio_dsp_fir_t *fir, int16_t *dst, const int16_t *src, uint32_t frames);
+
+/**
+ * @brief 16 bit samples to Q31 (left aligned).
+ */
+void audio_dsp_s16_to_q31(int32_t *dst, const int16_t *src, uint32_t samples);
+
+/**
+ * @brief Q31 to 16 bit samples, rounded to nearest and saturated.
+ */
+void audio_dsp_q31_to_s16(int16_t *dst, const int32_t *src, uint32_t samples);
+void audio_dsp_q31_to_s16_ref(int16_t *dst, const int32_t *src, uint32_t samples);
+
+/**
+ * Formato de las muestras de 24 y 32 bits en el buffer del DMA ("wire"):
+ * el registro de datos del I2S es de 16 bits, asi que cada muestra son dos
+ * uint16_t, primero la mitad mas significativa. En 24 bits el byte menos
+ * significativo va en 0. Es Q31 con las medias palabras invertidas.
+ *
+ * En memoria hay dos formatos de 24 bits: sin empaquetar (int32_t alineado a
+ * la derecha con extension de signo) y empaquetado (3 bytes little endian).
+ */
+
+/**
+ * @brief DMA buffer samples (2 halfwords each) to Q31. Any halfword alignment.
+ */
+void audio_dsp_wire_to_q31(int32_t *dst, const uint16_t *src, uint32_t samples);
+void audio_dsp_wire_to_q31_ref(int32_t *dst, const uint16_t *src, uint32_t samples);
+
+/**
+ * @brief Q31 to DMA buffer samples. The I2S drops the low byte in 24 bit mode.
+ */
+void audio_dsp_q31_to_wire(uint16_t *dst, const int32_t *src, uint32_t samples);
+void audio_dsp_q31_to_wire_ref(uint16_t *dst, const int32_t *src, uint32_t samples);
+
+/**
+ * @brief Unpacked 24 bit samples to Q31.
+ */
+void audio_dsp_s24_to_q31(int32_t *dst, const int32_t *src, uint32_t samples);
+
+/**
+ * @brief Q31 to unpacked 24 bit samples, rounded to nearest and saturated.
+ */
+void audio_dsp_q31_to_s24(int32_t *dst, const int32_t *src, uint32_t samples);
+void audio_dsp_q31_to_s24_ref(int32_t *dst, const int32_t *src, uint32_t samples);
+
+/**
+ * @brief Packed 24 bit samples (3 bytes each) to Q31.
+ */
+void audio_dsp_s24p_to_q31(int32_t *dst, const uint8_t *src, uint32_t samples);
+void audio_dsp_s24p_to_q31_ref(int32_t *dst, const uint8_t *src, uint32_t samples);
+
+/**
+ * @brief Q31 to packed 24 bit samples, rounded to nearest and saturated.
+ */
+void audio_dsp_q31_to_s24p(uint8_t *dst, const int32_t *src, uint32_t samples);
+void audio_dsp_q31_to_s24p_ref(uint8_t *dst, const int32_t *src, uint32_t samples);
+
+#endif /* AUDIO_DSP_H */
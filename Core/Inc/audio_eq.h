@@ -0,0 +1,89 @@
+/**
+ * @file audio_eq.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Multi band parametric equalizer for the audio path.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef AUDIO_EQ_H
+#define AUDIO_EQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_dsp.h"
+
+/**
+ * El EQ interno del ES8311 queda en bypass (DAC_EQBYPASS_DEFAULT, REG_1C_DEFAULT),
+ * toda la ecualizacion se hace aca. Cada banda es una etapa biquad en Q14
+ * con acumulador de 32 bits (ver audio_dsp_biquad).
+ */
+#define AUDIO_EQ_MAX_BANDS		AUDIO_DSP_BIQUAD_MAX_STAGES
+#define AUDIO_EQ_MAX_GAIN_DB	12.0f		//<--- Larger gains do not fit Q14 coefficients for every Q
+
+typedef enum
+{
+	AUDIO_EQ_PEAK,
+	AUDIO_EQ_LOW_SHELF,
+	AUDIO_EQ_HIGH_SHELF,
+} audio_eq_type_t;
+
+typedef struct
+{
+	audio_eq_type_t type;
+	float freq_hz;				//<--- Center / corner frequency
+	float gain_db;				//<--- 0 dB is a flat band
+	float q;					//<--- Quality factor (shelves: slope, 0.707 is usual)
+} audio_eq_band_t;
+
+typedef struct
+{
+	audio_dsp_biquad_t bq;
+	uint32_t sample_rate;
+	audio_dsp_biquad_coef_t pending[AUDIO_EQ_MAX_BANDS];	//<--- New coefficients, applied at the next block
+	volatile uint32_t pending_mask;							//<--- One bit per band with new coefficients
+	uint32_t cycles_per_band;		//<--- Last block, CPU cycles per band and per frame (x256)
+	uint32_t worst_cycles_per_band;	//<--- Worst block, CPU cycles per band and per frame (x256)
+} audio_eq_t;
+
+/**
+ * @brief Init an equalizer with all the bands flat.
+ *
+ * @return false if bands is 0 or more than AUDIO_EQ_MAX_BANDS.
+ */
+bool audio_eq_init(audio_eq_t *eq, uint32_t sample_rate, uint8_t bands);
+
+/**
+ * @brief Compute the Q14 coefficients of one band (RBJ cookbook).
+ *
+ * @return false if the band is out of range or does not fit in Q14.
+ */
+bool audio_eq_design(const audio_eq_band_t *band, uint32_t sample_rate, audio_dsp_biquad_coef_t *coef);
+
+/**
+ * @brief Change one band. The new coefficients are loaded at the start of the
+ * next block, keeping the filter state, so there is no glitch.
+ *
+ * Safe from an interrupt while audio_eq_process runs in the main loop.
+ */
+bool audio_eq_set_band(audio_eq_t *eq, uint8_t band, const audio_eq_band_t *cfg);
+
+/**
+ * @brief Run the equalizer on one block. Can work in place.
+ */
+void audio_eq_process(audio_eq_t *eq, int16_t *dst, const int16_t *src, uint32_t frames);
+
+/**
+ * @brief Bands that fit in a share of the CPU, from the measured worst cost.
+ *
+ * @param cpu_hz core clock
+ * @param sample_rate rate to project to (22050, 48000...)
+ * @param budget_pct share of the CPU available for the EQ
+ */
+uint32_t audio_eq_max_bands(const audio_eq_t *eq, uint32_t cpu_hz, uint32_t sample_rate, uint32_t budget_pct);
+
+#endif /* AUDIO_EQ_H */
@@ -0,0 +1,77 @@
+/**
+ * @file audio_move.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Block move engine for audio buffers (DMA2 memory to memory).
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef AUDIO_MOVE_H
+#define AUDIO_MOVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "main.h"
+
+#define AUDIO_MOVE_USE_DMA			1		//<--- 0: every move is done by the CPU
+#define AUDIO_MOVE_QUEUE_SIZE		8		//<--- Moves waiting for the DMA
+#define AUDIO_MOVE_DMA_MIN_BYTES	128		//<--- Shorter moves are cheaper with memcpy
+
+/**
+ * Se llama cuando la copia termino. Con DMA se ejecuta desde la
+ * interrupcion de DMA2 Stream0, con CPU desde quien pidio la copia.
+ */
+typedef void (*audio_move_cb_t)(void *ctx);
+
+typedef struct
+{
+	uint32_t dma_moves;			//<--- Moves done by DMA2
+	uint32_t cpu_moves;			//<--- Moves done by the CPU (fallback)
+	uint32_t errors;			//<--- DMA transfer errors, move was redone by the CPU
+	uint32_t max_queued;		//<--- Worst queue depth seen
+} audio_move_stats_t;
+
+/**
+ * @brief Configure DMA2 Stream0 for memory to memory transfers.
+ *
+ * @return false if the DMA could not be configured, moves will use the CPU.
+ */
+bool audio_move_init(void);
+
+/**
+ * @brief Queue a copy of bytes from src to dst.
+ *
+ * Buffers must stay valid until the callback is called. If the DMA can not
+ * take the move (disabled, queue full, short or unaligned move) the copy is
+ * done right away with memcpy and the callback is called before returning.
+ * Can be called from interrupts.
+ *
+ * @param cb may be NULL
+ */
+void audio_move_copy(void *dst, const void *src, uint32_t bytes, audio_move_cb_t cb, void *ctx);
+
+/**
+ * @brief Moves queued or in progress.
+ */
+uint32_t audio_move_pending(void);
+
+/**
+ * @brief Abort the move in progress and drop the queued ones, their
+ * callbacks are not called.
+ *
+ * Only when nothing else can queue moves (I2S stopped for a restart).
+ */
+void audio_move_flush(void);
+
+const audio_move_stats_t * audio_move_stats(void);
+
+/**
+ * @brief DMA2 Stream0 interrupt, call it from DMA2_Stream0_IRQHandler.
+ */
+void audio_move_irq(void);
+
+#endif /* AUDIO_MOVE_H */
@@ -0,0 +1,87 @@
+/**
+ * @file audio_power.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Sleep between audio blocks, idle telemetry and core clock scaling.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef AUDIO_POWER_H
+#define AUDIO_POWER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "main.h"
+
+#define AUDIO_POWER_SCALING			1		//<--- 0: always run at the SystemClock_Config frequency
+#define AUDIO_POWER_MAX_LEVEL		2		//<--- Deepest scaling, HCLK = SYSCLK >> level
+#define AUDIO_POWER_WINDOW			64		//<--- Periods observed before each scaling decision
+#define AUDIO_POWER_DOWN_IDLE_PCT	75		//<--- Worst idle above this: halve HCLK (load < 50 % after)
+#define AUDIO_POWER_UP_IDLE_PCT		30		//<--- Worst idle below this: double HCLK
+
+/**
+ * El DWT no cuenta con el core dormido, asi que los tiempos se miden con el
+ * SysTick (HCLK, sigue corriendo en Sleep). Idle es el tiempo en WFI entre
+ * dos periodos procesados, la latencia va desde el callback del DMA hasta
+ * que el main loop empieza a procesar.
+ */
+typedef struct
+{
+	uint32_t sleeps;				//<--- WFI executed
+	uint32_t periods;				//<--- Periods measured by audio_power_period
+	uint8_t idle_pct;				//<--- Idle time of the last period
+	uint8_t idle_pct_min;			//<--- Worst idle since audio_power_init or the last clock change
+	uint32_t wake_us;				//<--- Last DMA callback to processing latency
+	uint32_t wake_us_max;			//<--- Worst latency since audio_power_init
+	uint8_t level;					//<--- Current scaling, HCLK = SYSCLK >> level
+	uint32_t hclk_hz;
+	uint32_t scale_changes;
+} audio_power_stats_t;
+
+/**
+ * @brief Start measuring, at the clock set by SystemClock_Config.
+ */
+void audio_power_init(void);
+
+/**
+ * @brief Sleep until the next interrupt and account the time as idle.
+ *
+ * Must be called with interrupts disabled (__disable_irq) after checking
+ * that there is nothing to do. A pending interrupt still wakes the core, so
+ * a DMA block that arrives between the check and the WFI is not missed;
+ * its handler runs once interrupts are enabled again.
+ */
+void audio_power_sleep(void);
+
+/**
+ * @brief Timestamp of a new block, called from the DMA callbacks.
+ */
+void audio_power_block(void);
+
+/**
+ * @brief Called by the main loop before processing the periods that woke it.
+ */
+void audio_power_period(void);
+
+/**
+ * @brief Apply the clock level chosen from the last window.
+ *
+ * Call only when nothing depends on the bus timing (no I2C transfer or
+ * memory move in progress). HCLK changes, PCLK1 stays at the
+ * SystemClock_Config value and the I2S runs from PLLI2S, so audio and I2C
+ * are not affected.
+ *
+ * @return true if SystemCoreClock changed.
+ */
+bool audio_power_scale(void);
+
+/**
+ * @brief Get the power counters.
+ */
+const audio_power_stats_t * audio_power_stats(void);
+
+#endif /* AUDIO_POWER_H */
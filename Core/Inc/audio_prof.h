@@ -0,0 +1,87 @@
+/**
+ * @file audio_prof.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Cycle counter profiling of the audio hot paths.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef AUDIO_PROF_H
+#define AUDIO_PROF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * En la placa se usa el CYCCNT del DWT (core_cm4.h). Fuera de ella el
+ * contador es una variable que avanza audio_prof_mock_advance, en Tests/
+ * la llama el reloj del simulador. Las estadisticas se calculan igual.
+ */
+#if defined(__ARM_ARCH_7EM__)
+#include "stm32f4xx.h"
+#define AUDIO_PROF_CYCLES()		(DWT->CYCCNT)
+#else
+extern volatile uint32_t audio_prof_mock_cycles;
+#define AUDIO_PROF_CYCLES()		(audio_prof_mock_cycles)
+#endif
+
+#define AUDIO_PROF_HIST_BUCKETS		16
+#define AUDIO_PROF_HIST_SHIFT		6		//<--- Bucket 0 is below 128 cycles, each bucket doubles
+
+typedef enum
+{
+	PROF_I2S_HALF_CB,			//<--- HAL_I2SEx_TxRxHalfCpltCallback
+	PROF_I2S_CPLT_CB,			//<--- HAL_I2SEx_TxRxCpltCallback
+	PROF_DMA1_S3_IRQ,			//<--- DMA1_Stream3_IRQHandler (I2S2 ext RX)
+	PROF_DMA1_S4_IRQ,			//<--- DMA1_Stream4_IRQHandler (SPI2 TX)
+	PROF_PROCESS,				//<--- Processing of one period in the main loop
+	PROF_COUNT
+} audio_prof_id_t;
+
+typedef struct
+{
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[AUDIO_PROF_HIST_BUCKETS];		//<--- Log2 histogram, see AUDIO_PROF_HIST_SHIFT
+} audio_prof_stat_t;
+
+/**
+ * @brief Enable the cycle counter and clear every probe.
+ */
+void audio_prof_init(void);
+
+/**
+ * @brief Clear every probe, counter keeps running.
+ */
+void audio_prof_reset(void);
+
+static inline uint32_t audio_prof_start(void)
+{
+	return AUDIO_PROF_CYCLES();
+}
+
+/**
+ * @brief Account the cycles since start in one probe.
+ * A probe must be updated always from the same context.
+ *
+ * @return elapsed cycles
+ */
+uint32_t audio_prof_stop(audio_prof_id_t id, uint32_t start);
+
+const audio_prof_stat_t * audio_prof_get(audio_prof_id_t id);
+
+/**
+ * @brief Mean cycles of one probe, 0 if it never ran.
+ */
+uint32_t audio_prof_mean(audio_prof_id_t id);
+
+#if !defined(__ARM_ARCH_7EM__)
+void audio_prof_mock_advance(uint32_t cycles);
+#endif
+
+#endif /* AUDIO_PROF_H */
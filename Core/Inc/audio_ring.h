@@ -0,0 +1,92 @@
+/**
+ * @file audio_ring.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Lock-free single producer / single consumer ring of audio periods.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef AUDIO_RING_H
+#define AUDIO_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "es8311.h"
+
+/**
+ * Cantidad de periodos en el ring. Tiene que ser potencia de 2.
+ * Cada periodo es media transferencia del DMA (BUFFER_LENGHT / 2 muestras).
+ */
+#define AUDIO_RING_PERIODS		4
+#define AUDIO_PERIOD_SAMPLES	(BUFFER_LENGHT / 2)
+
+#if (AUDIO_RING_PERIODS & (AUDIO_RING_PERIODS - 1)) != 0
+#error "AUDIO_RING_PERIODS must be a power of 2"
+#endif
+
+/* El prefill de silencio (period_count - 2) tiene que entrar en el ring */
+#if ES8311_PERIOD_COUNT_MAX != AUDIO_RING_PERIODS + 1
+#error "ES8311_PERIOD_COUNT_MAX must be AUDIO_RING_PERIODS + 1"
+#endif
+
+/**
+ * Solo el productor escribe head y solo el consumidor escribe tail, asi que
+ * no hace falta deshabilitar interrupciones. Los contadores de error los
+ * incrementa quien detecta la condicion (overrun el productor, underrun el
+ * consumidor).
+ */
+typedef struct
+{
+	int16_t slot[AUDIO_RING_PERIODS][AUDIO_PERIOD_SAMPLES];
+	volatile uint32_t head;			//<--- Periods written, only producer modifies it
+	volatile uint32_t tail;			//<--- Periods read, only consumer modifies it
+	volatile uint32_t overrun;		//<--- Producer found the ring full
+	volatile uint32_t underrun;		//<--- Consumer found the ring empty when data was due
+} audio_ring_t;
+
+/**
+ * @brief Empty the ring and clear the counters.
+ * Must not be called while producer or consumer are running.
+ */
+void audio_ring_init(audio_ring_t *ring);
+
+/**
+ * @brief Drop every period written, the counters are kept.
+ * Must not be called while producer or consumer are running.
+ */
+void audio_ring_flush(audio_ring_t *ring);
+
+/**
+ * @brief Periods ready to be read.
+ */
+uint32_t audio_ring_count(const audio_ring_t *ring);
+
+/**
+ * @brief Get the next free period to write in.
+ *
+ * @return NULL if the ring is full.
+ */
+int16_t * audio_ring_write_acquire(audio_ring_t *ring);
+
+/**
+ * @brief Publish the period obtained with audio_ring_write_acquire.
+ */
+void audio_ring_write_commit(audio_ring_t *ring);
+
+/**
+ * @brief Get the oldest period written.
+ *
+ * @return NULL if the ring is empty.
+ */
+int16_t * audio_ring_read_acquire(audio_ring_t *ring);
+
+/**
+ * @brief Give back the period obtained with audio_ring_read_acquire.
+ */
+void audio_ring_read_release(audio_ring_t *ring);
+
+#endif /* AUDIO_RING_H */
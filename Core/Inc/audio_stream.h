@@ -0,0 +1,70 @@
+/**
+ * @file audio_stream.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Periods between the I2S DMA buffers and the rings of the main loop.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef AUDIO_STREAM_H
+#define AUDIO_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_ring.h"
+
+/**
+ * Los callbacks del DMA llaman a audio_stream_block con la mitad del
+ * buffer que termino: el periodo recibido se copia a rx y el siguiente
+ * periodo procesado sale de tx. El main loop toma de rx y deja en tx con
+ * las funciones de audio_ring.
+ *
+ * Las copias las hace audio_move (DMA2 o CPU). Mientras una copia no
+ * termino su slot sigue tomado y el bloque siguiente cuenta como error.
+ */
+typedef struct
+{
+	audio_ring_t rx;				//<--- DMA callbacks --> main loop
+	audio_ring_t tx;				//<--- main loop --> DMA callbacks
+	uint32_t period_bytes;			//<--- Bytes of one period (half of the DMA buffer)
+	uint32_t prefill;				//<--- Silent periods queued in tx at start
+	volatile bool rx_moving;		//<--- Block move from the DMA buffer to rx in progress
+	volatile bool tx_moving;		//<--- Block move from tx to the DMA buffer in progress
+} audio_stream_t;
+
+/**
+ * @brief Empty both rings and queue prefill silent periods in tx.
+ *
+ * El prefill es el margen que tiene el main loop para atrasarse sin que se
+ * corte el audio, tiene que dejar lugar para el periodo que se procesa.
+ *
+ * @param period_halfwords halfwords per period
+ * @param prefill less than AUDIO_RING_PERIODS
+ * @return false if the period or the prefill do not fit in the rings.
+ */
+bool audio_stream_init(audio_stream_t *stream, uint32_t period_halfwords, uint32_t prefill);
+
+/**
+ * @brief Back to the state of audio_stream_init for a stream restart, the
+ * counters are kept.
+ *
+ * Lo que quedo en los rings y las copias en curso son del stream viejo:
+ * se descartan (audio_move_flush, todas las copias pendientes) y tx vuelve
+ * a tener solo el prefill de silencio. Con el I2S parado, desde
+ * ES8311_I2S_restarting.
+ */
+void audio_stream_reset(audio_stream_t *stream);
+
+/**
+ * @brief Move one period between the DMA buffers and the rings.
+ *
+ * From the DMA half / complete callbacks. If the main loop did not keep up
+ * silence is sent and counted as underrun, DMA sync is never lost.
+ */
+void audio_stream_block(audio_stream_t *stream, uint16_t *tx, const uint16_t *rx);
+
+#endif /* AUDIO_STREAM_H */
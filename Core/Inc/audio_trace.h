@@ -0,0 +1,126 @@
+/**
+ * @file audio_trace.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Lock-free binary event trace of the audio path, decoded offline.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef AUDIO_TRACE_H
+#define AUDIO_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define AUDIO_TRACE_ENABLE			1		//<--- 0: audio_trace() compiles to nothing
+#define AUDIO_TRACE_RECORDS			512		//<--- Power of 2, 8 bytes each
+#define AUDIO_TRACE_MAGIC			0x31435254UL	//<--- "TRC1" in a little endian dump
+
+#if (AUDIO_TRACE_RECORDS & (AUDIO_TRACE_RECORDS - 1)) != 0
+#error "AUDIO_TRACE_RECORDS must be a power of 2"
+#endif
+
+/**
+ * Marca de tiempo con el CYCCNT del DWT, igual que audio_prof. Con el trace
+ * habilitado el HCLK sigue corriendo durante el WFI (DBGMCU_CR DBG_SLEEP)
+ * para que el contador no se frene, eso resta parte del ahorro del sleep.
+ */
+#if defined(__ARM_ARCH_7EM__)
+#include "stm32f4xx.h"
+#define AUDIO_TRACE_CYCLES()		(DWT->CYCCNT)
+#else
+extern volatile uint32_t audio_prof_mock_cycles;
+#define AUDIO_TRACE_CYCLES()		(audio_prof_mock_cycles)
+#endif
+
+/**
+ * Los argumentos de cada evento estan en el comentario, el decoder
+ * (Tools/trace_decode.c) tiene que seguir esta tabla.
+ */
+typedef enum
+{
+	TRACE_NONE,
+	TRACE_I2S_HALF,				//<--- DMA half transfer callback, arg16 = blocks
+	TRACE_I2S_CPLT,				//<--- DMA transfer complete callback, arg16 = blocks
+	TRACE_RX_PUSH,				//<--- Period queued to the main loop, arg8 = periods in ringRx
+	TRACE_TX_POP,				//<--- Period taken for the DMA, arg8 = periods in ringTx
+	TRACE_OVERRUN,				//<--- ringRx full or move busy, arg16 = overruns
+	TRACE_UNDERRUN,				//<--- ringTx empty, silence sent, arg16 = underruns
+	TRACE_PROCESS_START,		//<--- Main loop starts a period
+	TRACE_PROCESS_END,			//<--- Main loop finished a period
+	TRACE_I2C,					//<--- Codec transfer, arg8 = reg, arg16 = value | len << 8 | read << 14 | ok << 15
+	TRACE_I2S_ERROR,			//<--- Stream error detected, restart pending
+	TRACE_I2S_RECOVER,			//<--- Stream restarted, arg16 = time to recover in us (saturated)
+	TRACE_SLEEP,				//<--- WFI
+	TRACE_WAKE,					//<--- Back from WFI
+	TRACE_CLOCK,				//<--- HCLK changed, arg16 = MHz, later timestamps count at this rate
+	TRACE_MARK,					//<--- Free use, arg8 / arg16 from the caller
+	TRACE_EVENTS
+} audio_trace_event_t;
+
+typedef struct
+{
+	uint32_t cycles;
+	uint8_t event;				//<--- audio_trace_event_t
+	uint8_t arg8;
+	uint16_t arg16;
+} audio_trace_rec_t;
+
+/**
+ * El ring es una sola variable global para poder bajarlo del debugger:
+ * dump binary value trace.bin audio_trace
+ * head cuenta todos los registros, el mas viejo valido es head - records.
+ */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t records;
+	volatile uint32_t head;
+	uint32_t hclk_hz;			//<--- Timestamp rate at audio_trace_init
+	audio_trace_rec_t rec[AUDIO_TRACE_RECORDS];
+} audio_trace_t;
+
+extern audio_trace_t audio_trace_ring;
+
+/**
+ * @brief Clear the ring and start the cycle counter.
+ */
+void audio_trace_init(uint32_t hclk_hz);
+
+/**
+ * @brief Record one event. Lock-free, safe from any interrupt priority.
+ *
+ * The slot is reserved with LDREX/STREX, so an interrupt that preempts a
+ * writer takes the next slot instead of overwriting it.
+ */
+static inline void audio_trace(audio_trace_event_t event, uint8_t arg8, uint16_t arg16)
+{
+#if AUDIO_TRACE_ENABLE
+	audio_trace_rec_t *rec;
+	uint32_t index;
+
+#if defined(__ARM_ARCH_7EM__)
+	do
+	{
+		index = __LDREXW(&audio_trace_ring.head);
+	} while (__STREXW(index + 1, &audio_trace_ring.head) != 0);
+#else
+	index = audio_trace_ring.head++;
+#endif
+
+	rec = &audio_trace_ring.rec[index & (AUDIO_TRACE_RECORDS - 1)];
+	rec->cycles = AUDIO_TRACE_CYCLES();
+	rec->event = (uint8_t)event;
+	rec->arg8 = arg8;
+	rec->arg16 = arg16;
+#else
+	(void)event;
+	(void)arg8;
+	(void)arg16;
+#endif
+}
+
+#endif /* AUDIO_TRACE_H */
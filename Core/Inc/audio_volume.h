@@ -0,0 +1,79 @@
+/**
+ * @file audio_volume.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Output volume in dB with click free fades.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef AUDIO_VOLUME_H
+#define AUDIO_VOLUME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_dsp.h"
+#include "es8311.h"
+
+/**
+ * El volumen total es el del DAC del codec (REG32) mas una ganancia digital
+ * en el camino de audio. Un fade se hace de una de dos formas:
+ *  - HW: se escribe REG32 una sola vez y el codec rampea solo con la
+ *    velocidad de REG37 (pasos de 0.25 dB, potencias de 2 de LRCK).
+ *  - DSP: el codec queda quieto y la ganancia digital rampea muestra a
+ *    muestra, con la duracion exacta pedida. Cuesta CPU mientras dura.
+ * En modo AUTO se usa HW salvo que ninguna velocidad del codec quede cerca
+ * del tiempo pedido (fades mas cortos que la rampa mas rapida).
+ *
+ * La ganancia digital que queda de un fade DSP se devuelve en el fade HW
+ * siguiente cuando va en el mismo sentido, el codec hace el resto. La
+ * rampa digital nunca dura menos de AUDIO_VOLUME_MIN_FADE_MS.
+ */
+#define AUDIO_VOLUME_DSP_MAX_HALF_DB	24		//<--- Digital boost limit (+12 dB), more goes to the codec
+#define AUDIO_VOLUME_MIN_FADE_MS		5		//<--- Shortest digital ramp, a jump in one sample clicks
+
+typedef enum
+{
+	AUDIO_VOLUME_AUTO,
+	AUDIO_VOLUME_HW,
+	AUDIO_VOLUME_DSP,
+} audio_volume_ramp_t;
+
+typedef struct
+{
+	uint32_t sample_rate;
+	int16_t codec_half_db;			//<--- Codec DAC volume (target of its ramp)
+	int16_t dsp_half_db;			//<--- Digital gain (target of the ramp)
+	audio_dsp_ramp_t ramp;
+	uint32_t hw_fades;				//<--- Changes done with the codec ramp
+	uint32_t dsp_fades;				//<--- Changes done with the digital ramp
+} audio_volume_t;
+
+/**
+ * @brief Init with the volume the codec already has, digital gain at 0 dB.
+ */
+void audio_volume_init(audio_volume_t *vol, uint32_t sample_rate, int16_t codec_half_db);
+
+/**
+ * @brief Fade to a new volume. Main loop context, same as audio_volume_process.
+ *
+ * @param half_db volume in 0.5 dB steps, clamped to the codec range
+ * @param fade_ms fade time, 0 is the fastest click free change
+ * @return false if the codec write could not be queued
+ */
+bool audio_volume_set(audio_volume_t *vol, int16_t half_db, uint32_t fade_ms, audio_volume_ramp_t mode);
+
+/**
+ * @brief Current target volume in 0.5 dB steps.
+ */
+int16_t audio_volume_get(const audio_volume_t *vol);
+
+/**
+ * @brief Apply the digital gain to one block. Can work in place.
+ */
+void audio_volume_process(audio_volume_t *vol, int16_t *dst, const int16_t *src, uint32_t frames);
+
+#endif /* AUDIO_VOLUME_H */
@@ -0,0 +1,70 @@
+/**
+ * @file log_ring.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Byte ring of log_uart: whole messages in, single bytes out, drop counters.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOG_RING_BYTES			1024	//<--- Power of 2, bytes waiting to be sent
+
+#if (LOG_RING_BYTES & (LOG_RING_BYTES - 1)) != 0
+#error "LOG_RING_BYTES must be a power of 2"
+#endif
+
+typedef struct
+{
+	uint32_t bytes;				//<--- Bytes accepted
+	uint32_t sent;				//<--- Bytes taken out by the consumer
+	uint32_t dropped;			//<--- Bytes of messages that did not fit
+	uint32_t dropped_writes;	//<--- Messages dropped
+	uint32_t max_used;			//<--- Worst ring usage in bytes
+} log_ring_stats_t;
+
+/**
+ * No toca registros: log_uart pone el PRIMASK alrededor de log_ring_write
+ * (escriben el main loop y las interrupciones) y log_ring_read lo llama
+ * solo la interrupcion de TXE. Asi se prueba en el host (Tests/).
+ */
+typedef struct
+{
+	char data[LOG_RING_BYTES];
+	volatile uint32_t head;		//<--- Bytes written, only log_ring_write modifies it
+	volatile uint32_t tail;		//<--- Bytes read, only log_ring_read modifies it
+	log_ring_stats_t stats;
+} log_ring_t;
+
+/**
+ * @brief Empty the ring and clear the counters.
+ */
+void log_ring_init(log_ring_t *ring);
+
+/**
+ * @brief Copy a whole message or nothing.
+ *
+ * @return false if it did not fit, it is counted as dropped.
+ */
+bool log_ring_write(log_ring_t *ring, const char *data, uint32_t len);
+
+/**
+ * @brief Take the oldest byte.
+ *
+ * @return false if the ring is empty.
+ */
+bool log_ring_read(log_ring_t *ring, char *c);
+
+/**
+ * @brief Bytes still waiting in the ring.
+ */
+uint32_t log_ring_pending(const log_ring_t *ring);
+
+#endif /* LOG_RING_H */
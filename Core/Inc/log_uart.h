@@ -0,0 +1,63 @@
+/**
+ * @file log_uart.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Non-blocking stdout over USART3 (ST-LINK virtual COM port).
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef LOG_UART_H
+#define LOG_UART_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "main.h"
+#include "log_ring.h"
+
+#define LOG_UART_BAUD			115200	//<--- Console, audio_capture needs more (see main.c)
+#define LOG_UART_IRQ_PRIORITY	3		//<--- Below I2S DMA (0), block moves (1) and I2C (2)
+
+/**
+ * _write (printf) copia al ring (log_ring.h, LOG_RING_BYTES) y vuelve, la
+ * interrupcion de TXE va sacando los bytes. Si el mensaje no entra entero
+ * se descarta completo y se cuenta, nunca se espera a la UART.
+ *
+ * Los streams de TX de USART3 (DMA1 Stream3 / Stream4) los usa el I2S, por
+ * eso es por interrupcion y no por DMA.
+ */
+typedef log_ring_stats_t log_uart_stats_t;
+
+/**
+ * @brief Configure USART3 8N1 TX only. Pins are set by MX_GPIO_Init.
+ *
+ * @param baud LOG_UART_BAUD for text, up to PCLK1 / 16 (2.625 Mbaud)
+ */
+void log_uart_init(uint32_t baud);
+
+/**
+ * @brief Queue bytes for the UART, from any context. Never blocks.
+ *
+ * @return false if the message did not fit and was dropped.
+ */
+bool log_uart_write(const char *data, uint32_t len);
+
+/**
+ * @brief Bytes still waiting in the ring.
+ */
+uint32_t log_uart_pending(void);
+
+/**
+ * @brief USART3 interrupt, call it from USART3_IRQHandler.
+ */
+void log_uart_irq(void);
+
+/**
+ * @brief Get the log counters.
+ */
+const log_uart_stats_t * log_uart_stats(void);
+
+#endif /* LOG_UART_H */
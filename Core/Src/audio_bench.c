@@ -0,0 +1,351 @@
+/**
+ * @file audio_bench.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Benchmark of the audio processing stages.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "audio_bench.h"
+#include "audio_codec.h"
+#include "audio_dsp.h"
+#include "audio_eq.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__ARM_ARCH_7EM__)
+#include "stm32f4xx.h"
+
+static inline uint32_t bench_cycles(void)
+{
+	return DWT->CYCCNT;
+}
+#else
+#include <time.h>
+
+/* Host time converted to cycles of an AUDIO_BENCH_CPU_HZ core */
+static inline uint32_t bench_cycles(void)
+{
+	struct timespec ts;
+	uint64_t ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	return (uint32_t)((ns * (AUDIO_BENCH_CPU_HZ / 1000000UL)) / 1000UL);
+}
+#endif
+
+#define BENCH_FIR_TAPS		16
+
+typedef void (*bench_stage_t)(uint32_t samples);
+
+static int16_t bench_in[AUDIO_BENCH_MAX_SAMPLES];
+static int16_t bench_in2[AUDIO_BENCH_MAX_SAMPLES];
+static int16_t bench_out[AUDIO_BENCH_MAX_SAMPLES];
+static int32_t bench_q31[AUDIO_BENCH_MAX_SAMPLES];
+static int32_t bench_q31_out[AUDIO_BENCH_MAX_SAMPLES];
+static uint16_t bench_wire[2 * AUDIO_BENCH_MAX_SAMPLES];
+static uint8_t bench_s24p[3 * AUDIO_BENCH_MAX_SAMPLES];
+static uint8_t bench_codes[AUDIO_BENCH_MAX_SAMPLES];
+static uint8_t bench_alaw[AUDIO_BENCH_MAX_SAMPLES];
+static uint8_t bench_ulaw[AUDIO_BENCH_MAX_SAMPLES];
+static uint8_t bench_adpcm[AUDIO_BENCH_MAX_SAMPLES / 2];
+
+static audio_eq_t bench_eq;
+static audio_dsp_dc_t bench_dc;
+static audio_dsp_fir_t bench_fir;
+static audio_dsp_comp_t bench_comp;
+static audio_codec_adpcm_t bench_adpcm_enc;
+static audio_codec_adpcm_t bench_adpcm_dec;
+
+static void stage_copy(uint32_t samples)
+{
+	memcpy(bench_out, bench_in, samples * sizeof(int16_t));
+}
+
+static void stage_gain(uint32_t samples)
+{
+	audio_dsp_gain(bench_out, bench_in, samples, AUDIO_DSP_Q16_ONE / 2);
+}
+
+static void stage_mix(uint32_t samples)
+{
+	audio_dsp_mix(bench_out, bench_in, bench_in2, samples, AUDIO_DSP_Q15_MAX / 2, AUDIO_DSP_Q15_MAX / 2);
+}
+
+static void stage_add_sat(uint32_t samples)
+{
+	audio_dsp_add_sat(bench_out, bench_in, bench_in2, samples);
+}
+
+static void stage_dc(uint32_t samples)
+{
+	audio_dsp_dc_remove(&bench_dc, bench_out, bench_in, samples / AUDIO_BENCH_CHANNELS);
+}
+
+static void stage_eq(uint32_t samples)
+{
+	audio_eq_process(&bench_eq, bench_out, bench_in, samples / AUDIO_BENCH_CHANNELS);
+}
+
+static void stage_fir(uint32_t samples)
+{
+	audio_dsp_fir(&bench_fir, bench_out, bench_in, samples / AUDIO_BENCH_CHANNELS);
+}
+
+static void stage_comp(uint32_t samples)
+{
+	audio_dsp_comp(&bench_comp, bench_out, bench_in, samples / AUDIO_BENCH_CHANNELS);
+}
+
+static void stage_to_q31(uint32_t samples)
+{
+	audio_dsp_s16_to_q31(bench_q31, bench_in, samples);
+}
+
+static void stage_from_q31(uint32_t samples)
+{
+	audio_dsp_q31_to_s16(bench_out, bench_q31, samples);
+}
+
+static void stage_wire_to_q31(uint32_t samples)
+{
+	audio_dsp_wire_to_q31(bench_q31_out, bench_wire, samples);
+}
+
+static void stage_q31_to_wire(uint32_t samples)
+{
+	audio_dsp_q31_to_wire(bench_wire, bench_q31, samples);
+}
+
+static void stage_q31_to_s24p(uint32_t samples)
+{
+	audio_dsp_q31_to_s24p(bench_s24p, bench_q31, samples);
+}
+
+static void stage_s24p_to_q31(uint32_t samples)
+{
+	audio_dsp_s24p_to_q31(bench_q31_out, bench_s24p, samples);
+}
+
+static void stage_adpcm_enc(uint32_t samples)
+{
+	audio_codec_adpcm_encode(&bench_adpcm_enc, bench_codes, bench_in, samples, 1);
+}
+
+static void stage_adpcm_dec(uint32_t samples)
+{
+	audio_codec_adpcm_decode(&bench_adpcm_dec, bench_out, bench_adpcm, samples);
+}
+
+static void stage_alaw_enc(uint32_t samples)
+{
+	audio_codec_alaw_encode(bench_codes, bench_in, samples, 1);
+}
+
+static void stage_alaw_enc_ref(uint32_t samples)
+{
+	audio_codec_alaw_encode_ref(bench_codes, bench_in, samples, 1);
+}
+
+static void stage_alaw_dec(uint32_t samples)
+{
+	audio_codec_alaw_decode(bench_out, bench_alaw, samples);
+}
+
+static void stage_ulaw_enc(uint32_t samples)
+{
+	audio_codec_ulaw_encode(bench_codes, bench_in, samples, 1);
+}
+
+static void stage_ulaw_enc_ref(uint32_t samples)
+{
+	audio_codec_ulaw_encode_ref(bench_codes, bench_in, samples, 1);
+}
+
+static void stage_ulaw_dec(uint32_t samples)
+{
+	audio_codec_ulaw_decode(bench_out, bench_ulaw, samples);
+}
+
+static const struct
+{
+	const char *name;
+	bench_stage_t run;
+} stages[] =
+{
+	{ "copy",		stage_copy },
+	{ "gain",		stage_gain },
+	{ "mix",		stage_mix },
+	{ "add_sat",	stage_add_sat },
+	{ "dc_remove",	stage_dc },
+	{ "eq_3band",	stage_eq },
+	{ "fir_16",		stage_fir },
+	{ "compressor",	stage_comp },
+	{ "s16_to_q31",	stage_to_q31 },
+	{ "q31_to_s16",	stage_from_q31 },
+	{ "wire_to_q31",	stage_wire_to_q31 },
+	{ "q31_to_wire",	stage_q31_to_wire },
+	{ "q31_to_s24p",	stage_q31_to_s24p },
+	{ "s24p_to_q31",	stage_s24p_to_q31 },
+	{ "adpcm_enc",	stage_adpcm_enc },
+	{ "adpcm_dec",	stage_adpcm_dec },
+	{ "alaw_enc",	stage_alaw_enc },
+	{ "alaw_enc_ref",	stage_alaw_enc_ref },
+	{ "alaw_dec",	stage_alaw_dec },
+	{ "ulaw_enc",	stage_ulaw_enc },
+	{ "ulaw_enc_ref",	stage_ulaw_enc_ref },
+	{ "ulaw_dec",	stage_ulaw_dec },
+};
+
+#define BENCH_STAGES	(sizeof(stages) / sizeof(stages[0]))
+
+static void bench_setup(void)
+{
+	static const audio_eq_band_t bands[] =
+	{
+		{ AUDIO_EQ_LOW_SHELF,	200.0f,		3.0f,	0.707f },
+		{ AUDIO_EQ_PEAK,		1000.0f,	-6.0f,	1.0f },
+		{ AUDIO_EQ_HIGH_SHELF,	6000.0f,	2.0f,	0.707f },
+	};
+	int16_t taps[BENCH_FIR_TAPS];
+	uint32_t seed = 1;
+
+	/* Pseudo random signal so nothing is optimized as constant */
+	for (uint32_t i = 0; i < AUDIO_BENCH_MAX_SAMPLES; i++)
+	{
+		seed = seed * 1664525UL + 1013904223UL;
+		bench_in[i] = (int16_t)(seed >> 16);
+		bench_in2[i] = (int16_t)(seed >> 8);
+	}
+
+	for (uint32_t k = 0; k < BENCH_FIR_TAPS; k++)
+		taps[k] = AUDIO_DSP_Q15_MAX / BENCH_FIR_TAPS;
+
+	audio_eq_init(&bench_eq, 22050, 3);
+	for (uint8_t b = 0; b < 3; b++)
+		audio_eq_set_band(&bench_eq, b, &bands[b]);
+
+	audio_dsp_dc_init(&bench_dc, 32604);
+	audio_dsp_fir_init(&bench_fir, taps, BENCH_FIR_TAPS);
+	/* Low threshold, the gain curve runs on almost every frame (worst case) */
+	audio_dsp_comp_init(&bench_comp, 1024, 4, audio_dsp_comp_coef(1, 22050),
+			audio_dsp_comp_coef(100, 22050), AUDIO_DSP_Q16_ONE);
+	audio_dsp_s16_to_q31(bench_q31, bench_in, AUDIO_BENCH_MAX_SAMPLES);
+	audio_dsp_q31_to_wire(bench_wire, bench_q31, AUDIO_BENCH_MAX_SAMPLES);
+	audio_dsp_q31_to_s24p(bench_s24p, bench_q31, AUDIO_BENCH_MAX_SAMPLES);
+
+	/* Los decoders parten de datos codificados de la misma senal */
+	audio_codec_init();
+	audio_codec_alaw_encode(bench_alaw, bench_in, AUDIO_BENCH_MAX_SAMPLES, 1);
+	audio_codec_ulaw_encode(bench_ulaw, bench_in, AUDIO_BENCH_MAX_SAMPLES, 1);
+	audio_codec_adpcm_init(&bench_adpcm_enc);
+	audio_codec_adpcm_encode(&bench_adpcm_enc, bench_adpcm, bench_in, AUDIO_BENCH_MAX_SAMPLES, 1);
+	audio_codec_adpcm_init(&bench_adpcm_enc);
+	audio_codec_adpcm_init(&bench_adpcm_dec);
+}
+
+uint32_t audio_bench_run(audio_bench_result_t *results, uint32_t max, uint32_t block_samples)
+{
+	uint32_t count = 0;
+	uint32_t start;
+	uint32_t total;
+
+	if (block_samples > AUDIO_BENCH_MAX_SAMPLES)
+		block_samples = AUDIO_BENCH_MAX_SAMPLES;
+
+	bench_setup();
+
+	for (uint32_t s = 0; s < BENCH_STAGES && count < max; s++)
+	{
+		/* One run outside the measure to warm up the flash cache */
+		stages[s].run(block_samples);
+
+		start = bench_cycles();
+		for (uint32_t r = 0; r < AUDIO_BENCH_RUNS; r++)
+			stages[s].run(block_samples);
+		total = bench_cycles() - start;
+
+		results[count].name = stages[s].name;
+		results[count].cycles = total / AUDIO_BENCH_RUNS;
+		results[count].samples = block_samples;
+		count++;
+	}
+
+	return count;
+}
+
+uint32_t audio_bench_load(const audio_bench_result_t *result, uint32_t cpu_hz, uint32_t sample_rate)
+{
+	uint64_t frames = result->samples / AUDIO_BENCH_CHANNELS;
+
+	if (frames == 0 || cpu_hz == 0)
+		return 0;
+
+	/* cycles per frame * frames per second / cycles per second, x10000 */
+	return (uint32_t)(((uint64_t)result->cycles * sample_rate * 10000ULL) / (frames * cpu_hz));
+}
+
+uint64_t audio_bench_throughput(const audio_bench_result_t *result, uint32_t cpu_hz)
+{
+	if (result->cycles == 0)
+		return 0;
+
+	return ((uint64_t)cpu_hz * result->samples) / result->cycles;
+}
+
+int audio_bench_json(const audio_bench_result_t *results, uint32_t count, char *buf, size_t len)
+{
+	static const uint32_t rates[] = { 8000, 11025, 16000, 22050, 32000, 44100, 48000 };
+	size_t used = 0;
+	int n;
+
+#define JSON_APPEND(...)																\
+	do {																				\
+		n = snprintf(buf + (used < len ? used : len), (used < len ? len - used : 0), __VA_ARGS__);	\
+		if (n < 0) return n;															\
+		used += (size_t)n;																\
+	} while (0)
+
+	JSON_APPEND("{\"cpu_hz\":%lu,\"stages\":[", (unsigned long)AUDIO_BENCH_CPU_HZ);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		/* ns per sample x100, integer math so float printf is not needed */
+		uint64_t ns100 = ((uint64_t)results[i].cycles * 100000000000ULL) /
+				((uint64_t)AUDIO_BENCH_CPU_HZ * results[i].samples);
+
+		uint64_t per_s = audio_bench_throughput(&results[i], AUDIO_BENCH_CPU_HZ);
+
+		JSON_APPEND("%s{\"name\":\"%s\",\"samples\":%lu,\"cycles_per_block\":%lu,\"ns_per_sample\":%lu.%02lu,\"samples_per_s\":",
+				i ? "," : "", results[i].name, (unsigned long)results[i].samples, (unsigned long)results[i].cycles,
+				(unsigned long)(ns100 / 100), (unsigned long)(ns100 % 100));
+
+		/* Las etapas rapidas pasan los 32 bits y newlib nano no imprime %llu */
+		if (per_s >= 1000000000ULL)
+			JSON_APPEND("%lu%09lu", (unsigned long)(per_s / 1000000000ULL), (unsigned long)(per_s % 1000000000ULL));
+		else
+			JSON_APPEND("%lu", (unsigned long)per_s);
+
+		JSON_APPEND(",\"load_pct\":{");
+
+		for (uint32_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+		{
+			uint32_t load = audio_bench_load(&results[i], AUDIO_BENCH_CPU_HZ, rates[r]);
+
+			JSON_APPEND("%s\"%lu\":%lu.%02lu", r ? "," : "", (unsigned long)rates[r],
+					(unsigned long)(load / 100), (unsigned long)(load % 100));
+		}
+
+		JSON_APPEND("}}");
+	}
+
+	JSON_APPEND("]}");
+
+#undef JSON_APPEND
+
+	return (int)used;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file audio_capture.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Framed capture of the ADC stream for the host (Tools/capture_wav.c).
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_capture.h"
+#include "audio_codec.h"
+#include <stddef.h>
+#include <string.h>
+
+#define CAPTURE_CHANNELS	2		//<--- Slots per I2S frame, ES8311_I2S_CHANNELS
+
+#define CAPTURE_FRAME_BYTES	(AUDIO_CAPTURE_HEADER_BYTES + AUDIO_CAPTURE_FRAME_SAMPLES * 2 + AUDIO_CAPTURE_CRC_BYTES)
+
+#if AUDIO_CAPTURE_FRAME_SAMPLES & 1
+#error "AUDIO_CAPTURE_FRAME_SAMPLES must be even, ADPCM packs two samples per byte"
+#endif
+
+static int16_t pcm[AUDIO_CAPTURE_FRAME_SAMPLES];
+static uint8_t frame[CAPTURE_FRAME_BYTES];		//<--- Sized for PCM16, the largest payload
+static uint16_t crc_table[256];
+static uint32_t fill;				//<--- Samples in pcm
+static audio_capture_format_t encoding;
+static audio_codec_adpcm_t adpcm;
+static uint16_t sequence;
+static uint32_t rate;
+static uint32_t halfwords;
+static audio_capture_write_t sink;
+static audio_capture_stats_t stats;
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+void audio_capture_init(uint32_t rate_hz, uint32_t sample_halfwords, audio_capture_format_t format,
+		audio_capture_write_t write)
+{
+	/* Tabla en RAM, una lectura por byte en lugar de 8 pasos */
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint16_t crc = (uint16_t)(i << 8);
+
+		for (int b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		crc_table[i] = crc;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	fill = 0;
+	sequence = 0;
+	rate = rate_hz;
+	halfwords = sample_halfwords;
+	encoding = format < AUDIO_CAPTURE_FORMATS ? format : AUDIO_CAPTURE_PCM16;
+	sink = write;
+
+	audio_codec_init();
+	audio_codec_adpcm_init(&adpcm);
+}
+
+uint16_t audio_capture_crc16(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i++)
+		crc = (uint16_t)((crc << 8) ^ crc_table[((crc >> 8) ^ data[i]) & 0xFF]);
+
+	return crc;
+}
+
+/**
+ * @brief Close the frame and hand it to the sink, whole or not at all.
+ */
+static void audio_capture_send(void)
+{
+	uint8_t *payload = &frame[AUDIO_CAPTURE_HEADER_BYTES];
+	uint32_t bytes;
+	uint32_t len;
+
+	switch (encoding)
+	{
+	case AUDIO_CAPTURE_ADPCM:
+		bytes = audio_codec_adpcm_encode_block(&adpcm, payload, pcm, fill, 1);
+		break;
+	case AUDIO_CAPTURE_ALAW:
+		audio_codec_alaw_encode(payload, pcm, fill, 1);
+		bytes = fill;
+		break;
+	case AUDIO_CAPTURE_ULAW:
+		audio_codec_ulaw_encode(payload, pcm, fill, 1);
+		bytes = fill;
+		break;
+	default:
+		for (uint32_t i = 0; i < fill; i++)
+			put16(&payload[2 * i], (uint16_t)pcm[i]);
+		bytes = fill * 2;
+		break;
+	}
+	len = AUDIO_CAPTURE_HEADER_BYTES + bytes;
+
+	put16(&frame[0], AUDIO_CAPTURE_SYNC);
+	frame[2] = (uint8_t)encoding;
+	frame[3] = 1;
+	put16(&frame[4], sequence++);
+	put16(&frame[6], (uint16_t)rate);
+	put16(&frame[8], (uint16_t)fill);
+	put16(&frame[10], (uint16_t)bytes);
+	put16(&frame[len], audio_capture_crc16(0xFFFF, frame, len));
+
+	if (sink != NULL && sink((const char *)frame, len + AUDIO_CAPTURE_CRC_BYTES))
+		stats.frames++;
+	else
+		stats.dropped++;
+
+	fill = 0;
+}
+
+void audio_capture_period(const uint16_t *rx, uint32_t frames)
+{
+	uint32_t stride = CAPTURE_CHANNELS * halfwords;
+
+	/* En 24/32 bits la primera media palabra es la alta, se manda esa */
+	rx += AUDIO_CAPTURE_CHANNEL * halfwords;
+
+	for (uint32_t i = 0; i < frames; i++)
+	{
+		pcm[fill] = (int16_t)rx[i * stride];
+		if (++fill == AUDIO_CAPTURE_FRAME_SAMPLES)
+			audio_capture_send();
+	}
+
+	stats.samples += frames;
+}
+
+const audio_capture_stats_t * audio_capture_stats(void)
+{
+	return &stats;
+}
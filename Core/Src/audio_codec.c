@@ -0,0 +1,368 @@
+/**
+ * @file audio_codec.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief IMA-ADPCM (4:1) and G.711 A-law / u-law (2:1) codecs for 16 bit audio.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_codec.h"
+#include <stddef.h>
+
+#if defined(__ARM_ARCH_7EM__)
+#include "stm32f4xx.h"
+#endif
+
+#define ADPCM_MAX_INDEX		88
+
+#define ULAW_BIAS			0x84
+#define ULAW_CLIP			8159		//<--- 14 bit magnitude limit of the reference
+
+/******************************************************************************
+ * 								HELPER FUNCTIONS
+ *****************************************************************************/
+
+/**
+ * Fuera de la placa CLZ es el builtin de GCC, asi la version rapida se
+ * puede comparar con la _ref en la PC.
+ */
+static inline uint32_t codec_clz(uint32_t x)
+{
+#if defined(__ARM_ARCH_7EM__)
+	return __CLZ(x);
+#else
+	return x ? (uint32_t)__builtin_clz(x) : 32;
+#endif
+}
+
+static inline int32_t codec_sat16(int32_t x)
+{
+#if defined(__ARM_ARCH_7EM__)
+	return __SSAT(x, 16);
+#else
+	return x > INT16_MAX ? INT16_MAX : (x < INT16_MIN ? INT16_MIN : x);
+#endif
+}
+
+static const int16_t adpcm_steps[ADPCM_MAX_INDEX + 1] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t adpcm_index_adjust[16] =
+{
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static int16_t alaw_table[256];
+static int16_t ulaw_table[256];
+
+static inline uint8_t alaw_encode_ref(int16_t pcm)
+{
+	static const int16_t seg_end[8] = { 0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF };
+	int32_t v = pcm >> 3;
+	uint8_t mask;
+	uint8_t seg;
+
+	if (v >= 0)
+		mask = 0xD5;
+	else
+	{
+		mask = 0x55;
+		v = -v - 1;
+	}
+
+	for (seg = 0; seg < 8 && v > seg_end[seg]; seg++);
+
+	if (seg >= 8)
+		return 0x7F ^ mask;
+	if (seg < 2)
+		return (uint8_t)(((seg << 4) | ((v >> 1) & 0x0F)) ^ mask);
+	return (uint8_t)(((seg << 4) | ((v >> seg) & 0x0F)) ^ mask);
+}
+
+static inline int16_t alaw_decode_ref(uint8_t code)
+{
+	int32_t t;
+	uint32_t seg;
+
+	code ^= 0x55;
+	t = (code & 0x0F) << 4;
+	seg = (code & 0x70) >> 4;
+
+	if (seg == 0)
+		t += 8;
+	else
+		t = (t + 0x108) << (seg - 1);
+
+	return (int16_t)((code & 0x80) ? t : -t);
+}
+
+static inline uint8_t ulaw_encode_ref(int16_t pcm)
+{
+	static const int16_t seg_end[8] = { 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF };
+	int32_t v = pcm >> 2;
+	uint8_t mask;
+	uint8_t seg;
+
+	if (v < 0)
+	{
+		v = -v;
+		mask = 0x7F;
+	}
+	else
+		mask = 0xFF;
+
+	if (v > ULAW_CLIP)
+		v = ULAW_CLIP;
+	v += ULAW_BIAS >> 2;
+
+	for (seg = 0; seg < 8 && v > seg_end[seg]; seg++);
+
+	if (seg >= 8)
+		return 0x7F ^ mask;
+	return (uint8_t)(((seg << 4) | ((v >> (seg + 1)) & 0x0F)) ^ mask);
+}
+
+static inline int16_t ulaw_decode_ref(uint8_t code)
+{
+	int32_t t;
+
+	code = ~code;
+	t = ((code & 0x0F) << 3) + ULAW_BIAS;
+	t <<= (code & 0x70) >> 4;
+
+	return (int16_t)((code & 0x80) ? (ULAW_BIAS - t) : (t - ULAW_BIAS));
+}
+
+/******************************************************************************
+ * 								PUBLIC FUNCTIONS
+ *****************************************************************************/
+
+void audio_codec_init(void)
+{
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		alaw_table[i] = alaw_decode_ref((uint8_t)i);
+		ulaw_table[i] = ulaw_decode_ref((uint8_t)i);
+	}
+}
+
+void audio_codec_adpcm_init(audio_codec_adpcm_t *state)
+{
+	state->predictor = 0;
+	state->index = 0;
+}
+
+uint32_t audio_codec_adpcm_encode(audio_codec_adpcm_t *state, uint8_t *dst, const int16_t *src,
+		uint32_t samples, uint32_t stride)
+{
+	int32_t predictor = state->predictor;
+	int32_t index = state->index;
+	int32_t step = adpcm_steps[index];
+	uint32_t byte = 0;
+
+	/**
+	 * El vpdiff se arma con los mismos pasos step, step/2, step/4 que usa
+	 * el decoder, asi encoder y decoder reconstruyen la misma muestra.
+	 */
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		int32_t diff = src[i * stride] - predictor;
+		uint32_t nibble = 0;
+		int32_t vpdiff = step >> 3;
+
+		if (diff < 0)
+		{
+			nibble = 8;
+			diff = -diff;
+		}
+		if (diff >= step)
+		{
+			nibble |= 4;
+			diff -= step;
+			vpdiff += step;
+		}
+		if (diff >= (step >> 1))
+		{
+			nibble |= 2;
+			diff -= step >> 1;
+			vpdiff += step >> 1;
+		}
+		if (diff >= (step >> 2))
+		{
+			nibble |= 1;
+			vpdiff += step >> 2;
+		}
+
+		predictor = codec_sat16((nibble & 8) ? predictor - vpdiff : predictor + vpdiff);
+
+		index += adpcm_index_adjust[nibble];
+		if (index < 0)
+			index = 0;
+		else if (index > ADPCM_MAX_INDEX)
+			index = ADPCM_MAX_INDEX;
+		step = adpcm_steps[index];
+
+		if (i & 1)
+			*dst++ = (uint8_t)(byte | (nibble << 4));
+		else
+			byte = nibble;
+	}
+
+	if (samples & 1)
+		*dst = (uint8_t)byte;
+
+	state->predictor = (int16_t)predictor;
+	state->index = (uint8_t)index;
+
+	return (samples + 1) / 2;
+}
+
+void audio_codec_adpcm_decode(audio_codec_adpcm_t *state, int16_t *dst, const uint8_t *src, uint32_t samples)
+{
+	int32_t predictor = state->predictor;
+	int32_t index = state->index;
+	int32_t step = adpcm_steps[index];
+
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		uint32_t nibble = (i & 1) ? (src[i >> 1] >> 4) : (src[i >> 1] & 0x0F);
+		int32_t vpdiff = step >> 3;
+
+		if (nibble & 4)
+			vpdiff += step;
+		if (nibble & 2)
+			vpdiff += step >> 1;
+		if (nibble & 1)
+			vpdiff += step >> 2;
+
+		predictor = codec_sat16((nibble & 8) ? predictor - vpdiff : predictor + vpdiff);
+		dst[i] = (int16_t)predictor;
+
+		index += adpcm_index_adjust[nibble];
+		if (index < 0)
+			index = 0;
+		else if (index > ADPCM_MAX_INDEX)
+			index = ADPCM_MAX_INDEX;
+		step = adpcm_steps[index];
+	}
+
+	state->predictor = (int16_t)predictor;
+	state->index = (uint8_t)index;
+}
+
+uint32_t audio_codec_adpcm_encode_block(audio_codec_adpcm_t *state, uint8_t *dst, const int16_t *src,
+		uint32_t samples, uint32_t stride)
+{
+	dst[0] = (uint8_t)state->predictor;
+	dst[1] = (uint8_t)((uint16_t)state->predictor >> 8);
+	dst[2] = state->index;
+	dst[3] = 0;
+
+	return AUDIO_CODEC_ADPCM_HEADER +
+			audio_codec_adpcm_encode(state, dst + AUDIO_CODEC_ADPCM_HEADER, src, samples, stride);
+}
+
+bool audio_codec_adpcm_decode_block(int16_t *dst, const uint8_t *src, uint32_t samples)
+{
+	audio_codec_adpcm_t state;
+
+	if (src[2] > ADPCM_MAX_INDEX || src[3] != 0)
+		return false;
+
+	state.predictor = (int16_t)(src[0] | (src[1] << 8));
+	state.index = src[2];
+	audio_codec_adpcm_decode(&state, dst, src + AUDIO_CODEC_ADPCM_HEADER, samples);
+
+	return true;
+}
+
+void audio_codec_alaw_encode_ref(uint8_t *dst, const int16_t *src, uint32_t samples, uint32_t stride)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = alaw_encode_ref(src[i * stride]);
+}
+
+void audio_codec_alaw_encode(uint8_t *dst, const int16_t *src, uint32_t samples, uint32_t stride)
+{
+	/**
+	 * Sin busqueda de segmento: con el signo plegado (v = ~x si es negativo)
+	 * el segmento es la posicion del bit mas alto, y el bit 4 / bit 5
+	 * agregados dan el segmento 0 y el corrimiento minimo de 1.
+	 */
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		int32_t x = src[i * stride] >> 3;
+		int32_t sign = x >> 31;
+		uint32_t v = (uint32_t)(x ^ sign);
+		uint32_t seg = 27 - codec_clz(v | 0x10);
+		uint32_t shift = 27 - codec_clz(v | 0x20);
+
+		dst[i] = (uint8_t)(((seg << 4) | ((v >> shift) & 0x0F)) ^ (0x55 | (~sign & 0x80)));
+	}
+}
+
+void audio_codec_alaw_decode_ref(int16_t *dst, const uint8_t *src, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = alaw_decode_ref(src[i]);
+}
+
+void audio_codec_alaw_decode(int16_t *dst, const uint8_t *src, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = alaw_table[src[i]];
+}
+
+void audio_codec_ulaw_encode_ref(uint8_t *dst, const int16_t *src, uint32_t samples, uint32_t stride)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = ulaw_encode_ref(src[i * stride]);
+}
+
+void audio_codec_ulaw_encode(uint8_t *dst, const int16_t *src, uint32_t samples, uint32_t stride)
+{
+	/**
+	 * Con el limite en ULAW_CLIP - 1 el valor con bias nunca llega a 0x2000
+	 * (segmento 8) y el resultado es el mismo: ambos dan el codigo maximo.
+	 */
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		int32_t x = src[i * stride] >> 2;
+		uint32_t mask = x < 0 ? 0x7F : 0xFF;
+		uint32_t v = (uint32_t)(x < 0 ? -x : x);
+		uint32_t seg;
+
+		if (v > ULAW_CLIP - 1)
+			v = ULAW_CLIP - 1;
+		v += ULAW_BIAS >> 2;
+		seg = 26 - codec_clz(v);
+
+		dst[i] = (uint8_t)(((seg << 4) | ((v >> (seg + 1)) & 0x0F)) ^ mask);
+	}
+}
+
+void audio_codec_ulaw_decode_ref(int16_t *dst, const uint8_t *src, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = ulaw_decode_ref(src[i]);
+}
+
+void audio_codec_ulaw_decode(int16_t *dst, const uint8_t *src, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = ulaw_table[src[i]];
+}
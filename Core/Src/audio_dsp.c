@@ -0,0 +1,818 @@
+/**
+ * @file audio_dsp.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Fixed point DSP kernels for 16 bit interleaved audio, Q31 format conversions.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "audio_dsp.h"
+#include <stddef.h>
+#include <string.h>
+
+#if AUDIO_DSP_USE_SIMD && defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#include "stm32f4xx.h"
+#define DSP_SIMD	1
+#define DSP_ASM		1
+#elif AUDIO_DSP_USE_SIMD && defined(AUDIO_DSP_SIMD_HOST)
+/* Tests/: the same path with the intrinsics written in C (sim/stm32f4xx.h) */
+#include "stm32f4xx.h"
+#define DSP_SIMD	1
+#define DSP_ASM		0
+#else
+#define DSP_SIMD	0
+#define DSP_ASM		0
+#endif
+
+#define CH			AUDIO_DSP_CHANNELS
+
+/******************************************************************************
+ * 								HELPER FUNCTIONS
+ *****************************************************************************/
+
+static inline int16_t sat16(int32_t x)
+{
+	if (x > INT16_MAX)
+		return INT16_MAX;
+	if (x < INT16_MIN)
+		return INT16_MIN;
+	return (int16_t)x;
+}
+
+static inline uint32_t pack16(int32_t lo, int32_t hi)
+{
+	return (uint16_t)lo | ((uint32_t)(uint16_t)hi << 16);
+}
+
+static inline int32_t lo16(uint32_t pair)
+{
+	return (int16_t)(pair & 0xFFFF);
+}
+
+static inline int32_t hi16(uint32_t pair)
+{
+	return (int16_t)(pair >> 16);
+}
+
+/**
+ * Q15 gains are limited to +-32767 so a pair of products never overflows
+ * the 32 bit accumulator of __SMUAD.
+ */
+static inline int16_t q15_clip(int32_t x)
+{
+	return (x < -AUDIO_DSP_Q15_MAX) ? -AUDIO_DSP_Q15_MAX : sat16(x);
+}
+
+#if DSP_ASM
+/* SMULWx are not part of CMSIS: (32 bit * 16 bit) >> 16 */
+static inline int32_t smulwb(int32_t a, uint32_t b)
+{
+	int32_t result;
+	__ASM ("smulwb %0, %1, %2" : "=r" (result) : "r" (a), "r" (b));
+	return result;
+}
+
+static inline int32_t smulwt(int32_t a, uint32_t b)
+{
+	int32_t result;
+	__ASM ("smulwt %0, %1, %2" : "=r" (result) : "r" (a), "r" (b));
+	return result;
+}
+#elif DSP_SIMD
+static inline int32_t smulwb(int32_t a, uint32_t b)
+{
+	return (int32_t)(((int64_t)a * lo16(b)) >> 16);
+}
+
+static inline int32_t smulwt(int32_t a, uint32_t b)
+{
+	return (int32_t)(((int64_t)a * hi16(b)) >> 16);
+}
+#endif
+
+/******************************************************************************
+ * 								GAIN / MIX
+ *****************************************************************************/
+
+void audio_dsp_gain_ref(int16_t *dst, const int16_t *src, uint32_t samples, int32_t gain_q16)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = sat16((int32_t)(((int64_t)gain_q16 * src[i]) >> 16));
+}
+
+void audio_dsp_gain(int16_t *dst, const int16_t *src, uint32_t samples, int32_t gain_q16)
+{
+#if DSP_SIMD
+	uint32_t pairs = samples / 2;
+	uint32_t x;
+
+	while (pairs--)
+	{
+		x = __UNALIGNED_UINT32_READ(src);
+		__UNALIGNED_UINT32_WRITE(dst, __PKHBT(__SSAT(smulwb(gain_q16, x), 16),
+				__SSAT(smulwt(gain_q16, x), 16), 16));
+		src += 2;
+		dst += 2;
+	}
+
+	if (samples & 1)
+		audio_dsp_gain_ref(dst, src, 1, gain_q16);
+#else
+	audio_dsp_gain_ref(dst, src, samples, gain_q16);
+#endif
+}
+
+void audio_dsp_ramp_init(audio_dsp_ramp_t *ramp, int32_t gain_q16)
+{
+	ramp->gain_q16 = gain_q16;
+	ramp->target_q16 = gain_q16;
+	ramp->step_q16 = 0;
+}
+
+void audio_dsp_ramp_set(audio_dsp_ramp_t *ramp, int32_t target_q16, uint32_t frames)
+{
+	int64_t delta = (int64_t)target_q16 - ramp->gain_q16;
+
+	ramp->target_q16 = target_q16;
+	if (frames == 0 || delta == 0)
+	{
+		ramp->gain_q16 = target_q16;
+		ramp->step_q16 = 0;
+		return;
+	}
+
+	/* Very slow ramps still move, one LSB per frame */
+	ramp->step_q16 = (int32_t)(delta / (int64_t)frames);
+	if (ramp->step_q16 == 0)
+		ramp->step_q16 = (delta > 0) ? 1 : -1;
+}
+
+static inline void ramp_step(audio_dsp_ramp_t *ramp)
+{
+	int32_t left = ramp->target_q16 - ramp->gain_q16;
+
+	if ((ramp->step_q16 > 0 && left <= ramp->step_q16) ||
+			(ramp->step_q16 < 0 && left >= ramp->step_q16))
+		ramp->gain_q16 = ramp->target_q16;
+	else
+		ramp->gain_q16 += ramp->step_q16;
+}
+
+void audio_dsp_ramp_ref(audio_dsp_ramp_t *ramp, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+	for (uint32_t i = 0; i < frames; i++)
+	{
+		if (ramp->gain_q16 != ramp->target_q16)
+			ramp_step(ramp);
+
+		audio_dsp_gain_ref(dst, src, CH, ramp->gain_q16);
+		src += CH;
+		dst += CH;
+	}
+}
+
+void audio_dsp_ramp(audio_dsp_ramp_t *ramp, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+#if DSP_SIMD && (CH == 2)
+	uint32_t x;
+
+	while (frames && ramp->gain_q16 != ramp->target_q16)
+	{
+		ramp_step(ramp);
+
+		x = __UNALIGNED_UINT32_READ(src);
+		__UNALIGNED_UINT32_WRITE(dst, __PKHBT(__SSAT(smulwb(ramp->gain_q16, x), 16),
+				__SSAT(smulwt(ramp->gain_q16, x), 16), 16));
+		src += 2;
+		dst += 2;
+		frames--;
+	}
+
+	/* Rest of the block at the final gain */
+	if (frames)
+		audio_dsp_gain(dst, src, frames * CH, ramp->gain_q16);
+#else
+	audio_dsp_ramp_ref(ramp, dst, src, frames);
+#endif
+}
+
+/******************************************************************************
+ * 								COMPRESSOR
+ *****************************************************************************/
+
+/* log2(x) in Q16, linear between octaves. x > 0 */
+static inline int32_t log2_q16(uint32_t x)
+{
+	int32_t msb = 31 - __builtin_clz(x);
+	uint32_t mant = (msb >= 16) ? (x >> (msb - 16)) : (x << (16 - msb));
+
+	return (msb << 16) + (int32_t)(mant - 65536);
+}
+
+/* 2^y in Q16 for y <= 0 (Q16), linear between octaves */
+static inline int32_t exp2_q16(int32_t y)
+{
+	int32_t octave = -((-y + 0xFFFF) >> 16);				//<--- floor(y)
+	uint32_t mant = 65536 + (uint32_t)(y - (octave << 16));
+
+	if (octave <= -16)
+		return 0;
+
+	return (int32_t)(mant >> -octave);
+}
+
+int32_t audio_dsp_comp_coef(uint32_t time_ms, uint32_t sample_rate)
+{
+	uint64_t n = (uint64_t)time_ms * sample_rate;
+
+	if (n <= 1000)
+		return 32768;
+
+	return (int32_t)((32768ULL * 1000ULL) / n);
+}
+
+void audio_dsp_comp_init(audio_dsp_comp_t *comp, int16_t threshold_q15, uint16_t ratio,
+		int32_t attack_q15, int32_t release_q15, int32_t makeup_q16)
+{
+	comp->threshold_q15 = (threshold_q15 > 0) ? threshold_q15 : 1;
+	comp->slope_q16 = (ratio == 0) ? AUDIO_DSP_Q16_ONE : AUDIO_DSP_Q16_ONE - AUDIO_DSP_Q16_ONE / ratio;
+	comp->attack_q15 = attack_q15;
+	comp->release_q15 = release_q15;
+	comp->makeup_q16 = makeup_q16;
+	comp->env_q15 = 0;
+	comp->gain_q16 = makeup_q16;
+}
+
+/**
+ * Envolvente y ganancia de un frame. Devuelve la ganancia total en Q16.
+ */
+static inline int32_t comp_frame(audio_dsp_comp_t *comp, const int16_t *frame)
+{
+	int32_t peak = 0;
+	int32_t x;
+	int32_t over;
+
+	for (uint32_t c = 0; c < CH; c++)
+	{
+		x = frame[c] < 0 ? -frame[c] : frame[c];
+		if (x > peak)
+			peak = x;
+	}
+
+	if (peak > comp->env_q15)
+		comp->env_q15 += ((peak - comp->env_q15) * comp->attack_q15) >> 15;
+	else
+		comp->env_q15 += ((peak - comp->env_q15) * comp->release_q15) >> 15;
+
+	if (comp->env_q15 <= comp->threshold_q15)
+		return comp->makeup_q16;
+
+	/* Gain in log2: -(log2(env) - log2(thr)) * (1 - 1/ratio) */
+	over = log2_q16(comp->env_q15) - log2_q16(comp->threshold_q15);
+	x = exp2_q16(-(int32_t)(((int64_t)over * comp->slope_q16) >> 16));
+
+	return (int32_t)(((int64_t)x * comp->makeup_q16) >> 16);
+}
+
+void audio_dsp_comp_ref(audio_dsp_comp_t *comp, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+	for (uint32_t i = 0; i < frames; i++)
+	{
+		comp->gain_q16 = comp_frame(comp, src);
+		audio_dsp_gain_ref(dst, src, CH, comp->gain_q16);
+		src += CH;
+		dst += CH;
+	}
+}
+
+void audio_dsp_comp(audio_dsp_comp_t *comp, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+#if DSP_SIMD && (CH == 2)
+	uint32_t x;
+
+	while (frames--)
+	{
+		comp->gain_q16 = comp_frame(comp, src);
+
+		x = __UNALIGNED_UINT32_READ(src);
+		__UNALIGNED_UINT32_WRITE(dst, __PKHBT(__SSAT(smulwb(comp->gain_q16, x), 16),
+				__SSAT(smulwt(comp->gain_q16, x), 16), 16));
+		src += 2;
+		dst += 2;
+	}
+#else
+	audio_dsp_comp_ref(comp, dst, src, frames);
+#endif
+}
+
+void audio_dsp_add_sat_ref(int16_t *dst, const int16_t *a, const int16_t *b, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = sat16((int32_t)a[i] + b[i]);
+}
+
+void audio_dsp_add_sat(int16_t *dst, const int16_t *a, const int16_t *b, uint32_t samples)
+{
+#if DSP_SIMD
+	uint32_t pairs = samples / 2;
+
+	while (pairs--)
+	{
+		__UNALIGNED_UINT32_WRITE(dst, __QADD16(__UNALIGNED_UINT32_READ(a), __UNALIGNED_UINT32_READ(b)));
+		a += 2;
+		b += 2;
+		dst += 2;
+	}
+
+	if (samples & 1)
+		audio_dsp_add_sat_ref(dst, a, b, 1);
+#else
+	audio_dsp_add_sat_ref(dst, a, b, samples);
+#endif
+}
+
+void audio_dsp_mix_ref(int16_t *dst, const int16_t *a, const int16_t *b, uint32_t samples,
+		int16_t gain_a_q15, int16_t gain_b_q15)
+{
+	int32_t ga = q15_clip(gain_a_q15);
+	int32_t gb = q15_clip(gain_b_q15);
+
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = sat16((a[i] * ga + b[i] * gb) >> 15);
+}
+
+void audio_dsp_mix(int16_t *dst, const int16_t *a, const int16_t *b, uint32_t samples,
+		int16_t gain_a_q15, int16_t gain_b_q15)
+{
+#if DSP_SIMD
+	uint32_t gains = pack16(q15_clip(gain_a_q15), q15_clip(gain_b_q15));
+
+	/* One dual multiply-accumulate per output sample */
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = __SSAT((int32_t)__SMUAD(__PKHBT(a[i], b[i], 16), gains) >> 15, 16);
+#else
+	audio_dsp_mix_ref(dst, a, b, samples, gain_a_q15, gain_b_q15);
+#endif
+}
+
+/******************************************************************************
+ * 								DC REMOVAL
+ *****************************************************************************/
+
+void audio_dsp_dc_init(audio_dsp_dc_t *dc, int16_t r_q15)
+{
+	memset(dc, 0, sizeof(*dc));
+
+	/* Con -32768, r * y1 >> 15 llega a 32768 y el par empaquetado da la vuelta */
+	dc->r = q15_clip(r_q15);
+}
+
+void audio_dsp_dc_remove_ref(audio_dsp_dc_t *dc, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+	int16_t x;
+	int16_t d;
+
+	for (uint32_t n = 0; n < frames; n++)
+	{
+		for (uint32_t ch = 0; ch < CH; ch++)
+		{
+			x = src[n * CH + ch];
+			d = sat16((int32_t)x - dc->x1[ch]);
+			dc->y1[ch] = sat16(d + ((dc->r * dc->y1[ch]) >> 15));
+			dc->x1[ch] = x;
+			dst[n * CH + ch] = dc->y1[ch];
+		}
+	}
+}
+
+void audio_dsp_dc_remove(audio_dsp_dc_t *dc, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+#if DSP_SIMD && (AUDIO_DSP_CHANNELS == 2)
+	/* Both channels of a frame at once: (r * y1) >> 15 == smulw(2 * r, y1) */
+	int32_t r2 = 2 * (int32_t)dc->r;
+	uint32_t x1 = pack16(dc->x1[0], dc->x1[1]);
+	uint32_t y1 = pack16(dc->y1[0], dc->y1[1]);
+	uint32_t x;
+
+	while (frames--)
+	{
+		x = __UNALIGNED_UINT32_READ(src);
+		y1 = __QADD16(__QSUB16(x, x1), __PKHBT(smulwb(r2, y1), smulwt(r2, y1), 16));
+		x1 = x;
+		__UNALIGNED_UINT32_WRITE(dst, y1);
+		src += 2;
+		dst += 2;
+	}
+
+	dc->x1[0] = lo16(x1);
+	dc->x1[1] = hi16(x1);
+	dc->y1[0] = lo16(y1);
+	dc->y1[1] = hi16(y1);
+#else
+	audio_dsp_dc_remove_ref(dc, dst, src, frames);
+#endif
+}
+
+/******************************************************************************
+ * 								BIQUAD CASCADE
+ *****************************************************************************/
+
+bool audio_dsp_biquad_init(audio_dsp_biquad_t *bq, const audio_dsp_biquad_coef_t *coef, uint8_t stages)
+{
+	if (stages == 0 || stages > AUDIO_DSP_BIQUAD_MAX_STAGES)
+		return false;
+
+	memset(bq, 0, sizeof(*bq));
+	bq->stages = stages;
+	for (uint8_t s = 0; s < stages; s++)
+		audio_dsp_biquad_set(bq, s, &coef[s]);
+
+	return true;
+}
+
+void audio_dsp_biquad_set(audio_dsp_biquad_t *bq, uint8_t stage, const audio_dsp_biquad_coef_t *coef)
+{
+	audio_dsp_biquad_stage_t *st = &bq->stage[stage];
+
+	/* Feedback is stored negated so the whole sum is multiply-accumulate */
+	st->b0 = coef->b0;
+	st->b12 = pack16(coef->b1, coef->b2);
+	st->a12 = pack16(q15_clip(-(int32_t)coef->a1), q15_clip(-(int32_t)coef->a2));
+}
+
+void audio_dsp_biquad_ref(audio_dsp_biquad_t *bq, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+	const int16_t *in = src;
+	audio_dsp_biquad_stage_t *st;
+	uint32_t acc;
+	int32_t x0;
+	int32_t y0;
+
+	for (uint8_t s = 0; s < bq->stages; s++)
+	{
+		st = &bq->stage[s];
+		for (uint32_t ch = 0; ch < CH; ch++)
+		{
+			uint32_t x12 = bq->x12[s][ch];
+			uint32_t y12 = bq->y12[s][ch];
+
+			for (uint32_t n = 0; n < frames; n++)
+			{
+				x0 = in[n * CH + ch];
+
+				/* Unsigned sum wraps like the hardware accumulator */
+				acc = (uint32_t)(x0 * st->b0);
+				acc += (uint32_t)(lo16(x12) * lo16(st->b12)) + (uint32_t)(hi16(x12) * hi16(st->b12));
+				acc += (uint32_t)(lo16(y12) * lo16(st->a12)) + (uint32_t)(hi16(y12) * hi16(st->a12));
+				y0 = sat16((int32_t)(acc + (1 << 13)) >> 14);
+
+				dst[n * CH + ch] = y0;
+				x12 = pack16(x0, lo16(x12));
+				y12 = pack16(y0, lo16(y12));
+			}
+
+			bq->x12[s][ch] = x12;
+			bq->y12[s][ch] = y12;
+		}
+		in = dst;
+	}
+}
+
+void audio_dsp_biquad(audio_dsp_biquad_t *bq, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+#if DSP_SIMD
+	const int16_t *in = src;
+	audio_dsp_biquad_stage_t *st;
+	uint32_t acc;
+	int32_t x0;
+	int32_t y0;
+
+	for (uint8_t s = 0; s < bq->stages; s++)
+	{
+		st = &bq->stage[s];
+		for (uint32_t ch = 0; ch < CH; ch++)
+		{
+			uint32_t x12 = bq->x12[s][ch];
+			uint32_t y12 = bq->y12[s][ch];
+
+			for (uint32_t n = 0; n < frames; n++)
+			{
+				x0 = in[n * CH + ch];
+
+				acc = (uint32_t)(x0 * st->b0);
+				acc = __SMLAD(x12, st->b12, acc);
+				acc = __SMLAD(y12, st->a12, acc);
+				y0 = __SSAT((int32_t)(acc + (1 << 13)) >> 14, 16);
+
+				dst[n * CH + ch] = y0;
+				x12 = __PKHBT(x0, x12, 16);
+				y12 = __PKHBT(y0, y12, 16);
+			}
+
+			bq->x12[s][ch] = x12;
+			bq->y12[s][ch] = y12;
+		}
+		in = dst;
+	}
+#else
+	audio_dsp_biquad_ref(bq, dst, src, frames);
+#endif
+}
+
+/******************************************************************************
+ * 								FIR
+ *****************************************************************************/
+
+bool audio_dsp_fir_init(audio_dsp_fir_t *fir, const int16_t *coef_q15, uint16_t taps)
+{
+	uint16_t even = (taps + 1) & ~1;
+
+	if (taps == 0 || even > AUDIO_DSP_FIR_MAX_TAPS)
+		return false;
+
+	memset(fir, 0, sizeof(*fir));
+	fir->taps = even;
+
+	/* Reversed, an odd filter gets a zero tap in front (coef[0]) */
+	for (uint16_t k = 0; k < taps; k++)
+		fir->coef[even - 1 - k] = coef_q15[k];
+
+	return true;
+}
+
+/**
+ * Copia historia + entrada nueva de un canal en un buffer lineal, asi cada
+ * salida es un producto punto contra coef sin indices circulares.
+ */
+static uint32_t fir_load_line(audio_dsp_fir_t *fir, int16_t *line, const int16_t *src, uint32_t ch, uint32_t frames)
+{
+	uint32_t hist = fir->taps - 1;
+
+	memcpy(line, fir->delay[ch], hist * sizeof(int16_t));
+	for (uint32_t n = 0; n < frames; n++)
+		line[hist + n] = src[n * CH + ch];
+
+	return hist;
+}
+
+void audio_dsp_fir_ref(audio_dsp_fir_t *fir, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+	int16_t line[AUDIO_DSP_FIR_MAX_TAPS + AUDIO_DSP_MAX_FRAMES];
+	uint32_t chunk;
+	uint32_t hist;
+	uint32_t acc;
+
+	while (frames)
+	{
+		chunk = (frames > AUDIO_DSP_MAX_FRAMES) ? AUDIO_DSP_MAX_FRAMES : frames;
+
+		for (uint32_t ch = 0; ch < CH; ch++)
+		{
+			hist = fir_load_line(fir, line, src, ch, chunk);
+
+			for (uint32_t n = 0; n < chunk; n++)
+			{
+				acc = 0;
+				for (uint32_t k = 0; k < fir->taps; k++)
+					acc += (uint32_t)(line[n + k] * fir->coef[k]);
+				dst[n * CH + ch] = sat16((int32_t)(acc + (1 << 14)) >> 15);
+			}
+
+			memcpy(fir->delay[ch], &line[chunk], hist * sizeof(int16_t));
+		}
+
+		src += chunk * CH;
+		dst += chunk * CH;
+		frames -= chunk;
+	}
+}
+
+void audio_dsp_fir(audio_dsp_fir_t *fir, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+#if DSP_SIMD
+	int16_t line[AUDIO_DSP_FIR_MAX_TAPS + AUDIO_DSP_MAX_FRAMES];
+	uint32_t chunk;
+	uint32_t hist;
+	uint32_t acc;
+
+	while (frames)
+	{
+		chunk = (frames > AUDIO_DSP_MAX_FRAMES) ? AUDIO_DSP_MAX_FRAMES : frames;
+
+		for (uint32_t ch = 0; ch < CH; ch++)
+		{
+			hist = fir_load_line(fir, line, src, ch, chunk);
+
+			for (uint32_t n = 0; n < chunk; n++)
+			{
+				acc = 0;
+				for (uint32_t k = 0; k < fir->taps; k += 2)
+					acc = __SMLAD(__UNALIGNED_UINT32_READ(&line[n + k]), __UNALIGNED_UINT32_READ(&fir->coef[k]), acc);
+				dst[n * CH + ch] = __SSAT((int32_t)(acc + (1 << 14)) >> 15, 16);
+			}
+
+			memcpy(fir->delay[ch], &line[chunk], hist * sizeof(int16_t));
+		}
+
+		src += chunk * CH;
+		dst += chunk * CH;
+		frames -= chunk;
+	}
+#else
+	audio_dsp_fir_ref(fir, dst, src, frames);
+#endif
+}
+
+/******************************************************************************
+ * 								FORMAT CONVERSION
+ *****************************************************************************/
+
+void audio_dsp_s16_to_q31(int32_t *dst, const int16_t *src, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = (int32_t)((uint32_t)(int32_t)src[i] << 16);
+}
+
+void audio_dsp_q31_to_s16_ref(int16_t *dst, const int32_t *src, uint32_t samples)
+{
+	int64_t x;
+
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		x = (int64_t)src[i] + 0x8000;
+		if (x > INT32_MAX)
+			x = INT32_MAX;
+		dst[i] = (int16_t)(x >> 16);
+	}
+}
+
+void audio_dsp_q31_to_s16(int16_t *dst, const int32_t *src, uint32_t samples)
+{
+#if DSP_SIMD
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = (int16_t)(__QADD(src[i], 0x8000) >> 16);
+#else
+	audio_dsp_q31_to_s16_ref(dst, src, samples);
+#endif
+}
+
+/* Q31 a 24 bits con redondeo, satura solo cerca de +1.0 */
+static inline int32_t q31_round24(int32_t x)
+{
+	int64_t r = (int64_t)x + 0x80;
+
+	if (r > INT32_MAX)
+		r = INT32_MAX;
+	return (int32_t)r >> 8;
+}
+
+static inline uint32_t ror16(uint32_t x)
+{
+	return (x >> 16) | (x << 16);
+}
+
+void audio_dsp_wire_to_q31_ref(int32_t *dst, const uint16_t *src, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = (int32_t)(((uint32_t)src[2 * i] << 16) | src[2 * i + 1]);
+}
+
+void audio_dsp_wire_to_q31(int32_t *dst, const uint16_t *src, uint32_t samples)
+{
+#if DSP_SIMD
+	uint32_t w;
+
+	/**
+	 * Una lectura de 32 bits (el M4 acepta LDR desalineado a media palabra)
+	 * y una rotacion por muestra, en lugar de dos lecturas y un ORR.
+	 */
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		memcpy(&w, &src[2 * i], sizeof(w));
+		dst[i] = (int32_t)__ROR(w, 16);
+	}
+#else
+	audio_dsp_wire_to_q31_ref(dst, src, samples);
+#endif
+}
+
+void audio_dsp_q31_to_wire_ref(uint16_t *dst, const int32_t *src, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		dst[2 * i] = (uint16_t)((uint32_t)src[i] >> 16);
+		dst[2 * i + 1] = (uint16_t)src[i];
+	}
+}
+
+void audio_dsp_q31_to_wire(uint16_t *dst, const int32_t *src, uint32_t samples)
+{
+#if DSP_SIMD
+	uint32_t w;
+
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		w = __ROR((uint32_t)src[i], 16);
+		memcpy(&dst[2 * i], &w, sizeof(w));
+	}
+#else
+	audio_dsp_q31_to_wire_ref(dst, src, samples);
+#endif
+}
+
+void audio_dsp_s24_to_q31(int32_t *dst, const int32_t *src, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = (int32_t)((uint32_t)src[i] << 8);
+}
+
+void audio_dsp_q31_to_s24_ref(int32_t *dst, const int32_t *src, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = q31_round24(src[i]);
+}
+
+void audio_dsp_q31_to_s24(int32_t *dst, const int32_t *src, uint32_t samples)
+{
+#if DSP_SIMD
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = __QADD(src[i], 0x80) >> 8;
+#else
+	audio_dsp_q31_to_s24_ref(dst, src, samples);
+#endif
+}
+
+void audio_dsp_s24p_to_q31_ref(int32_t *dst, const uint8_t *src, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++, src += 3)
+		dst[i] = (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24));
+}
+
+void audio_dsp_s24p_to_q31(int32_t *dst, const uint8_t *src, uint32_t samples)
+{
+	uint32_t w0, w1, w2;
+	uint32_t i = 0;
+
+	/**
+	 * De a 4 muestras: 3 lecturas de 32 bits en lugar de 12 de un byte.
+	 * memcpy porque el buffer empaquetado puede no estar alineado.
+	 */
+	for (; i + 4 <= samples; i += 4, src += 12)
+	{
+		memcpy(&w0, src, 4);
+		memcpy(&w1, src + 4, 4);
+		memcpy(&w2, src + 8, 4);
+		dst[i] = (int32_t)(w0 << 8);
+		dst[i + 1] = (int32_t)(((w0 >> 16) | (w1 << 16)) & 0xFFFFFF00UL);
+		dst[i + 2] = (int32_t)(((w1 >> 8) | (w2 << 24)) & 0xFFFFFF00UL);
+		dst[i + 3] = (int32_t)(w2 & 0xFFFFFF00UL);
+	}
+
+	audio_dsp_s24p_to_q31_ref(dst + i, src, samples - i);
+}
+
+void audio_dsp_q31_to_s24p_ref(uint8_t *dst, const int32_t *src, uint32_t samples)
+{
+	int32_t v;
+
+	for (uint32_t i = 0; i < samples; i++, dst += 3)
+	{
+		v = q31_round24(src[i]);
+		dst[0] = (uint8_t)v;
+		dst[1] = (uint8_t)(v >> 8);
+		dst[2] = (uint8_t)(v >> 16);
+	}
+}
+
+void audio_dsp_q31_to_s24p(uint8_t *dst, const int32_t *src, uint32_t samples)
+{
+	uint32_t a, b, c, d;
+	uint32_t w;
+	uint32_t i = 0;
+
+	for (; i + 4 <= samples; i += 4, dst += 12)
+	{
+#if DSP_SIMD
+		a = (uint32_t)(__QADD(src[i], 0x80) >> 8) & 0xFFFFFFUL;
+		b = (uint32_t)(__QADD(src[i + 1], 0x80) >> 8) & 0xFFFFFFUL;
+		c = (uint32_t)(__QADD(src[i + 2], 0x80) >> 8) & 0xFFFFFFUL;
+		d = (uint32_t)(__QADD(src[i + 3], 0x80) >> 8) & 0xFFFFFFUL;
+#else
+		a = (uint32_t)q31_round24(src[i]) & 0xFFFFFFUL;
+		b = (uint32_t)q31_round24(src[i + 1]) & 0xFFFFFFUL;
+		c = (uint32_t)q31_round24(src[i + 2]) & 0xFFFFFFUL;
+		d = (uint32_t)q31_round24(src[i + 3]) & 0xFFFFFFUL;
+#endif
+		w = a | (b << 24);
+		memcpy(dst, &w, 4);
+		w = (b >> 8) | (c << 16);
+		memcpy(dst + 4, &w, 4);
+		w = (c >> 16) | (d << 8);
+		memcpy(dst + 8, &w, 4);
+	}
+
+	audio_dsp_q31_to_s24p_ref(dst, src + i, samples - i);
+}
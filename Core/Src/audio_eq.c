@@ -0,0 +1,189 @@
+/**
+ * @file audio_eq.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Multi band parametric equalizer for the audio path.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "audio_eq.h"
+#include "audio_prof.h"
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#define EQ_CYCLES()		AUDIO_PROF_CYCLES()		//<--- Enabled by audio_prof_init
+
+/**
+ * audio_eq_set_band puede llamarse desde una interrupcion mientras el main
+ * loop procesa, los coeficientes pendientes y su bit se escriben y se leen
+ * con PRIMASK. Fuera de la placa no hay interrupciones.
+ */
+#if defined(__ARM_ARCH_7EM__)
+#include "stm32f4xx.h"
+#define EQ_LOCK(primask)	do { (primask) = __get_PRIMASK(); __disable_irq(); } while (0)
+#define EQ_UNLOCK(primask)	__set_PRIMASK(primask)
+#else
+#define EQ_LOCK(primask)	((primask) = 0)
+#define EQ_UNLOCK(primask)	((void)(primask))
+#endif
+
+#define EQ_PI			3.14159265f
+
+static const audio_dsp_biquad_coef_t flat = { AUDIO_DSP_Q14_ONE, 0, 0, 0, 0 };
+
+static bool to_q14(float value, int16_t *out)
+{
+	float scaled = roundf(value * AUDIO_DSP_Q14_ONE);
+
+	if (scaled > INT16_MAX || scaled < INT16_MIN)
+		return false;
+
+	*out = (int16_t)scaled;
+	return true;
+}
+
+bool audio_eq_init(audio_eq_t *eq, uint32_t sample_rate, uint8_t bands)
+{
+	audio_dsp_biquad_coef_t coef[AUDIO_EQ_MAX_BANDS];
+
+	if (bands == 0 || bands > AUDIO_EQ_MAX_BANDS)
+		return false;
+
+	for (uint8_t i = 0; i < bands; i++)
+		coef[i] = flat;
+
+	memset(eq, 0, sizeof(*eq));
+	eq->sample_rate = sample_rate;
+
+	return audio_dsp_biquad_init(&eq->bq, coef, bands);
+}
+
+bool audio_eq_design(const audio_eq_band_t *band, uint32_t sample_rate, audio_dsp_biquad_coef_t *coef)
+{
+	float A, w0, cs, alpha, sq;
+	float b0, b1, b2, a0, a1, a2;
+
+	if (band->freq_hz <= 0.0f || band->freq_hz >= sample_rate / 2.0f || band->q <= 0.0f ||
+			fabsf(band->gain_db) > AUDIO_EQ_MAX_GAIN_DB)
+		return false;
+
+	if (band->gain_db == 0.0f)
+	{
+		*coef = flat;
+		return true;
+	}
+
+	A = powf(10.0f, band->gain_db / 40.0f);
+	w0 = 2.0f * EQ_PI * band->freq_hz / sample_rate;
+	cs = cosf(w0);
+	alpha = sinf(w0) / (2.0f * band->q);
+	sq = 2.0f * sqrtf(A) * alpha;
+
+	switch (band->type)
+	{
+	case AUDIO_EQ_PEAK:
+		b0 = 1.0f + alpha * A;
+		b1 = -2.0f * cs;
+		b2 = 1.0f - alpha * A;
+		a0 = 1.0f + alpha / A;
+		a1 = -2.0f * cs;
+		a2 = 1.0f - alpha / A;
+		break;
+
+	case AUDIO_EQ_LOW_SHELF:
+		b0 = A * ((A + 1.0f) - (A - 1.0f) * cs + sq);
+		b1 = 2.0f * A * ((A - 1.0f) - (A + 1.0f) * cs);
+		b2 = A * ((A + 1.0f) - (A - 1.0f) * cs - sq);
+		a0 = (A + 1.0f) + (A - 1.0f) * cs + sq;
+		a1 = -2.0f * ((A - 1.0f) + (A + 1.0f) * cs);
+		a2 = (A + 1.0f) + (A - 1.0f) * cs - sq;
+		break;
+
+	case AUDIO_EQ_HIGH_SHELF:
+		b0 = A * ((A + 1.0f) + (A - 1.0f) * cs + sq);
+		b1 = -2.0f * A * ((A - 1.0f) + (A + 1.0f) * cs);
+		b2 = A * ((A + 1.0f) + (A - 1.0f) * cs - sq);
+		a0 = (A + 1.0f) - (A - 1.0f) * cs + sq;
+		a1 = 2.0f * ((A - 1.0f) - (A + 1.0f) * cs);
+		a2 = (A + 1.0f) - (A - 1.0f) * cs - sq;
+		break;
+
+	default:
+		return false;
+	}
+
+	return to_q14(b0 / a0, &coef->b0) && to_q14(b1 / a0, &coef->b1) && to_q14(b2 / a0, &coef->b2) &&
+			to_q14(a1 / a0, &coef->a1) && to_q14(a2 / a0, &coef->a2);
+}
+
+bool audio_eq_set_band(audio_eq_t *eq, uint8_t band, const audio_eq_band_t *cfg)
+{
+	audio_dsp_biquad_coef_t coef;
+	uint32_t primask;
+
+	if (band >= eq->bq.stages || !audio_eq_design(cfg, eq->sample_rate, &coef))
+		return false;
+
+	/* The block in progress keeps the old coefficients */
+	EQ_LOCK(primask);
+	eq->pending[band] = coef;
+	eq->pending_mask |= (1UL << band);
+	EQ_UNLOCK(primask);
+
+	return true;
+}
+
+void audio_eq_process(audio_eq_t *eq, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+	uint32_t start;
+	uint32_t cost;
+	uint32_t primask;
+
+	/**
+	 * Los coeficientes nuevos se cargan entre bloques. La forma directa I
+	 * guarda entradas y salidas, no estados internos, asi que el cambio no
+	 * genera transitorios grandes. Con PRIMASK nunca se toma una banda a
+	 * medio escribir (son unos pocos ciclos por banda).
+	 */
+	if (eq->pending_mask)
+	{
+		EQ_LOCK(primask);
+		uint32_t mask = eq->pending_mask;
+
+		eq->pending_mask = 0;
+		for (uint8_t band = 0; band < eq->bq.stages; band++)
+		{
+			if (mask & (1UL << band))
+				audio_dsp_biquad_set(&eq->bq, band, &eq->pending[band]);
+		}
+		EQ_UNLOCK(primask);
+	}
+
+	start = EQ_CYCLES();
+	audio_dsp_biquad(&eq->bq, dst, src, frames);
+
+	if (frames)
+	{
+		cost = ((EQ_CYCLES() - start) * 256) / (frames * eq->bq.stages);
+		eq->cycles_per_band = cost;
+		if (cost > eq->worst_cycles_per_band)
+			eq->worst_cycles_per_band = cost;
+	}
+}
+
+uint32_t audio_eq_max_bands(const audio_eq_t *eq, uint32_t cpu_hz, uint32_t sample_rate, uint32_t budget_pct)
+{
+	uint64_t budget;
+
+	if (eq->worst_cycles_per_band == 0 || sample_rate == 0)
+		return 0;
+
+	/* Cycles per frame available, x256 like the measured cost */
+	budget = ((uint64_t)cpu_hz * 256 * budget_pct) / ((uint64_t)sample_rate * 100);
+
+	return (uint32_t)(budget / eq->worst_cycles_per_band);
+}
@@ -0,0 +1,236 @@
+/**
+ * @file audio_move.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Block move engine for audio buffers (DMA2 memory to memory).
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "audio_move.h"
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Solo DMA2 puede hacer memoria a memoria. Se usa el Stream0, DMA1 queda
+ * para el I2S.
+ */
+#define MOVE_DMA_STREAM		DMA2_Stream0
+#define MOVE_DMA_IRQ		DMA2_Stream0_IRQn
+
+typedef struct
+{
+	void *dst;
+	const void *src;
+	uint32_t bytes;
+	audio_move_cb_t cb;
+	void *ctx;
+} audio_move_t;
+
+static DMA_HandleTypeDef hdma_move;
+static audio_move_t queue[AUDIO_MOVE_QUEUE_SIZE];
+static uint32_t queue_head;			//<--- Next free entry
+static uint32_t queue_tail;			//<--- Move in progress (if head != tail)
+static bool dma_ready;
+static audio_move_stats_t stats;
+
+static void audio_move_error(DMA_HandleTypeDef *hdma);
+
+static void audio_move_cpu(void *dst, const void *src, uint32_t bytes, audio_move_cb_t cb, void *ctx)
+{
+	memcpy(dst, src, bytes);
+	stats.cpu_moves++;
+
+	if (cb != NULL)
+		cb(ctx);
+}
+
+/**
+ * Arranca el DMA con la copia mas vieja de la cola. Se llama con las
+ * interrupciones deshabilitadas. Si el DMA no la toma, quien llama tiene
+ * que terminar la cola con audio_move_error despues de habilitarlas.
+ */
+static bool audio_move_start(void)
+{
+	audio_move_t *move = &queue[queue_tail % AUDIO_MOVE_QUEUE_SIZE];
+
+	/* Halfword transfers, the DMA counts items not bytes */
+	return HAL_DMA_Start_IT(&hdma_move, (uint32_t)move->src, (uint32_t)move->dst, move->bytes / 2) == HAL_OK;
+}
+
+static void audio_move_done(DMA_HandleTypeDef *hdma)
+{
+	audio_move_t move = queue[queue_tail % AUDIO_MOVE_QUEUE_SIZE];
+	uint32_t primask;
+	bool started = true;
+
+	/* A higher priority interrupt may queue a move in between */
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	queue_tail++;
+	stats.dma_moves++;
+
+	if (queue_head != queue_tail)
+		started = audio_move_start();
+
+	__set_PRIMASK(primask);
+
+	if (move.cb != NULL)
+		move.cb(move.ctx);
+
+	if (!started)
+		audio_move_error(hdma);
+}
+
+static void audio_move_error(DMA_HandleTypeDef *hdma)
+{
+	audio_move_t move;
+	uint32_t primask;
+
+	(void)hdma;
+
+	/**
+	 * Terminar con la CPU la copia que fallo y todo lo encolado. Solo se
+	 * toma la entrada con PRIMASK, el memcpy y el callback van con las
+	 * interrupciones habilitadas para no demorar la del I2S un periodo.
+	 */
+	dma_ready = false;
+	while (1)
+	{
+		primask = __get_PRIMASK();
+		__disable_irq();
+
+		if (queue_head == queue_tail)
+		{
+			__set_PRIMASK(primask);
+			break;
+		}
+
+		move = queue[queue_tail % AUDIO_MOVE_QUEUE_SIZE];
+		queue_tail++;
+		stats.errors++;
+
+		__set_PRIMASK(primask);
+
+		audio_move_cpu(move.dst, move.src, move.bytes, move.cb, move.ctx);
+	}
+}
+
+bool audio_move_init(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	queue_head = queue_tail = 0;
+	dma_ready = false;
+
+#if AUDIO_MOVE_USE_DMA
+	__HAL_RCC_DMA2_CLK_ENABLE();
+
+	hdma_move.Instance = MOVE_DMA_STREAM;
+	hdma_move.Init.Channel = DMA_CHANNEL_0;
+	hdma_move.Init.Direction = DMA_MEMORY_TO_MEMORY;
+	hdma_move.Init.PeriphInc = DMA_PINC_ENABLE;
+	hdma_move.Init.MemInc = DMA_MINC_ENABLE;
+	hdma_move.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+	hdma_move.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+	hdma_move.Init.Mode = DMA_NORMAL;
+	hdma_move.Init.Priority = DMA_PRIORITY_HIGH;
+	hdma_move.Init.FIFOMode = DMA_FIFOMODE_ENABLE;		/* Direct mode is not allowed for memory to memory */
+	hdma_move.Init.FIFOThreshold = DMA_FIFO_THRESHOLD_FULL;
+	hdma_move.Init.MemBurst = DMA_MBURST_SINGLE;
+	hdma_move.Init.PeriphBurst = DMA_PBURST_SINGLE;
+	if (HAL_DMA_Init(&hdma_move) != HAL_OK)
+	{
+		return false;
+	}
+
+	hdma_move.XferCpltCallback = audio_move_done;
+	hdma_move.XferErrorCallback = audio_move_error;
+
+	/* Below the I2S DMA, a late block move must never delay an audio period */
+	HAL_NVIC_SetPriority(MOVE_DMA_IRQ, 1, 0);
+	HAL_NVIC_EnableIRQ(MOVE_DMA_IRQ);
+
+	dma_ready = true;
+#endif
+
+	return dma_ready;
+}
+
+void audio_move_copy(void *dst, const void *src, uint32_t bytes, audio_move_cb_t cb, void *ctx)
+{
+	uint32_t primask;
+	audio_move_t *move;
+	bool started = true;
+
+	if (!dma_ready || bytes < AUDIO_MOVE_DMA_MIN_BYTES || (bytes / 2) > 0xFFFF ||
+			((uint32_t)dst | (uint32_t)src | bytes) & 1)
+	{
+		audio_move_cpu(dst, src, bytes, cb, ctx);
+		return;
+	}
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (queue_head - queue_tail >= AUDIO_MOVE_QUEUE_SIZE)
+	{
+		__set_PRIMASK(primask);
+		audio_move_cpu(dst, src, bytes, cb, ctx);
+		return;
+	}
+
+	move = &queue[queue_head % AUDIO_MOVE_QUEUE_SIZE];
+	move->dst = dst;
+	move->src = src;
+	move->bytes = bytes;
+	move->cb = cb;
+	move->ctx = ctx;
+	queue_head++;
+
+	if (queue_head - queue_tail > stats.max_queued)
+		stats.max_queued = queue_head - queue_tail;
+
+	/* Queue was empty, DMA is idle */
+	if (queue_head - queue_tail == 1)
+		started = audio_move_start();
+
+	__set_PRIMASK(primask);
+
+	if (!started)
+		audio_move_error(&hdma_move);
+}
+
+uint32_t audio_move_pending(void)
+{
+	return queue_head - queue_tail;
+}
+
+void audio_move_flush(void)
+{
+	/* Empty queue: DMA idle, or never configured */
+	if (queue_head == queue_tail)
+		return;
+
+	/**
+	 * Nadie mas encola, alcanza con que la interrupcion de DMA2 no corra
+	 * mientras se aborta. HAL_DMA_Abort borra los flags del stream, si la
+	 * interrupcion ya estaba pendiente no encuentra nada que hacer.
+	 */
+	HAL_NVIC_DisableIRQ(MOVE_DMA_IRQ);
+	HAL_DMA_Abort(&hdma_move);
+	queue_tail = queue_head;
+	HAL_NVIC_EnableIRQ(MOVE_DMA_IRQ);
+}
+
+const audio_move_stats_t * audio_move_stats(void)
+{
+	return &stats;
+}
+
+void audio_move_irq(void)
+{
+	HAL_DMA_IRQHandler(&hdma_move);
+}
@@ -0,0 +1,195 @@
+/**
+ * @file audio_power.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Sleep between audio blocks, idle telemetry and core clock scaling.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_power.h"
+#include <string.h>
+
+/**
+ * Divisores por nivel. El APB1 se divide menos a medida que baja el HCLK para
+ * que PCLK1 (I2C2) no cambie, el APB2 no puede bajar de /1.
+ */
+static const uint32_t ahb_div[] = { RCC_SYSCLK_DIV1, RCC_SYSCLK_DIV2, RCC_SYSCLK_DIV4, RCC_SYSCLK_DIV8 };
+static const uint32_t apb_div[] = { RCC_HCLK_DIV1, RCC_HCLK_DIV2, RCC_HCLK_DIV4, RCC_HCLK_DIV8, RCC_HCLK_DIV16 };
+
+#if AUDIO_POWER_MAX_LEVEL >= 4
+#error "AUDIO_POWER_MAX_LEVEL must be below 4"
+#endif
+
+static audio_power_stats_t stats;
+static uint8_t apb1_base;			//<--- Index in apb_div set by SystemClock_Config
+static uint8_t apb2_base;
+static uint32_t flash_latency;
+static uint32_t mark;				//<--- Time of the last audio_power_period
+static uint32_t sleep_acc;			//<--- Time in WFI since mark
+static volatile uint32_t block_stamp;
+static bool stamp_valid;			//<--- block_stamp was taken with the current HCLK
+static uint8_t target_level;
+static uint32_t window_periods;
+static uint8_t window_min;
+
+/******************************************************************************
+ * 								HELPER FUNCTIONS
+ *****************************************************************************/
+
+/**
+ * Tiempo en ciclos de HCLK: ms del HAL por el reload del SysTick mas lo que
+ * ya conto. Si el SysTick dio la vuelta y su IRQ todavia no corrio (PRIMASK
+ * o una IRQ de mas prioridad) el tick se corrige con el pendiente.
+ */
+static uint32_t audio_power_now(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t load;
+	uint32_t tick;
+	uint32_t val;
+
+	__disable_irq();
+	load = SysTick->LOAD + 1;
+	tick = HAL_GetTick();
+	val = SysTick->VAL;
+	if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
+	{
+		val = SysTick->VAL;
+		tick++;
+	}
+	__set_PRIMASK(primask);
+
+	return tick * load + (load - 1 - val);
+}
+
+static uint8_t apb_index(uint32_t div)
+{
+	for (uint8_t i = 0; i < sizeof(apb_div) / sizeof(apb_div[0]); i++)
+		if (apb_div[i] == div)
+			return i;
+	return 0;
+}
+
+static void audio_power_restart(void)
+{
+	mark = audio_power_now();
+	sleep_acc = 0;
+	stamp_valid = false;
+	window_periods = 0;
+	window_min = 100;
+	stats.idle_pct_min = 100;
+	stats.hclk_hz = HAL_RCC_GetHCLKFreq();
+}
+
+/******************************************************************************
+ * 								PUBLIC FUNCTIONS
+ *****************************************************************************/
+
+void audio_power_init(void)
+{
+	RCC_ClkInitTypeDef clk;
+
+	memset(&stats, 0, sizeof(stats));
+
+	HAL_RCC_GetClockConfig(&clk, &flash_latency);
+	apb1_base = apb_index(clk.APB1CLKDivider);
+	apb2_base = apb_index(clk.APB2CLKDivider);
+	target_level = 0;
+
+	audio_power_restart();
+}
+
+void audio_power_sleep(void)
+{
+	uint32_t start = audio_power_now();
+
+	__DSB();
+	__WFI();
+
+	sleep_acc += audio_power_now() - start;
+	stats.sleeps++;
+}
+
+void audio_power_block(void)
+{
+	block_stamp = audio_power_now();
+	stamp_valid = true;
+}
+
+void audio_power_period(void)
+{
+	uint32_t now = audio_power_now();
+	uint32_t elapsed = now - mark;
+	uint32_t idle;
+
+	idle = (elapsed != 0) ? (uint32_t)(((uint64_t)sleep_acc * 100) / elapsed) : 100;
+	stats.idle_pct = (idle > 100) ? 100 : (uint8_t)idle;
+	if (stats.idle_pct < stats.idle_pct_min)
+		stats.idle_pct_min = stats.idle_pct;
+	stats.periods++;
+	mark = now;
+	sleep_acc = 0;
+
+	if (stamp_valid)
+	{
+		stats.wake_us = (uint32_t)(((uint64_t)(now - block_stamp) * 1000000ULL) / stats.hclk_hz);
+		if (stats.wake_us > stats.wake_us_max)
+			stats.wake_us_max = stats.wake_us;
+	}
+
+#if AUDIO_POWER_SCALING
+	/**
+	 * Subir el clock apenas falta CPU, bajarlo solo si toda la ventana tuvo
+	 * margen. Con los umbrales elegidos el nivel nuevo no vuelve a cambiar.
+	 */
+	if (stats.idle_pct < window_min)
+		window_min = stats.idle_pct;
+
+	if (stats.idle_pct < AUDIO_POWER_UP_IDLE_PCT && stats.level > 0)
+	{
+		target_level = stats.level - 1;
+	}
+	else if (++window_periods >= AUDIO_POWER_WINDOW)
+	{
+		if (window_min > AUDIO_POWER_DOWN_IDLE_PCT && stats.level < AUDIO_POWER_MAX_LEVEL)
+			target_level = stats.level + 1;
+		window_periods = 0;
+		window_min = 100;
+	}
+#endif
+}
+
+bool audio_power_scale(void)
+{
+	RCC_ClkInitTypeDef clk = {0};
+	uint8_t level = target_level;
+
+	if (level == stats.level)
+		return false;
+
+	clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+	clk.AHBCLKDivider = ahb_div[level];
+	clk.APB1CLKDivider = apb_div[(apb1_base > level) ? apb1_base - level : 0];
+	clk.APB2CLKDivider = apb_div[(apb2_base > level) ? apb2_base - level : 0];
+
+	/* La latencia del flash de 168 MHz sirve para cualquier HCLK menor */
+	if (HAL_RCC_ClockConfig(&clk, flash_latency) != HAL_OK)
+	{
+		target_level = stats.level;
+		return false;
+	}
+
+	stats.level = level;
+	stats.scale_changes++;
+	audio_power_restart();
+
+	return true;
+}
+
+const audio_power_stats_t * audio_power_stats(void)
+{
+	return &stats;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file audio_prof.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Cycle counter profiling of the audio hot paths.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "audio_prof.h"
+#include <stddef.h>
+#include <string.h>
+
+static audio_prof_stat_t prof[PROF_COUNT];
+
+#if !defined(__ARM_ARCH_7EM__)
+volatile uint32_t audio_prof_mock_cycles;
+
+void audio_prof_mock_advance(uint32_t cycles)
+{
+	audio_prof_mock_cycles += cycles;
+}
+#endif
+
+void audio_prof_init(void)
+{
+#if defined(__ARM_ARCH_7EM__)
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#else
+	audio_prof_mock_cycles = 0;
+#endif
+
+	audio_prof_reset();
+}
+
+void audio_prof_reset(void)
+{
+	memset(prof, 0, sizeof(prof));
+	for (uint32_t i = 0; i < PROF_COUNT; i++)
+		prof[i].min = UINT32_MAX;
+}
+
+uint32_t audio_prof_stop(audio_prof_id_t id, uint32_t start)
+{
+	uint32_t cycles = AUDIO_PROF_CYCLES() - start;
+	audio_prof_stat_t *stat = &prof[id];
+	int32_t bucket;
+
+	stat->count++;
+	stat->sum += cycles;
+	if (cycles < stat->min)
+		stat->min = cycles;
+	if (cycles > stat->max)
+		stat->max = cycles;
+
+	/* Position of the highest bit set, so each bucket doubles the previous one */
+	bucket = (31 - __builtin_clz(cycles | 1)) - AUDIO_PROF_HIST_SHIFT;
+	if (bucket < 0)
+		bucket = 0;
+	if (bucket >= AUDIO_PROF_HIST_BUCKETS)
+		bucket = AUDIO_PROF_HIST_BUCKETS - 1;
+	stat->hist[bucket]++;
+
+	return cycles;
+}
+
+const audio_prof_stat_t * audio_prof_get(audio_prof_id_t id)
+{
+	return &prof[id];
+}
+
+uint32_t audio_prof_mean(audio_prof_id_t id)
+{
+	if (prof[id].count == 0)
+		return 0;
+
+	return (uint32_t)(prof[id].sum / prof[id].count);
+}
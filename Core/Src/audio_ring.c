@@ -0,0 +1,68 @@
+/**
+ * @file audio_ring.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Lock-free single producer / single consumer ring of audio periods.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "audio_ring.h"
+#include <stddef.h>
+#include <string.h>
+
+#define RING_INDEX(x)	((x) & (AUDIO_RING_PERIODS - 1))
+
+void audio_ring_init(audio_ring_t *ring)
+{
+	memset(ring, 0, sizeof(*ring));
+}
+
+void audio_ring_flush(audio_ring_t *ring)
+{
+	ring->tail = ring->head;
+}
+
+uint32_t audio_ring_count(const audio_ring_t *ring)
+{
+	/* head and tail are free running, the difference is always valid */
+	return ring->head - ring->tail;
+}
+
+int16_t * audio_ring_write_acquire(audio_ring_t *ring)
+{
+	uint32_t head = ring->head;
+
+	if (head - ring->tail >= AUDIO_RING_PERIODS)
+		return NULL;
+
+	return ring->slot[RING_INDEX(head)];
+}
+
+void audio_ring_write_commit(audio_ring_t *ring)
+{
+	/* Period data must be in memory before the consumer sees the new head */
+	__DMB();
+	ring->head++;
+}
+
+int16_t * audio_ring_read_acquire(audio_ring_t *ring)
+{
+	uint32_t tail = ring->tail;
+
+	if (ring->head == tail)
+		return NULL;
+
+	/* Do not read period data before head was observed */
+	__DMB();
+	return ring->slot[RING_INDEX(tail)];
+}
+
+void audio_ring_read_release(audio_ring_t *ring)
+{
+	/* Period data must be read before the producer can reuse the slot */
+	__DMB();
+	ring->tail++;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file audio_stream.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Periods between the I2S DMA buffers and the rings of the main loop.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_stream.h"
+#include "audio_move.h"
+#include "audio_trace.h"
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * @brief Block move callbacks, the period is handed over once copied.
+ */
+static void audio_stream_rx_moved(void *ctx)
+{
+	audio_stream_t *stream = ctx;
+
+	audio_ring_write_commit(&stream->rx);
+	audio_trace(TRACE_RX_PUSH, (uint8_t)audio_ring_count(&stream->rx), 0);
+	stream->rx_moving = false;
+}
+
+static void audio_stream_tx_moved(void *ctx)
+{
+	audio_stream_t *stream = ctx;
+
+	audio_ring_read_release(&stream->tx);
+	audio_trace(TRACE_TX_POP, (uint8_t)audio_ring_count(&stream->tx), 0);
+	stream->tx_moving = false;
+}
+
+bool audio_stream_init(audio_stream_t *stream, uint32_t period_halfwords, uint32_t prefill)
+{
+	if (period_halfwords > AUDIO_PERIOD_SAMPLES || prefill >= AUDIO_RING_PERIODS)
+		return false;
+
+	audio_ring_init(&stream->rx);
+	audio_ring_init(&stream->tx);
+	stream->period_bytes = sizeof(int16_t) * period_halfwords;
+	stream->prefill = prefill;
+	stream->rx_moving = false;
+	stream->tx_moving = false;
+
+	/* audio_ring_init deja los slots en cero, son periodos de silencio */
+	for (uint32_t i = 0; i < prefill; i++)
+	{
+		audio_ring_write_acquire(&stream->tx);
+		audio_ring_write_commit(&stream->tx);
+	}
+
+	return true;
+}
+
+void audio_stream_reset(audio_stream_t *stream)
+{
+	int16_t *slot;
+
+	/* Los callbacks de las copias descartadas no se llaman, sus flags quedarian puestos */
+	audio_move_flush();
+	stream->rx_moving = false;
+	stream->tx_moving = false;
+
+	audio_ring_flush(&stream->rx);
+	audio_ring_flush(&stream->tx);
+
+	for (uint32_t i = 0; i < stream->prefill; i++)
+	{
+		slot = audio_ring_write_acquire(&stream->tx);
+		memset(slot, 0, stream->period_bytes);
+		audio_ring_write_commit(&stream->tx);
+	}
+}
+
+void audio_stream_block(audio_stream_t *stream, uint16_t *tx, const uint16_t *rx)
+{
+	int16_t *slot;
+
+	slot = audio_ring_write_acquire(&stream->rx);
+	if (slot != NULL && !stream->rx_moving)
+	{
+		stream->rx_moving = true;
+		audio_move_copy(slot, rx, stream->period_bytes, audio_stream_rx_moved, stream);
+	}
+	else
+	{
+		stream->rx.overrun++;
+		audio_trace(TRACE_OVERRUN, 0, (uint16_t)stream->rx.overrun);
+	}
+
+	slot = audio_ring_read_acquire(&stream->tx);
+	if (slot != NULL && !stream->tx_moving)
+	{
+		stream->tx_moving = true;
+		audio_move_copy(tx, slot, stream->period_bytes, audio_stream_tx_moved, stream);
+	}
+	else
+	{
+		memset(tx, 0, stream->period_bytes);
+		stream->tx.underrun++;
+		audio_trace(TRACE_UNDERRUN, 0, (uint16_t)stream->tx.underrun);
+	}
+}
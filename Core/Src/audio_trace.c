@@ -0,0 +1,30 @@
+/**
+ * @file audio_trace.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Lock-free binary event trace of the audio path, decoded offline.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_trace.h"
+#include <string.h>
+
+audio_trace_t audio_trace_ring;
+
+void audio_trace_init(uint32_t hclk_hz)
+{
+#if defined(__ARM_ARCH_7EM__)
+	/* No resetea el CYCCNT, audio_prof puede estar midiendo */
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	DBGMCU->CR |= DBGMCU_CR_DBG_SLEEP;
+#endif
+
+	memset(&audio_trace_ring, 0, sizeof(audio_trace_ring));
+	audio_trace_ring.records = AUDIO_TRACE_RECORDS;
+	audio_trace_ring.hclk_hz = hclk_hz;
+	audio_trace_ring.magic = AUDIO_TRACE_MAGIC;
+}
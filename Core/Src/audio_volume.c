@@ -0,0 +1,145 @@
+/**
+ * @file audio_volume.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Output volume in dB with click free fades.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "audio_volume.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int32_t half_db_to_q16(int16_t half_db)
+{
+	float gain = powf(10.0f, half_db / 40.0f) * AUDIO_DSP_Q16_ONE;
+
+	return (gain >= (float)INT32_MAX) ? INT32_MAX : (int32_t)(gain + 0.5f);
+}
+
+static uint32_t ms_to_frames(const audio_volume_t *vol, uint32_t ms)
+{
+	if (ms < AUDIO_VOLUME_MIN_FADE_MS)
+		ms = AUDIO_VOLUME_MIN_FADE_MS;
+
+	return (uint32_t)(((uint64_t)ms * vol->sample_rate) / 1000);
+}
+
+void audio_volume_init(audio_volume_t *vol, uint32_t sample_rate, int16_t codec_half_db)
+{
+	memset(vol, 0, sizeof(*vol));
+	vol->sample_rate = sample_rate;
+	vol->codec_half_db = codec_half_db;
+	audio_dsp_ramp_init(&vol->ramp, AUDIO_DSP_Q16_ONE);
+}
+
+/**
+ * La ganancia digital que dejo un fade DSP se devuelve solo si va en el
+ * mismo sentido que el cambio, y solo hasta donde el codec no tenga que
+ * moverse en contra. El codec rampea lineal en dB y la ganancia digital
+ * lineal en amplitud: si uno sube mientras el otro baja, el total se
+ * pasa a mitad del fade. Yendo los dos para el mismo lado es monotono.
+ */
+static bool audio_volume_hw(audio_volume_t *vol, int16_t half_db, uint32_t fade_ms)
+{
+	int16_t dsp_half_db = vol->dsp_half_db;
+	int16_t codec_half_db;
+	uint32_t steps;
+	uint32_t ms = fade_ms;
+	uint8_t rate = 1;
+
+	if (half_db < audio_volume_get(vol) && dsp_half_db > 0)
+		dsp_half_db = (half_db > vol->codec_half_db) ? half_db - vol->codec_half_db : 0;
+	else if (half_db > audio_volume_get(vol) && dsp_half_db < 0)
+		dsp_half_db = (half_db < vol->codec_half_db) ? half_db - vol->codec_half_db : 0;
+
+	codec_half_db = half_db - dsp_half_db;
+	steps = abs(codec_half_db - vol->codec_half_db);
+
+	if (steps > 0)
+	{
+		if (fade_ms > 0)
+			rate = ES8311_dac_ramp_rate(steps, fade_ms, vol->sample_rate);
+
+		/* Two queued writes at most, REG37 is skipped by the cache when it does not change */
+		if (!ES8311_dac_ramp(rate) || !ES8311_dac_volume(codec_half_db))
+			return false;
+
+		vol->codec_half_db = codec_half_db;
+		ms = ES8311_dac_ramp_ms(rate, steps, vol->sample_rate);
+		vol->hw_fades++;
+	}
+	else
+	{
+		vol->dsp_fades++;
+	}
+
+	/* The digital part moves at the same pace as the codec */
+	if (dsp_half_db != vol->dsp_half_db)
+	{
+		vol->dsp_half_db = dsp_half_db;
+		audio_dsp_ramp_set(&vol->ramp, half_db_to_q16(dsp_half_db), ms_to_frames(vol, ms));
+	}
+
+	return true;
+}
+
+bool audio_volume_set(audio_volume_t *vol, int16_t half_db, uint32_t fade_ms, audio_volume_ramp_t mode)
+{
+	uint32_t steps;
+	uint32_t hw_ms;
+	int16_t dsp_half_db;
+
+	if (half_db < ES8311_DAC_VOL_MIN_HALF_DB)
+		half_db = ES8311_DAC_VOL_MIN_HALF_DB;
+	if (half_db > ES8311_DAC_VOL_MAX_HALF_DB)
+		half_db = ES8311_DAC_VOL_MAX_HALF_DB;
+
+	if (half_db == audio_volume_get(vol))
+		return true;
+
+	if (mode == AUDIO_VOLUME_AUTO)
+	{
+		mode = AUDIO_VOLUME_HW;
+		if (fade_ms > 0)
+		{
+			steps = abs(half_db - audio_volume_get(vol));
+			hw_ms = ES8311_dac_ramp_ms(ES8311_dac_ramp_rate(steps, fade_ms, vol->sample_rate),
+					steps, vol->sample_rate);
+			if (hw_ms > 2 * fade_ms || 2 * hw_ms < fade_ms)
+				mode = AUDIO_VOLUME_DSP;
+		}
+	}
+
+	dsp_half_db = half_db - vol->codec_half_db;
+	if (mode == AUDIO_VOLUME_HW || dsp_half_db > AUDIO_VOLUME_DSP_MAX_HALF_DB)
+		return audio_volume_hw(vol, half_db, fade_ms);
+
+	vol->dsp_half_db = dsp_half_db;
+	audio_dsp_ramp_set(&vol->ramp, half_db_to_q16(dsp_half_db), ms_to_frames(vol, fade_ms));
+	vol->dsp_fades++;
+
+	return true;
+}
+
+int16_t audio_volume_get(const audio_volume_t *vol)
+{
+	return vol->codec_half_db + vol->dsp_half_db;
+}
+
+void audio_volume_process(audio_volume_t *vol, int16_t *dst, const int16_t *src, uint32_t frames)
+{
+	/* At 0 dB and not moving there is nothing to do */
+	if (vol->ramp.gain_q16 == AUDIO_DSP_Q16_ONE && vol->ramp.target_q16 == AUDIO_DSP_Q16_ONE)
+	{
+		if (dst != src)
+			memmove(dst, src, sizeof(int16_t) * frames * AUDIO_DSP_CHANNELS);
+		return;
+	}
+
+	audio_dsp_ramp(&vol->ramp, dst, src, frames);
+}
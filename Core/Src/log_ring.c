@@ -0,0 +1,63 @@
+/**
+ * @file log_ring.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Byte ring of log_uart: whole messages in, single bytes out, drop counters.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "log_ring.h"
+#include <string.h>
+
+#define RING_INDEX(x)	((x) & (LOG_RING_BYTES - 1))
+
+void log_ring_init(log_ring_t *ring)
+{
+	memset(ring, 0, sizeof(*ring));
+}
+
+bool log_ring_write(log_ring_t *ring, const char *data, uint32_t len)
+{
+	uint32_t head = ring->head;
+	uint32_t used = head - ring->tail;
+
+	if (len > LOG_RING_BYTES - used)
+	{
+		ring->stats.dropped += len;
+		ring->stats.dropped_writes++;
+		return false;
+	}
+
+	for (uint32_t i = 0; i < len; i++)
+		ring->data[RING_INDEX(head + i)] = data[i];
+	ring->head = head + len;
+
+	ring->stats.bytes += len;
+	if (used + len > ring->stats.max_used)
+		ring->stats.max_used = used + len;
+
+	return true;
+}
+
+bool log_ring_read(log_ring_t *ring, char *c)
+{
+	uint32_t tail = ring->tail;
+
+	if (tail == ring->head)
+		return false;
+
+	*c = ring->data[RING_INDEX(tail)];
+	ring->tail = tail + 1;
+	ring->stats.sent++;
+
+	return true;
+}
+
+uint32_t log_ring_pending(const log_ring_t *ring)
+{
+	/* head and tail are free running, the difference is always valid */
+	return ring->head - ring->tail;
+}
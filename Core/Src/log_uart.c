@@ -0,0 +1,104 @@
+/**
+ * @file log_uart.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Non-blocking stdout over USART3 (ST-LINK virtual COM port).
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "log_uart.h"
+#include <stddef.h>
+
+#define LOG_USART			USART3
+#define LOG_USART_IRQ		USART3_IRQn
+
+static log_ring_t ring;
+static bool ready;
+
+void log_uart_init(uint32_t baud)
+{
+	uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+
+	__HAL_RCC_USART3_CLK_ENABLE();
+
+	/**
+	 * Oversampling x16: BRR = PCLK1 / baud redondeado, mantisa y fraccion
+	 * quedan en su lugar. PCLK1 no cambia con audio_power_scale.
+	 */
+	LOG_USART->CR1 = 0;
+	LOG_USART->CR2 = 0;
+	LOG_USART->CR3 = 0;
+	LOG_USART->BRR = (pclk + baud / 2) / baud;
+	LOG_USART->CR1 = USART_CR1_UE | USART_CR1_TE;
+
+	log_ring_init(&ring);
+	ready = true;
+
+	HAL_NVIC_SetPriority(LOG_USART_IRQ, LOG_UART_IRQ_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(LOG_USART_IRQ);
+}
+
+bool log_uart_write(const char *data, uint32_t len)
+{
+	uint32_t primask;
+	bool ok;
+
+	if (!ready || len == 0)
+		return ready;
+
+	/**
+	 * Puede escribir el main loop y cualquier interrupcion, la copia se hace
+	 * con PRIMASK para que los mensajes no se mezclen (unos ns por byte).
+	 */
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	ok = log_ring_write(&ring, data, len);
+	if (ok)
+		LOG_USART->CR1 |= USART_CR1_TXEIE;
+
+	__set_PRIMASK(primask);
+	return ok;
+}
+
+uint32_t log_uart_pending(void)
+{
+	return log_ring_pending(&ring);
+}
+
+void log_uart_irq(void)
+{
+	if ((LOG_USART->SR & USART_SR_TXE) && (LOG_USART->CR1 & USART_CR1_TXEIE))
+	{
+		char c;
+
+		if (log_ring_read(&ring, &c))
+			LOG_USART->DR = (uint8_t)c;
+		else
+			LOG_USART->CR1 &= ~USART_CR1_TXEIE;
+	}
+}
+
+const log_uart_stats_t * log_uart_stats(void)
+{
+	return &ring.stats;
+}
+
+/**
+ * stdout y stderr van al ring, reemplaza el _write weak de syscalls.c que
+ * mandaba de a un caracter con __io_putchar.
+ */
+int _write(int file, char *ptr, int len)
+{
+	(void)file;
+
+	if (len <= 0)
+		return 0;
+
+	/* Lo que no entra se cuenta como perdido, printf no tiene que reintentar */
+	log_uart_write(ptr, (uint32_t)len);
+	return len;
+}
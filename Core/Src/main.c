@@ -22,18 +22,88 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include "es8311.h"
+#include "audio_ring.h"
+#include "audio_stream.h"
+#include "audio_move.h"
+#include "audio_eq.h"
+#include "audio_bench.h"
+#include "audio_prof.h"
+#include "audio_volume.h"
+#include "audio_power.h"
+#include "audio_trace.h"
+#include "log_uart.h"
+#include "audio_capture.h"
+#include <stdio.h>
 #include <string.h>
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN PTD */
 
+/**
+ * Estadisticas del lazo de audio por bloque (media transferencia del DMA).
+ * Se leen desde el debugger para ver si el procesamiento llega a tiempo.
+ * Los tiempos de cada camino (callbacks, IRQs y proceso) estan en audio_prof.
+ */
+typedef struct
+{
+	uint32_t blocks;			//<--- Blocks delivered by the DMA callbacks
+	uint32_t period_cycles;		//<--- CPU cycles available for each block
+	uint32_t headroom_pct;		//<--- Worst case free CPU time per block, in percent
+} audio_stats_t;
+
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
 
-#define SAMPLES_QTY			160
+/**
+ * Loopback sin copias: el DMA transmite directamente el buffer de recepcion.
+ * El TX lee cada muestra antes de que el RX la pise, asi que sale lo recibido
+ * un buffer completo antes (2 periodos), sin pasar por la CPU.
+ * Usar solo cuando no hay procesamiento en el camino de audio.
+ */
+#define AUDIO_ZERO_COPY		0
+
+#define AUDIO_EQ_BANDS		3		//<--- Bands of the equalizer between RX and TX, flat at start
+#define AUDIO_EQ_BUDGET_PCT	50		//<--- CPU share used to project how many bands fit
+
+#define AUDIO_BENCH_AT_BOOT	0		//<--- 1: benchmark the processing stages before starting audio
+#define AUDIO_BENCH_CHUNK	256		//<--- Bytes of the report per printf, well under LOG_RING_BYTES
+
+/**
+ * Control de dinamica de la salida:
+ * 0 sin DRC, 1 DRC del codec (no usa CPU), 2 compresor en el MCU (cualquier
+ * modo, curva con ratio y tiempos en ms, cuesta CPU; ver "compressor" en el benchmark).
+ */
+#define AUDIO_DRC			0
+
+/**
+ * Largo de palabra del stream: 16, 24 o 32 bits. En 24 y 32 bits el periodo se
+ * pasa a Q31 (audio_dsp_wire_to_q31) y vuelve al buffer del DMA sin perder
+ * resolucion; el EQ, el compresor y la parte digital del volumen son de
+ * 16 bits y no se aplican, el volumen queda en el codec.
+ */
+#define AUDIO_WORD_BITS		16
+
+/**
+ * 1: el main loop duerme (WFI) mientras no haya periodos para procesar y baja
+ * el clock del core si sobra CPU (AUDIO_POWER_SCALING). Idle y latencia de
+ * despertar en audio_power_stats().
+ */
+#define AUDIO_SLEEP			1
+
+/**
+ * 1: cada periodo recibido sale tambien por la UART del ST-LINK en frames
+ * con secuencia y CRC (audio_capture.h), Tools/capture_wav.c arma el WAV.
+ * Se manda un solo canal, en PCM16 son 2 bytes por muestra mas ~5% de framing:
+ * a 921600 baud entra hasta 32 kHz, a 44.1/48 kHz hacen falta 2 Mbaud, G.711
+ * (1 byte) o ADPCM (1/2 byte), si no se pierden frames (el host los cuenta).
+ * No se usa con AUDIO_ZERO_COPY.
+ */
+#define AUDIO_CAPTURE		0
+#define AUDIO_CAPTURE_BAUD	921600
+#define AUDIO_CAPTURE_FORMAT	AUDIO_CAPTURE_PCM16	//<--- audio_capture_format_t
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -49,11 +119,37 @@ DMA_HandleTypeDef hdma_spi2_tx;
 DMA_HandleTypeDef hdma_i2s2_ext_rx;
 
 /* USER CODE BEGIN PV */
+/**
+ * Configuracion del stream. Los periodos de mas de 2 se precargan con
+ * silencio en audioStream.tx, es el margen que tiene el main loop para atrasarse.
+ */
+es8311_audio_config_t audioConfig = ES8311_AUDIO_CONFIG_DEFAULT;
+uint32_t audioLatencyUs;		//<--- Round trip latency of audioConfig
+uint16_t periodSamples;			//<--- Halfwords per period (half of the DMA buffer)
+es8311_bus_usage_t codecInitBus;	//<--- Control bus time spent by ES8311_init
+
 uint16_t buffer_Tx[BUFFER_LENGHT];
 uint16_t buffer_Rx[BUFFER_LENGHT];
-uint16_t *pingPong_Tx;
-uint16_t *pingPong_Rx;
-bool changeBuffer = false;
+audio_stream_t audioStream;		//<--- Rings between the DMA callbacks and the main loop
+audio_stats_t audioStats;
+
+#if AUDIO_WORD_BITS != 16
+int32_t periodQ31[BUFFER_LENGHT / 4];	//<--- Period being processed, Q31 interleaved
+#endif
+audio_eq_t audioEq;
+audio_volume_t audioVolume;		//<--- Output volume, audio_volume_set() fades without clicks
+#if AUDIO_DRC == 1
+const es8311_drc_config_t audioDrc = { true, 2, 14, 10 };	//<--- Datasheet codes, see es8311_drc_config_t
+#elif AUDIO_DRC == 2
+audio_dsp_comp_t audioComp;		//<--- -12 dBFS, 4:1, 1 ms / 100 ms
+#endif
+uint32_t eqMaxBands22k;			//<--- Bands that fit in AUDIO_EQ_BUDGET_PCT at 22.05 kHz (measured cost)
+uint32_t eqMaxBands48k;			//<--- Bands that fit in AUDIO_EQ_BUDGET_PCT at 48 kHz (measured cost)
+
+#if AUDIO_BENCH_AT_BOOT
+audio_bench_result_t benchResults[AUDIO_BENCH_MAX_STAGES];
+char benchJson[5120];			//<--- Benchmark report, also printed on the log UART
+#endif
 
 /* USER CODE END PV */
 
@@ -64,37 +160,155 @@ static void MX_I2C2_Init(void);
 static void MX_DMA_Init(void);
 static void MX_I2S2_Init(void);
 /* USER CODE BEGIN PFP */
-
+static void audio_stats_init(const es8311_audio_config_t *config);
+static void audio_stats_budget(const es8311_audio_config_t *config);
+#if !AUDIO_ZERO_COPY
+static void audio_stats_done(uint32_t start);
+#endif
+static void audio_dma_block(uint16_t *tx, const uint16_t *rx);
+#if AUDIO_BENCH_AT_BOOT
+static void audio_bench_print(const char *json, int len);
+#endif
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
 
+/**
+ * @brief Enable the DWT cycle counter and compute the cycle budget per block.
+ */
+static void audio_stats_init(const es8311_audio_config_t *config)
+{
+	memset(&audioStats, 0, sizeof(audioStats));
+	audio_stats_budget(config);
+
+	audio_prof_init();
+}
+
+/**
+ * @brief Cycles per block at the current SystemCoreClock.
+ */
+static void audio_stats_budget(const es8311_audio_config_t *config)
+{
+	audioStats.period_cycles = (SystemCoreClock / ES8311_sampling_hz(config->sampling)) * config->period_frames;
+	audioStats.headroom_pct = 100;
+}
+
+#if !AUDIO_ZERO_COPY
+/**
+ * @brief Called from the main loop once a block was processed.
+ */
+static void audio_stats_done(uint32_t start)
+{
+	uint32_t cycles = audio_prof_stop(PROF_PROCESS, start);
+
+	if (cycles == audio_prof_get(PROF_PROCESS)->max)
+	{
+		audioStats.headroom_pct = (cycles < audioStats.period_cycles) ?
+				((audioStats.period_cycles - cycles) * 100) / audioStats.period_cycles : 0;
+	}
+}
+#endif
+
+#if AUDIO_BENCH_AT_BOOT
+/**
+ * @brief Print the benchmark report on the log UART.
+ *
+ * El reporte no entra en el ring del log (log_uart_write descarta todo
+ * el mensaje), va de a AUDIO_BENCH_CHUNK esperando que la UART haga
+ * lugar. Solo al arrancar, antes del audio: bloquear no molesta.
+ */
+static void audio_bench_print(const char *json, int len)
+{
+	if (len >= (int)sizeof(benchJson))
+		len = sizeof(benchJson) - 1;
+
+	fflush(stdout);
+	for (int i = 0; i < len; i += AUDIO_BENCH_CHUNK)
+	{
+		int n = (len - i < AUDIO_BENCH_CHUNK) ? len - i : AUDIO_BENCH_CHUNK;
+
+		while (log_uart_pending() > LOG_RING_BYTES - (uint32_t)n);
+		printf("%.*s", n, json + i);
+		fflush(stdout);
+	}
+	printf("\r\n");
+}
+#endif
+
+/**
+ * @brief One DMA half transfer: stats, stream check and the period to the rings.
+ */
+static void audio_dma_block(uint16_t *tx, const uint16_t *rx)
+{
+	audioStats.blocks++;
+#if AUDIO_SLEEP
+	audio_power_block();
+#endif
+#if CONFIG_ES8311_I2S_RECOVERY
+	/* Con OVR/UDR las muestras pueden estar corridas un slot, no sirve el bloque */
+	if (ES8311_I2S_check())
+	{
+		audio_trace(TRACE_I2S_ERROR, 0, 0);
+		return;
+	}
+#endif
+
+#if AUDIO_ZERO_COPY
+	(void)tx;
+	(void)rx;
+#else
+	audio_stream_block(&audioStream, tx, rx);
+#endif
+}
+
 void HAL_I2SEx_TxRxHalfCpltCallback(I2S_HandleTypeDef *hi2s)  {
+	uint32_t start = audio_prof_start();
+
+	audio_trace(TRACE_I2S_HALF, 0, (uint16_t)audioStats.blocks);
 
 	/**
 	 * Esta interrupcion se da cuando se llega a BUFFER_SIZE/2
-	 * Asi que cambiamos el puntero de envio a la primer mitad.
-	 * Se supone que la segunda mitad ya tiene datos
+	 * Asi que la primer mitad ya se recibio y se puede cargar la proxima salida.
 	 */
-	pingPong_Tx = buffer_Tx;
-	pingPong_Rx = buffer_Rx;
-	changeBuffer = true;
+	audio_dma_block(buffer_Tx, buffer_Rx);
 
+	audio_prof_stop(PROF_I2S_HALF_CB, start);
 }
 
 void HAL_I2SEx_TxRxCpltCallback(I2S_HandleTypeDef *hi2s)  {
+	uint32_t start = audio_prof_start();
+
+	audio_trace(TRACE_I2S_CPLT, 0, (uint16_t)audioStats.blocks);
 
 	/**
 	 * Esta interrupcion se da cuando se llega a BUFFER_SIZE
-	 * Asi que cambiamos el puntero de envio a la segunda mitad.
-	 * Se supone que la segunda mitad ya tiene datos
+	 * Asi que la segunda mitad ya se recibio y se puede cargar la proxima salida.
 	 */
-	pingPong_Tx = buffer_Tx + (BUFFER_LENGHT / 2);		//segunda mitad
-	pingPong_Rx = buffer_Rx + (BUFFER_LENGHT / 2);		//segunda mitad
-	changeBuffer = true;
+	audio_dma_block(buffer_Tx + periodSamples, buffer_Rx + periodSamples);		//segunda mitad
+
+	audio_prof_stop(PROF_I2S_CPLT_CB, start);
 }
 
+/**
+ * @brief Codec transfers to the trace, replaces the weak one of the driver.
+ */
+void ES8311_bus_event(uint8_t reg, uint8_t value, uint8_t len, bool read, bool ok)
+{
+	audio_trace(TRACE_I2C, reg, (uint16_t)(value | ((len & 0x3F) << 8) | (read << 14) | (ok << 15)));
+}
+
+#if CONFIG_ES8311_I2S_RECOVERY && !AUDIO_ZERO_COPY
+/**
+ * @brief ES8311_I2S_recover is about to restart the DMA: periods and moves
+ * of the old stream are dropped, the output starts again from the prefill.
+ */
+void ES8311_I2S_restarting(void)
+{
+	audio_stream_reset(&audioStream);
+}
+#endif
+
 /* USER CODE END 0 */
 
 /**
@@ -129,19 +343,86 @@ int main(void)
   MX_DMA_Init();
   MX_I2S2_Init();
   /* USER CODE BEGIN 2 */
-
-  if(!ES8311_init(SAMPLING_22K))
+#if AUDIO_CAPTURE && !AUDIO_ZERO_COPY
+  log_uart_init(AUDIO_CAPTURE_BAUD);
+#else
+  log_uart_init(LOG_UART_BAUD);
+#endif
+
+#if AUDIO_WORD_BITS == 32
+  ES8311_config_word_length(&audioConfig, ES8311_WORD_32);
+#elif AUDIO_WORD_BITS == 24
+  ES8311_config_word_length(&audioConfig, ES8311_WORD_24);
+#endif
+
+#if AUDIO_ZERO_COPY
+  /* Without rings only the DMA double buffer is in the path */
+  audioConfig.period_count = 2;
+#endif
+
+  ES8311_bus_usage(&codecInitBus);
+  if(!ES8311_init(&audioConfig))
 	  while(1);
+  ES8311_bus_usage_since(&codecInitBus, &codecInitBus);
+
+  printf("es8311: %lu Hz (I2S %+ld ppm), %u bit, I2C %lu Hz, init %lu us of bus\r\n",
+		  (unsigned long)ES8311_sampling_hz(audioConfig.sampling), (long)ES8311_i2s_clock()->error_ppm,
+		  AUDIO_WORD_BITS, (unsigned long)ES8311_I2C_clock_hz(), (unsigned long)codecInitBus.bus_us);
+
+  periodSamples = ES8311_config_buffer_length(&audioConfig) / 2;
+  audioLatencyUs = ES8311_config_latency_us(&audioConfig);
+
+  bzero(buffer_Tx,sizeof(buffer_Tx));
+  bzero(buffer_Rx,sizeof(buffer_Rx));
+
+#if !AUDIO_ZERO_COPY
   /**
-   * Primera posicion del ping pong buffer
+   * Se arranca con algunos periodos de silencio en la salida, es el margen
+   * que tiene el main loop para atrasarse sin que se corte el audio. Tienen
+   * que entrar en el ring junto con el periodo que se procesa.
    */
-  pingPong_Tx = buffer_Tx;
-  pingPong_Rx = buffer_Rx;
+  if(audioConfig.period_count < 2 || !audio_stream_init(&audioStream, periodSamples, audioConfig.period_count - 2))
+	  while(1);
+
+  audio_move_init();
+
+  if(!audio_eq_init(&audioEq, ES8311_sampling_hz(audioConfig.sampling), AUDIO_EQ_BANDS))
+	  while(1);
 
-  bzero(buffer_Tx,BUFFER_LENGHT);
-  bzero(buffer_Rx,BUFFER_LENGHT);
+  audio_volume_init(&audioVolume, ES8311_sampling_hz(audioConfig.sampling), ES8311_DAC_VOL_INIT_HALF_DB);
 
-  HAL_I2SEx_TransmitReceive_DMA(&hi2s2, buffer_Tx, buffer_Rx, BUFFER_LENGHT);
+#if AUDIO_DRC == 2
+  audio_dsp_comp_init(&audioComp, 8231, 4,
+		  audio_dsp_comp_coef(1, ES8311_sampling_hz(audioConfig.sampling)),
+		  audio_dsp_comp_coef(100, ES8311_sampling_hz(audioConfig.sampling)), AUDIO_DSP_Q16_ONE);
+#endif
+#endif
+
+#if AUDIO_DRC == 1
+  if(!ES8311_drc_config(&audioDrc))
+	  while(1);
+#endif
+
+  audio_stats_init(&audioConfig);
+  audio_trace_init(SystemCoreClock);
+#if AUDIO_CAPTURE && !AUDIO_ZERO_COPY
+  audio_capture_init(ES8311_sampling_hz(audioConfig.sampling),
+		  ES8311_config_sample_halfwords(&audioConfig), AUDIO_CAPTURE_FORMAT, log_uart_write);
+#endif
+#if AUDIO_SLEEP
+  audio_power_init();
+#endif
+
+#if AUDIO_BENCH_AT_BOOT
+  audio_bench_print(benchJson, audio_bench_json(benchResults, audio_bench_run(benchResults, AUDIO_BENCH_MAX_STAGES,
+		  audioConfig.period_frames * ES8311_I2S_CHANNELS),
+		  benchJson, sizeof(benchJson)));
+#endif
+#if AUDIO_ZERO_COPY
+  ES8311_I2S_start(&audioConfig, (int16_t *)buffer_Rx, (int16_t *)buffer_Rx);
+#else
+  ES8311_I2S_start(&audioConfig, (int16_t *)buffer_Tx, (int16_t *)buffer_Rx);
+#endif
 
 
 
@@ -151,13 +432,104 @@ int main(void)
   /* USER CODE BEGIN WHILE */
   while (1)
   {
-	  if(changeBuffer)  {
+#if CONFIG_ES8311_I2S_RECOVERY
+	  /* Reiniciar el stream si se paro por un error, ver ES8311_I2S_stats() */
+	  const es8311_i2s_stats_t *i2sStats = ES8311_I2S_stats();
+	  uint32_t recoveries = i2sStats->recoveries;
+
+	  ES8311_I2S_recover();
+	  if (i2sStats->recoveries != recoveries)
+		  audio_trace(TRACE_I2S_RECOVER, 0,
+				  (uint16_t)(i2sStats->recover_us > UINT16_MAX ? UINT16_MAX : i2sStats->recover_us));
+#endif
+
+#if !AUDIO_ZERO_COPY
+	  int16_t *in;
+	  int16_t *out;
+	  uint32_t eqWorst = audioEq.worst_cycles_per_band;
+
+#if AUDIO_SLEEP
+	  if (audio_ring_count(&audioStream.rx) != 0)
+		  audio_power_period();
+#endif
+
+	  /**
+	   * Procesar todos los periodos pendientes mientras haya lugar en la salida
+	   */
+	  while ((in = audio_ring_read_acquire(&audioStream.rx)) != NULL &&
+			  (out = audio_ring_write_acquire(&audioStream.tx)) != NULL)  {
+		  uint32_t start = audio_prof_start();
+
+		  audio_trace(TRACE_PROCESS_START, 0, 0);
+#if AUDIO_CAPTURE
+		  /* Lo que entrego el ADC, antes de procesar */
+		  audio_capture_period((const uint16_t *)in, audioConfig.period_frames);
+#endif
+#if AUDIO_WORD_BITS == 16
+		  /**
+		   * Ecualizar el siguiente tramo de onda hacia el buffer de salida
+		   */
+		  audio_eq_process(&audioEq, out, in, audioConfig.period_frames);
+#if AUDIO_DRC == 2
+		  audio_dsp_comp(&audioComp, out, out, audioConfig.period_frames);
+#endif
+		  audio_volume_process(&audioVolume, out, out, audioConfig.period_frames);
+#else
 		  /**
-		   * Copiar el siguiente tramo de onda al buffer de salida
+		   * Procesamiento de medicion en Q31 entre estas dos conversiones
 		   */
-		  memcpy(pingPong_Tx,pingPong_Rx,(sizeof(uint16_t) * BUFFER_LENGHT/2));
-		  changeBuffer = false;
+		  audio_dsp_wire_to_q31(periodQ31, (const uint16_t *)in, audioConfig.period_frames * ES8311_I2S_CHANNELS);
+		  audio_dsp_q31_to_wire((uint16_t *)out, periodQ31, audioConfig.period_frames * ES8311_I2S_CHANNELS);
+#endif
+
+		  audio_ring_read_release(&audioStream.rx);
+		  audio_ring_write_commit(&audioStream.tx);
+		  audio_stats_done(start);
+		  audio_trace(TRACE_PROCESS_END, 0, 0);
+	  }
+
+	  if (audioEq.worst_cycles_per_band != eqWorst)  {
+		  eqMaxBands22k = audio_eq_max_bands(&audioEq, SystemCoreClock, 22050, AUDIO_EQ_BUDGET_PCT);
+		  eqMaxBands48k = audio_eq_max_bands(&audioEq, SystemCoreClock, 48000, AUDIO_EQ_BUDGET_PCT);
+	  }
+#endif
+
+#if AUDIO_SLEEP
+#if AUDIO_POWER_SCALING
+	  /* Cambiar el clock solo con el I2C y las copias quietos */
+	  if (audio_move_pending() == 0 &&
+#if CONFIG_ES8311_ASYNC
+			  ES8311_async_pending() == 0 &&
+#endif
+			  audio_power_scale())
+	  {
+		  audio_stats_budget(&audioConfig);
+		  audio_trace(TRACE_CLOCK, 0, (uint16_t)(SystemCoreClock / 1000000));
+	  }
+#endif
+
+	  /**
+	   * Dormir hasta la proxima interrupcion si no hay nada para procesar.
+	   * Con PRIMASK un bloque que llega despues del chequeo igual despierta
+	   * al core, y su callback corre recien al habilitar las interrupciones.
+	   */
+	  __disable_irq();
+#if AUDIO_ZERO_COPY
+	  bool idle = true;
+#else
+	  bool idle = audio_ring_count(&audioStream.rx) == 0 || audio_ring_count(&audioStream.tx) == AUDIO_RING_PERIODS;
+#endif
+#if CONFIG_ES8311_I2S_RECOVERY
+	  idle = idle && !ES8311_I2S_recovery_pending();
+#endif
+	  if (idle)
+	  {
+		  audio_trace(TRACE_SLEEP, 0, 0);
+		  audio_power_sleep();
+		  audio_trace(TRACE_WAKE, 0, 0);
 	  }
+	  __enable_irq();
+#endif
 
     /* USER CODE END WHILE */
 
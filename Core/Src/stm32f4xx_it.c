@@ -22,6 +22,9 @@
 #include "stm32f4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "audio_move.h"
+#include "audio_prof.h"
+#include "log_uart.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -58,6 +61,7 @@
 extern DMA_HandleTypeDef hdma_spi2_tx;
 extern DMA_HandleTypeDef hdma_i2s2_ext_rx;
 /* USER CODE BEGIN EV */
+extern I2C_HandleTypeDef hi2c2;
 
 /* USER CODE END EV */
 
@@ -205,11 +209,11 @@ void SysTick_Handler(void)
 void DMA1_Stream3_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Stream3_IRQn 0 */
-
+  uint32_t start = audio_prof_start();
   /* USER CODE END DMA1_Stream3_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_i2s2_ext_rx);
   /* USER CODE BEGIN DMA1_Stream3_IRQn 1 */
-
+  audio_prof_stop(PROF_DMA1_S3_IRQ, start);
   /* USER CODE END DMA1_Stream3_IRQn 1 */
 }
 
@@ -219,14 +223,46 @@ void DMA1_Stream3_IRQHandler(void)
 void DMA1_Stream4_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Stream4_IRQn 0 */
-
+  uint32_t start = audio_prof_start();
   /* USER CODE END DMA1_Stream4_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_spi2_tx);
   /* USER CODE BEGIN DMA1_Stream4_IRQn 1 */
-
+  audio_prof_stop(PROF_DMA1_S4_IRQ, start);
   /* USER CODE END DMA1_Stream4_IRQn 1 */
 }
 
 /* USER CODE BEGIN 1 */
 
+/**
+  * @brief This function handles DMA2 stream0 global interrupt (audio block moves).
+  */
+void DMA2_Stream0_IRQHandler(void)
+{
+  audio_move_irq();
+}
+
+/**
+  * @brief This function handles I2C2 event interrupt (codec control queue).
+  */
+void I2C2_EV_IRQHandler(void)
+{
+  HAL_I2C_EV_IRQHandler(&hi2c2);
+}
+
+/**
+  * @brief This function handles I2C2 error interrupt.
+  */
+void I2C2_ER_IRQHandler(void)
+{
+  HAL_I2C_ER_IRQHandler(&hi2c2);
+}
+
+/**
+  * @brief This function handles USART3 global interrupt (stdout to the ST-LINK VCP).
+  */
+void USART3_IRQHandler(void)
+{
+  log_uart_irq();
+}
+
 /* USER CODE END 1 */
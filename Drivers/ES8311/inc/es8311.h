@@ -19,8 +19,30 @@
 #include "main.h"
 #define es8311_delay(x) HAL_Delay(x)
 #define CONFIG_USE_ES8311_A0_HIGH 0
+#define CONFIG_ES8311_BUS_LOG 1						//<--- Keep a log of the last I2C transactions
+#ifndef CONFIG_ES8311_REG_CACHE
+#define CONFIG_ES8311_REG_CACHE 1					//<--- Keep a shadow copy of the codec registers
+#endif
+#define CONFIG_ES8311_ASYNC 1						//<--- Interrupt driven register queue (I2C2 EV/ER IRQs)
+#define CONFIG_ES8311_I2C_FAST 1					//<--- Try 400 kHz fast mode, 100 kHz if the codec does not answer
+#define CONFIG_ES8311_I2S_RECOVERY 1				//<--- Restart the I2S DMA after OVR/UDR or DMA errors
+
+#define ES8311_BUS_LOG_SIZE	32
+#define ES8311_BURST_MAX	8		//<--- Registers per auto-increment write, 1 disables bursts
+#define ES8311_ASYNC_QUEUE_SIZE	16	//<--- Register operations waiting for the bus
+#define ES8311_I2C_STD_HZ	100000
+#define ES8311_I2C_FAST_HZ	400000
+#define ES8311_I2S_RETRY_MS	10		//<--- Wait between failed I2S restarts
+#define ES8311_I2S_STALL_MS	50		//<--- No DMA block for this long counts as a stall, well above one period
 
+/**
+ * Tamaño maximo del buffer de DMA en medias palabras (dos periodos). En 16 bits
+ * es una muestra por media palabra, en 24 y 32 bits cada muestra ocupa dos.
+ * El tamaño real se elige en tiempo de ejecucion con es8311_audio_config_t.
+ */
 #define BUFFER_LENGHT	128
+#define ES8311_I2S_CHANNELS		2		//<--- I2S Philips always carries two slots per frame
+#define ES8311_PERIOD_COUNT_MAX	5		//<--- DMA double buffer plus the silence prefill, must match AUDIO_RING_PERIODS + 1
 /**
  * Esta configuracion depende del pin correspondiente. El circuito basico trae el pin A0 --> GND
  * por lo que se usa la direccion 0x18 mayormente
@@ -88,6 +110,147 @@
  *
  */
 
+/******************************************************************************
+ * 				MAPA DE REGISTROS PARA ES8311
+ *****************************************************************************/
+
+#define ES8311_REG_RW			0x01		//<--- Register can be written
+#define ES8311_REG_VOLATILE		0x02		//<--- Chip may change the value by itself
+
+typedef struct
+{
+	uint8_t reg;			//<--- Register address
+	uint8_t reset;			//<--- Value after power on reset
+	uint8_t flags;			//<--- ES8311_REG_xx flags
+} es8311_reg_info_t;
+
+/**
+ * Registro de transacciones I2C. El tiempo de bus se calcula con el
+ * clock configurado en el I2C (no incluye el overhead del HAL).
+ */
+typedef struct
+{
+	uint8_t reg;
+	uint8_t value;			//<--- First data byte
+	uint8_t len;			//<--- Data bytes, more than one for bursts
+	bool read;
+	bool ok;
+	uint16_t time_us;		//<--- Bus time for this transaction
+} es8311_bus_xfer_t;
+
+typedef struct
+{
+	uint32_t transfers;		//<--- Total transactions since last clear
+	uint32_t errors;		//<--- Transactions not acknowledged / timed out
+	uint32_t total_us;		//<--- Accumulated bus time
+	es8311_bus_xfer_t xfer[ES8311_BUS_LOG_SIZE];	//<--- Last transactions, circular
+} es8311_bus_log_t;
+
+/**
+ * ALC del ADC y DRC del DAC. Los niveles y ventanas son los codigos de 4
+ * bits de la hoja de datos. El codec no tiene ataque y release separados:
+ * la ventana (winsize) fija la velocidad con que la ganancia sigue al nivel,
+ * en los dos sentidos.
+ */
+typedef struct
+{
+	bool enable;
+	uint8_t winsize;			//<--- ALC_WINSIZE, speed of attack and release
+	uint8_t max_level;			//<--- ALC_MAXLEVEL, target upper level
+	uint8_t min_level;			//<--- ALC_MINLEVEL, target lower level
+	bool noise_gate;			//<--- ADC automute below gate_level
+	uint8_t gate_winsize;		//<--- ADC_AUTOMUTE_WS
+	uint8_t gate_level;			//<--- ADC_AUTOMUTE_NG
+	uint8_t gate_vol;			//<--- ADC_AUTOMUTE_VOL, attenuation while gated (0..7)
+} es8311_alc_config_t;
+
+typedef struct
+{
+	bool enable;
+	uint8_t winsize;			//<--- DRC_WINSIZE, speed of attack and release
+	uint8_t max_level;			//<--- DRC_MAXLEVEL
+	uint8_t min_level;			//<--- DRC_MINLEVEL
+} es8311_drc_config_t;
+
+/**
+ * Uso acumulado del bus de control desde el arranque (no se borra con el log).
+ * Para medir una operacion se toma una marca antes y se pide la diferencia.
+ */
+typedef struct
+{
+	uint32_t transfers;		//<--- Transactions, bursts count once
+	uint32_t bytes;			//<--- Data bytes after the register address
+	uint32_t errors;
+	uint32_t bus_us;		//<--- Bus time at the real SCL frequency
+} es8311_bus_usage_t;
+
+/**
+ * Cache de registros (write-through). Un registro entra al cache la primera
+ * vez que se lee o escribe con exito; los volatiles siempre van al bus.
+ */
+typedef struct
+{
+	uint32_t read_hits;		//<--- Reads served from the cache
+	uint32_t write_skips;	//<--- Writes skipped because the value did not change
+} es8311_cache_stats_t;
+
+/**
+ * Cola de operaciones de registro por interrupcion. Una escritura al mismo
+ * registro (con el mismo callback) que la ultima encolada, si esa todavia
+ * no salio al bus, la reemplaza. El orden de la cola siempre se respeta.
+ * El callback se llama desde la interrupcion del I2C, o en el momento si
+ * la operacion se resuelve con el cache.
+ */
+typedef void (*es8311_async_cb_t)(uint8_t reg, uint8_t value, bool ok, void *ctx);
+
+typedef struct
+{
+	uint32_t queued;		//<--- Operations accepted
+	uint32_t coalesced;		//<--- Writes merged with the last one queued
+	uint32_t completed;		//<--- Operations finished on the bus
+	uint32_t errors;		//<--- Operations failed or not started
+	uint32_t rejected;		//<--- Queue full or invalid register
+	uint32_t max_pending;	//<--- Worst queue depth
+} es8311_async_stats_t;
+
+/**
+ * Errores del stream de audio. Cualquiera de ellos deja el DMA parado o las
+ * muestras corridas un slot (L/R cruzados), asi que se reinician los dos
+ * sentidos juntos desde el principio de los buffers.
+ */
+typedef struct
+{
+	uint32_t xrun;			//<--- OVR on RX (I2S2ext), UDR on TX (SPI2)
+	uint32_t dma_te;		//<--- DMA transfer errors
+	uint32_t dma_fe;		//<--- DMA FIFO errors
+	uint32_t dma_dme;		//<--- DMA direct mode errors
+} es8311_stream_errors_t;
+
+typedef struct
+{
+	es8311_stream_errors_t tx;
+	es8311_stream_errors_t rx;
+	uint32_t stalls;			//<--- Stream running without blocks for ES8311_I2S_STALL_MS
+	uint32_t recoveries;		//<--- Successful restarts
+	uint32_t failed;			//<--- Restart attempts that failed, retried after ES8311_I2S_RETRY_MS
+	uint32_t recover_us;		//<--- Last error detection to DMA running again
+	uint32_t recover_us_max;
+} es8311_i2s_stats_t;
+
+/**
+ * Secuencias de registros (init, encendido, apagado). Se guardan en flash y
+ * se ejecutan con ES8311_seq_run, que junta registros consecutivos en una
+ * sola escritura con auto-incremento. La demora se aplica despues del paso.
+ */
+typedef struct
+{
+	uint8_t reg;
+	uint8_t value;
+	uint16_t delay_ms;		//<--- Wait after writing this register
+} es8311_seq_step_t;
+
+#define ES8311_SEQ_LEN(seq)		(sizeof(seq) / sizeof((seq)[0]))
+
 /******************************************************************************
  * 				DEFINICIONES DE BITS PARA ES8311
  *****************************************************************************/
@@ -137,22 +300,27 @@
 
 //------------------------- SDP REG 0x09 -------------------------------------
 /**
- * NOTA: El software esta preparado para resolucion de 16 bits, asi que esa
- * configuracion se hace hardcoded.
+ * NOTA: El largo de palabra sale de es8311_audio_config_t.word_length, el
+ * formato (I2S Philips) queda fijo.
  */
 
 #define SDP_IN_MUTE			0x40		//<--- Mask of SDP_IN_MUTE bit
+#define SDP_IN_WL_MASK		0x1C		//<--- Mask of IN Word Length bits
+#define SDP_IN_WL_24BIT		0x00		//<--- Value IN Word Length 24 bits
 #define SDP_IN_WL_16BIT		0x0C		//<--- Value IN Word Length 16 bits
+#define SDP_IN_WL_32BIT		0x10		//<--- Value IN Word Length 32 bits
 #define SDP_IN_FMT_LEFT		0x01		//<--- Value for left justify serial audio data format
 
 //------------------------- SDP REG 0x0A -------------------------------------
 /**
- * NOTA: El software esta preparado para resolucion de 16 bits, asi que esa
- * configuracion se hace hardcoded.
+ * NOTA: Igual que SDP IN, mismo largo de palabra en las dos direcciones.
  */
 
 #define SDP_OUT_MUTE			0x40		//<--- Mask of SDP_OUT_MUTE bit
+#define SDP_OUT_WL_MASK		0x1C		//<--- Mask of OUT Word Length bits
+#define SDP_OUT_WL_24BIT		0x00		//<--- Value OUT Word Length 24 bits
 #define SDP_OUT_WL_16BIT		0x0C		//<--- Value OUT Word Length 16 bits
+#define SDP_OUT_WL_32BIT		0x10		//<--- Value OUT Word Length 32 bits
 #define SDP_OUT_FMT_LEFT		0x01		//<--- Value for left justify serial audio data format
 
 //------------------------- SYSTEM REG 0x0D ----------------------------------
@@ -188,6 +356,8 @@
 #define PGAGAIN_24DB			0x08
 #define PGAGAIN_27DB			0x09
 #define PGAGAIN_30DB			0x0A
+#define PGAGAIN_MASK			0x0F
+#define PGAGAIN_STEP_HALF_DB	6			//<--- 3 dB per PGAGAIN step
 
 
 /*
@@ -205,6 +375,30 @@ enum PGAGAIN {
 								PGAGAIN_30DB,
 };*/
 
+//------------------------- ADC VOL REG 0x17 --------------------------------
+
+/* Same scale as the DAC: 0x00 is -95.5 dB, 0xBF is 0 dB, 0xFF is +32 dB */
+#define ADC_VOLUME_0DB			0xBF
+#define ES8311_ADC_VOL_MIN_HALF_DB	(-191)
+#define ES8311_ADC_VOL_MAX_HALF_DB	64
+#define ADC_VOL_HALF_DB(x)		((uint8_t)(ADC_VOLUME_0DB + (x)))	//<--- Register value for x * 0.5 dB
+
+/* Total mic gain range, PGA plus ADC volume */
+#define ES8311_MIC_GAIN_MIN_HALF_DB	ES8311_ADC_VOL_MIN_HALF_DB
+#define ES8311_MIC_GAIN_MAX_HALF_DB	(PGAGAIN_30DB * PGAGAIN_STEP_HALF_DB + ES8311_ADC_VOL_MAX_HALF_DB)
+
+//------------------------- ADC ALC REG 0x18 - 0x1B -------------------------
+
+#define ALC_EN					0x80		//<--- Mask of ALC_EN bit (REG18)
+#define ADC_AUTOMUTE_EN			0x40		//<--- Mask of ADC_AUTOMUTE_EN bit, noise gate (REG18)
+#define ALC_WINSIZE_MASK		0x0F		//<--- ALC_WINSIZE[3:0] (REG18)
+#define ALC_MAXLEVEL_SHIFT		4			//<--- ALC_MAXLEVEL[7:4] (REG19)
+#define ALC_MINLEVEL_MASK		0x0F		//<--- ALC_MINLEVEL[3:0] (REG19)
+#define ADC_AUTOMUTE_WS_SHIFT	4			//<--- ADC_AUTOMUTE_WS[7:4] (REG1A)
+#define ADC_AUTOMUTE_NG_MASK	0x0F		//<--- ADC_AUTOMUTE_NG[3:0] (REG1A)
+#define ADC_AUTOMUTE_VOL_SHIFT	5			//<--- ADC_AUTOMUTE_VOL[7:5] (REG1B)
+#define ADC_AUTOMUTE_VOL_MASK	0xE0
+
 //------------------------- ADC REG 0x1C -------------------------------------
 
 #define REG_1C_DEFAULT			0x6A		//<--- Value for default startup
@@ -213,9 +407,24 @@ enum PGAGAIN {
 
 #define DAC_VOLUME_0DB			0xBF		//<--- 0 dB for DAC volume (not default)
 
+/* 0.5 dB steps: 0x00 is -95.5 dB, 0xBF is 0 dB, 0xFF is +32 dB */
+#define ES8311_DAC_VOL_MIN_HALF_DB	(-191)
+#define ES8311_DAC_VOL_MAX_HALF_DB	64
+#define ES8311_DAC_VOL_INIT_HALF_DB	13		//<--- Volume set by ES8311_init, +6.5 dB
+#define DAC_VOL_HALF_DB(x)		((uint8_t)(DAC_VOLUME_0DB + (x)))	//<--- Register value for x * 0.5 dB
+
+//------------------------- DAC DRC REG 0x34 - 0x35 -------------------------
+
+#define DRC_EN					0x80		//<--- Mask of DRC_EN bit (REG34)
+#define DRC_WINSIZE_MASK		0x0F		//<--- DRC_WINSIZE[3:0] (REG34)
+#define DRC_MAXLEVEL_SHIFT		4			//<--- DRC_MAXLEVEL[7:4] (REG35)
+#define DRC_MINLEVEL_MASK		0x0F		//<--- DRC_MINLEVEL[3:0] (REG35)
+
 //------------------------- DAC REG 0x37 -------------------------------------
 
 #define DAC_RAMPRATE_DEFAULT	0x40		//<--- Value for 0.25dB/32LRCK
+#define DAC_RAMPRATE_SHIFT		4			//<--- DAC_RAMPRATE[7:4], n -> 0.25dB every 2^(n+1) LRCK, 0 no ramp
+#define DAC_RAMPRATE_MAX		15			//<--- 0.25dB/65536LRCK
 #define DAC_EQBYPASS_DEFAULT	0x08		//<--- Value for DAC_EQ bypass
 
 
@@ -255,20 +464,120 @@ enum PGAGAIN {
 
 typedef enum sampling_options
 {
-	SAMPLING_8K, SAMPLING_11K, SAMPLING_16K, SAMPLING_22K
+	SAMPLING_8K, SAMPLING_11K, SAMPLING_16K, SAMPLING_22K,
+	SAMPLING_32K, SAMPLING_44K, SAMPLING_48K
 } sampling_options_t;
 
+/**
+ * Clock del I2S calculado por ES8311_i2s_clock_solve:
+ * Fs = (PLL input * PLLI2SN / PLLI2SR) / (frame bits * i2s_div)
+ * con i2s_div = 2 * I2SDIV + ODD, igual que lo calcula HAL_I2S_Init (sin MCLK).
+ */
+typedef struct
+{
+	uint16_t plli2sn;
+	uint8_t plli2sr;
+	uint16_t i2s_div;			//<--- 2 * I2SDIV + ODD
+	uint32_t rate_hz;			//<--- Rate really produced, rounded down
+	int32_t error_ppm;			//<--- (real - requested) / requested
+} es8311_i2s_clock_t;
+
+#define ES8311_PLLI2SN_MIN		50
+#define ES8311_PLLI2SN_MAX		432
+#define ES8311_PLLI2SR_MIN		2
+#define ES8311_PLLI2SR_MAX		7
+#define ES8311_PLLI2S_VCO_MIN	100000000UL
+#define ES8311_PLLI2S_VCO_MAX	432000000UL
+
+/**
+ * Largo de palabra del I2S y del codec. El slot siempre es de 32 bits
+ * (16 bits usa I2S_DATAFORMAT_16B_EXTENDED), asi que el clock no cambia.
+ */
+typedef enum
+{
+	ES8311_WORD_16, ES8311_WORD_24, ES8311_WORD_32
+} es8311_word_length_t;
+
+/**
+ * Configuracion del stream de audio. Un periodo es media transferencia del
+ * DMA, que es el bloque que se procesa en cada interrupcion.
+ */
+typedef struct
+{
+	sampling_options_t sampling;	//<--- Sample rate
+	uint16_t period_frames;			//<--- Frames per period (DMA half transfer)
+	uint8_t period_count;			//<--- Periods from ADC to DAC, 2 is the DMA double buffer alone, up to ES8311_PERIOD_COUNT_MAX
+	uint8_t channels;				//<--- Samples per frame, must be ES8311_I2S_CHANNELS
+	es8311_word_length_t word_length;	//<--- 24 and 32 bits use two halfwords per sample in the DMA buffer
+} es8311_audio_config_t;
+
+#define ES8311_AUDIO_CONFIG_DEFAULT		{ SAMPLING_22K, BUFFER_LENGHT / 2 / ES8311_I2S_CHANNELS, 4, ES8311_I2S_CHANNELS, ES8311_WORD_16 }
+
 
 /******************************************************************************
  * 				PROTOTIPO DE FUNCIONES PARA ES8311
  *****************************************************************************/
 
+/**
+ * @brief Sample rate in Hz of one sampling option.
+ *
+ * @return 0 if not valid.
+ */
+uint32_t ES8311_sampling_hz(sampling_options_t sampling);
+
+/**
+ * @brief Search PLLI2S N/R and the I2S prescaler for the closest rate.
+ *
+ * @param sample_hz requested rate
+ * @param pll_input_hz PLL source / PLLM (shared with the main PLL)
+ * @param frame_bits bits per frame (packet length of HAL_I2S_Init, 64 for 16B extended I2S)
+ * @param clock solution, the one with lowest |error|, lowest VCO on ties
+ * @return false if no combination is valid
+ */
+bool ES8311_i2s_clock_solve(uint32_t sample_hz, uint32_t pll_input_hz, uint32_t frame_bits,
+		es8311_i2s_clock_t *clock);
+
+/**
+ * @brief I2S clock set by the last ES8311_hardware_init.
+ */
+const es8311_i2s_clock_t * ES8311_i2s_clock(void);
+
+/**
+ * @brief Check an audio configuration against the driver limits.
+ *
+ * @return true if the configuration can be used.
+ */
+bool ES8311_config_valid(const es8311_audio_config_t *config);
+
+/**
+ * @brief Change the word length keeping the DMA buffer size: 24 and 32 bit
+ * samples take two halfwords, the same periods hold half the frames.
+ */
+void ES8311_config_word_length(es8311_audio_config_t *config, es8311_word_length_t word_length);
+
+/**
+ * @brief DMA buffer length (two periods) in halfwords.
+ */
+uint16_t ES8311_config_buffer_length(const es8311_audio_config_t *config);
+
+/**
+ * @brief Halfwords per sample in the DMA buffer, 1 for 16 bits and 2 for 24 / 32 bits.
+ */
+uint8_t ES8311_config_sample_halfwords(const es8311_audio_config_t *config);
+
+/**
+ * @brief Round trip latency from ADC to DAC of the buffering, in microseconds.
+ * Codec filters group delay is not included.
+ */
+uint32_t ES8311_config_latency_us(const es8311_audio_config_t *config);
+
 /**
  * @brief Hardware init for es8311
- * Configure I2C, I2S and clocks
+ * Configure I2C, I2S and clocks. The I2C speed is negotiated here, the
+ * codec must be powered.
  *
  */
-bool ES8311_hardware_init(sampling_options_t sampling);
+bool ES8311_hardware_init(const es8311_audio_config_t *config);
 
 /**
  * @brief Release configuration of clocks.
@@ -292,16 +601,185 @@ bool ES8311_I2C_write(const uint8_t reg, uint8_t value);
  */
 bool ES8311_I2C_read(const uint8_t reg , uint8_t * out);
 
+/**
+ * @brief Write consecutive registers in one transaction (address auto-increment).
+ *
+ * @param reg first register
+ * @param values one byte per register
+ * @param len number of registers
+ */
+bool ES8311_I2C_write_burst(const uint8_t reg, const uint8_t *values, uint8_t len);
+
+/**
+ * @brief Run a register sequence, merging consecutive registers in bursts.
+ *
+ * @return false on the first failed write, the rest is not sent.
+ */
+bool ES8311_seq_run(const es8311_seq_step_t *seq, uint32_t steps);
+
+/**
+ * @brief Read-modify-write of a bitfield in one register.
+ * The current value comes from the register cache when it is known, and
+ * nothing is sent if the bitfield already has the value.
+ *
+ * @param reg
+ * @param mask bits to change
+ * @param value new value of the bits in mask
+ */
+bool ES8311_reg_update(uint8_t reg, uint8_t mask, uint8_t value);
+
+/**
+ * @brief Get the register map entry for one register.
+ *
+ * @param reg
+ * @return NULL if the register is not documented.
+ */
+const es8311_reg_info_t * ES8311_reg_info(uint8_t reg);
+
+/**
+ * @brief Bus time of one register transaction.
+ *
+ * @param clock_hz I2C SCL frequency
+ * @param data_len data bytes after the register address
+ * @param read true for a register read (repeated start)
+ * @return uint32_t microseconds, rounded up
+ */
+uint32_t ES8311_bus_time_us(uint32_t clock_hz, uint8_t data_len, bool read);
+
+/**
+ * @brief Change the control bus speed. Duty cycle is chosen for the
+ * highest SCL not above clock_hz. Queued operations are finished first.
+ */
+bool ES8311_I2C_set_speed(uint32_t clock_hz);
+
+/**
+ * @brief Real SCL frequency, from the peripheral registers.
+ */
+uint32_t ES8311_I2C_clock_hz(void);
+
+/**
+ * @brief Bus usage since boot.
+ */
+void ES8311_bus_usage(es8311_bus_usage_t *usage);
+
+/**
+ * @brief Bus usage since a mark taken with ES8311_bus_usage.
+ */
+void ES8311_bus_usage_since(const es8311_bus_usage_t *mark, es8311_bus_usage_t *delta);
+
+/**
+ * @brief Called on every codec transfer (blocking, burst or queued), also
+ * from the I2C interrupt. Weak and empty in the driver, override it to
+ * trace the bus like the HAL callbacks.
+ */
+void ES8311_bus_event(uint8_t reg, uint8_t value, uint8_t len, bool read, bool ok);
+
+#if CONFIG_ES8311_BUS_LOG
+/**
+ * @brief Get the I2C transaction log.
+ */
+const es8311_bus_log_t * ES8311_bus_log(void);
+
+/**
+ * @brief Clear the I2C transaction log.
+ */
+void ES8311_bus_log_clear(void);
+#endif
+
+#if CONFIG_ES8311_ASYNC
+/**
+ * @brief Queue a register write, never blocks.
+ *
+ * @param cb called when the value is on the chip (may be NULL)
+ * @return false if the register is not writable or the queue is full
+ */
+bool ES8311_async_write(uint8_t reg, uint8_t value, es8311_async_cb_t cb, void *ctx);
+
+/**
+ * @brief Queue a register read, never blocks. The value comes in the callback.
+ */
+bool ES8311_async_read(uint8_t reg, es8311_async_cb_t cb, void *ctx);
+
+/**
+ * @brief Operations queued or on the bus.
+ */
+uint32_t ES8311_async_pending(void);
+
+/**
+ * @brief Wait until the queue is empty. Blocking accesses call it first.
+ *
+ * @return false on timeout
+ */
+bool ES8311_async_wait(uint32_t timeout_ms);
+
+/**
+ * @brief Get the queue counters.
+ */
+const es8311_async_stats_t * ES8311_async_stats(void);
+#endif
+
+#if CONFIG_ES8311_REG_CACHE
+/**
+ * @brief Forget every cached register, next access goes to the bus.
+ */
+void ES8311_cache_invalidate(void);
+
+/**
+ * @brief Get the register cache counters.
+ */
+const es8311_cache_stats_t * ES8311_cache_stats(void);
+#endif
+
 /**
  * @brief Start I2S DMA transmit and receive
  * 
  * @return true if successful
  * @return false hardware error.
  */
-bool ES8311_I2S_start(int16_t *buffer_tx, int16_t *buffer_rx, uint16_t buffer_length);
+bool ES8311_I2S_start(const es8311_audio_config_t *config, int16_t *buffer_tx, int16_t *buffer_rx);
 
 void ES8311_I2S_loopStart(uint16_t* tx, uint16_t* rx);
 
+#if CONFIG_ES8311_I2S_RECOVERY
+/**
+ * @brief Look for OVR/UDR, from the DMA half / complete callbacks.
+ *
+ * The HAL does not report them in DMA mode. DMA errors arrive through
+ * HAL_I2S_ErrorCallback.
+ *
+ * @return true if the stream has to be restarted.
+ */
+bool ES8311_I2S_check(void);
+
+/**
+ * @brief Stream stopped or misaligned, waiting for ES8311_I2S_recover.
+ */
+bool ES8311_I2S_recovery_pending(void);
+
+/**
+ * @brief Restart both DMA streams from the start of the buffers.
+ * Call from the main loop, the TX buffer is cleared before restarting.
+ * It also restarts a stream that stopped delivering blocks (the callbacks
+ * come from the RX stream, if it stops ES8311_I2S_check is not called).
+ *
+ * @return true if nothing was pending or the stream is running again.
+ */
+bool ES8311_I2S_recover(void);
+
+/**
+ * @brief Called by ES8311_I2S_recover with both DMA streams stopped, right
+ * before restarting them (on every attempt). Weak and empty in the driver,
+ * override it to drop what the application keeps between the callbacks and
+ * the main loop (rings, block moves in flight).
+ */
+void ES8311_I2S_restarting(void);
+
+/**
+ * @brief Get the stream error counters.
+ */
+const es8311_i2s_stats_t * ES8311_I2S_stats(void);
+#endif
+
 /**
  * @brief Stop I2S DMA transmit and receive
  * 
@@ -311,10 +789,11 @@ void ES8311_I2S_loopStart(uint16_t* tx, uint16_t* rx);
 bool ES8311_I2S_stop(void);
 
 /**
- * @brief
+ * @brief Codec init, audio should be available through I2S after it.
  *
+ * @return false if the configuration is not valid or the codec does not answer.
  */
-bool ES8311_init(sampling_options_t sampling);
+bool ES8311_init(const es8311_audio_config_t *config);
 
 /**
  * @brief
@@ -337,11 +816,59 @@ void ES8311_mic_loop(uint16_t* tx, uint16_t* rx);
 bool ES8311_stop(void);
 
 /**
- * @brief
- *
+ * @brief DAC volume in percent, uniform in dB: 1..100 is -49.5..0 dB, 0 is -95.5 dB.
+ * Uses the ramp rate already set in the codec.
  */
 bool ES8311_dac_level(int dac_level);
 
+/**
+ * @brief DAC volume (REG32) in 0.5 dB steps, clamped to the codec range.
+ * Queued when CONFIG_ES8311_ASYNC, the codec ramps to it with the REG37 rate.
+ */
+bool ES8311_dac_volume(int16_t half_db);
+
+/**
+ * @brief Set the DAC volume ramp (REG37 DAC_RAMPRATE), 0 disables it.
+ */
+bool ES8311_dac_ramp(uint8_t rate);
+
+/**
+ * @brief Ramp rate whose fade time is closest to fade_ms.
+ *
+ * @param half_db_steps volume change, in 0.5 dB steps
+ * @return 1..DAC_RAMPRATE_MAX
+ */
+uint8_t ES8311_dac_ramp_rate(uint32_t half_db_steps, uint32_t fade_ms, uint32_t sample_hz);
+
+/**
+ * @brief Fade time of the codec ramp for a volume change.
+ */
+uint32_t ES8311_dac_ramp_ms(uint8_t rate, uint32_t half_db_steps, uint32_t sample_hz);
+
+/**
+ * @brief Mute or unmute the DAC serial input (SDP_IN_MUTE).
+ */
+bool ES8311_dac_mute(bool mute);
+
+/**
+ * @brief Enable or disable the headphone driver (HPSW).
+ */
+bool ES8311_hp_enable(bool enable);
+
+/**
+ * @brief Configure the ADC ALC and noise gate (REG18..REG1B).
+ *
+ * @return false if a field is out of range or the bus fails.
+ */
+bool ES8311_alc_config(const es8311_alc_config_t *alc);
+
+/**
+ * @brief Configure the DAC DRC (REG34, REG35).
+ *
+ * @return false if a field is out of range or the bus fails.
+ */
+bool ES8311_drc_config(const es8311_drc_config_t *drc);
+
 /**
  * @brief
  *
@@ -355,11 +882,28 @@ bool ES8311_dac_level(int dac_level);
 bool ES8311_output_mix(uint8_t dac_gain, uint8_t adc_to_dac_level);
 
 /**
- * @brief
- *
+ * @brief Mic gain in dB, see ES8311_mic_gain_half_db.
  */
 bool ES8311_mic_gain(int mic_gain);
 
+/**
+ * @brief Mic gain in 0.5 dB steps, clamped to the codec range.
+ * Split with ES8311_mic_gain_split; registers that do not change are not
+ * written (register cache). Queued when CONFIG_ES8311_ASYNC.
+ */
+bool ES8311_mic_gain_half_db(int16_t half_db);
+
+/**
+ * @brief Split a mic gain between the analog PGA and the ADC digital volume.
+ * As much gain as possible goes to the PGA (3 dB steps up to 30 dB), before
+ * the ADC adds its noise; the ADC volume does the 0.5 dB rest, boosts above
+ * 30 dB and any attenuation.
+ *
+ * @param pga PGAGAIN value for REG14
+ * @param adc_vol value for REG17
+ */
+void ES8311_mic_gain_split(int16_t half_db, uint8_t *pga, uint8_t *adc_vol);
+
 /**
  * @brief
  *
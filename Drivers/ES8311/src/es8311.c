@@ -15,109 +15,292 @@
 
 #define POWER_ON_WAIT 	100
 
+#define ADC_VOL_INIT	ADC_VOL_HALF_DB(-13)
+
+static uint8_t mic_adc_vol = ADC_VOL_INIT;		//<--- Last ADC volume sent, to order the gain writes
+
+/******************************************************************************
+ * 						SECUENCIAS DE REGISTROS
+ *****************************************************************************/
+
+/* Reset ES8311 to its default and power on the state machine */
+static const es8311_seq_step_t es8311_seq_reset[] =
+{
+	{ ES8311_RESET_REG00, RST_DIG | RST_CMG | RST_MST | RST_ADC_DIG | RST_DAC_DIG, 20 },	// 0x1F
+	{ ES8311_RESET_REG00, 0x00, 0 },
+	{ ES8311_RESET_REG00, CSM_ON, 0 },						//0x80  Power-on command
+};
+
 /**
- * Taken from ESP32 example, adapted and more self-explaining code
- * After this function, audio should be available by solely send through I2S
+ * Clocks con BCLK = 32 * LRCK (automatico desde el frame del uC) => IMCLK = 8 * BCLK
+ * IMCLK = (32 * 8 * LRCK), la relacion no depende del sample rate. Si algun rate
+ * necesita otra configuracion, es esta la tabla que hay que elegir segun sampling.
+ *
+ * REG03 y REG04 (oversampling) se escriben con sus valores de POR para que
+ * REG01..REG05 salgan en una sola rafaga.
+ * REG06, REG07 y REG08 no se usan en modo slave (DIV_BCLK y DIV_LRCK deshabilitados).
  */
-bool ES8311_init(sampling_options_t sampling)
+static const es8311_seq_step_t es8311_seq_clock[] =
 {
-	uint8_t chip_read;
+	{ ES8311_CLK_MANAGER_REG01, MCLK_SEL | BCLK_ON | CLKADC_ON | CLKDAC_ON | ANACLKADC_ON | ANACLKDAC_ON, 0 },
+	{ ES8311_CLK_MANAGER_REG02, MULT_PRE | DIV_PRE, 0 },
+	{ ES8311_CLK_MANAGER_REG03, 0x10, 0 },
+	{ ES8311_CLK_MANAGER_REG04, 0x10, 0 },
+	{ ES8311_CLK_MANAGER_REG05, DIV_CLKADC | DIV_CLKDAC, 0 },
+};
+
+/* Analog power up and levels, in register order so it goes in few bursts */
+static const es8311_seq_step_t es8311_seq_power_up[] =
+{
+	{ ES8311_SYSTEM_REG0D, REG_0D_DEFAULT, 0 },			// Power up analog circuitry - NOT default
+	{ ES8311_SYSTEM_REG0E, REG_0E_DEFAULT, 0 },			// Enable analog PGA, enable ADC modulator - NOT default
+	{ ES8311_SYSTEM_REG12, REG_12_DEFAULT, 0 },			// power-up DAC - NOT default
+	{ ES8311_SYSTEM_REG13, HPSW, 0 },					// Enable output to HP drive - NOT default
+	{ ES8311_SYSTEM_REG14, LINSEL | PGAGAIN_15DB, 0 },	// PGA Gain for Mic (differential input) and DIG_MIC off
+	{ ES8311_ADC_REG17, ADC_VOL_INIT, 0 },				// ADC Volume -6.5 dB (70% of the register range)
+	{ ES8311_ADC_REG1C, REG_1C_DEFAULT, 0 },			// ADC Equalizer bypass, cancel DC offset in digital domain
+	{ ES8311_DAC_REG32, DAC_VOL_HALF_DB(ES8311_DAC_VOL_INIT_HALF_DB), 0 },	// DAC Volume
+	{ ES8311_DAC_REG37, DAC_RAMPRATE_DEFAULT | DAC_EQBYPASS_DEFAULT, 0 },	// DAC ramprate, bypass DAC equalizer - NOT default
+};
+
+static const es8311_seq_step_t es8311_seq_power_down[] =
+{
+	{ ES8311_RESET_REG00, RST_DIG | RST_CMG | RST_MST | RST_ADC_DIG | RST_DAC_DIG, 0 },
+};
+
+bool ES8311_seq_run(const es8311_seq_step_t *seq, uint32_t steps)
+{
+	uint8_t burst[ES8311_BURST_MAX];
+	uint32_t i = 0;
+	uint32_t len;
 
-	if (!ES8311_hardware_init(sampling))
+	while (i < steps)
 	{
+		/* Merge while registers are consecutive and no wait is needed in between */
+		len = 0;
+		do
+		{
+			burst[len] = seq[i + len].value;
+			len++;
+		} while (i + len < steps && len < ES8311_BURST_MAX &&
+				seq[i + len - 1].delay_ms == 0 &&
+				seq[i + len].reg == seq[i + len - 1].reg + 1);
+
+		if (!ES8311_I2C_write_burst(seq[i].reg, burst, len))
+			return false;
+
+		if (seq[i + len - 1].delay_ms)
+			es8311_delay(seq[i + len - 1].delay_ms);
+
+		i += len;
+	}
+
+	return true;
+}
+
+uint32_t ES8311_sampling_hz(sampling_options_t sampling)
+{
+	switch (sampling)
+	{
+	case SAMPLING_8K:	return 8000;
+	case SAMPLING_11K:	return 11025;
+	case SAMPLING_16K:	return 16000;
+	case SAMPLING_22K:	return 22050;
+	case SAMPLING_32K:	return 32000;
+	case SAMPLING_44K:	return 44100;
+	case SAMPLING_48K:	return 48000;
+	default:			return 0;
+	}
+}
+
+bool ES8311_i2s_clock_solve(uint32_t sample_hz, uint32_t pll_input_hz, uint32_t frame_bits,
+		es8311_i2s_clock_t *clock)
+{
+	uint64_t vco;
+	uint32_t i2sclk;
+	uint32_t div;
+	int64_t err;
+	int64_t best_err = INT64_MAX;
+
+	if (sample_hz == 0 || frame_bits == 0)
 		return false;
+
+	for (uint32_t r = ES8311_PLLI2SR_MIN; r <= ES8311_PLLI2SR_MAX; r++)
+	{
+		for (uint32_t n = ES8311_PLLI2SN_MIN; n <= ES8311_PLLI2SN_MAX; n++)
+		{
+			vco = (uint64_t)pll_input_hz * n;
+			if (vco < ES8311_PLLI2S_VCO_MIN || vco > ES8311_PLLI2S_VCO_MAX)
+				continue;
+
+			/* Same integer math as HAL_RCCEx_GetPeriphCLKFreq and HAL_I2S_Init */
+			i2sclk = (uint32_t)(vco / r);
+			div = ((((i2sclk / frame_bits) * 10U) / sample_hz) + 5U) / 10U;
+			if (div / 2 < 2 || div / 2 > 255)
+				continue;
+
+			err = ((int64_t)i2sclk * 1000000LL) / ((int64_t)frame_bits * div) - (int64_t)sample_hz * 1000000LL;
+			err /= (int64_t)sample_hz;
+
+			if ((err < 0 ? -err : err) < (best_err < 0 ? -best_err : best_err) ||
+					((err < 0 ? -err : err) == (best_err < 0 ? -best_err : best_err) &&
+					vco < (uint64_t)pll_input_hz * clock->plli2sn))
+			{
+				best_err = err;
+				clock->plli2sn = n;
+				clock->plli2sr = r;
+				clock->i2s_div = div;
+				clock->rate_hz = i2sclk / (frame_bits * div);
+				clock->error_ppm = (int32_t)err;
+			}
+		}
 	}
-	/**
-	 * NO OFICIAL SE CAMBIO SOLO PARA PROBAR
-	 */
-	es8311_delay(POWER_ON_WAIT);
 
+	return best_err != INT64_MAX;
+}
 
+bool ES8311_config_valid(const es8311_audio_config_t *config)
+{
+	if (config == NULL || ES8311_sampling_hz(config->sampling) == 0)
+		return false;
 
-	/**
-	 * Chequeo de presencia del codec. Tiene que devolver si o si este valor, sino esta
-	 * desconectado o roto
-	 */
-	if (  !ES8311_I2C_read(ES8311_CHIP_ID1, & chip_read ) ||
-			chip_read != ES8311_DEFAULT_ID1 )
+	if (config->word_length > ES8311_WORD_32)
 		return false;
 
-	/* Reset ES8311 to its default */
-	if(!ES8311_I2C_write(ES8311_RESET_REG00, RST_DIG | RST_CMG | RST_MST | RST_ADC_DIG | RST_DAC_DIG)) return false;	// 0x1F;
+	if (config->channels != ES8311_I2S_CHANNELS)
+		return false;
 
-	es8311_delay(20);
+	/* Both periods must fit in the DMA buffer */
+	if (config->period_frames == 0 ||
+			ES8311_config_buffer_length(config) > BUFFER_LENGHT)
+		return false;
 
-	if(!ES8311_I2C_write(ES8311_RESET_REG00, 0x00)) return false;
-	if(!ES8311_I2C_write(ES8311_RESET_REG00, CSM_ON)) return false;	//0x80  Power-on command
+	return config->period_count >= 2 && config->period_count <= ES8311_PERIOD_COUNT_MAX;
+}
 
-	/* Setup clock: source BCLK, polarities defaults, ADC and DAC clocks on */
-	if(!ES8311_I2C_write(ES8311_CLK_MANAGER_REG01, MCLK_SEL | BCLK_ON | CLKADC_ON | CLKDAC_ON | ANACLKADC_ON | ANACLKDAC_ON)) return false;
+void ES8311_config_word_length(es8311_audio_config_t *config, es8311_word_length_t word_length)
+{
+	uint16_t halfwords = config->period_frames * ES8311_config_sample_halfwords(config);
 
-	/* Frecuency config with BCLK = 32 * LRCK (automatic from uC frame) => IMCLK = 8 * BCLK
-	 * Simple math ==> IMCLK = (32 * 8 * LRCK) , where LRCK = Sample Rate*/
-	if(!ES8311_I2C_write(ES8311_CLK_MANAGER_REG02, MULT_PRE | DIV_PRE)) return false;
+	config->word_length = word_length;
+	config->period_frames = halfwords / ES8311_config_sample_halfwords(config);
+}
 
+uint16_t ES8311_config_buffer_length(const es8311_audio_config_t *config)
+{
+	return 2 * config->period_frames * config->channels * ES8311_config_sample_halfwords(config);
+}
 
-	/* register ES8311_CLK_MANAGER_REG03 as default after POR */
-	/* register ES8311_CLK_MANAGER_REG04 as default after POR */
+uint8_t ES8311_config_sample_halfwords(const es8311_audio_config_t *config)
+{
+	return (config->word_length == ES8311_WORD_16) ? 1 : 2;
+}
 
-	/* Oversampling as POR defaults on REG03 and REG04 */
+uint32_t ES8311_config_latency_us(const es8311_audio_config_t *config)
+{
+	uint64_t frames = (uint64_t)config->period_count * config->period_frames;
 
-	/* DIV_CLKADC=0 and DIV_CLKDAC=0 as defaults, but just for reasurement*/
-	if(!ES8311_I2C_write(ES8311_CLK_MANAGER_REG05, DIV_CLKADC | DIV_CLKDAC)) return false;
+	return (uint32_t)((frames * 1000000ULL) / ES8311_sampling_hz(config->sampling));
+}
+
+/**
+ * Taken from ESP32 example, adapted and more self-explaining code
+ * After this function, audio should be available by solely send through I2S
+ */
+bool ES8311_init(const es8311_audio_config_t *config)
+{
+	uint8_t chip_read;
+	es8311_seq_step_t format[2];
 
-	/* register ES8311_CLK_MANAGER_REG06 as default after POR */
-	/* register ES8311_CLK_MANAGER_REG07 as default after POR */
-	/* register ES8311_CLK_MANAGER_REG08 as default after POR */
+	if (!ES8311_config_valid(config))
+	{
+		return false;
+	}
 
 	/**
-	 * REG06, REG07 and REG08 has no use in slave operation as DIV_BCLK and DIV_LRCK are disabled
+	 * NO OFICIAL SE CAMBIO SOLO PARA PROBAR
+	 * Antes del hardware init, que ya habla con el codec para elegir la velocidad del I2C
 	 */
+	es8311_delay(POWER_ON_WAIT);
 
-	/* Setup audio format (fmt): master/slave, resolution, I2S
-	 *
-	 * Beware, example code has a new reset on REG00 with 0xBF value
-	 * Not sure if needed here*/
-//	if(!ES8311_I2C_write(ES8311_RESET_REG00, 0xBF);	//????????
+	if (!ES8311_hardware_init(config))
+	{
+		return false;
+	}
+
+#if CONFIG_ES8311_REG_CACHE
+	/* The codec may keep old values or be power cycled, nothing is known yet */
+	ES8311_cache_invalidate();
+#endif
 
 
-	/* Setup SDP In and Out resolution 16bits both */
-	if(!ES8311_I2C_write(ES8311_SDPIN_REG09, SDP_IN_WL_16BIT )) return false;
-	if(!ES8311_I2C_write(ES8311_SDPOUT_REG0A, SDP_OUT_WL_16BIT)) return false;
 
 	/**
-	 * SDP_IN_FMT (REG09 [1:0]) have a default value (00) so its config as I2S serial audio data format
-	 * Check if Left Justify is needed (01). Not sure about this
-	 *
-	 * Same with SDP_OUT_FMT
-	 *
+	 * Chequeo de presencia del codec. Tiene que devolver si o si este valor, sino esta
+	 * desconectado o roto
 	 */
+	if (  !ES8311_I2C_read(ES8311_CHIP_ID1, & chip_read ) ||
+			chip_read != ES8311_DEFAULT_ID1 )
+		return false;
 
-	if(!ES8311_I2C_write(ES8311_SYSTEM_REG0D, REG_0D_DEFAULT)) return false;	// Power up analog circuitry - NOT default
-	if(!ES8311_I2C_write(ES8311_SYSTEM_REG0E, REG_0E_DEFAULT)) return false;	// Enable analog PGA, enable ADC modulator - NOT default
-	if(!ES8311_I2C_write(ES8311_SYSTEM_REG12, REG_12_DEFAULT)) return false; 	// power-up DAC - NOT default
-	if(!ES8311_I2C_write(ES8311_SYSTEM_REG13, HPSW)) return false;				// Enable output to HP drive - NOT default
-	if(!ES8311_I2C_write(ES8311_ADC_REG1C, REG_1C_DEFAULT)) return false;		// ADC Equalizer bypass, cancel DC offset in digital domain
+	if (  !ES8311_I2C_read(ES8311_CHIP_ID2, & chip_read ) ||
+			chip_read != ES8311_DEFAULT_ID2 )
+		return false;
 
-	/* DAC ramprate and bypass DAC equalizer - NOT default */
-	if(!ES8311_I2C_write(ES8311_DAC_REG37, DAC_RAMPRATE_DEFAULT | DAC_EQBYPASS_DEFAULT)) return false;
+	if (!ES8311_seq_run(es8311_seq_reset, ES8311_SEQ_LEN(es8311_seq_reset)))
+		return false;
 
-	/* Set DAC Volume */
-	if(!ES8311_I2C_write(ES8311_DAC_REG32, DAC_VOL_PERCENT_LEVEL(80) )) return false;
+	/* Check that the state machine is really on, before configuring anything else */
+	if (  !ES8311_I2C_read(ES8311_RESET_REG00, & chip_read ) ||
+			!(chip_read & CSM_ON) )
+		return false;
 
-	/* Set ADC Volume */
-	if(!ES8311_I2C_write(ES8311_ADC_REG17, ADC_VOL_PERCENT_LEVEL(70))) return false;
+	if (!ES8311_seq_run(es8311_seq_clock, ES8311_SEQ_LEN(es8311_seq_clock)))
+		return false;
 
-	/* Set max PGA Gain for Mic (differential input) and turn DIG_MIC off */
-	if(!ES8311_I2C_write(ES8311_SYSTEM_REG14, LINSEL | PGAGAIN_15DB)) return false;
+	/**
+	 * SDP In y Out con el largo de palabra de la configuracion, formato I2S
+	 * (SDP_xx_FMT en 00 por defecto).
+	 *
+	 * Beware, example code has a new reset on REG00 with 0xBF value
+	 * Not sure if needed here
+	 */
+	format[0].reg = ES8311_SDPIN_REG09;
+	format[1].reg = ES8311_SDPOUT_REG0A;
+	switch (config->word_length)
+	{
+	case ES8311_WORD_24:
+		format[0].value = SDP_IN_WL_24BIT;
+		format[1].value = SDP_OUT_WL_24BIT;
+		break;
+	case ES8311_WORD_32:
+		format[0].value = SDP_IN_WL_32BIT;
+		format[1].value = SDP_OUT_WL_32BIT;
+		break;
+	default:
+		format[0].value = SDP_IN_WL_16BIT;
+		format[1].value = SDP_OUT_WL_16BIT;
+		break;
+	}
+	format[0].delay_ms = format[1].delay_ms = 0;
+
+	if (!ES8311_seq_run(format, ES8311_SEQ_LEN(format)))
+		return false;
+
+	if (!ES8311_seq_run(es8311_seq_power_up, ES8311_SEQ_LEN(es8311_seq_power_up)))
+		return false;
+	mic_adc_vol = ADC_VOL_INIT;
 
 	return true;
 }
 
 void ES8311_deinit(void)
 {
-	ES8311_I2C_write(ES8311_RESET_REG00, RST_DIG | RST_CMG | RST_MST | RST_ADC_DIG | RST_DAC_DIG);
+	ES8311_seq_run(es8311_seq_power_down, ES8311_SEQ_LEN(es8311_seq_power_down));
 	ES8311_hardware_deinit();
+#if CONFIG_ES8311_REG_CACHE
+	ES8311_cache_invalidate();
+#endif
 }
 
 bool ES8311_start(void)
@@ -136,73 +319,175 @@ bool ES8311_stop(void)
 	return ES8311_I2S_stop();
 }
 
+/**
+ * Escritura en tiempo de ejecucion: va a la cola del I2C si esta, asi el
+ * lazo de audio no se bloquea esperando el bus.
+ */
+static bool ES8311_write_nb(uint8_t reg, uint8_t value)
+{
+#if CONFIG_ES8311_ASYNC
+	return ES8311_async_write(reg, value, NULL, NULL);
+#else
+	return ES8311_I2C_write(reg, value);
+#endif
+}
+
 bool ES8311_dac_level(int dac_level)
 {
-	/**
-	 * TODO: Implement
-	 */
-	return true;
+	if (dac_level < 0 || dac_level > 100)
+		return false;
+
+	/* Perceptually uniform: every percent is 0.5 dB */
+	if (dac_level == 0)
+		return ES8311_dac_volume(ES8311_DAC_VOL_MIN_HALF_DB);
 
+	return ES8311_dac_volume(dac_level - 100);
 }
 
-/**
- * @brief Map simple mic gain to I2C register
- * 
- *  MAX9860 Codec - Microphone Input Register - Address 0x0C
- * | b7 | b6  b5 | b4 b3 b2 b1 b0 |
- * | 0  | PREAMP | 	GAIN		  |
- * 
- * 0x00 to 0x19 -> disabled.
- * 0x20 to 0x3F -> 0 to 20 db
- * 0x40 to 0x5F -> 20 to 40 db
- * 0x60 to 0x7F -> 40 to 50 db
- * 
- * @param mic_gain between 0 and 50.
- * @return uint8_t I2C value register
- */
+bool ES8311_dac_volume(int16_t half_db)
+{
+	if (half_db < ES8311_DAC_VOL_MIN_HALF_DB)
+		half_db = ES8311_DAC_VOL_MIN_HALF_DB;
+	if (half_db > ES8311_DAC_VOL_MAX_HALF_DB)
+		half_db = ES8311_DAC_VOL_MAX_HALF_DB;
 
-/**
- * TODO: IMPLEMENT
- */
+	return ES8311_write_nb(ES8311_DAC_REG32, DAC_VOL_HALF_DB(half_db));
+}
 
-bool ES8311_mic_gain(int mic_gain)
+bool ES8311_dac_ramp(uint8_t rate)
 {
+	if (rate > DAC_RAMPRATE_MAX)
+		return false;
 
-#if 0
-	mic_input_t mic_input_register;
+	return ES8311_write_nb(ES8311_DAC_REG37, (rate << DAC_RAMPRATE_SHIFT) | DAC_EQBYPASS_DEFAULT);
+}
 
-	if (mic_gain < 0 || mic_gain > MAX9860_MIC_GAIN_MAX)
-	{
-		return false;
-	}
+uint32_t ES8311_dac_ramp_ms(uint8_t rate, uint32_t half_db_steps, uint32_t sample_hz)
+{
+	/* Two 0.25 dB steps per 0.5 dB, each one 2^(rate+1) LRCK long */
+	uint64_t lrck = (uint64_t)half_db_steps * 2 * (1UL << (rate + 1));
 
-	/* Before to call this function, check volume is between 0 and 50 */
-	if (mic_gain == 0)
-	{
-		mic_input_register.pam = MIC_PAM_DISABLED;
-	}
-	else if (mic_gain > 0 && mic_gain < 20)
-	{
-		mic_input_register.pam = MIC_PAM_0DB;
-	}
-	else if (mic_gain >= 20 && mic_gain < 30)
+	if (rate == 0 || sample_hz == 0)
+		return 0;
+
+	return (uint32_t)((lrck * 1000) / sample_hz);
+}
+
+uint8_t ES8311_dac_ramp_rate(uint32_t half_db_steps, uint32_t fade_ms, uint32_t sample_hz)
+{
+	uint8_t best = 1;
+	uint32_t best_err = UINT32_MAX;
+	uint32_t ms, err;
+
+	for (uint8_t rate = 1; rate <= DAC_RAMPRATE_MAX; rate++)
 	{
-		mic_input_register.pam = MIC_PAM_20DB;
-		mic_gain -= 20;
+		ms = ES8311_dac_ramp_ms(rate, half_db_steps, sample_hz);
+		err = (ms > fade_ms) ? ms - fade_ms : fade_ms - ms;
+		if (err < best_err)
+		{
+			best = rate;
+			best_err = err;
+		}
 	}
-	else /* mic_gain > 30 && mic_gain <= 50 */
+
+	return best;
+}
+
+bool ES8311_dac_mute(bool mute)
+{
+	return ES8311_reg_update(ES8311_SDPIN_REG09, SDP_IN_MUTE, mute ? SDP_IN_MUTE : 0);
+}
+
+bool ES8311_hp_enable(bool enable)
+{
+	return ES8311_reg_update(ES8311_SYSTEM_REG13, HPSW, enable ? HPSW : 0);
+}
+
+bool ES8311_alc_config(const es8311_alc_config_t *alc)
+{
+	uint8_t regs[3];
+
+	if (alc->winsize > ALC_WINSIZE_MASK || alc->max_level > 0x0F || alc->min_level > ALC_MINLEVEL_MASK ||
+			alc->gate_winsize > 0x0F || alc->gate_level > ADC_AUTOMUTE_NG_MASK ||
+			alc->gate_vol > (ADC_AUTOMUTE_VOL_MASK >> ADC_AUTOMUTE_VOL_SHIFT))
+		return false;
+
+	regs[0] = (alc->enable ? ALC_EN : 0) | (alc->noise_gate ? ADC_AUTOMUTE_EN : 0) | alc->winsize;
+	regs[1] = (alc->max_level << ALC_MAXLEVEL_SHIFT) | alc->min_level;
+	regs[2] = (alc->gate_winsize << ADC_AUTOMUTE_WS_SHIFT) | alc->gate_level;
+
+	/* REG1B shares the byte with the HPF setting, only the gate volume changes */
+	return ES8311_I2C_write_burst(ES8311_ADC_REG18, regs, sizeof(regs)) &&
+			ES8311_reg_update(ES8311_ADC_REG1B, ADC_AUTOMUTE_VOL_MASK, alc->gate_vol << ADC_AUTOMUTE_VOL_SHIFT);
+}
+
+bool ES8311_drc_config(const es8311_drc_config_t *drc)
+{
+	uint8_t regs[2];
+
+	if (drc->winsize > DRC_WINSIZE_MASK || drc->max_level > 0x0F || drc->min_level > DRC_MINLEVEL_MASK)
+		return false;
+
+	regs[0] = (drc->enable ? DRC_EN : 0) | drc->winsize;
+	regs[1] = (drc->max_level << DRC_MAXLEVEL_SHIFT) | drc->min_level;
+
+	return ES8311_I2C_write_burst(ES8311_DAC_REG34, regs, sizeof(regs));
+}
+
+void ES8311_mic_gain_split(int16_t half_db, uint8_t *pga, uint8_t *adc_vol)
+{
+	uint8_t steps = 0;
+
+	if (half_db < ES8311_MIC_GAIN_MIN_HALF_DB)
+		half_db = ES8311_MIC_GAIN_MIN_HALF_DB;
+	if (half_db > ES8311_MIC_GAIN_MAX_HALF_DB)
+		half_db = ES8311_MIC_GAIN_MAX_HALF_DB;
+
+	/* Analog first: it amplifies before the ADC noise is added */
+	if (half_db > 0)
 	{
-		mic_input_register.pam = MIC_PAM_30DB;
-		mic_gain -= 30;
+		steps = half_db / PGAGAIN_STEP_HALF_DB;
+		if (steps > PGAGAIN_30DB)
+			steps = PGAGAIN_30DB;
 	}
 
-	/* Invert pgam because min gain is the max value */
-	mic_gain = 20 - mic_gain;
-	mic_input_register.pgam = mic_gain;
+	*pga = steps;
+	*adc_vol = ADC_VOL_HALF_DB(half_db - steps * PGAGAIN_STEP_HALF_DB);
+}
 
-	max9860_I2C_write(MIC_GAIN, mic_input_register.value);
-#endif
-	return true;
+bool ES8311_mic_gain_half_db(int16_t half_db)
+{
+	uint8_t pga, adc_vol;
+
+	ES8311_mic_gain_split(half_db, &pga, &adc_vol);
+
+	/**
+	 * Si sube la ganancia se baja primero la digital y despues se sube la
+	 * analogica, al reves si baja, asi nunca hay un pico de mas ganancia
+	 * entre las dos escrituras. La cola async respeta el orden (solo junta
+	 * con la ultima escritura encolada), aunque queden escrituras de una
+	 * llamada anterior.
+	 */
+	bool adc_first = adc_vol < mic_adc_vol;
+	bool ok;
+
+	if (adc_first)
+		ok = ES8311_write_nb(ES8311_ADC_REG17, adc_vol) &&
+				ES8311_write_nb(ES8311_SYSTEM_REG14, LINSEL | pga);
+	else
+		ok = ES8311_write_nb(ES8311_SYSTEM_REG14, LINSEL | pga) &&
+				ES8311_write_nb(ES8311_ADC_REG17, adc_vol);
+
+	/* Si algo fallo el registro quedo con el valor viejo o desconocido */
+	if (ok)
+		mic_adc_vol = adc_vol;
+
+	return ok;
+}
+
+bool ES8311_mic_gain(int mic_gain)
+{
+	return ES8311_mic_gain_half_db(mic_gain * 2);
 }
 
 /*
@@ -30,42 +30,507 @@ extern I2S_HandleTypeDef hi2s2;
 #define I2C_HAL_HANDLER &hi2c2                    //!< This depends on number of peripheral use in STM32
 #define I2C_TIMEOUT 50                            //!< Milliseconds
 
-bool ES8311_hardware_init(sampling_options_t sampling)
+static es8311_bus_usage_t bus_usage;
+static uint32_t bus_scl_hz = ES8311_I2C_STD_HZ;		//<--- Real SCL, updated on speed changes
+
+#if CONFIG_ES8311_BUS_LOG
+static es8311_bus_log_t bus_log;
+
+const es8311_bus_log_t * ES8311_bus_log(void)
 {
-    RCC_PeriphCLKInitTypeDef PeriphClkInitStruct = {0};
+    return &bus_log;
+}
 
-    /*	Adjust the audio frequency. */
-    switch (sampling)
+void ES8311_bus_log_clear(void)
+{
+    memset(&bus_log, 0, sizeof(bus_log));
+}
+#endif
+
+__weak void ES8311_bus_event(uint8_t reg, uint8_t value, uint8_t len, bool read, bool ok)
+{
+    (void)reg;
+    (void)value;
+    (void)len;
+    (void)read;
+    (void)ok;
+}
+
+/**
+ * Cuenta una transaccion en el uso del bus y en el log. Se llama desde el
+ * main loop y desde la interrupcion del I2C.
+ */
+static void ES8311_bus_log_add(uint8_t reg, uint8_t value, uint8_t len, bool read, bool ok)
+{
+    uint32_t time_us = ES8311_bus_time_us(bus_scl_hz, len, read);
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    bus_usage.transfers++;
+    bus_usage.bytes += len;
+    bus_usage.bus_us += time_us;
+    if (!ok)
+        bus_usage.errors++;
+
+#if CONFIG_ES8311_BUS_LOG
+    es8311_bus_xfer_t *xfer = &bus_log.xfer[bus_log.transfers % ES8311_BUS_LOG_SIZE];
+
+    xfer->reg = reg;
+    xfer->value = value;
+    xfer->len = len;
+    xfer->read = read;
+    xfer->ok = ok;
+    xfer->time_us = time_us;
+
+    bus_log.transfers++;
+    bus_log.total_us += time_us;
+    if (!ok)
+        bus_log.errors++;
+#endif
+
+    __set_PRIMASK(primask);
+
+    ES8311_bus_event(reg, value, len, read, ok);
+}
+
+void ES8311_bus_usage(es8311_bus_usage_t *usage)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    *usage = bus_usage;
+    __set_PRIMASK(primask);
+}
+
+void ES8311_bus_usage_since(const es8311_bus_usage_t *mark, es8311_bus_usage_t *delta)
+{
+    es8311_bus_usage_t now;
+
+    /* mark and delta may be the same struct */
+    ES8311_bus_usage(&now);
+
+    delta->transfers = now.transfers - mark->transfers;
+    delta->bytes = now.bytes - mark->bytes;
+    delta->errors = now.errors - mark->errors;
+    delta->bus_us = now.bus_us - mark->bus_us;
+}
+
+#if CONFIG_ES8311_REG_CACHE
+static uint8_t reg_cache[ES8311_MAX_REGISTER + 1];
+static uint32_t reg_cache_valid[(ES8311_MAX_REGISTER + 1) / 32];		//<--- One bit per register
+static es8311_cache_stats_t cache_stats;
+
+static bool ES8311_cache_get(const es8311_reg_info_t *info, uint8_t *value)
+{
+	if (info == NULL || (info->flags & ES8311_REG_VOLATILE))
+		return false;
+
+	if (!(reg_cache_valid[info->reg / 32] & (1UL << (info->reg % 32))))
+		return false;
+
+	*value = reg_cache[info->reg];
+	return true;
+}
+
+static void ES8311_cache_set(const es8311_reg_info_t *info, uint8_t value, bool valid)
+{
+	if (info == NULL || (info->flags & ES8311_REG_VOLATILE))
+		return;
+
+	reg_cache[info->reg] = value;
+	if (valid)
+		reg_cache_valid[info->reg / 32] |= 1UL << (info->reg % 32);
+	else
+		reg_cache_valid[info->reg / 32] &= ~(1UL << (info->reg % 32));
+}
+
+void ES8311_cache_invalidate(void)
+{
+	memset(reg_cache_valid, 0, sizeof(reg_cache_valid));
+}
+
+const es8311_cache_stats_t * ES8311_cache_stats(void)
+{
+	return &cache_stats;
+}
+#else
+/* Sin cache: los argumentos se evaluan igual, asi no quedan variables sin usar */
+#define ES8311_cache_get(info, value)		((void)(info), (void)(value), false)
+#define ES8311_cache_set(info, value, valid)	((void)(info), (void)(value), (void)(valid))
+#endif
+
+#if CONFIG_ES8311_ASYNC
+typedef struct
+{
+	uint8_t reg;
+	uint8_t value;
+	bool read;
+	es8311_async_cb_t cb;
+	void *ctx;
+} es8311_async_op_t;
+
+static es8311_async_op_t async_queue[ES8311_ASYNC_QUEUE_SIZE];
+static volatile uint32_t async_head;		//<--- Next free entry
+static volatile uint32_t async_tail;		//<--- Operation on the bus (if async_busy)
+static volatile bool async_busy;
+static uint8_t async_data;					//<--- Data byte of the operation on the bus
+static es8311_async_stats_t async_stats;
+
+/**
+ * Arranca la operacion mas vieja de la cola si el bus esta libre. Si hay
+ * una transferencia bloqueante en curso (HAL_BUSY) queda en la cola y se
+ * arranca cuando esa termina.
+ */
+static void ES8311_async_kick(void)
+{
+	es8311_async_op_t op;
+	HAL_StatusTypeDef status;
+	uint32_t primask;
+
+	while (1)
+	{
+		primask = __get_PRIMASK();
+		__disable_irq();
+
+		if (async_busy || async_tail == async_head)
+		{
+			__set_PRIMASK(primask);
+			return;
+		}
+
+		op = async_queue[async_tail % ES8311_ASYNC_QUEUE_SIZE];
+		async_data = op.value;
+
+		if (op.read)
+			status = HAL_I2C_Mem_Read_IT(I2C_HAL_HANDLER, ES8311_I2C_ADDR << 1, op.reg, sizeof(op.reg), &async_data, sizeof(async_data));
+		else
+			status = HAL_I2C_Mem_Write_IT(I2C_HAL_HANDLER, ES8311_I2C_ADDR << 1, op.reg, sizeof(op.reg), &async_data, sizeof(async_data));
+
+		if (status == HAL_OK)
+			async_busy = true;
+		else if (status != HAL_BUSY)
+		{
+			async_tail++;
+			async_stats.errors++;
+		}
+
+		__set_PRIMASK(primask);
+
+		if (status == HAL_OK || status == HAL_BUSY)
+			return;
+
+		/* Could not start, report it and try the next one */
+		ES8311_bus_log_add(op.reg, op.value, sizeof(op.value), op.read, false);
+		if (op.cb != NULL)
+			op.cb(op.reg, op.value, false, op.ctx);
+	}
+}
+
+/**
+ * Fin de la operacion en curso, desde la interrupcion del I2C.
+ */
+static void ES8311_async_done(bool ok)
+{
+	es8311_async_op_t op = async_queue[async_tail % ES8311_ASYNC_QUEUE_SIZE];
+	const es8311_reg_info_t *info = ES8311_reg_info(op.reg);
+	uint32_t primask;
+
+	if (op.read)
+		op.value = ok ? async_data : 0;
+
+	ES8311_bus_log_add(op.reg, op.value, sizeof(op.value), op.read, ok);
+	/* A failed write leaves the register in an unknown state, a failed read changes nothing */
+	if (ok || !op.read)
+		ES8311_cache_set(info, op.value, ok);
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	async_tail++;
+	async_busy = false;
+	__set_PRIMASK(primask);
+
+	if (ok)
+		async_stats.completed++;
+	else
+		async_stats.errors++;
+
+	ES8311_async_kick();
+
+	if (op.cb != NULL)
+		op.cb(op.reg, op.value, ok, op.ctx);
+}
+
+static bool ES8311_async_queue(uint8_t reg, uint8_t value, bool read, es8311_async_cb_t cb, void *ctx)
+{
+	es8311_async_op_t *op;
+	uint32_t primask;
+	uint8_t cached;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	/**
+	 * Solo se reemplaza la ultima escritura encolada y si todavia no salio
+	 * al bus. Cambiar una mas vieja adelantaria el valor nuevo a las
+	 * operaciones encoladas despues (el orden entre registros importa, ver
+	 * ES8311_mic_gain_half_db) y a una lectura del mismo registro.
+	 */
+	if (!read && async_head - async_tail > (async_busy ? 1U : 0U))
+	{
+		op = &async_queue[(async_head - 1) % ES8311_ASYNC_QUEUE_SIZE];
+		if (!op->read && op->reg == reg && op->cb == cb && op->ctx == ctx)
+		{
+			op->value = value;
+			async_stats.coalesced++;
+			__set_PRIMASK(primask);
+			return true;
+		}
+	}
+
+	/* Nothing else queued for the chip, the cache may already have the answer */
+	if (async_tail == async_head && ES8311_cache_get(ES8311_reg_info(reg), &cached) &&
+			(read || cached == value))
+	{
+		__set_PRIMASK(primask);
+#if CONFIG_ES8311_REG_CACHE
+		if (read)
+			cache_stats.read_hits++;
+		else
+			cache_stats.write_skips++;
+#endif
+		if (cb != NULL)
+			cb(reg, cached, true, ctx);
+		return true;
+	}
+
+	if (async_head - async_tail >= ES8311_ASYNC_QUEUE_SIZE)
+	{
+		async_stats.rejected++;
+		__set_PRIMASK(primask);
+		return false;
+	}
+
+	op = &async_queue[async_head % ES8311_ASYNC_QUEUE_SIZE];
+	op->reg = reg;
+	op->value = value;
+	op->read = read;
+	op->cb = cb;
+	op->ctx = ctx;
+	async_head++;
+
+	async_stats.queued++;
+	if (async_head - async_tail > async_stats.max_pending)
+		async_stats.max_pending = async_head - async_tail;
+
+	__set_PRIMASK(primask);
+
+	ES8311_async_kick();
+	return true;
+}
+
+bool ES8311_async_write(uint8_t reg, uint8_t value, es8311_async_cb_t cb, void *ctx)
+{
+	const es8311_reg_info_t *info = ES8311_reg_info(reg);
+
+	if (info == NULL || !(info->flags & ES8311_REG_RW))
+	{
+		async_stats.rejected++;
+		return false;
+	}
+
+	return ES8311_async_queue(reg, value, false, cb, ctx);
+}
+
+bool ES8311_async_read(uint8_t reg, es8311_async_cb_t cb, void *ctx)
+{
+	return ES8311_async_queue(reg, 0, true, cb, ctx);
+}
+
+uint32_t ES8311_async_pending(void)
+{
+	return async_head - async_tail;
+}
+
+bool ES8311_async_wait(uint32_t timeout_ms)
+{
+	uint32_t start = HAL_GetTick();
+
+	while (async_head != async_tail)
+	{
+		if (HAL_GetTick() - start > timeout_ms)
+			return false;
+	}
+
+	return true;
+}
+
+const es8311_async_stats_t * ES8311_async_stats(void)
+{
+	return &async_stats;
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c == I2C_HAL_HANDLER)
+		ES8311_async_done(true);
+}
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c == I2C_HAL_HANDLER)
+		ES8311_async_done(true);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c == I2C_HAL_HANDLER && async_busy)
+		ES8311_async_done(false);
+}
+#else
+#define ES8311_async_wait(timeout_ms)	true
+#define ES8311_async_kick()
+#endif
+
+uint32_t ES8311_I2C_clock_hz(void)
+{
+    uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+    uint32_t ccr = hi2c2.Instance->CCR;
+    uint32_t div = ccr & I2C_CCR_CCR;
+
+    if (div == 0)
+        return hi2c2.Init.ClockSpeed;
+
+    /* Standard: Thigh = Tlow = CCR. Fast: 1+2 or 9+16 periods of CCR */
+    if (!(ccr & I2C_CCR_FS))
+        return pclk / (2 * div);
+
+    return pclk / (((ccr & I2C_CCR_DUTY) ? 25 : 3) * div);
+}
+
+bool ES8311_I2C_set_speed(uint32_t clock_hz)
+{
+    uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+    uint32_t div2, div16_9;
+
+    if (!ES8311_async_wait(I2C_TIMEOUT))
+        return false;
+
+    /**
+     * El HAL redondea el divisor hacia arriba, nunca supera clock_hz. Con
+     * APB1 = 42 MHz el 2:1 da 400 kHz justos y el 16:9 solo 336 kHz, asi que
+     * se elige el que queda mas cerca.
+     */
+    hi2c2.Init.ClockSpeed = clock_hz;
+    hi2c2.Init.DutyCycle = I2C_DUTYCYCLE_2;
+    if (clock_hz > ES8311_I2C_STD_HZ)
     {
-    case SAMPLING_8K:
-        PeriphClkInitStruct.PLLI2S.PLLI2SN = 128;
-        PeriphClkInitStruct.PLLI2S.PLLI2SR = 2;
-        hi2s2.Init.AudioFreq = I2S_AUDIOFREQ_8K;
-        break;
+        div2 = (pclk - 1) / (clock_hz * 3) + 1;
+        div16_9 = (pclk - 1) / (clock_hz * 25) + 1;
+        if (pclk / (25 * div16_9) > pclk / (3 * div2))
+            hi2c2.Init.DutyCycle = I2C_DUTYCYCLE_16_9;
+    }
 
-    case SAMPLING_11K:
-        PeriphClkInitStruct.PLLI2S.PLLI2SN = 350;
-        PeriphClkInitStruct.PLLI2S.PLLI2SR = 4;
-        hi2s2.Init.AudioFreq = I2S_AUDIOFREQ_11K;
-        break;
+    if (HAL_I2C_Init(I2C_HAL_HANDLER) != HAL_OK)
+        return false;
 
-    case SAMPLING_16K:
-        PeriphClkInitStruct.PLLI2S.PLLI2SN = 256;
-        PeriphClkInitStruct.PLLI2S.PLLI2SR = 2;
-        hi2s2.Init.AudioFreq = I2S_AUDIOFREQ_16K;
-        break;
+    bus_scl_hz = ES8311_I2C_clock_hz();
+    return true;
+}
 
-    case SAMPLING_22K: /* Real frequency = 22.051 KHz */
-        PeriphClkInitStruct.PLLI2S.PLLI2SN = 350;
-        PeriphClkInitStruct.PLLI2S.PLLI2SR = 4;
-        hi2s2.Init.AudioFreq = I2S_AUDIOFREQ_22K;
-        break;
+#if CONFIG_ES8311_I2C_FAST
+/**
+ * La lectura de los ID tiene que dar bien dos veces seguidas, un bus con
+ * mucha capacidad puede andar a veces y otras no.
+ */
+static bool ES8311_I2C_probe(void)
+{
+    HAL_StatusTypeDef status;
+    uint8_t id;
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        id = 0;
+        status = HAL_I2C_Mem_Read(I2C_HAL_HANDLER, ES8311_I2C_ADDR << 1, ES8311_CHIP_ID1, sizeof(uint8_t), &id, sizeof(id), I2C_TIMEOUT);
+        ES8311_bus_log_add(ES8311_CHIP_ID1, id, sizeof(id), true, status == HAL_OK);
+
+        if (status != HAL_OK || id != ES8311_DEFAULT_ID1)
+            return false;
+    }
+
+    return true;
+}
+#endif
+
+static es8311_i2s_clock_t i2s_clock;
+
+/**
+ * Entrada de los PLL: HSE o HSI dividido por PLLM (compartido con el PLL principal).
+ */
+static uint32_t ES8311_pll_input_hz(void)
+{
+    uint32_t pllm = RCC->PLLCFGR & RCC_PLLCFGR_PLLM;
+    uint32_t source = (RCC->PLLCFGR & RCC_PLLCFGR_PLLSRC) ? HSE_VALUE : HSI_VALUE;
+
+    return (pllm != 0) ? source / pllm : 0;
+}
+
+const es8311_i2s_clock_t * ES8311_i2s_clock(void)
+{
+    return &i2s_clock;
+}
 
+bool ES8311_hardware_init(const es8311_audio_config_t *config)
+{
+    RCC_PeriphCLKInitTypeDef PeriphClkInitStruct = {0};
+    sampling_options_t sampling = config->sampling;
+    uint32_t frame_bits;
+
+    /**
+     * Largo de palabra. El DMA sigue en media palabra en todos los casos (el
+     * registro de datos es de 16 bits), en 24 / 32 bits HAL transfiere dos
+     * medias palabras por muestra.
+     */
+    switch (config->word_length)
+    {
+    case ES8311_WORD_24:
+        hi2s2.Init.DataFormat = I2S_DATAFORMAT_24B;
+        break;
+    case ES8311_WORD_32:
+        hi2s2.Init.DataFormat = I2S_DATAFORMAT_32B;
+        break;
     default:
-        return false; /* Not a valid Frequency */
+        hi2s2.Init.DataFormat = I2S_DATAFORMAT_16B_EXTENDED;
         break;
     }
 
+    /* Packet length as HAL_I2S_Init computes it, MCLK output is not used */
+    frame_bits = (hi2s2.Init.DataFormat == I2S_DATAFORMAT_16B) ? 16 : 32;
+    if (hi2s2.Init.Standard <= I2S_STANDARD_LSB)
+        frame_bits *= 2;
+
+    /*	Adjust the audio frequency. */
+    if (!ES8311_i2s_clock_solve(ES8311_sampling_hz(sampling), ES8311_pll_input_hz(), frame_bits, &i2s_clock))
+    {
+        return false; /* Not a valid Frequency */
+    }
+
+    /**
+     * Despues de ES8311_hardware_deinit el handle queda en RESET y
+     * HAL_I2S_Init llama a HAL_I2S_MspInit, que vuelve a poner el PLLI2S de
+     * CubeMX. Ese init va primero, asi el clock del solver es el ultimo.
+     */
+    hi2s2.Init.AudioFreq = ES8311_sampling_hz(sampling);
+    if (hi2s2.State == HAL_I2S_STATE_RESET && HAL_I2S_Init(I2S_HAL_HANDLER) != HAL_OK)
+    {
+        return false;
+    }
+
+    PeriphClkInitStruct.PLLI2S.PLLI2SN = i2s_clock.plli2sn;
+    PeriphClkInitStruct.PLLI2S.PLLI2SR = i2s_clock.plli2sr;
+
     PeriphClkInitStruct.PeriphClockSelection = RCC_PERIPHCLK_I2S;
     if (HAL_RCCEx_PeriphCLKConfig(&PeriphClkInitStruct) != HAL_OK)
     {
@@ -85,6 +550,18 @@ bool ES8311_hardware_init(sampling_options_t sampling)
     {
         return false;
     }
+
+#if CONFIG_ES8311_I2C_FAST
+    /* Fast mode only if the codec answers at 400 kHz, else back to standard */
+    if (!ES8311_I2C_set_speed(ES8311_I2C_FAST_HZ) || !ES8311_I2C_probe())
+    {
+        if (!ES8311_I2C_set_speed(ES8311_I2C_STD_HZ))
+            return false;
+    }
+#else
+    bus_scl_hz = ES8311_I2C_clock_hz();
+#endif
+
     return true;
 }
 
@@ -97,13 +574,41 @@ void ES8311_hardware_deinit(void)
 bool ES8311_I2C_write(const uint8_t reg, uint8_t value)
 {
 	HAL_StatusTypeDef status;
+	const es8311_reg_info_t *info;
 	bool ret = false;
 
+	/* Never send writes to undocumented or read only registers */
+	info = ES8311_reg_info(reg);
+	if (info == NULL || !(info->flags & ES8311_REG_RW))
+		return false;
+
+	/* Queued operations go first, they may change the cached value */
+	if (!ES8311_async_wait(I2C_TIMEOUT))
+		return false;
+
+#if CONFIG_ES8311_REG_CACHE
+	uint8_t cached;
+
+	if (ES8311_cache_get(info, &cached) && cached == value)
+	{
+		cache_stats.write_skips++;
+		return true;
+	}
+#endif
+
 	status = HAL_I2C_Mem_Write(I2C_HAL_HANDLER, ES8311_I2C_ADDR << 1, reg, sizeof(reg), &value, sizeof(value), I2C_TIMEOUT);
 
 	if (status == HAL_OK)
 		ret = true;
 
+	ES8311_bus_log_add(reg, value, sizeof(value), false, ret);
+	ES8311_async_kick();
+
+#if CONFIG_ES8311_REG_CACHE
+	/* A failed write leaves the register in an unknown state */
+	ES8311_cache_set(info, value, ret);
+#endif
+
 	return ret;
 }
 
@@ -112,14 +617,96 @@ bool ES8311_I2C_read(const uint8_t reg, uint8_t * out )
 	HAL_StatusTypeDef status;
 	bool ret = false;
 
+	if (!ES8311_async_wait(I2C_TIMEOUT))
+		return false;
+
+#if CONFIG_ES8311_REG_CACHE
+	const es8311_reg_info_t *info = ES8311_reg_info(reg);
+
+	if (ES8311_cache_get(info, out))
+	{
+		cache_stats.read_hits++;
+		return true;
+	}
+#endif
+
 	status =  HAL_I2C_Mem_Read(I2C_HAL_HANDLER, ES8311_I2C_ADDR << 1, reg, sizeof(reg), out, sizeof(uint8_t), I2C_TIMEOUT);
 
 	if (status == HAL_OK)
 		ret = true;
 
+	/* Lo que haya en out si fallo no salio del codec */
+	ES8311_bus_log_add(reg, ret ? *out : 0, sizeof(uint8_t), true, ret);
+	ES8311_async_kick();
+
+#if CONFIG_ES8311_REG_CACHE
+	if (ret)
+		ES8311_cache_set(info, *out, true);
+#endif
+
+	return ret;
+}
+
+bool ES8311_I2C_write_burst(const uint8_t reg, const uint8_t *values, uint8_t len)
+{
+	HAL_StatusTypeDef status;
+	const es8311_reg_info_t *info[ES8311_BURST_MAX];
+	bool ret = false;
+
+	if (len == 0 || len > ES8311_BURST_MAX || reg + len - 1 > ES8311_MAX_REGISTER)
+		return false;
+
+	/* Every register in the range must be writable, holes are not skipped by the chip */
+	for (uint8_t i = 0; i < len; i++)
+	{
+		info[i] = ES8311_reg_info(reg + i);
+		if (info[i] == NULL || !(info[i]->flags & ES8311_REG_RW))
+			return false;
+	}
+
+	if (!ES8311_async_wait(I2C_TIMEOUT))
+		return false;
+
+#if CONFIG_ES8311_REG_CACHE
+	uint8_t cached;
+	uint8_t same = 0;
+
+	while (same < len && ES8311_cache_get(info[same], &cached) && cached == values[same])
+		same++;
+
+	if (same == len)
+	{
+		cache_stats.write_skips += len;
+		return true;
+	}
+#endif
+
+	status = HAL_I2C_Mem_Write(I2C_HAL_HANDLER, ES8311_I2C_ADDR << 1, reg, sizeof(reg), (uint8_t *)values, len, I2C_TIMEOUT);
+
+	if (status == HAL_OK)
+		ret = true;
+
+	ES8311_bus_log_add(reg, values[0], len, false, ret);
+	ES8311_async_kick();
+
+#if CONFIG_ES8311_REG_CACHE
+	for (uint8_t i = 0; i < len; i++)
+		ES8311_cache_set(info[i], values[i], ret);
+#endif
+
 	return ret;
 }
 
+bool ES8311_reg_update(uint8_t reg, uint8_t mask, uint8_t value)
+{
+	uint8_t current;
+
+	if (!ES8311_I2C_read(reg, &current))
+		return false;
+
+	return ES8311_I2C_write(reg, (current & ~mask) | (value & mask));
+}
+
 
 void ES8311_I2S_loopStart (uint16_t* tx, uint16_t* rx)  {
 	volatile HAL_StatusTypeDef ret;
@@ -137,17 +724,57 @@ void ES8311_I2S_loopStart (uint16_t* tx, uint16_t* rx)  {
 }
 
 
-bool ES8311_I2S_start(int16_t *buff_tx, int16_t *buff_rx, uint16_t buff_length)
+/**
+ * Buffers del stream en curso, para poder reiniciarlo igual que se arranco.
+ */
+static int16_t *i2s_tx;
+static int16_t *i2s_rx;
+static uint16_t i2s_length;				//<--- Samples, as HAL_I2SEx_TransmitReceive_DMA counts them
+static uint32_t i2s_bytes;				//<--- Size of each DMA buffer
+
+#if CONFIG_ES8311_I2S_RECOVERY
+static es8311_i2s_stats_t i2s_stats;
+static volatile bool i2s_pending;		//<--- Error seen, stream waits for ES8311_I2S_recover
+static uint32_t i2s_fault_cycles;		//<--- DWT stamp of the first error
+static uint32_t i2s_retry_tick;
+static bool i2s_retry;
+static bool i2s_running;				//<--- Between ES8311_I2S_start and ES8311_I2S_stop
+static volatile uint32_t i2s_block_tick;	//<--- Last ES8311_I2S_check
+#endif
+
+static bool ES8311_I2S_dma_start(void)
 {
+    return HAL_OK == HAL_I2SEx_TransmitReceive_DMA(I2S_HAL_HANDLER,
+                                                   (uint16_t *)i2s_tx,
+                                                   (uint16_t *)i2s_rx,
+                                                   i2s_length);
+}
+
+bool ES8311_I2S_start(const es8311_audio_config_t *config, int16_t *buff_tx, int16_t *buff_rx)
+{
+    /* HAL counts samples, for 24 / 32 bits it moves two halfwords per sample */
+    i2s_length = ES8311_config_buffer_length(config) / ES8311_config_sample_halfwords(config);
+    i2s_bytes = ES8311_config_buffer_length(config) * sizeof(uint16_t);
+    i2s_tx = buff_tx;
+    i2s_rx = buff_rx;
+
+#if CONFIG_ES8311_I2S_RECOVERY
+    i2s_pending = false;
+    i2s_retry = false;
+    i2s_running = true;
+    i2s_block_tick = HAL_GetTick();
+
+    /* Tiempo de recuperacion con el DWT, si ya estaba andando no se resetea */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
     /* Try start audio tranfer 3 times */
     uint8_t tries = 3;
 
     while (tries--)
     {
-        if (HAL_OK == HAL_I2SEx_TransmitReceive_DMA(I2S_HAL_HANDLER,
-                                                    (uint16_t *)buff_tx,
-                                                    (uint16_t *)buff_rx,
-                                                    buff_length))
+        if (ES8311_I2S_dma_start())
         {
             return true;
         }
@@ -158,10 +785,168 @@ bool ES8311_I2S_start(int16_t *buff_tx, int16_t *buff_rx, uint16_t buff_length)
     return false;
 }
 
+#if CONFIG_ES8311_I2S_RECOVERY
+static void ES8311_I2S_fault(void)
+{
+    if (!i2s_pending)
+    {
+        i2s_fault_cycles = DWT->CYCCNT;
+        i2s_pending = true;
+    }
+}
+
+/**
+ * Cuenta los errores del stream y los borra del handle, el otro stream
+ * puede volver a llamar al callback antes del reinicio.
+ */
+static void ES8311_I2S_dma_errors(DMA_HandleTypeDef *hdma, es8311_stream_errors_t *errors)
+{
+    if (hdma == NULL)
+        return;
+
+    if (hdma->ErrorCode & HAL_DMA_ERROR_TE)
+        errors->dma_te++;
+    if (hdma->ErrorCode & HAL_DMA_ERROR_FE)
+        errors->dma_fe++;
+    if (hdma->ErrorCode & HAL_DMA_ERROR_DME)
+        errors->dma_dme++;
+
+    hdma->ErrorCode = HAL_DMA_ERROR_NONE;
+}
+
+/**
+ * Deja I2S, I2Sext y los dos streams apagados. HAL_I2S_DMAStop no sirve
+ * despues de un error de DMA: el HAL ya paso a READY y no toca el I2Sext.
+ */
+static void ES8311_I2S_teardown(void)
+{
+    I2S_HandleTypeDef *hi2s = I2S_HAL_HANDLER;
+
+    HAL_DMA_Abort(hi2s->hdmatx);
+    HAL_DMA_Abort(hi2s->hdmarx);
+
+    CLEAR_BIT(hi2s->Instance->CR2, SPI_CR2_TXDMAEN | SPI_CR2_RXDMAEN);
+    CLEAR_BIT(I2SxEXT(hi2s->Instance)->CR2, SPI_CR2_TXDMAEN | SPI_CR2_RXDMAEN);
+    __HAL_I2S_DISABLE(hi2s);
+    __HAL_I2SEXT_DISABLE(hi2s);
+    __HAL_I2S_CLEAR_UDRFLAG(hi2s);
+    __HAL_I2SEXT_CLEAR_OVRFLAG(hi2s);
+
+    hi2s->ErrorCode = HAL_I2S_ERROR_NONE;
+    hi2s->State = HAL_I2S_STATE_READY;
+    __HAL_UNLOCK(hi2s);
+}
+
+bool ES8311_I2S_check(void)
+{
+    I2S_HandleTypeDef *hi2s = I2S_HAL_HANDLER;
+
+    i2s_block_tick = HAL_GetTick();
+
+    /* Los flags quedan puestos hasta el reinicio, se cuentan una sola vez */
+    if (i2s_pending)
+        return true;
+
+    if (__HAL_I2SEXT_GET_FLAG(hi2s, I2S_FLAG_OVR))
+    {
+        i2s_stats.rx.xrun++;
+        ES8311_I2S_fault();
+    }
+
+    if (__HAL_I2S_GET_FLAG(hi2s, I2S_FLAG_UDR))
+    {
+        i2s_stats.tx.xrun++;
+        ES8311_I2S_fault();
+    }
+
+    return i2s_pending;
+}
+
+bool ES8311_I2S_recovery_pending(void)
+{
+    return i2s_pending;
+}
+
+__weak void ES8311_I2S_restarting(void)
+{
+}
+
+bool ES8311_I2S_recover(void)
+{
+    uint32_t cycles;
+
+    if (i2s_running && !i2s_pending && (HAL_GetTick() - i2s_block_tick) > ES8311_I2S_STALL_MS)
+    {
+        i2s_stats.stalls++;
+        ES8311_I2S_fault();
+    }
+
+    if (!i2s_pending)
+        return true;
+
+    if (i2s_retry && (HAL_GetTick() - i2s_retry_tick) < ES8311_I2S_RETRY_MS)
+        return false;
+
+    ES8311_I2S_teardown();
+
+    /**
+     * Los dos sentidos arrancan juntos desde el indice 0, el primer slot
+     * vuelve a ser el izquierdo. Lo que quedaba en TX ya es viejo.
+     */
+    memset(i2s_tx, 0, i2s_bytes);
+    ES8311_I2S_restarting();
+
+    cycles = DWT->CYCCNT - i2s_fault_cycles;
+    i2s_pending = false;
+
+    if (!ES8311_I2S_dma_start())
+    {
+        i2s_pending = true;
+        i2s_retry = true;
+        i2s_retry_tick = HAL_GetTick();
+        i2s_stats.failed++;
+        return false;
+    }
+
+    i2s_retry = false;
+    i2s_block_tick = HAL_GetTick();
+    i2s_stats.recoveries++;
+    i2s_stats.recover_us = (uint32_t)(((uint64_t)cycles * 1000000ULL) / SystemCoreClock);
+    if (i2s_stats.recover_us > i2s_stats.recover_us_max)
+        i2s_stats.recover_us_max = i2s_stats.recover_us;
+
+    return true;
+}
+
+const es8311_i2s_stats_t * ES8311_I2S_stats(void)
+{
+    return &i2s_stats;
+}
+
+/**
+ * Error de DMA de cualquiera de los dos streams. El HAL ya deshabilito los
+ * pedidos de DMA, el reinicio se hace desde el main loop.
+ */
+void HAL_I2S_ErrorCallback(I2S_HandleTypeDef *hi2s)
+{
+    if (hi2s != I2S_HAL_HANDLER)
+        return;
+
+    ES8311_I2S_dma_errors(hi2s->hdmatx, &i2s_stats.tx);
+    ES8311_I2S_dma_errors(hi2s->hdmarx, &i2s_stats.rx);
+    ES8311_I2S_fault();
+}
+#endif
+
 
 
 bool ES8311_I2S_stop(void)
 {
+#if CONFIG_ES8311_I2S_RECOVERY
+    i2s_running = false;
+    i2s_pending = false;
+#endif
+
     if (HAL_OK == HAL_I2S_DMAStop(I2S_HAL_HANDLER))
     {
         return true;
@@ -202,13 +987,5 @@ HAL_I2SEx_TxRxCpltCallback ( I2S_HandleTypeDef * hi2s )
         codec.buffer_length
 	);
 }
-
-void HAL_I2S_ErrorCallback(I2S_HandleTypeDef *hi2s)
-{
-    HAL_I2SEx_TransmitReceive_DMA(I2S_HAL_HANDLER,
-                                  (uint16_t *)codec.buffer_tx,
-                                  (uint16_t *)codec.buffer_rx,
-                                  codec.buffer_length);
-}
 #endif
 #endif /* IPAC_PLATFORM == WANPAGE_9 */
@@ -0,0 +1,95 @@
+/**
+ * @file es8311_regmap.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief ES8311 register map description.
+ * @version 0.1
+ * @date 2022-06-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "es8311.h"
+#include <stddef.h>
+
+/**
+ * Valores de reset segun "ES8311 DS.pdf" / user guide.
+ * Cada registro que la API conoce (ES8311_RESET_REG00 .. ES8311_CHIP_VER) tiene una entrada.
+ */
+static const es8311_reg_info_t es8311_regmap[] =
+{
+	{ ES8311_RESET_REG00,		0x1F, ES8311_REG_RW | ES8311_REG_VOLATILE },	/* CSM state machine changes it */
+	{ ES8311_CLK_MANAGER_REG01,	0x00, ES8311_REG_RW },
+	{ ES8311_CLK_MANAGER_REG02,	0x00, ES8311_REG_RW },
+	{ ES8311_CLK_MANAGER_REG03,	0x10, ES8311_REG_RW },
+	{ ES8311_CLK_MANAGER_REG04,	0x10, ES8311_REG_RW },
+	{ ES8311_CLK_MANAGER_REG05,	0x00, ES8311_REG_RW },
+	{ ES8311_CLK_MANAGER_REG06,	0x03, ES8311_REG_RW },
+	{ ES8311_CLK_MANAGER_REG07,	0x00, ES8311_REG_RW },
+	{ ES8311_CLK_MANAGER_REG08,	0xFF, ES8311_REG_RW },
+	{ ES8311_SDPIN_REG09,		0x00, ES8311_REG_RW },
+	{ ES8311_SDPOUT_REG0A,		0x00, ES8311_REG_RW },
+	{ ES8311_SYSTEM_REG0B,		0x00, ES8311_REG_RW },
+	{ ES8311_SYSTEM_REG0C,		0x20, ES8311_REG_RW },
+	{ ES8311_SYSTEM_REG0D,		0xFC, ES8311_REG_RW },
+	{ ES8311_SYSTEM_REG0E,		0x6A, ES8311_REG_RW },
+	{ ES8311_SYSTEM_REG0F,		0x00, ES8311_REG_RW },
+	{ ES8311_SYSTEM_REG10,		0x13, ES8311_REG_RW },
+	{ 0x11,						0x7C, 0 },										/* internal use, not to be modified */
+	{ ES8311_SYSTEM_REG12,		0x02, ES8311_REG_RW },
+	{ ES8311_SYSTEM_REG13,		0x40, ES8311_REG_RW },
+	{ ES8311_SYSTEM_REG14,		0x10, ES8311_REG_RW },
+	{ ES8311_ADC_REG15,			0x00, ES8311_REG_RW },
+	{ ES8311_ADC_REG16,			0x04, ES8311_REG_RW },
+	{ ES8311_ADC_REG17,			0x00, ES8311_REG_RW },
+	{ ES8311_ADC_REG18,			0x00, ES8311_REG_RW },
+	{ ES8311_ADC_REG19,			0x00, ES8311_REG_RW },
+	{ ES8311_ADC_REG1A,			0x00, ES8311_REG_RW },
+	{ ES8311_ADC_REG1B,			0x0C, ES8311_REG_RW },
+	{ ES8311_ADC_REG1C,			0x4C, ES8311_REG_RW },
+	{ ES8311_DAC_REG31,			0x00, ES8311_REG_RW },
+	{ ES8311_DAC_REG32,			0x00, ES8311_REG_RW },
+	{ ES8311_DAC_REG33,			0x00, ES8311_REG_RW },
+	{ ES8311_DAC_REG34,			0x00, ES8311_REG_RW },
+	{ ES8311_DAC_REG35,			0x00, ES8311_REG_RW },
+	{ ES8311_DAC_REG37,			0x08, ES8311_REG_RW },
+	{ ES8311_GPIO_REG44,		0x00, ES8311_REG_RW },
+	{ ES8311_GP_REG45,			0x00, ES8311_REG_RW },
+	{ ES8311_CHIP_ID1,			ES8311_DEFAULT_ID1, 0 },
+	{ ES8311_CHIP_ID2,			ES8311_DEFAULT_ID2, 0 },
+	{ ES8311_CHIP_VER,			ES8311_DEFAULT_VER, 0 },
+};
+
+#define ES8311_REGMAP_SIZE	(sizeof(es8311_regmap) / sizeof(es8311_regmap[0]))
+
+
+const es8311_reg_info_t * ES8311_reg_info(uint8_t reg)
+{
+	/* Table is sorted by address, so stop as soon as we pass it */
+	for (uint32_t i = 0; i < ES8311_REGMAP_SIZE && es8311_regmap[i].reg <= reg; i++)
+	{
+		if (es8311_regmap[i].reg == reg)
+			return &es8311_regmap[i];
+	}
+
+	return NULL;
+}
+
+uint32_t ES8311_bus_time_us(uint32_t clock_hz, uint8_t data_len, bool read)
+{
+	uint32_t bits;
+
+	/**
+	 * Each byte takes 9 SCL periods (8 data + ACK). START and STOP are
+	 * counted as one period each.
+	 *
+	 * Write: S | ADDR+W | REG | DATA... | P
+	 * Read:  S | ADDR+W | REG | Sr | ADDR+R | DATA... | P
+	 */
+	if (read)
+		bits = 1 + 9 * 2 + 1 + 9 * (1 + data_len) + 1;
+	else
+		bits = 1 + 9 * (2 + data_len) + 1;
+
+	return (bits * 1000000UL + clock_hz - 1) / clock_hz;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file audio_loop.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Host copy of the audio path of main.c: DMA callbacks, rings and main loop step.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_loop.h"
+#include "audio_move.h"
+#include "audio_prof.h"
+#include "audio_trace.h"
+#include <stddef.h>
+#include <string.h>
+
+uint16_t loopTx[BUFFER_LENGHT];
+uint16_t loopRx[BUFFER_LENGHT];
+audio_stream_t loopStream;
+
+static es8311_audio_config_t config;
+static uint16_t period_samples;
+static audio_loop_process_t process;
+static void *process_ctx;
+static audio_loop_stats_t stats;
+static bool zero_copy;
+
+static void audio_loop_block(uint16_t *tx, const uint16_t *rx)
+{
+	stats.blocks++;
+
+	if (ES8311_I2S_check())
+	{
+		stats.dropped++;
+		return;
+	}
+
+	/* Sin rings el DMA saca lo que recibio, como AUDIO_ZERO_COPY */
+	if (!zero_copy)
+		audio_stream_block(&loopStream, tx, rx);
+}
+
+void HAL_I2SEx_TxRxHalfCpltCallback(I2S_HandleTypeDef *hi2s)
+{
+	uint32_t start = audio_prof_start();
+	(void)hi2s;
+
+	audio_trace(TRACE_I2S_HALF, 0, (uint16_t)stats.blocks);
+	audio_loop_block(loopTx, loopRx);
+	audio_prof_stop(PROF_I2S_HALF_CB, start);
+}
+
+void HAL_I2SEx_TxRxCpltCallback(I2S_HandleTypeDef *hi2s)
+{
+	uint32_t start = audio_prof_start();
+	(void)hi2s;
+
+	audio_trace(TRACE_I2S_CPLT, 0, (uint16_t)stats.blocks);
+	audio_loop_block(loopTx + period_samples, loopRx + period_samples);
+	audio_prof_stop(PROF_I2S_CPLT_CB, start);
+}
+
+void ES8311_I2S_restarting(void)
+{
+	if (!zero_copy)
+		audio_stream_reset(&loopStream);
+}
+
+static void audio_loop_reset(const es8311_audio_config_t *cfg, audio_loop_process_t proc, void *ctx)
+{
+	config = *cfg;
+	process = proc;
+	process_ctx = ctx;
+	memset(&stats, 0, sizeof(stats));
+	audio_prof_init();
+	audio_trace_init(SystemCoreClock);
+
+	period_samples = ES8311_config_buffer_length(&config) / 2;
+	memset(loopTx, 0, sizeof(loopTx));
+	memset(loopRx, 0, sizeof(loopRx));
+}
+
+bool audio_loop_start(const es8311_audio_config_t *cfg, audio_loop_process_t proc, void *ctx)
+{
+	audio_loop_reset(cfg, proc, ctx);
+	zero_copy = false;
+
+	if (config.period_count < 2 || !audio_stream_init(&loopStream, period_samples, config.period_count - 2))
+		return false;
+
+	/* Sin DMA2 las copias las hace la CPU, el stream anda igual */
+	audio_move_init();
+
+	return ES8311_I2S_start(&config, (int16_t *)loopTx, (int16_t *)loopRx);
+}
+
+bool audio_loop_start_zero_copy(const es8311_audio_config_t *cfg)
+{
+	audio_loop_reset(cfg, NULL, NULL);
+	zero_copy = true;
+
+	/* Los contadores del stream quedan en cero, no se usa */
+	memset(&loopStream, 0, sizeof(loopStream));
+
+	return ES8311_I2S_start(&config, (int16_t *)loopRx, (int16_t *)loopRx);
+}
+
+uint32_t audio_loop_run(void)
+{
+	int16_t *in;
+	int16_t *out;
+	uint32_t count = 0;
+
+	ES8311_I2S_recover();
+	if (zero_copy)
+		return 0;
+
+	while ((in = audio_ring_read_acquire(&loopStream.rx)) != NULL &&
+			(out = audio_ring_write_acquire(&loopStream.tx)) != NULL)
+	{
+		uint32_t start = audio_prof_start();
+
+		audio_trace(TRACE_PROCESS_START, 0, 0);
+		if (process != NULL)
+			process(out, in, config.period_frames, process_ctx);
+		else
+			memcpy(out, in, sizeof(int16_t) * period_samples);
+
+		audio_ring_read_release(&loopStream.rx);
+		audio_ring_write_commit(&loopStream.tx);
+		audio_prof_stop(PROF_PROCESS, start);
+		audio_trace(TRACE_PROCESS_END, 0, 0);
+		count++;
+	}
+
+	stats.processed += count;
+	return count;
+}
+
+const audio_loop_stats_t * audio_loop_stats(void)
+{
+	return &stats;
+}
+
+uint16_t audio_loop_tag(uint32_t period, uint32_t i)
+{
+	return (uint16_t)(((period & 0x7F) + 1) << 8 | (i & 0xFF));
+}
+
+void audio_loop_source(uint16_t *data, uint32_t halfwords, void *ctx)
+{
+	audio_loopback_t *lb = ctx;
+
+	for (uint32_t i = 0; i < halfwords; i++)
+		data[i] = audio_loop_tag(lb->received, i);
+	lb->received++;
+}
+
+void audio_loop_sink(uint16_t *data, uint32_t halfwords, void *ctx)
+{
+	audio_loopback_t *lb = ctx;
+	uint32_t expected = lb->sent - lb->latency;
+	bool silent = true;
+	bool match = lb->sent >= lb->latency;
+
+	for (uint32_t i = 0; i < halfwords; i++)
+	{
+		silent = silent && data[i] == 0;
+		match = match && data[i] == audio_loop_tag(expected, i);
+	}
+
+	if (silent)
+		lb->silent++;
+	else if (!match)
+		lb->wrong++;
+	lb->sent++;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file audio_loop.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Host copy of the audio path of main.c: DMA callbacks, rings and main loop step.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef AUDIO_LOOP_H
+#define AUDIO_LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_stream.h"
+#include "es8311.h"
+
+/**
+ * main.c no se puede linkear en el host (main, MX_xx_Init, printf por la
+ * UART), esto repite lo mismo que hacen sus callbacks y su while(1) con
+ * los mismos modulos: ES8311_I2S_check y audio_stream_block en cada mitad,
+ * ES8311_I2S_recover y el proceso de los periodos en el loop, y
+ * ES8311_I2S_restarting vacia los rings antes de cada reinicio. Los
+ * callbacks y el proceso se miden en audio_prof y dejan sus eventos en
+ * audio_trace como en main.c, con el reloj del simulador.
+ *
+ * El proceso es un callback, NULL copia la entrada a la salida.
+ */
+typedef void (*audio_loop_process_t)(int16_t *out, const int16_t *in, uint32_t frames, void *ctx);
+
+typedef struct
+{
+	uint32_t blocks;			//<--- DMA half transfers seen by the callbacks
+	uint32_t dropped;			//<--- Blocks skipped by ES8311_I2S_check
+	uint32_t processed;			//<--- Periods processed by audio_loop_run
+} audio_loop_stats_t;
+
+/**
+ * Loopback para sim_i2s_io: cada media palabra recibida lleva el numero de
+ * periodo en el byte alto y la posicion en el bajo, nunca vale cero y se
+ * distingue del silencio. El sink espera lo recibido latency mitades antes.
+ */
+typedef struct
+{
+	uint32_t received;			//<--- Periods generated by the source
+	uint32_t sent;				//<--- Halves seen by the sink
+	uint32_t silent;			//<--- Halves that went out as silence
+	uint32_t wrong;				//<--- Halves that were neither silence nor the expected period
+	uint32_t latency;			//<--- Periods from the source to the sink
+} audio_loopback_t;
+
+extern uint16_t loopTx[BUFFER_LENGHT];
+extern uint16_t loopRx[BUFFER_LENGHT];
+extern audio_stream_t loopStream;
+
+/**
+ * @brief What main() does between ES8311_init and the loop: rings, block
+ * moves and the I2S DMA.
+ *
+ * @param config word length set with ES8311_config_word_length.
+ * @return false if any step failed.
+ */
+bool audio_loop_start(const es8311_audio_config_t *config, audio_loop_process_t process, void *ctx);
+
+/**
+ * @brief The AUDIO_ZERO_COPY start of main(): loopRx is both DMA buffers,
+ * no rings and nothing to process, the callbacks only check the stream.
+ *
+ * @param config period_count 2, only the DMA double buffer is in the path.
+ */
+bool audio_loop_start_zero_copy(const es8311_audio_config_t *config);
+
+/**
+ * @brief One pass of the main loop: recover the stream and process every
+ * period that is waiting while there is room for the output.
+ *
+ * @return periods processed.
+ */
+uint32_t audio_loop_run(void);
+
+const audio_loop_stats_t * audio_loop_stats(void);
+
+/**
+ * @brief Halfword i of the received period, never 0.
+ */
+uint16_t audio_loop_tag(uint32_t period, uint32_t i);
+
+/**
+ * @brief sim_i2s_io source: the next period tagged, ctx is an audio_loopback_t.
+ */
+void audio_loop_source(uint16_t *data, uint32_t halfwords, void *ctx);
+
+/**
+ * @brief sim_i2s_io sink: counts silent halves and the ones that are not
+ * the period received latency halves before, ctx is an audio_loopback_t.
+ */
+void audio_loop_sink(uint16_t *data, uint32_t halfwords, void *ctx);
+
+#endif /* AUDIO_LOOP_H */
@@ -0,0 +1,111 @@
+/**
+ * @file bench_stages.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief audio_bench on the host: cycles and throughput of each processing stage projected to the target core.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_bench.h"
+#include "es8311.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t] [block samples, 1..%u]\n"
+			"  -t  table of throughput and load at 48 kHz instead of JSON\n", prog, AUDIO_BENCH_MAX_SAMPLES);
+}
+
+/**
+ * Lo mismo que el JSON para leer en la terminal: samples_per_s es lo que
+ * procesa la etapa sola con todo el core.
+ */
+static void print_table(const audio_bench_result_t *results, uint32_t count)
+{
+	printf("%-14s %10s %10s %14s %9s\n", "stage", "cycles", "ns/sample", "samples/s", "48k load");
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t load = audio_bench_load(&results[i], AUDIO_BENCH_CPU_HZ, 48000);
+
+		printf("%-14s %10lu %10.2f %14llu %8lu.%02lu%%\n", results[i].name, (unsigned long)results[i].cycles,
+				results[i].cycles * 1e9 / ((double)AUDIO_BENCH_CPU_HZ * results[i].samples),
+				(unsigned long long)audio_bench_throughput(&results[i], AUDIO_BENCH_CPU_HZ),
+				(unsigned long)(load / 100), (unsigned long)(load % 100));
+	}
+}
+
+/**
+ * AUDIO_DRC de main.c: el DRC del codec (1) no gasta ciclos del MCU, el
+ * compresor (2) cuesta lo que mide su etapa.
+ */
+static void print_dynamics(FILE *out, const audio_bench_result_t *results, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t load;
+
+		if (strcmp(results[i].name, "compressor") != 0)
+			continue;
+
+		load = audio_bench_load(&results[i], AUDIO_BENCH_CPU_HZ, 48000);
+		fprintf(out, "dynamics, %lu samples per block at 48 kHz:\n"
+				"  codec DRC (AUDIO_DRC 1)    %8lu cycles %5lu.%02lu%%\n"
+				"  compressor (AUDIO_DRC 2)   %8lu cycles %5lu.%02lu%%\n",
+				(unsigned long)results[i].samples, 0UL, 0UL, 0UL,
+				(unsigned long)results[i].cycles, (unsigned long)(load / 100), (unsigned long)(load % 100));
+	}
+}
+
+/**
+ * El mismo bloque que mide main.c con AUDIO_BENCH_AT_BOOT: un periodo de
+ * la configuracion por defecto, o las muestras que se pasen como argumento.
+ * Con el JSON en stdout la comparacion de dinamica sale por stderr.
+ */
+int main(int argc, char **argv)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+	uint32_t block_samples = config.period_frames * ES8311_I2S_CHANNELS;
+	audio_bench_result_t results[AUDIO_BENCH_MAX_STAGES];
+	static char json[8192];
+	bool table = false;
+	uint32_t count;
+	int len;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-t") == 0)
+			table = true;
+		else
+			block_samples = strtoul(argv[i], NULL, 0);
+	}
+	if (block_samples == 0 || block_samples > AUDIO_BENCH_MAX_SAMPLES)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	count = audio_bench_run(results, AUDIO_BENCH_MAX_STAGES, block_samples);
+	if (count == 0)
+		return 1;
+
+	if (table)
+	{
+		print_table(results, count);
+		print_dynamics(stdout, results, count);
+		return 0;
+	}
+
+	len = audio_bench_json(results, count, json, sizeof(json));
+	if (len < 0 || (size_t)len >= sizeof(json))
+		return 1;
+	printf("%s\n", json);
+	print_dynamics(stderr, results, count);
+
+	return 0;
+}
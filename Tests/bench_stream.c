@@ -0,0 +1,288 @@
+/**
+ * @file bench_stream.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Stream benchmark on the HAL simulator: deadline misses and CPU headroom per block.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_eq.h"
+#include "audio_loop.h"
+#include "audio_move.h"
+#include "audio_volume.h"
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_EQ_BANDS		3		//<--- Same as AUDIO_EQ_BANDS of main.c
+
+/**
+ * El reloj de muestras es virtual: la mitad k del DMA termina en k * T,
+ * T = period_frames / fs. Lo que tardan los callbacks y el proceso se
+ * mide en el host (ns, por scale para acercarlo al target) y avanza el
+ * tiempo virtual. Las mitades que vencen mientras se procesa un periodo
+ * se entregan antes de su commit, como la interrupcion en la placa: asi
+ * un proceso lento se ve como underrun del stream real.
+ */
+typedef struct
+{
+	double scale;				//<--- Target ns per host ns
+	uint64_t period_ns;			//<--- T
+	uint64_t now_ns;			//<--- Virtual time
+	uint64_t next_half_ns;		//<--- Next DMA half transfer
+	uint32_t halves;			//<--- Halves delivered
+	uint32_t target;			//<--- Halves to run
+	uint64_t cb_ns;				//<--- Callbacks since the last processed block
+	uint64_t cb_sum;
+	uint64_t cb_max;
+	uint64_t proc_sum;
+	uint64_t proc_max;
+	uint32_t blocks;			//<--- Periods processed
+	uint32_t late;				//<--- Blocks whose callbacks + process took more than T
+	uint32_t headroom_min;		//<--- Percent of T left, worst block
+	uint64_t headroom_sum;
+	bool verbose;
+	audio_eq_t eq;
+	audio_volume_t vol;
+} bench_t;
+
+static uint64_t host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Deliver the DMA halves that are due at the current virtual time.
+ */
+static void bench_deliver(bench_t *b)
+{
+	while (b->next_half_ns <= b->now_ns && b->halves < b->target)
+	{
+		uint64_t start = host_ns();
+		uint64_t ns;
+
+		sim_i2s_half();
+		sim_irq_run();
+
+		ns = (uint64_t)((double)(host_ns() - start) * b->scale);
+		b->now_ns += ns;
+		b->cb_ns += ns;
+		b->cb_sum += ns;
+		if (ns > b->cb_max)
+			b->cb_max = ns;
+
+		b->next_half_ns += b->period_ns;
+		b->halves++;
+	}
+}
+
+/**
+ * @brief Account one block: the callbacks since the last one and ns of processing.
+ */
+static void bench_block(bench_t *b, uint64_t ns)
+{
+	uint64_t load;
+	uint32_t headroom;
+
+	b->proc_sum += ns;
+	if (ns > b->proc_max)
+		b->proc_max = ns;
+
+	load = ns + b->cb_ns;
+	b->cb_ns = 0;
+	headroom = load < b->period_ns ? (uint32_t)(((b->period_ns - load) * 100) / b->period_ns) : 0;
+	if (load > b->period_ns)
+		b->late++;
+	if (headroom < b->headroom_min)
+		b->headroom_min = headroom;
+	b->headroom_sum += headroom;
+
+	if (b->verbose)
+		printf("%u,%llu,%llu,%u\n", b->blocks, (unsigned long long)(load - ns), (unsigned long long)ns, headroom);
+	b->blocks++;
+}
+
+/**
+ * @brief The processing of main.c: equalizer and volume.
+ */
+static void bench_process(int16_t *out, const int16_t *in, uint32_t frames, void *ctx)
+{
+	bench_t *b = ctx;
+	uint64_t start = host_ns();
+	uint64_t ns;
+
+	audio_eq_process(&b->eq, out, in, frames);
+	audio_volume_process(&b->vol, out, out, frames);
+
+	ns = (uint64_t)((double)(host_ns() - start) * b->scale);
+	bench_block(b, ns);
+
+	/* Lo que vencio mientras se procesaba corre antes del commit */
+	b->now_ns += ns;
+	bench_deliver(b);
+}
+
+/**
+ * Los caminos que se comparan: rings con las copias por DMA2 o por CPU, y
+ * AUDIO_ZERO_COPY (un solo buffer, sin rings ni proceso).
+ */
+typedef enum
+{
+	BENCH_DMA,
+	BENCH_CPU,
+	BENCH_ZERO_COPY,
+} bench_path_t;
+
+static bool bench_run(bench_t *b, const es8311_audio_config_t *config, bench_path_t path)
+{
+	static const audio_eq_band_t bands[BENCH_EQ_BANDS] = {
+		{ AUDIO_EQ_LOW_SHELF, 150.0f, 6.0f, 0.707f },
+		{ AUDIO_EQ_PEAK, 1000.0f, -3.0f, 1.0f },
+		{ AUDIO_EQ_HIGH_SHELF, 6000.0f, 4.0f, 0.707f },
+	};
+	uint32_t rate = ES8311_sampling_hz(config->sampling);
+
+	b->period_ns = ((uint64_t)config->period_frames * 1000000000ULL) / rate;
+	b->now_ns = b->next_half_ns = 0;
+	b->halves = b->blocks = b->late = 0;
+	b->cb_ns = b->cb_sum = b->cb_max = b->proc_sum = b->proc_max = b->headroom_sum = 0;
+	b->headroom_min = 100;
+
+	if (!audio_eq_init(&b->eq, rate, BENCH_EQ_BANDS))
+		return false;
+	for (uint8_t i = 0; i < BENCH_EQ_BANDS; i++)
+		audio_eq_set_band(&b->eq, i, &bands[i]);
+	audio_volume_init(&b->vol, rate, ES8311_DAC_VOL_INIT_HALF_DB);
+
+	sim_reset();
+	if (path == BENCH_ZERO_COPY)
+	{
+		es8311_audio_config_t zero = *config;
+
+		/* Cada mitad es un bloque que solo cuesta sus callbacks */
+		zero.period_count = 2;
+		if (!audio_loop_start_zero_copy(&zero))
+			return false;
+
+		while (b->halves < b->target)
+		{
+			audio_loop_run();
+			b->now_ns = b->next_half_ns;
+			bench_deliver(b);
+			bench_block(b, 0);
+		}
+		return true;
+	}
+
+	sim_dma_fail_init(path == BENCH_CPU);
+	if (!audio_loop_start(config, bench_process, b))
+		return false;
+
+	while (b->halves < b->target)
+	{
+		/* Nada para procesar: el core duerme hasta la proxima mitad */
+		if (audio_loop_run() == 0)
+		{
+			if (b->now_ns < b->next_half_ns)
+				b->now_ns = b->next_half_ns;
+			bench_deliver(b);
+		}
+	}
+
+	return true;
+}
+
+static void bench_report(const bench_t *b, const char *moves)
+{
+	printf("%-6s %7u %7llu %7llu %8llu %8llu %5u%% %5llu%% %6u %6u %6u %6u\n", moves, b->blocks,
+			(unsigned long long)(b->halves ? b->cb_sum / b->halves : 0), (unsigned long long)b->cb_max,
+			(unsigned long long)(b->blocks ? b->proc_sum / b->blocks : 0), (unsigned long long)b->proc_max,
+			b->headroom_min, (unsigned long long)(b->blocks ? b->headroom_sum / b->blocks : 0), b->late,
+			(unsigned)loopStream.tx.underrun, (unsigned)loopStream.rx.overrun, audio_loop_stats()->dropped);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n halves] [-s scale] [-f 8|11|16|22|32|44|48] [-v]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct { unsigned khz; sampling_options_t sampling; } rates[] = {
+		{ 8, SAMPLING_8K }, { 11, SAMPLING_11K }, { 16, SAMPLING_16K }, { 22, SAMPLING_22K },
+		{ 32, SAMPLING_32K }, { 44, SAMPLING_44K }, { 48, SAMPLING_48K },
+	};
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+	bench_t bench = { .scale = 1.0, .target = 20000 };
+	bool ok = true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			bench.target = strtoul(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			bench.scale = strtod(argv[++i], NULL);
+		else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+		{
+			unsigned khz = strtoul(argv[++i], NULL, 0);
+			size_t j;
+
+			for (j = 0; j < sizeof(rates) / sizeof(rates[0]) && rates[j].khz != khz; j++)
+				;
+			if (j == sizeof(rates) / sizeof(rates[0]))
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			config.sampling = rates[j].sampling;
+		}
+		else if (strcmp(argv[i], "-v") == 0)
+			bench.verbose = true;
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (bench.target == 0 || bench.scale <= 0.0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	printf("# %lu Hz, %u frames per period (%llu ns), %u bands, %u halves, scale %.2f\n",
+			(unsigned long)ES8311_sampling_hz(config.sampling), (unsigned)config.period_frames,
+			(unsigned long long)(((uint64_t)config.period_frames * 1000000000ULL) / ES8311_sampling_hz(config.sampling)),
+			BENCH_EQ_BANDS, bench.target, bench.scale);
+	if (bench.verbose)
+		printf("# block,callbacks_ns,process_ns,headroom_pct\n");
+	else
+		printf("%-6s %7s %7s %7s %8s %8s %6s %6s %6s %6s %6s %6s\n", "moves", "blocks", "cb_avg", "cb_max",
+				"proc_avg", "proc_max", "hr_min", "hr_avg", "late", "under", "over", "drop");
+
+	ok = ok && bench_run(&bench, &config, BENCH_DMA);
+	if (ok && !bench.verbose)
+		bench_report(&bench, "dma");
+
+	ok = ok && bench_run(&bench, &config, BENCH_CPU);
+	if (ok && !bench.verbose)
+		bench_report(&bench, "cpu");
+
+	ok = ok && bench_run(&bench, &config, BENCH_ZERO_COPY);
+	if (ok && !bench.verbose)
+		bench_report(&bench, "zero");
+
+	if (!ok)
+		fprintf(stderr, "stream did not start\n");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+/**
+ * @file sim.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Control of the host HAL simulator: time, interrupts, I2S stream and fault injection.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "stm32f4xx_hal.h"
+
+/**
+ * Los handles que en la placa define main.c (CubeMX), sim_reset los deja
+ * como MX_I2C2_Init / MX_I2S2_Init / HAL_I2S_MspInit.
+ */
+extern I2C_HandleTypeDef hi2c2;
+extern I2S_HandleTypeDef hi2s2;
+extern DMA_HandleTypeDef hdma_spi2_tx;
+extern DMA_HandleTypeDef hdma_i2s2_ext_rx;
+
+/**
+ * Tiempo e interrupciones:
+ *
+ * - El tiempo es sim_tick (ms), el DWT->CYCCNT y el contador de audio_prof
+ *   (las marcas de audio_trace) avanzan con el a SystemCoreClock.
+ * - Las interrupciones pendientes (fin de copia de DMA2, fin de operacion
+ *   de I2C por interrupcion) se entregan con sim_irq_run, y desde cada
+ *   HAL_GetTick si PRIMASK lo permite: asi los loops de espera del
+ *   firmware ven terminar lo que esperan. Un HAL_GetTick sin nada
+ *   pendiente avanza un ms, los timeouts se cumplen.
+ * - Las mitades del stream I2S las genera el programa con sim_i2s_half,
+ *   que es el reloj de muestras: cada llamada es un periodo.
+ */
+typedef struct
+{
+	uint32_t starts;			//<--- HAL_I2SEx_TransmitReceive_DMA accepted
+	uint32_t halves;			//<--- Half transfers delivered to the callbacks
+	uint32_t dma_moves;			//<--- Memory to memory transfers completed
+	uint32_t dma_errors;		//<--- Memory to memory transfers ended with TE
+	uint32_t i2c_transfers;		//<--- Blocking and interrupt I2C transactions started
+	uint32_t i2c_nacks;			//<--- Transactions no device answered
+	uint64_t i2c_bus_ns;		//<--- SCL time of every transaction at the CCR divider
+} sim_stats_t;
+
+/**
+ * Dispositivo en el bus de I2C2, 7 bits de direccion. Las transferencias
+ * de registro (Mem_Write / Mem_Read) llegan con el registro inicial y len
+ * bytes, el auto incremento lo hace el dispositivo. false es NACK.
+ */
+typedef struct
+{
+	uint8_t address;
+	bool (*write)(void *ctx, uint8_t reg, const uint8_t *data, uint16_t len);
+	bool (*read)(void *ctx, uint8_t reg, uint8_t *data, uint16_t len);
+	void *ctx;
+} sim_i2c_device_t;
+
+/**
+ * @brief Samples in and out of the I2S, called on every half transfer.
+ *
+ * @param data half of the DMA buffer, interleaved wire format
+ * @param halfwords length of data
+ */
+typedef void (*sim_i2s_io_t)(uint16_t *data, uint32_t halfwords, void *ctx);
+
+/**
+ * @brief Peripherals, handles, time and counters back to power on.
+ */
+void sim_reset(void);
+
+void sim_advance_ms(uint32_t ms);
+
+/**
+ * @brief Time spent by the code under test, in core cycles: CYCCNT, the
+ * audio_prof counter and the tick move together.
+ */
+void sim_advance_cycles(uint32_t cycles);
+
+/**
+ * @brief Deliver the pending interrupts, unless PRIMASK is set.
+ *
+ * @return interrupts delivered.
+ */
+uint32_t sim_irq_run(void);
+
+const sim_stats_t * sim_stats(void);
+
+/**
+ * @brief Set where the received samples come from (source) and where the
+ * transmitted ones go (sink). NULL sends silence and discards.
+ */
+/**
+ * @brief Connect a device to I2C2, NULL leaves the bus empty (every
+ * transaction is a NACK). sim_reset disconnects it.
+ */
+void sim_i2c_attach(const sim_i2c_device_t *device);
+
+/**
+ * @brief SCL frequency of the CCR divider HAL_I2C_Init left.
+ */
+uint32_t sim_i2c_scl_hz(void);
+
+/**
+ * @brief Frame rate the I2S produces with PLLI2SCFGR and the I2SPR that
+ * HAL_I2S_Init left: I2SxCLK / (packet length * (2 * I2SDIV + ODD)).
+ */
+double sim_i2s_rate_hz(void);
+
+void sim_i2s_io(sim_i2s_io_t source, sim_i2s_io_t sink, void *ctx);
+
+/**
+ * @brief One half of the DMA buffer transferred: the sink gets the TX half
+ * that went out, the source fills the RX half and the HAL callback runs.
+ *
+ * @return false if the stream is not running.
+ */
+bool sim_i2s_half(void);
+
+bool sim_i2s_running(void);
+
+/**
+ * @brief Set OVR on the I2S2ext (RX) and / or UDR on SPI2 (TX), the stream keeps running.
+ */
+void sim_i2s_xrun(bool rx_overrun, bool tx_underrun);
+
+/**
+ * @brief DMA error on one stream: the HAL stops both and calls HAL_I2S_ErrorCallback.
+ *
+ * @param error_code HAL_DMA_ERROR_xx
+ */
+void sim_i2s_dma_error(bool rx, uint32_t error_code);
+
+/**
+ * @brief The next count HAL_I2SEx_TransmitReceive_DMA return HAL_ERROR.
+ */
+void sim_i2s_fail_start(uint32_t count);
+
+/**
+ * @brief Memory to memory DMA faults: starts that fail, transfers that end
+ * with a transfer error, or a DMA that never finishes (hold).
+ */
+void sim_dma_fail_init(bool fail);
+void sim_dma_fail_start(uint32_t count);
+void sim_dma_fail_transfer(uint32_t count);
+void sim_dma_hold(bool hold);
+
+#endif /* SIM_H */
@@ -0,0 +1,94 @@
+/**
+ * @file sim_es8311.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief ES8311 register model on the simulated I2C2 bus.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "sim_es8311.h"
+#include "sim.h"
+#include "es8311.h"
+#include <string.h>
+
+static sim_i2c_device_t device;
+
+static void sim_es8311_reset(sim_es8311_t *codec, bool keep_reg00)
+{
+	for (uint32_t reg = 0; reg < 256; reg++)
+	{
+		const es8311_reg_info_t *info = ES8311_reg_info((uint8_t)reg);
+
+		if (keep_reg00 && reg == ES8311_RESET_REG00)
+			continue;
+		codec->reg[reg] = (info != NULL) ? info->reset : 0x00;
+	}
+}
+
+void sim_es8311_init(sim_es8311_t *codec)
+{
+	memset(codec, 0, sizeof(*codec));
+	sim_es8311_reset(codec, false);
+}
+
+static bool sim_es8311_answers(const sim_es8311_t *codec)
+{
+	return codec->max_scl_hz == 0 || sim_i2c_scl_hz() <= codec->max_scl_hz;
+}
+
+static bool sim_es8311_write(void *ctx, uint8_t reg, const uint8_t *data, uint16_t len)
+{
+	sim_es8311_t *codec = ctx;
+
+	if (!sim_es8311_answers(codec))
+		return false;
+
+	for (uint16_t i = 0; i < len; i++, reg++)
+	{
+		const es8311_reg_info_t *info = ES8311_reg_info(reg);
+
+		codec->writes++;
+		if (info != NULL && !(info->flags & ES8311_REG_RW))
+		{
+			codec->ignored++;
+			continue;
+		}
+
+		codec->reg[reg] = data[i];
+		if (reg == ES8311_RESET_REG00 && (data[i] & RST_DIG))
+		{
+			codec->resets++;
+			sim_es8311_reset(codec, true);
+		}
+	}
+
+	return true;
+}
+
+static bool sim_es8311_read(void *ctx, uint8_t reg, uint8_t *data, uint16_t len)
+{
+	sim_es8311_t *codec = ctx;
+
+	if (!sim_es8311_answers(codec))
+		return false;
+
+	for (uint16_t i = 0; i < len; i++, reg++)
+	{
+		data[i] = codec->reg[reg];
+		codec->reads++;
+	}
+
+	return true;
+}
+
+void sim_es8311_attach(sim_es8311_t *codec)
+{
+	device.address = ES8311_I2C_ADDR;
+	device.write = sim_es8311_write;
+	device.read = sim_es8311_read;
+	device.ctx = codec;
+	sim_i2c_attach(&device);
+}
@@ -0,0 +1,50 @@
+/**
+ * @file sim_es8311.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief ES8311 register model on the simulated I2C2 bus.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SIM_ES8311_H
+#define SIM_ES8311_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Archivo de 256 registros con los valores de reset del regmap del driver
+ * (ES8311_reg_info), en ES8311_I2C_ADDR:
+ *
+ * - Los registros sin ES8311_REG_RW (CHIP_ID1/2, VER, 0x11) no se
+ *   escriben, el ACK se da igual como en el chip.
+ * - REG00 arranca en 0x1F, con la maquina de estados (CSM_ON) apagada.
+ * - Escribir REG00 con RST_DIG vuelve los demas registros a su reset.
+ * - Las rafagas auto incrementan la direccion.
+ * - Con max_scl_hz distinto de cero el codec no contesta (NACK) si SCL
+ *   es mas rapido, como un bus largo o con mucha capacidad.
+ */
+typedef struct
+{
+	uint8_t reg[256];
+	uint32_t max_scl_hz;		//<--- 0: answers at any speed
+	uint32_t writes;			//<--- Registers written (each byte of a burst)
+	uint32_t reads;				//<--- Registers read
+	uint32_t ignored;			//<--- Writes to read only registers
+	uint32_t resets;			//<--- REG00 writes with RST_DIG
+} sim_es8311_t;
+
+/**
+ * @brief Power on reset: every register to its reset value.
+ */
+void sim_es8311_init(sim_es8311_t *codec);
+
+/**
+ * @brief Connect the codec to I2C2, after sim_reset.
+ */
+void sim_es8311_attach(sim_es8311_t *codec);
+
+#endif /* SIM_ES8311_H */
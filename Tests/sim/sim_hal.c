@@ -0,0 +1,853 @@
+/**
+ * @file sim_hal.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Host HAL simulator: I2S full duplex DMA, DMA2 memory moves, I2C bus and time.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "sim.h"
+#include "audio_prof.h"
+#include <stdint.h>
+#include <string.h>
+
+#define SIM_PCLK1_HZ		42000000U		//<--- APB1 of SystemClock_Config (HCLK / 4)
+#define SIM_DMA_HANDLES		8
+
+uint32_t SystemCoreClock = 168000000U;
+volatile uint32_t sim_primask;
+
+DWT_Type sim_dwt;
+CoreDebug_Type sim_core_debug;
+SPI_TypeDef sim_spi2;
+SPI_TypeDef sim_i2s2ext;
+DMA_Stream_TypeDef sim_dma1_stream3;
+DMA_Stream_TypeDef sim_dma1_stream4;
+DMA_Stream_TypeDef sim_dma2_stream0;
+I2C_TypeDef sim_i2c2;
+RCC_TypeDef sim_rcc;
+
+I2C_HandleTypeDef hi2c2;
+I2S_HandleTypeDef hi2s2;
+DMA_HandleTypeDef hdma_spi2_tx;
+DMA_HandleTypeDef hdma_i2s2_ext_rx;
+
+static uint32_t tick;
+static uint32_t tick_cycles;				//<--- Cycles since the last tick
+static sim_stats_t stats;
+
+static DMA_HandleTypeDef *dma_handles[SIM_DMA_HANDLES];
+static uint32_t dma_count;
+static bool dma_fail_init;
+static uint32_t dma_fail_start;
+static uint32_t dma_fail_transfer;
+static bool dma_hold;
+
+static bool i2s_running;
+static uint32_t i2s_half_index;		//<--- Next half to complete, 0 or 1
+static uint32_t i2s_halfwords;			//<--- Whole DMA buffer
+static uint32_t i2s_fail_start;
+static uint32_t i2s_packet_bits;		//<--- Packet length of the last HAL_I2S_Init
+static sim_i2s_io_t i2s_source;
+static sim_i2s_io_t i2s_sink;
+static void *i2s_ctx;
+
+static const sim_i2c_device_t *i2c_device;
+
+/**
+ * Operacion de I2C por interrupcion en curso, termina con sim_irq_run.
+ */
+typedef struct
+{
+	bool pending;
+	bool read;
+	uint16_t address;
+	uint8_t reg;
+	uint8_t *data;
+	uint16_t len;
+} sim_i2c_op_t;
+
+static sim_i2c_op_t i2c_op;
+
+static bool sim_i2c_irq(void);
+
+/******************************************************************************
+ * 								SIMULATOR
+ *****************************************************************************/
+
+void sim_reset(void)
+{
+	memset(&sim_dwt, 0, sizeof(sim_dwt));
+	memset(&sim_core_debug, 0, sizeof(sim_core_debug));
+	memset(&sim_spi2, 0, sizeof(sim_spi2));
+	memset(&sim_i2s2ext, 0, sizeof(sim_i2s2ext));
+	memset(&sim_dma1_stream3, 0, sizeof(sim_dma1_stream3));
+	memset(&sim_dma1_stream4, 0, sizeof(sim_dma1_stream4));
+	memset(&sim_dma2_stream0, 0, sizeof(sim_dma2_stream0));
+	memset(&sim_i2c2, 0, sizeof(sim_i2c2));
+	memset(&stats, 0, sizeof(stats));
+
+	/* SystemClock_Config: HSE 8 MHz / PLLM 4, PLLN 168 */
+	memset(&sim_rcc, 0, sizeof(sim_rcc));
+	sim_rcc.PLLCFGR = RCC_PLLCFGR_PLLSRC | (168UL << 6) | 4UL;
+	SystemCoreClock = 168000000U;
+
+	sim_primask = 0;
+	tick = 0;
+	tick_cycles = 0;
+
+	dma_count = 0;
+	dma_fail_init = false;
+	dma_fail_start = 0;
+	dma_fail_transfer = 0;
+	dma_hold = false;
+
+	i2s_running = false;
+	i2s_half_index = 0;
+	i2s_halfwords = 0;
+	i2s_fail_start = 0;
+	i2s_packet_bits = 0;
+	i2s_source = NULL;
+	i2s_sink = NULL;
+	i2s_ctx = NULL;
+
+	i2c_device = NULL;
+	memset(&i2c_op, 0, sizeof(i2c_op));
+
+	/* MX_I2C2_Init */
+	memset(&hi2c2, 0, sizeof(hi2c2));
+	hi2c2.Instance = I2C2;
+	hi2c2.Init.ClockSpeed = 100000;
+	hi2c2.Init.DutyCycle = I2C_DUTYCYCLE_2;
+	hi2c2.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
+	HAL_I2C_Init(&hi2c2);
+
+	/* MX_I2S2_Init y HAL_I2S_MspInit */
+	memset(&hi2s2, 0, sizeof(hi2s2));
+	memset(&hdma_spi2_tx, 0, sizeof(hdma_spi2_tx));
+	memset(&hdma_i2s2_ext_rx, 0, sizeof(hdma_i2s2_ext_rx));
+	hi2s2.Instance = SPI2;
+	hi2s2.Init.Mode = I2S_MODE_MASTER_TX;
+	hi2s2.Init.Standard = I2S_STANDARD_PHILIPS;
+	hi2s2.Init.DataFormat = I2S_DATAFORMAT_16B_EXTENDED;
+	hi2s2.Init.MCLKOutput = I2S_MCLKOUTPUT_DISABLE;
+	hi2s2.Init.AudioFreq = I2S_AUDIOFREQ_8K;
+	hi2s2.Init.CPOL = I2S_CPOL_LOW;
+	hi2s2.Init.ClockSource = I2S_CLOCK_PLL;
+	hi2s2.Init.FullDuplexMode = I2S_FULLDUPLEXMODE_ENABLE;
+
+	hdma_spi2_tx.Instance = DMA1_Stream4;
+	hdma_spi2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+	hdma_spi2_tx.Init.Mode = DMA_CIRCULAR;
+	HAL_DMA_Init(&hdma_spi2_tx);
+	__HAL_LINKDMA(&hi2s2, hdmatx, hdma_spi2_tx);
+
+	hdma_i2s2_ext_rx.Instance = DMA1_Stream3;
+	hdma_i2s2_ext_rx.Init.Channel = DMA_CHANNEL_3;
+	hdma_i2s2_ext_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+	hdma_i2s2_ext_rx.Init.Mode = DMA_CIRCULAR;
+	HAL_DMA_Init(&hdma_i2s2_ext_rx);
+	__HAL_LINKDMA(&hi2s2, hdmarx, hdma_i2s2_ext_rx);
+
+	HAL_I2S_Init(&hi2s2);
+}
+
+/**
+ * El CYCCNT y el contador de audio_prof avanzan con el reloj del
+ * simulador. Los tests que no linkean audio_prof usan esta.
+ */
+__weak void audio_prof_mock_advance(uint32_t cycles)
+{
+	(void)cycles;
+}
+
+void sim_advance_ms(uint32_t ms)
+{
+	tick += ms;
+	sim_dwt.CYCCNT += ms * (SystemCoreClock / 1000U);
+	audio_prof_mock_advance(ms * (SystemCoreClock / 1000U));
+}
+
+void sim_advance_cycles(uint32_t cycles)
+{
+	uint32_t per_ms = SystemCoreClock / 1000U;
+
+	sim_dwt.CYCCNT += cycles;
+	audio_prof_mock_advance(cycles);
+
+	tick += cycles / per_ms;
+	tick_cycles += cycles % per_ms;
+	if (tick_cycles >= per_ms)
+	{
+		tick_cycles -= per_ms;
+		tick++;
+	}
+}
+
+const sim_stats_t * sim_stats(void)
+{
+	return &stats;
+}
+
+/**
+ * Solo las copias memoria a memoria terminan por su cuenta, los streams
+ * del I2S avanzan con sim_i2s_half.
+ */
+static bool sim_dma_pending(const DMA_HandleTypeDef *hdma)
+{
+	return hdma->State == HAL_DMA_STATE_BUSY && hdma->Init.Direction == DMA_MEMORY_TO_MEMORY && !dma_hold;
+}
+
+uint32_t sim_irq_run(void)
+{
+	uint32_t delivered = 0;
+	bool again = true;
+
+	/* Una copia que termina puede arrancar la siguiente, se sigue hasta que no quede nada */
+	while (again && sim_primask == 0)
+	{
+		again = false;
+		if (sim_i2c_irq())
+		{
+			delivered++;
+			again = true;
+		}
+		for (uint32_t i = 0; i < dma_count; i++)
+		{
+			if (sim_dma_pending(dma_handles[i]))
+			{
+				HAL_DMA_IRQHandler(dma_handles[i]);
+				delivered++;
+				again = true;
+			}
+		}
+	}
+
+	return delivered;
+}
+
+void sim_dma_fail_init(bool fail)
+{
+	dma_fail_init = fail;
+}
+
+void sim_dma_fail_start(uint32_t count)
+{
+	dma_fail_start = count;
+}
+
+void sim_dma_fail_transfer(uint32_t count)
+{
+	dma_fail_transfer = count;
+}
+
+void sim_dma_hold(bool hold)
+{
+	dma_hold = hold;
+}
+
+/******************************************************************************
+ * 								TIME / NVIC
+ *****************************************************************************/
+
+uint32_t HAL_GetTick(void)
+{
+	if (sim_irq_run() == 0)
+		sim_advance_ms(1);
+
+	return tick;
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+	sim_irq_run();
+	sim_advance_ms(Delay);
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+	(void)IRQn;
+	(void)PreemptPriority;
+	(void)SubPriority;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+	(void)IRQn;
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+	(void)IRQn;
+}
+
+/******************************************************************************
+ * 								DMA
+ *****************************************************************************/
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma)
+{
+	uint32_t i;
+
+	if (dma_fail_init && hdma->Init.Direction == DMA_MEMORY_TO_MEMORY)
+		return HAL_ERROR;
+
+	for (i = 0; i < dma_count && dma_handles[i] != hdma; i++)
+		;
+	if (i == dma_count)
+	{
+		if (dma_count == SIM_DMA_HANDLES)
+			return HAL_ERROR;
+		dma_handles[dma_count++] = hdma;
+	}
+
+	hdma->State = HAL_DMA_STATE_READY;
+	hdma->ErrorCode = HAL_DMA_ERROR_NONE;
+	hdma->Lock = HAL_UNLOCKED;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma)
+{
+	hdma->State = HAL_DMA_STATE_RESET;
+	return HAL_OK;
+}
+
+/**
+ * Las direcciones son de 32 bits como en el chip: los programas se linkean
+ * sin PIE para que los buffers estaticos queden abajo de 4 GB.
+ */
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress, uint32_t DataLength)
+{
+	if (hdma->State != HAL_DMA_STATE_READY)
+		return HAL_BUSY;
+
+	if (dma_fail_start != 0)
+	{
+		dma_fail_start--;
+		return HAL_ERROR;
+	}
+
+	hdma->Instance->PAR = SrcAddress;
+	hdma->Instance->M0AR = DstAddress;
+	hdma->Instance->NDTR = DataLength;
+	hdma->Instance->CR |= 1UL;
+	hdma->ErrorCode = HAL_DMA_ERROR_NONE;
+	hdma->State = HAL_DMA_STATE_BUSY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma)
+{
+	if (hdma == NULL)
+		return HAL_ERROR;
+
+	hdma->Instance->CR &= ~1UL;
+	hdma->State = HAL_DMA_STATE_READY;
+	return HAL_OK;
+}
+
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma)
+{
+	uint32_t size = (hdma->Init.MemDataAlignment == DMA_MDATAALIGN_HALFWORD) ? 2 : 1;
+
+	if (!sim_dma_pending(hdma))
+		return;
+
+	hdma->Instance->CR &= ~1UL;
+	hdma->State = HAL_DMA_STATE_READY;
+
+	if (dma_fail_transfer != 0)
+	{
+		dma_fail_transfer--;
+		stats.dma_errors++;
+		hdma->ErrorCode |= HAL_DMA_ERROR_TE;
+		if (hdma->XferErrorCallback != NULL)
+			hdma->XferErrorCallback(hdma);
+		return;
+	}
+
+	memcpy((void *)(uintptr_t)hdma->Instance->M0AR, (const void *)(uintptr_t)hdma->Instance->PAR,
+			hdma->Instance->NDTR * size);
+	hdma->Instance->NDTR = 0;
+	stats.dma_moves++;
+
+	if (hdma->XferCpltCallback != NULL)
+		hdma->XferCpltCallback(hdma);
+}
+
+/******************************************************************************
+ * 								I2S
+ *****************************************************************************/
+
+void sim_i2s_io(sim_i2s_io_t source, sim_i2s_io_t sink, void *ctx)
+{
+	i2s_source = source;
+	i2s_sink = sink;
+	i2s_ctx = ctx;
+}
+
+/**
+ * Con I2SE en cero (ES8311_I2S_teardown) no salen mas mitades aunque el
+ * stream no se haya parado por el HAL.
+ */
+bool sim_i2s_running(void)
+{
+	return i2s_running && READ_BIT(sim_spi2.I2SCFGR, SPI_I2SCFGR_I2SE) != 0;
+}
+
+bool sim_i2s_half(void)
+{
+	uint32_t half = i2s_halfwords / 2;
+	uint16_t *tx;
+	uint16_t *rx;
+
+	if (!sim_i2s_running())
+		return false;
+
+	tx = hi2s2.pTxBuffPtr + i2s_half_index * half;
+	rx = hi2s2.pRxBuffPtr + i2s_half_index * half;
+
+	if (i2s_sink != NULL)
+		i2s_sink(tx, half, i2s_ctx);
+
+	if (i2s_source != NULL)
+		i2s_source(rx, half, i2s_ctx);
+	else
+		memset(rx, 0, half * sizeof(uint16_t));
+
+	stats.halves++;
+
+	/* Los callbacks los da el stream de RX, como en HAL_I2SEx_TransmitReceive_DMA */
+	if (i2s_half_index == 0)
+	{
+		i2s_half_index = 1;
+		HAL_I2SEx_TxRxHalfCpltCallback(&hi2s2);
+	}
+	else
+	{
+		i2s_half_index = 0;
+		HAL_I2SEx_TxRxCpltCallback(&hi2s2);
+	}
+
+	return true;
+}
+
+void sim_i2s_xrun(bool rx_overrun, bool tx_underrun)
+{
+	if (rx_overrun)
+		sim_i2s2ext.SR |= I2S_FLAG_OVR;
+	if (tx_underrun)
+		sim_spi2.SR |= I2S_FLAG_UDR;
+}
+
+static void sim_i2s_halt(void)
+{
+	i2s_running = false;
+	hi2s2.hdmatx->State = HAL_DMA_STATE_READY;
+	hi2s2.hdmarx->State = HAL_DMA_STATE_READY;
+	CLEAR_BIT(sim_spi2.CR2, SPI_CR2_TXDMAEN | SPI_CR2_RXDMAEN);
+	CLEAR_BIT(sim_i2s2ext.CR2, SPI_CR2_TXDMAEN | SPI_CR2_RXDMAEN);
+}
+
+void sim_i2s_dma_error(bool rx, uint32_t error_code)
+{
+	DMA_HandleTypeDef *hdma = rx ? hi2s2.hdmarx : hi2s2.hdmatx;
+
+	if (!i2s_running)
+		return;
+
+	/* I2SEx_TxRxDMAError: saca los pedidos de DMA, pasa a READY y avisa */
+	hdma->ErrorCode |= error_code;
+	sim_i2s_halt();
+	hi2s2.State = HAL_I2S_STATE_READY;
+	hi2s2.ErrorCode |= HAL_I2S_ERROR_DMA;
+	HAL_I2S_ErrorCallback(&hi2s2);
+}
+
+void sim_i2s_fail_start(uint32_t count)
+{
+	i2s_fail_start = count;
+}
+
+/**
+ * HAL_I2S_MspInit de stm32f4xx_hal_msp.c: HAL_I2S_Init la llama con el
+ * handle en RESET (el primer init y despues de HAL_I2S_DeInit) y pone el
+ * PLLI2S de CubeMX.
+ */
+static void sim_i2s_msp_init(void)
+{
+	sim_rcc.PLLI2SCFGR = (60UL << 6) | (2UL << 28);
+}
+
+HAL_StatusTypeDef HAL_I2S_Init(I2S_HandleTypeDef *hi2s)
+{
+	uint32_t i2sclk;
+	uint32_t tmp;
+
+	if (hi2s->State == HAL_I2S_STATE_RESET)
+		sim_i2s_msp_init();
+
+	/* Prescaler with the integer math of the HAL, MCLK output disabled */
+	i2s_packet_bits = (hi2s->Init.DataFormat == I2S_DATAFORMAT_16B) ? 16U : 32U;
+	if (hi2s->Init.Standard <= I2S_STANDARD_LSB)
+		i2s_packet_bits *= 2U;
+
+	tmp = 2U * 2U;
+	if (hi2s->Init.AudioFreq != I2S_AUDIOFREQ_DEFAULT)
+	{
+		i2sclk = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_I2S);
+		tmp = ((((i2sclk / i2s_packet_bits) * 10U) / hi2s->Init.AudioFreq) + 5U) / 10U;
+	}
+
+	if (tmp / 2U < 2U || tmp / 2U > 0xFFU)
+	{
+		hi2s->ErrorCode |= HAL_I2S_ERROR_PRESCALER;
+		return HAL_ERROR;
+	}
+
+	hi2s->Instance->I2SPR = (tmp / 2U) | ((tmp & 1U) << 8);
+	hi2s->ErrorCode = HAL_I2S_ERROR_NONE;
+	hi2s->State = HAL_I2S_STATE_READY;
+	return HAL_OK;
+}
+
+double sim_i2s_rate_hz(void)
+{
+	uint32_t div = 2U * (SPI2->I2SPR & SPI_I2SPR_I2SDIV) + ((SPI2->I2SPR & SPI_I2SPR_ODD) ? 1U : 0U);
+
+	if (div == 0 || i2s_packet_bits == 0)
+		return 0.0;
+	return (double)HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_I2S) / ((double)i2s_packet_bits * div);
+}
+
+HAL_StatusTypeDef HAL_I2S_DeInit(I2S_HandleTypeDef *hi2s)
+{
+	hi2s->State = HAL_I2S_STATE_RESET;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2S_DMAStop(I2S_HandleTypeDef *hi2s)
+{
+	if (hi2s == &hi2s2)
+		sim_i2s_halt();
+
+	__HAL_I2S_DISABLE(hi2s);
+	hi2s->State = HAL_I2S_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2SEx_TransmitReceive(I2S_HandleTypeDef *hi2s, uint16_t *pTxData, uint16_t *pRxData,
+		uint16_t Size, uint32_t Timeout)
+{
+	(void)hi2s;
+	(void)pTxData;
+	(void)Timeout;
+
+	memset(pRxData, 0, Size * sizeof(uint16_t));
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2SEx_TransmitReceive_DMA(I2S_HandleTypeDef *hi2s, uint16_t *pTxData, uint16_t *pRxData,
+		uint16_t Size)
+{
+	if (hi2s != &hi2s2 || pTxData == NULL || pRxData == NULL || Size == 0)
+		return HAL_ERROR;
+
+	if (hi2s->State != HAL_I2S_STATE_READY)
+		return HAL_BUSY;
+
+	if (i2s_fail_start != 0)
+	{
+		i2s_fail_start--;
+		return HAL_ERROR;
+	}
+
+	/* En 24 y 32 bits Size son muestras de dos medias palabras */
+	hi2s->pTxBuffPtr = pTxData;
+	hi2s->pRxBuffPtr = pRxData;
+	hi2s->TxXferSize = hi2s->RxXferSize = Size;
+	i2s_halfwords = Size;
+	if (hi2s->Init.DataFormat == I2S_DATAFORMAT_24B || hi2s->Init.DataFormat == I2S_DATAFORMAT_32B)
+		i2s_halfwords *= 2;
+
+	hi2s->ErrorCode = HAL_I2S_ERROR_NONE;
+	hi2s->State = HAL_I2S_STATE_BUSY_TX_RX;
+	hi2s->hdmatx->State = HAL_DMA_STATE_BUSY;
+	hi2s->hdmarx->State = HAL_DMA_STATE_BUSY;
+	SET_BIT(sim_spi2.CR2, SPI_CR2_TXDMAEN);
+	SET_BIT(sim_i2s2ext.CR2, SPI_CR2_RXDMAEN);
+	SET_BIT(sim_spi2.I2SCFGR, SPI_I2SCFGR_I2SE);
+	SET_BIT(sim_i2s2ext.I2SCFGR, SPI_I2SCFGR_I2SE);
+
+	i2s_running = true;
+	i2s_half_index = 0;
+	stats.starts++;
+	return HAL_OK;
+}
+
+__weak void HAL_I2SEx_TxRxHalfCpltCallback(I2S_HandleTypeDef *hi2s)
+{
+	(void)hi2s;
+}
+
+__weak void HAL_I2SEx_TxRxCpltCallback(I2S_HandleTypeDef *hi2s)
+{
+	(void)hi2s;
+}
+
+__weak void HAL_I2S_ErrorCallback(I2S_HandleTypeDef *hi2s)
+{
+	(void)hi2s;
+}
+
+/******************************************************************************
+ * 								I2C
+ *****************************************************************************/
+
+/**
+ * Divisor de SCL como I2C_Init del HAL: standard, fast 2:1 o fast 16:9.
+ */
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c)
+{
+	uint32_t pclk = SIM_PCLK1_HZ;
+	uint32_t speed = hi2c->Init.ClockSpeed;
+	uint32_t ccr;
+
+	if (speed == 0 || speed > 400000U)
+		return HAL_ERROR;
+
+	if (speed <= 100000U)
+	{
+		ccr = ((pclk - 1U) / (speed * 2U)) + 1U;
+		if (ccr < 4U)
+			ccr = 4U;
+	}
+	else if (hi2c->Init.DutyCycle == I2C_DUTYCYCLE_2)
+	{
+		ccr = (((pclk - 1U) / (speed * 3U)) + 1U) | I2C_CCR_FS;
+	}
+	else
+	{
+		ccr = (((pclk - 1U) / (speed * 25U)) + 1U) | I2C_CCR_FS | I2C_CCR_DUTY;
+	}
+
+	if ((ccr & I2C_CCR_CCR) == 0)
+		ccr |= 1U;
+
+	hi2c->Instance->CCR = ccr;
+	hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+	hi2c->State = HAL_I2C_STATE_READY;
+	return HAL_OK;
+}
+
+void sim_i2c_attach(const sim_i2c_device_t *device)
+{
+	i2c_device = device;
+}
+
+uint32_t sim_i2c_scl_hz(void)
+{
+	uint32_t ccr = sim_i2c2.CCR;
+	uint32_t div = ccr & I2C_CCR_CCR;
+
+	if (div == 0)
+		return 0;
+	if (!(ccr & I2C_CCR_FS))
+		return SIM_PCLK1_HZ / (2U * div);
+	return SIM_PCLK1_HZ / (((ccr & I2C_CCR_DUTY) ? 25U : 3U) * div);
+}
+
+/**
+ * Tiempo de SCL con el divisor real, no con la frecuencia pedida:
+ * periodo = CCR * (2, 3 o 25) / PCLK1. START y STOP cuentan un periodo.
+ */
+static void sim_i2c_bus_time(uint32_t bits)
+{
+	uint32_t ccr = sim_i2c2.CCR;
+	uint32_t mult = !(ccr & I2C_CCR_FS) ? 2U : ((ccr & I2C_CCR_DUTY) ? 25U : 3U);
+
+	stats.i2c_bus_ns += ((uint64_t)bits * (ccr & I2C_CCR_CCR) * mult * 1000000000ULL) / SIM_PCLK1_HZ;
+}
+
+/**
+ * Transaccion de registro completa: el dispositivo tiene que responder en
+ * la direccion (DevAddress viene corrida un bit, como en el HAL).
+ */
+static bool sim_i2c_transfer(uint16_t address, uint8_t reg, uint8_t *data, uint16_t len, bool read)
+{
+	bool ok;
+
+	stats.i2c_transfers++;
+
+	if (i2c_device == NULL || (address >> 1) != i2c_device->address)
+	{
+		/* S | ADDR+W NACK | P */
+		sim_i2c_bus_time(1 + 9 + 1);
+		stats.i2c_nacks++;
+		return false;
+	}
+
+	if (read)
+	{
+		sim_i2c_bus_time(1 + 9 * 2 + 1 + 9 * (1 + len) + 1);
+		ok = i2c_device->read != NULL && i2c_device->read(i2c_device->ctx, reg, data, len);
+	}
+	else
+	{
+		sim_i2c_bus_time(1 + 9 * (2 + len) + 1);
+		ok = i2c_device->write != NULL && i2c_device->write(i2c_device->ctx, reg, data, len);
+	}
+
+	if (!ok)
+		stats.i2c_nacks++;
+	return ok;
+}
+
+static HAL_StatusTypeDef sim_i2c_blocking(I2C_HandleTypeDef *hi2c, uint16_t address, uint16_t reg,
+		uint8_t *data, uint16_t len, bool read)
+{
+	if (hi2c->State != HAL_I2C_STATE_READY)
+		return HAL_BUSY;
+
+	hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+	if (!sim_i2c_transfer(address, (uint8_t)reg, data, len, read))
+	{
+		hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+		return HAL_ERROR;
+	}
+
+	return HAL_OK;
+}
+
+static HAL_StatusTypeDef sim_i2c_start_it(I2C_HandleTypeDef *hi2c, uint16_t address, uint16_t reg,
+		uint8_t *data, uint16_t len, bool read)
+{
+	if (hi2c->State != HAL_I2C_STATE_READY)
+		return HAL_BUSY;
+
+	i2c_op.pending = true;
+	i2c_op.read = read;
+	i2c_op.address = address;
+	i2c_op.reg = (uint8_t)reg;
+	i2c_op.data = data;
+	i2c_op.len = len;
+
+	hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+	hi2c->State = read ? HAL_I2C_STATE_BUSY_RX : HAL_I2C_STATE_BUSY_TX;
+	return HAL_OK;
+}
+
+/**
+ * Fin de la operacion por interrupcion: como I2C2_EV / I2C2_ER, el handle
+ * vuelve a READY antes del callback.
+ */
+static bool sim_i2c_irq(void)
+{
+	sim_i2c_op_t op = i2c_op;
+
+	if (!op.pending)
+		return false;
+
+	i2c_op.pending = false;
+	hi2c2.State = HAL_I2C_STATE_READY;
+
+	if (!sim_i2c_transfer(op.address, op.reg, op.data, op.len, op.read))
+	{
+		hi2c2.ErrorCode = HAL_I2C_ERROR_AF;
+		HAL_I2C_ErrorCallback(&hi2c2);
+	}
+	else if (op.read)
+		HAL_I2C_MemRxCpltCallback(&hi2c2);
+	else
+		HAL_I2C_MemTxCpltCallback(&hi2c2);
+
+	return true;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	(void)MemAddSize;
+	(void)Timeout;
+
+	return sim_i2c_blocking(hi2c, DevAddress, MemAddress, pData, Size, false);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	(void)MemAddSize;
+	(void)Timeout;
+
+	return sim_i2c_blocking(hi2c, DevAddress, MemAddress, pData, Size, true);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size)
+{
+	(void)MemAddSize;
+
+	return sim_i2c_start_it(hi2c, DevAddress, MemAddress, pData, Size, false);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size)
+{
+	(void)MemAddSize;
+
+	return sim_i2c_start_it(hi2c, DevAddress, MemAddress, pData, Size, true);
+}
+
+__weak void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	(void)hi2c;
+}
+
+__weak void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	(void)hi2c;
+}
+
+__weak void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	(void)hi2c;
+}
+
+/******************************************************************************
+ * 								RCC
+ *****************************************************************************/
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+	return SIM_PCLK1_HZ;
+}
+
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef *PeriphClkInit)
+{
+	if (PeriphClkInit->PeriphClockSelection & RCC_PERIPHCLK_I2S)
+	{
+		if (PeriphClkInit->PLLI2S.PLLI2SN < 50 || PeriphClkInit->PLLI2S.PLLI2SN > 432 ||
+				PeriphClkInit->PLLI2S.PLLI2SR < 2 || PeriphClkInit->PLLI2S.PLLI2SR > 7)
+			return HAL_ERROR;
+
+		sim_rcc.PLLI2SCFGR = (PeriphClkInit->PLLI2S.PLLI2SN << 6) | (PeriphClkInit->PLLI2S.PLLI2SR << 28);
+	}
+
+	return HAL_OK;
+}
+
+uint32_t HAL_RCCEx_GetPeriphCLKFreq(uint32_t PeriphClk)
+{
+	uint32_t pllm = sim_rcc.PLLCFGR & RCC_PLLCFGR_PLLM;
+	uint32_t n = (sim_rcc.PLLI2SCFGR & RCC_PLLI2SCFGR_PLLI2SN) >> 6;
+	uint32_t r = (sim_rcc.PLLI2SCFGR & RCC_PLLI2SCFGR_PLLI2SR) >> 28;
+
+	if (PeriphClk != RCC_PERIPHCLK_I2S || pllm == 0 || r == 0)
+		return 0;
+
+	return (uint32_t)(((uint64_t)(HSE_VALUE / pllm) * n) / r);
+}
@@ -0,0 +1,274 @@
+/**
+ * @file stm32f4xx.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Host stand-in for the CMSIS device header: registers in RAM, PRIMASK as a variable.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Solo para los programas de Tests/, se incluye en lugar del de CMSIS
+ * porque Tests/sim va primero en el include path. Tiene los registros y
+ * bits que usa el firmware, con los mismos nombres y valores.
+ */
+
+#ifndef SIM_STM32F4XX_H
+#define SIM_STM32F4XX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define __IO		volatile
+#define __weak		__attribute__((weak))
+
+#define SET_BIT(REG, BIT)		((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT)		((REG) &= ~(BIT))
+#define READ_BIT(REG, BIT)		((REG) & (BIT))
+
+#define HSE_VALUE	8000000U
+#define HSI_VALUE	16000000U
+
+extern uint32_t SystemCoreClock;
+
+/******************************************************************************
+ * 								CORE
+ *****************************************************************************/
+
+/**
+ * PRIMASK es una variable: las "interrupciones" del simulador (sim.h) no se
+ * entregan mientras vale 1, igual que en el core.
+ */
+extern volatile uint32_t sim_primask;
+
+static inline uint32_t __get_PRIMASK(void)
+{
+	return sim_primask;
+}
+
+static inline void __set_PRIMASK(uint32_t primask)
+{
+	sim_primask = primask;
+}
+
+static inline void __disable_irq(void)
+{
+	sim_primask = 1;
+}
+
+static inline void __enable_irq(void)
+{
+	sim_primask = 0;
+}
+
+#define __DMB()		__sync_synchronize()
+#define __DSB()		__sync_synchronize()
+#define __ISB()		__sync_synchronize()
+#define __WFI()
+
+typedef struct
+{
+	__IO uint32_t CTRL;
+	__IO uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+	__IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type sim_dwt;
+extern CoreDebug_Type sim_core_debug;
+
+#define DWT							(&sim_dwt)
+#define CoreDebug					(&sim_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk		(1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk	(1UL << 24)
+
+typedef enum
+{
+	DMA1_Stream3_IRQn = 14,
+	DMA1_Stream4_IRQn = 15,
+	I2C2_EV_IRQn = 33,
+	I2C2_ER_IRQn = 34,
+	USART3_IRQn = 39,
+	DMA2_Stream0_IRQn = 56,
+} IRQn_Type;
+
+/******************************************************************************
+ * 								DSP INSTRUCTIONS
+ *****************************************************************************/
+
+/**
+ * Las instrucciones SIMD del M4 que usa audio_dsp.c, en C con el mismo
+ * resultado bit a bit: saturacion por media palabra, acumulador de 32 bits
+ * que da la vuelta (SMLAD solo marca el flag Q). Con AUDIO_DSP_SIMD_HOST el
+ * camino rapido compila en el host y se compara contra los _ref.
+ */
+static inline int32_t sim_sat(int64_t x, uint32_t bits)
+{
+	int64_t max = ((int64_t)1 << (bits - 1)) - 1;
+
+	return (int32_t)(x > max ? max : (x < -max - 1 ? -max - 1 : x));
+}
+
+static inline int32_t __SSAT(int32_t x, uint32_t bits)
+{
+	return sim_sat(x, bits);
+}
+
+static inline int32_t __QADD(int32_t a, int32_t b)
+{
+	return sim_sat((int64_t)a + b, 32);
+}
+
+static inline uint32_t __QADD16(uint32_t a, uint32_t b)
+{
+	return (uint16_t)sim_sat((int16_t)a + (int16_t)b, 16) |
+			((uint32_t)(uint16_t)sim_sat((int16_t)(a >> 16) + (int16_t)(b >> 16), 16) << 16);
+}
+
+static inline uint32_t __QSUB16(uint32_t a, uint32_t b)
+{
+	return (uint16_t)sim_sat((int16_t)a - (int16_t)b, 16) |
+			((uint32_t)(uint16_t)sim_sat((int16_t)(a >> 16) - (int16_t)(b >> 16), 16) << 16);
+}
+
+static inline uint32_t __SMUAD(uint32_t x, uint32_t y)
+{
+	return (uint32_t)((int16_t)x * (int16_t)y) + (uint32_t)((int16_t)(x >> 16) * (int16_t)(y >> 16));
+}
+
+static inline uint32_t __SMLAD(uint32_t x, uint32_t y, uint32_t acc)
+{
+	return acc + __SMUAD(x, y);
+}
+
+static inline uint32_t __ROR(uint32_t x, uint32_t n)
+{
+	n &= 31;
+	return n == 0 ? x : (x >> n) | (x << (32 - n));
+}
+
+#define __PKHBT(ARG1, ARG2, ARG3)	((((uint32_t)(ARG1)) & 0x0000FFFFUL) | \
+		((((uint32_t)(ARG2)) << (ARG3)) & 0xFFFF0000UL))
+
+static inline uint32_t sim_unaligned_read32(const void *addr)
+{
+	uint32_t v;
+
+	__builtin_memcpy(&v, addr, sizeof(v));
+	return v;
+}
+
+static inline void sim_unaligned_write32(void *addr, uint32_t v)
+{
+	__builtin_memcpy(addr, &v, sizeof(v));
+}
+
+#define __UNALIGNED_UINT32_READ(addr)		sim_unaligned_read32(addr)
+#define __UNALIGNED_UINT32_WRITE(addr, val)	sim_unaligned_write32((addr), (val))
+
+/******************************************************************************
+ * 								SPI / I2S
+ *****************************************************************************/
+
+typedef struct
+{
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t SR;
+	__IO uint32_t DR;
+	__IO uint32_t CRCPR;
+	__IO uint32_t RXCRCR;
+	__IO uint32_t TXCRCR;
+	__IO uint32_t I2SCFGR;
+	__IO uint32_t I2SPR;
+} SPI_TypeDef;
+
+extern SPI_TypeDef sim_spi2;
+extern SPI_TypeDef sim_i2s2ext;
+
+#define SPI2					(&sim_spi2)
+#define I2S2ext					(&sim_i2s2ext)
+#define I2SxEXT(__INSTANCE__)	((__INSTANCE__) == SPI2 ? I2S2ext : NULL)
+
+#define SPI_CR2_RXDMAEN			(1UL << 0)
+#define SPI_CR2_TXDMAEN			(1UL << 1)
+#define SPI_SR_UDR				(1UL << 3)
+#define SPI_SR_OVR				(1UL << 6)
+#define SPI_I2SCFGR_I2SE		(1UL << 10)
+#define SPI_I2SPR_I2SDIV		0x000000FFUL
+#define SPI_I2SPR_ODD			(1UL << 8)
+
+/******************************************************************************
+ * 								DMA
+ *****************************************************************************/
+
+typedef struct
+{
+	__IO uint32_t CR;
+	__IO uint32_t NDTR;
+	__IO uint32_t PAR;
+	__IO uint32_t M0AR;
+	__IO uint32_t M1AR;
+	__IO uint32_t FCR;
+} DMA_Stream_TypeDef;
+
+extern DMA_Stream_TypeDef sim_dma1_stream3;
+extern DMA_Stream_TypeDef sim_dma1_stream4;
+extern DMA_Stream_TypeDef sim_dma2_stream0;
+
+#define DMA1_Stream3			(&sim_dma1_stream3)
+#define DMA1_Stream4			(&sim_dma1_stream4)
+#define DMA2_Stream0			(&sim_dma2_stream0)
+
+/******************************************************************************
+ * 								I2C
+ *****************************************************************************/
+
+typedef struct
+{
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t OAR1;
+	__IO uint32_t OAR2;
+	__IO uint32_t DR;
+	__IO uint32_t SR1;
+	__IO uint32_t SR2;
+	__IO uint32_t CCR;
+	__IO uint32_t TRISE;
+	__IO uint32_t FLTR;
+} I2C_TypeDef;
+
+extern I2C_TypeDef sim_i2c2;
+
+#define I2C2					(&sim_i2c2)
+
+#define I2C_CCR_CCR				0x00000FFFUL
+#define I2C_CCR_DUTY			(1UL << 14)
+#define I2C_CCR_FS				(1UL << 15)
+
+/******************************************************************************
+ * 								RCC
+ *****************************************************************************/
+
+typedef struct
+{
+	__IO uint32_t CR;
+	__IO uint32_t PLLCFGR;
+	__IO uint32_t CFGR;
+	__IO uint32_t PLLI2SCFGR;
+} RCC_TypeDef;
+
+extern RCC_TypeDef sim_rcc;
+
+#define RCC						(&sim_rcc)
+
+#define RCC_PLLCFGR_PLLM		0x0000003FUL
+#define RCC_PLLCFGR_PLLN		0x00007FC0UL
+#define RCC_PLLCFGR_PLLSRC		(1UL << 22)
+#define RCC_PLLI2SCFGR_PLLI2SN	0x00007FC0UL
+#define RCC_PLLI2SCFGR_PLLI2SR	0x70000000UL
+
+#endif /* SIM_STM32F4XX_H */
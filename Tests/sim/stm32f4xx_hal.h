@@ -0,0 +1,289 @@
+/**
+ * @file stm32f4xx_hal.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Host stand-in for the STM32F4 HAL used by the audio path (sim_hal.c).
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * main.h lo incluye igual que al HAL real. Los handles tienen los campos
+ * que usa el firmware, las funciones hacen lo que el firmware espera de
+ * ellas y el simulador (sim.h) genera las interrupciones.
+ */
+
+#ifndef SIM_STM32F4XX_HAL_H
+#define SIM_STM32F4XX_HAL_H
+
+#include "stm32f4xx.h"
+
+typedef enum
+{
+	HAL_OK = 0x00U,
+	HAL_ERROR = 0x01U,
+	HAL_BUSY = 0x02U,
+	HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+	HAL_UNLOCKED = 0x00U,
+	HAL_LOCKED = 0x01U
+} HAL_LockTypeDef;
+
+#define __HAL_UNLOCK(__HANDLE__)		do { (__HANDLE__)->Lock = HAL_UNLOCKED; } while (0)
+#define __HAL_LINKDMA(__HANDLE__, __PPP_DMA_FIELD__, __DMA_HANDLE__) \
+	do { (__HANDLE__)->__PPP_DMA_FIELD__ = &(__DMA_HANDLE__); (__DMA_HANDLE__).Parent = (__HANDLE__); } while (0)
+
+/**
+ * @brief Current tick. Every call lets the pending interrupts run, see sim.h.
+ */
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+
+/******************************************************************************
+ * 								DMA
+ *****************************************************************************/
+
+#define DMA_CHANNEL_0				0x00000000U
+#define DMA_CHANNEL_3				0x06000000U
+#define DMA_PERIPH_TO_MEMORY		0x00000000U
+#define DMA_MEMORY_TO_PERIPH		0x00000040U
+#define DMA_MEMORY_TO_MEMORY		0x00000080U
+#define DMA_PINC_ENABLE				0x00000200U
+#define DMA_PINC_DISABLE			0x00000000U
+#define DMA_MINC_ENABLE				0x00000400U
+#define DMA_MINC_DISABLE			0x00000000U
+#define DMA_PDATAALIGN_HALFWORD		0x00000800U
+#define DMA_MDATAALIGN_HALFWORD		0x00002000U
+#define DMA_NORMAL					0x00000000U
+#define DMA_CIRCULAR				0x00000100U
+#define DMA_PRIORITY_HIGH			0x00020000U
+#define DMA_PRIORITY_VERY_HIGH		0x00030000U
+#define DMA_FIFOMODE_DISABLE		0x00000000U
+#define DMA_FIFOMODE_ENABLE			0x00000004U
+#define DMA_FIFO_THRESHOLD_FULL		0x00000003U
+#define DMA_MBURST_SINGLE			0x00000000U
+#define DMA_PBURST_SINGLE			0x00000000U
+
+#define HAL_DMA_ERROR_NONE			0x00000000U
+#define HAL_DMA_ERROR_TE			0x00000001U
+#define HAL_DMA_ERROR_FE			0x00000002U
+#define HAL_DMA_ERROR_DME			0x00000004U
+
+typedef enum
+{
+	HAL_DMA_STATE_RESET = 0x00U,
+	HAL_DMA_STATE_READY = 0x01U,
+	HAL_DMA_STATE_BUSY = 0x02U
+} HAL_DMA_StateTypeDef;
+
+typedef struct
+{
+	uint32_t Channel;
+	uint32_t Direction;
+	uint32_t PeriphInc;
+	uint32_t MemInc;
+	uint32_t PeriphDataAlignment;
+	uint32_t MemDataAlignment;
+	uint32_t Mode;
+	uint32_t Priority;
+	uint32_t FIFOMode;
+	uint32_t FIFOThreshold;
+	uint32_t MemBurst;
+	uint32_t PeriphBurst;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef
+{
+	DMA_Stream_TypeDef *Instance;
+	DMA_InitTypeDef Init;
+	HAL_LockTypeDef Lock;
+	__IO HAL_DMA_StateTypeDef State;
+	void *Parent;
+	void (*XferCpltCallback)(struct __DMA_HandleTypeDef *hdma);
+	void (*XferHalfCpltCallback)(struct __DMA_HandleTypeDef *hdma);
+	void (*XferErrorCallback)(struct __DMA_HandleTypeDef *hdma);
+	void (*XferAbortCallback)(struct __DMA_HandleTypeDef *hdma);
+	__IO uint32_t ErrorCode;
+} DMA_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress, uint32_t DataLength);
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+
+#define __HAL_RCC_DMA1_CLK_ENABLE()		((void)0)
+#define __HAL_RCC_DMA2_CLK_ENABLE()		((void)0)
+
+/******************************************************************************
+ * 								I2S
+ *****************************************************************************/
+
+#define I2S_MODE_MASTER_TX				0x00000200U
+#define I2S_STANDARD_PHILIPS			0x00000000U
+#define I2S_STANDARD_MSB				0x00000010U
+#define I2S_STANDARD_LSB				0x00000020U
+#define I2S_DATAFORMAT_16B				0x00000000U
+#define I2S_DATAFORMAT_16B_EXTENDED		0x00000001U
+#define I2S_DATAFORMAT_24B				0x00000003U
+#define I2S_DATAFORMAT_32B				0x00000005U
+#define I2S_MCLKOUTPUT_DISABLE			0x00000000U
+#define I2S_AUDIOFREQ_DEFAULT			2U
+#define I2S_AUDIOFREQ_8K				8000U
+#define I2S_CPOL_LOW					0x00000000U
+#define I2S_CPOL_HIGH					0x00000008U
+#define I2S_CLOCK_PLL					0x00000000U
+#define I2S_FULLDUPLEXMODE_ENABLE		0x00000001U
+
+#define I2S_FLAG_UDR					SPI_SR_UDR
+#define I2S_FLAG_OVR					SPI_SR_OVR
+
+#define HAL_I2S_ERROR_NONE				0x00000000U
+#define HAL_I2S_ERROR_DMA				0x00000008U
+#define HAL_I2S_ERROR_PRESCALER			0x00000010U
+
+typedef enum
+{
+	HAL_I2S_STATE_RESET = 0x00U,
+	HAL_I2S_STATE_READY = 0x01U,
+	HAL_I2S_STATE_BUSY_TX_RX = 0x05U,
+	HAL_I2S_STATE_ERROR = 0x07U
+} HAL_I2S_StateTypeDef;
+
+typedef struct
+{
+	uint32_t Mode;
+	uint32_t Standard;
+	uint32_t DataFormat;
+	uint32_t MCLKOutput;
+	uint32_t AudioFreq;
+	uint32_t CPOL;
+	uint32_t ClockSource;
+	uint32_t FullDuplexMode;
+} I2S_InitTypeDef;
+
+typedef struct __I2S_HandleTypeDef
+{
+	SPI_TypeDef *Instance;
+	I2S_InitTypeDef Init;
+	uint16_t *pTxBuffPtr;
+	uint16_t *pRxBuffPtr;
+	__IO uint16_t TxXferSize;
+	__IO uint16_t RxXferSize;
+	DMA_HandleTypeDef *hdmatx;
+	DMA_HandleTypeDef *hdmarx;
+	__IO HAL_LockTypeDef Lock;
+	__IO HAL_I2S_StateTypeDef State;
+	__IO uint32_t ErrorCode;
+} I2S_HandleTypeDef;
+
+#define __HAL_I2S_ENABLE(__HANDLE__)			SET_BIT((__HANDLE__)->Instance->I2SCFGR, SPI_I2SCFGR_I2SE)
+#define __HAL_I2S_DISABLE(__HANDLE__)			CLEAR_BIT((__HANDLE__)->Instance->I2SCFGR, SPI_I2SCFGR_I2SE)
+#define __HAL_I2SEXT_DISABLE(__HANDLE__)		CLEAR_BIT(I2SxEXT((__HANDLE__)->Instance)->I2SCFGR, SPI_I2SCFGR_I2SE)
+#define __HAL_I2S_GET_FLAG(__HANDLE__, __FLAG__)	((((__HANDLE__)->Instance->SR) & (__FLAG__)) == (__FLAG__))
+#define __HAL_I2SEXT_GET_FLAG(__HANDLE__, __FLAG__)	(((I2SxEXT((__HANDLE__)->Instance)->SR) & (__FLAG__)) == (__FLAG__))
+/* En el chip se borran leyendo DR y SR, aca se borra el bit */
+#define __HAL_I2S_CLEAR_UDRFLAG(__HANDLE__)		CLEAR_BIT((__HANDLE__)->Instance->SR, I2S_FLAG_UDR)
+#define __HAL_I2SEXT_CLEAR_OVRFLAG(__HANDLE__)	CLEAR_BIT(I2SxEXT((__HANDLE__)->Instance)->SR, I2S_FLAG_OVR)
+
+HAL_StatusTypeDef HAL_I2S_Init(I2S_HandleTypeDef *hi2s);
+HAL_StatusTypeDef HAL_I2S_DeInit(I2S_HandleTypeDef *hi2s);
+HAL_StatusTypeDef HAL_I2S_DMAStop(I2S_HandleTypeDef *hi2s);
+HAL_StatusTypeDef HAL_I2SEx_TransmitReceive(I2S_HandleTypeDef *hi2s, uint16_t *pTxData, uint16_t *pRxData,
+		uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2SEx_TransmitReceive_DMA(I2S_HandleTypeDef *hi2s, uint16_t *pTxData, uint16_t *pRxData,
+		uint16_t Size);
+void HAL_I2SEx_TxRxHalfCpltCallback(I2S_HandleTypeDef *hi2s);
+void HAL_I2SEx_TxRxCpltCallback(I2S_HandleTypeDef *hi2s);
+void HAL_I2S_ErrorCallback(I2S_HandleTypeDef *hi2s);
+
+/******************************************************************************
+ * 								I2C
+ *****************************************************************************/
+
+#define I2C_DUTYCYCLE_2					0x00000000U
+#define I2C_DUTYCYCLE_16_9				I2C_CCR_DUTY
+#define I2C_ADDRESSINGMODE_7BIT			0x00004000U
+#define I2C_DUALADDRESS_DISABLE			0x00000000U
+#define I2C_GENERALCALL_DISABLE			0x00000000U
+#define I2C_NOSTRETCH_DISABLE			0x00000000U
+#define I2C_MEMADD_SIZE_8BIT			0x00000001U
+
+#define HAL_I2C_ERROR_NONE				0x00000000U
+#define HAL_I2C_ERROR_AF				0x00000004U
+
+typedef enum
+{
+	HAL_I2C_STATE_RESET = 0x00U,
+	HAL_I2C_STATE_READY = 0x20U,
+	HAL_I2C_STATE_BUSY_TX = 0x21U,
+	HAL_I2C_STATE_BUSY_RX = 0x22U
+} HAL_I2C_StateTypeDef;
+
+typedef struct
+{
+	uint32_t ClockSpeed;
+	uint32_t DutyCycle;
+	uint32_t OwnAddress1;
+	uint32_t AddressingMode;
+	uint32_t DualAddressMode;
+	uint32_t OwnAddress2;
+	uint32_t GeneralCallMode;
+	uint32_t NoStretchMode;
+} I2C_InitTypeDef;
+
+typedef struct __I2C_HandleTypeDef
+{
+	I2C_TypeDef *Instance;
+	I2C_InitTypeDef Init;
+	uint8_t *pBuffPtr;
+	uint16_t XferSize;
+	uint16_t Devaddress;
+	uint16_t Memaddress;
+	HAL_LockTypeDef Lock;
+	__IO HAL_I2C_StateTypeDef State;
+	__IO uint32_t ErrorCode;
+} I2C_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size);
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+
+/******************************************************************************
+ * 								RCC
+ *****************************************************************************/
+
+#define RCC_PERIPHCLK_I2S				0x00000001U
+
+typedef struct
+{
+	uint32_t PLLI2SN;
+	uint32_t PLLI2SR;
+} RCC_PLLI2SInitTypeDef;
+
+typedef struct
+{
+	uint32_t PeriphClockSelection;
+	RCC_PLLI2SInitTypeDef PLLI2S;
+} RCC_PeriphCLKInitTypeDef;
+
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef *PeriphClkInit);
+uint32_t HAL_RCCEx_GetPeriphCLKFreq(uint32_t PeriphClk);
+
+#endif /* SIM_STM32F4XX_HAL_H */
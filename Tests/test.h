@@ -0,0 +1,48 @@
+/**
+ * @file test.h
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Minimal checks for the host test programs.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+/**
+ * Cada programa de Tests/ es un main que corre sus casos con CHECK y
+ * termina con TEST_END: el codigo de salida es distinto de cero si algo
+ * fallo, asi make se detiene.
+ */
+static unsigned test_checks;
+static unsigned test_failures;
+
+#define CHECK(cond)		do { \
+		test_checks++; \
+		if (!(cond)) { \
+			test_failures++; \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		} \
+	} while (0)
+
+#define CHECK_EQ(a, b)	do { \
+		long long check_a = (long long)(a); \
+		long long check_b = (long long)(b); \
+		test_checks++; \
+		if (check_a != check_b) { \
+			test_failures++; \
+			printf("%s:%d: %s == %s failed (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, check_a, check_b); \
+		} \
+	} while (0)
+
+#define TEST_END()		do { \
+		printf("%s: %u checks, %u failed\n", __FILE__, test_checks, test_failures); \
+		return test_failures != 0; \
+	} while (0)
+
+#endif /* TEST_H */
@@ -0,0 +1,228 @@
+/**
+ * @file test_audio_codec.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief G.711 fast vs _ref over every input, IMA-ADPCM golden vectors and lost blocks.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_codec.h"
+#include "test.h"
+#include <string.h>
+
+#define ARRAY_LEN(a)	(sizeof(a) / sizeof((a)[0]))
+
+/******************************************************************************
+ * 								G.711
+ *****************************************************************************/
+
+static int16_t pcm_all[65536];
+static int16_t pcm_all_x2[2 * 65536];
+static uint8_t code_fast[65536];
+static uint8_t code_ref[65536];
+
+/**
+ * Todas las muestras de 16 bits: el encoder rapido tiene que dar el mismo
+ * byte que el _ref, tambien leyendo un canal del periodo intercalado.
+ */
+static void test_g711_encode(void)
+{
+	uint32_t alaw_diff = 0;
+	uint32_t ulaw_diff = 0;
+
+	for (uint32_t i = 0; i < 65536; i++)
+	{
+		pcm_all[i] = (int16_t)(i - 32768);
+		pcm_all_x2[2 * i] = pcm_all[i];
+		pcm_all_x2[2 * i + 1] = (int16_t)~pcm_all[i];
+	}
+
+	audio_codec_alaw_encode(code_fast, pcm_all, 65536, 1);
+	audio_codec_alaw_encode_ref(code_ref, pcm_all, 65536, 1);
+	for (uint32_t i = 0; i < 65536; i++)
+		alaw_diff += code_fast[i] != code_ref[i];
+	audio_codec_alaw_encode(code_fast, pcm_all_x2, 65536, 2);
+	CHECK_EQ(memcmp(code_fast, code_ref, sizeof(code_ref)), 0);
+
+	audio_codec_ulaw_encode(code_fast, pcm_all, 65536, 1);
+	audio_codec_ulaw_encode_ref(code_ref, pcm_all, 65536, 1);
+	for (uint32_t i = 0; i < 65536; i++)
+		ulaw_diff += code_fast[i] != code_ref[i];
+	audio_codec_ulaw_encode(code_fast, pcm_all_x2, 65536, 2);
+	CHECK_EQ(memcmp(code_fast, code_ref, sizeof(code_ref)), 0);
+
+	CHECK_EQ(alaw_diff, 0);
+	CHECK_EQ(ulaw_diff, 0);
+}
+
+/**
+ * Los 256 codigos, contra el _ref y contra valores de la tabla de G.711.
+ */
+static void test_g711_decode(void)
+{
+	uint8_t codes[256];
+	int16_t fast[256];
+	int16_t ref[256];
+	uint8_t again[256];
+
+	for (uint32_t i = 0; i < 256; i++)
+		codes[i] = (uint8_t)i;
+
+	audio_codec_alaw_decode(fast, codes, 256);
+	audio_codec_alaw_decode_ref(ref, codes, 256);
+	CHECK_EQ(memcmp(fast, ref, sizeof(ref)), 0);
+	CHECK_EQ(fast[0xD5], 8);
+	CHECK_EQ(fast[0x55], -8);
+	CHECK_EQ(fast[0xAA], 32256);
+	CHECK_EQ(fast[0x2A], -32256);
+
+	/* Cada valor decodificado vuelve a su codigo */
+	audio_codec_alaw_encode(again, fast, 256, 1);
+	CHECK_EQ(memcmp(again, codes, sizeof(codes)), 0);
+
+	audio_codec_ulaw_decode(fast, codes, 256);
+	audio_codec_ulaw_decode_ref(ref, codes, 256);
+	CHECK_EQ(memcmp(fast, ref, sizeof(ref)), 0);
+	CHECK_EQ(fast[0xFF], 0);
+	CHECK_EQ(fast[0x7F], 0);
+	CHECK_EQ(fast[0x80], 32124);
+	CHECK_EQ(fast[0x00], -32124);
+
+	/* u-law tiene dos ceros (0xFF y 0x7F), el encoder elige el positivo */
+	audio_codec_ulaw_encode(again, fast, 256, 1);
+	again[0x7F] = 0x7F;
+	CHECK_EQ(memcmp(again, codes, sizeof(codes)), 0);
+}
+
+/******************************************************************************
+ * 								IMA-ADPCM
+ *****************************************************************************/
+
+/**
+ * Vectores del codificador de referencia de la IMA / DVI (adpcm.c de
+ * Jack Jansen) con el orden de nibbles de los WAV, desde silencio. Pasan
+ * por la saturacion en los dos extremos y por el indice 88.
+ */
+static const int16_t adpcm_input[] =
+{
+	0, 0, 64, -64, 500, 1000, 2000, 4000, 8000, 16000, 32767, 32767, 32767, 20000, 0, -20000,
+	-32768, -32768, -32768, -10000, -1000, -100, -10, 0, 7, -7, 300, -300, 12345, -12345, 0, 0, 0,
+};
+
+static const uint8_t adpcm_golden[] =
+{
+	0x00, 0xF7, 0x77, 0x77, 0x77, 0x77, 0xB2, 0xBE, 0x8A, 0x50, 0x01, 0x08, 0x08, 0x08, 0xF4, 0x01, 0x08,
+};
+
+static const int16_t adpcm_decoded[] =
+{
+	0, 0, 11, -19, 44, 180, 473, 1104, 2461, 5371, 11607, 24979, 32767, 20607, 76, -19510,
+	-32228, -32768, -30666, -9644, -1250, 1293, -1019, 1083, -828, 909, -670, 765, 12512, -11177, -1021, 2056, -742,
+};
+
+static void test_adpcm_golden(void)
+{
+	audio_codec_adpcm_t enc;
+	audio_codec_adpcm_t dec;
+	uint8_t code[ARRAY_LEN(adpcm_golden)];
+	int16_t pcm[ARRAY_LEN(adpcm_input)];
+	int16_t stereo[2 * ARRAY_LEN(adpcm_input)];
+	uint32_t samples = ARRAY_LEN(adpcm_input);
+
+	audio_codec_adpcm_init(&enc);
+	CHECK_EQ(audio_codec_adpcm_encode(&enc, code, adpcm_input, samples, 1), sizeof(adpcm_golden));
+	CHECK_EQ(memcmp(code, adpcm_golden, sizeof(code)), 0);
+	CHECK_EQ(enc.predictor, -742);
+	CHECK_EQ(enc.index, 83);
+
+	audio_codec_adpcm_init(&dec);
+	audio_codec_adpcm_decode(&dec, pcm, adpcm_golden, samples);
+	CHECK_EQ(memcmp(pcm, adpcm_decoded, sizeof(pcm)), 0);
+	CHECK_EQ(dec.predictor, enc.predictor);
+	CHECK_EQ(dec.index, enc.index);
+
+	/* Un canal del periodo intercalado, el otro no tiene que influir */
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		stereo[2 * i] = adpcm_input[i];
+		stereo[2 * i + 1] = INT16_MIN;
+	}
+	audio_codec_adpcm_init(&enc);
+	memset(code, 0xFF, sizeof(code));
+	audio_codec_adpcm_encode(&enc, code, stereo, samples, 2);
+	CHECK_EQ(memcmp(code, adpcm_golden, sizeof(code)), 0);
+
+	/* Partido en dos llamadas, con un numero par en la primera, da lo mismo */
+	audio_codec_adpcm_init(&enc);
+	audio_codec_adpcm_encode(&enc, code, adpcm_input, 10, 1);
+	audio_codec_adpcm_encode(&enc, code + 5, adpcm_input + 10, samples - 10, 1);
+	CHECK_EQ(memcmp(code, adpcm_golden, sizeof(code)), 0);
+}
+
+#define BLOCK_SAMPLES	32
+#define BLOCKS			8
+
+/**
+ * Bloques con el estado en el header: si se pierde uno, los siguientes
+ * decodifican igual que con el stream completo.
+ */
+static void test_adpcm_blocks(void)
+{
+	static int16_t pcm[BLOCKS * BLOCK_SAMPLES];
+	static int16_t full[BLOCKS * BLOCK_SAMPLES];
+	static uint8_t block[BLOCKS][AUDIO_CODEC_ADPCM_BLOCK_BYTES(BLOCK_SAMPLES)];
+	int16_t out[BLOCK_SAMPLES];
+	audio_codec_adpcm_t enc;
+	audio_codec_adpcm_t dec;
+	uint32_t seed = 1;
+
+	/* Ruido con una rampa, para que el indice se mueva entre bloques */
+	for (uint32_t i = 0; i < BLOCKS * BLOCK_SAMPLES; i++)
+	{
+		seed = seed * 1103515245U + 12345U;
+		pcm[i] = (int16_t)((int32_t)(i * 200) - 25000 + (int32_t)((seed >> 16) & 0x3FF) - 512);
+	}
+
+	audio_codec_adpcm_init(&enc);
+	for (uint32_t b = 0; b < BLOCKS; b++)
+		CHECK_EQ(audio_codec_adpcm_encode_block(&enc, block[b], pcm + b * BLOCK_SAMPLES, BLOCK_SAMPLES, 1),
+				sizeof(block[b]));
+
+	/* Referencia: el stream entero decodificado con un solo estado */
+	audio_codec_adpcm_init(&dec);
+	for (uint32_t b = 0; b < BLOCKS; b++)
+		audio_codec_adpcm_decode(&dec, full + b * BLOCK_SAMPLES, block[b] + AUDIO_CODEC_ADPCM_HEADER, BLOCK_SAMPLES);
+
+	/* Se pierden los bloques 2, 3 y 6 */
+	for (uint32_t b = 0; b < BLOCKS; b++)
+	{
+		if (b == 2 || b == 3 || b == 6)
+			continue;
+
+		memset(out, 0, sizeof(out));
+		CHECK(audio_codec_adpcm_decode_block(out, block[b], BLOCK_SAMPLES));
+		CHECK_EQ(memcmp(out, full + b * BLOCK_SAMPLES, sizeof(out)), 0);
+	}
+
+	/* Header con indice fuera de la tabla o el byte reservado puesto */
+	block[1][2] = 89;
+	CHECK(!audio_codec_adpcm_decode_block(out, block[1], BLOCK_SAMPLES));
+	block[1][2] = 0;
+	block[1][3] = 1;
+	CHECK(!audio_codec_adpcm_decode_block(out, block[1], BLOCK_SAMPLES));
+}
+
+int main(void)
+{
+	audio_codec_init();
+
+	test_g711_encode();
+	test_g711_decode();
+	test_adpcm_golden();
+	test_adpcm_blocks();
+
+	TEST_END();
+}
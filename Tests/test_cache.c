@@ -0,0 +1,226 @@
+/**
+ * @file test_cache.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Register cache of the driver: bus transactions with and without CONFIG_ES8311_REG_CACHE.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "es8311.h"
+#include "sim.h"
+#include "sim_es8311.h"
+#include "test.h"
+
+/**
+ * Transacciones contra el codec recien reseteado. El Makefile arma este
+ * test dos veces (test_cache y test_cache_off), cada uno controla la suya.
+ *
+ * ES8311_init vacia el cache y sus secuencias solo escriben: cuesta lo
+ * mismo con o sin cache. La diferencia esta en el control despues.
+ */
+#define INIT_TRANSFERS				16
+#define CONTROL_TRANSFERS_CACHED	3
+#define CONTROL_TRANSFERS_UNCACHED	13
+
+#define CACHED(on, off)		(CONFIG_ES8311_REG_CACHE ? (on) : (off))
+
+static sim_es8311_t codec;
+
+static bool codec_init(void)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+
+	sim_reset();
+	sim_es8311_init(&codec);
+	sim_es8311_attach(&codec);
+	return ES8311_init(&config);
+}
+
+static uint32_t transfers(void)
+{
+	return sim_stats()->i2c_transfers;
+}
+
+/**
+ * Con cache, cada operacion que no salio al bus es un acierto o una
+ * escritura salteada contada: la diferencia entre las dos cuentas.
+ */
+static void test_transfers(void)
+{
+	uint8_t value;
+	uint32_t mark;
+#if CONFIG_ES8311_REG_CACHE
+	es8311_cache_stats_t before = *ES8311_cache_stats();
+#endif
+
+	CHECK(codec_init());
+	CHECK_EQ(transfers(), INIT_TRANSFERS);
+#if CONFIG_ES8311_REG_CACHE
+	CHECK_EQ(ES8311_cache_stats()->read_hits, before.read_hits);
+	CHECK_EQ(ES8311_cache_stats()->write_skips, before.write_skips);
+#endif
+
+	/* Lo que hace la aplicacion despues: mute, auriculares, volumen */
+	mark = transfers();
+	CHECK(ES8311_dac_mute(true));
+	CHECK(ES8311_dac_mute(false));
+	CHECK(ES8311_dac_mute(false));
+	CHECK(ES8311_hp_enable(true));
+	CHECK(ES8311_hp_enable(true));
+	CHECK(ES8311_I2C_write(ES8311_DAC_REG32, 0xA0));
+	CHECK(ES8311_I2C_write(ES8311_DAC_REG32, 0xA0));
+	CHECK(ES8311_I2C_read(ES8311_DAC_REG32, &value));
+	CHECK_EQ(value, 0xA0);
+
+	printf("cache %s: ES8311_init %lu transfers, control %lu transfers\n", CONFIG_ES8311_REG_CACHE ? "on" : "off",
+			(unsigned long)mark, (unsigned long)(transfers() - mark));
+
+	CHECK_EQ(transfers() - mark, CACHED(CONTROL_TRANSFERS_CACHED, CONTROL_TRANSFERS_UNCACHED));
+	CHECK(CONTROL_TRANSFERS_CACHED < CONTROL_TRANSFERS_UNCACHED);
+#if CONFIG_ES8311_REG_CACHE
+	CHECK_EQ(transfers() + ES8311_cache_stats()->read_hits - before.read_hits +
+			ES8311_cache_stats()->write_skips - before.write_skips,
+			INIT_TRANSFERS + CONTROL_TRANSFERS_UNCACHED);
+#endif
+}
+
+/**
+ * Escribir el valor que el registro ya tiene no sale al bus.
+ */
+static void test_write_skip(void)
+{
+	uint8_t value;
+	uint32_t mark;
+
+	CHECK(codec_init());
+	value = codec.reg[ES8311_ADC_REG17] ^ 0x10;
+
+	mark = transfers();
+	CHECK(ES8311_I2C_write(ES8311_ADC_REG17, value));
+	CHECK_EQ(transfers(), mark + 1);
+
+#if CONFIG_ES8311_REG_CACHE
+	uint32_t skips = ES8311_cache_stats()->write_skips;
+#endif
+	CHECK(ES8311_I2C_write(ES8311_ADC_REG17, value));
+	CHECK_EQ(transfers(), mark + CACHED(1, 2));
+#if CONFIG_ES8311_REG_CACHE
+	CHECK_EQ(ES8311_cache_stats()->write_skips, skips + 1);
+#endif
+	CHECK_EQ(codec.reg[ES8311_ADC_REG17], value);
+}
+
+/**
+ * La segunda lectura de un registro comun sale de RAM: si el codec lo
+ * cambia por su cuenta no se ve. REG00 es volatil, siempre va al bus.
+ */
+static void test_read_hit(void)
+{
+	uint8_t first;
+	uint8_t second;
+	uint32_t mark;
+
+	CHECK(codec_init());
+
+	CHECK(ES8311_I2C_read(ES8311_ADC_REG17, &first));
+	mark = transfers();
+#if CONFIG_ES8311_REG_CACHE
+	uint32_t hits = ES8311_cache_stats()->read_hits;
+#endif
+	codec.reg[ES8311_ADC_REG17] = first ^ 0x01;
+	CHECK(ES8311_I2C_read(ES8311_ADC_REG17, &second));
+	CHECK_EQ(transfers(), mark + CACHED(0, 1));
+	CHECK_EQ(second, CACHED(first, first ^ 0x01));
+#if CONFIG_ES8311_REG_CACHE
+	CHECK_EQ(ES8311_cache_stats()->read_hits, hits + 1);
+#endif
+
+	mark = transfers();
+	CHECK(ES8311_I2C_read(ES8311_RESET_REG00, &first));
+	codec.reg[ES8311_RESET_REG00] ^= CSM_ON;
+	CHECK(ES8311_I2C_read(ES8311_RESET_REG00, &second));
+	CHECK_EQ(transfers(), mark + 2);
+	CHECK_EQ(second, first ^ CSM_ON);
+}
+
+/**
+ * Los read-modify-write de la API no leen el bus una vez que el registro
+ * esta en el cache, y repetir el mismo estado no transmite nada.
+ */
+static void test_update(void)
+{
+	uint32_t reads;
+	uint32_t writes;
+
+	CHECK(codec_init());
+
+	/* El primero puede tener que leer, despues el registro queda conocido */
+	CHECK(ES8311_dac_mute(false));
+	CHECK(ES8311_hp_enable(false));
+
+	reads = codec.reads;
+	writes = codec.writes;
+	CHECK(ES8311_dac_mute(true));
+	CHECK(ES8311_hp_enable(true));
+	CHECK_EQ(codec.reads, reads + CACHED(0, 2));
+	CHECK_EQ(codec.writes, writes + 2);
+	CHECK(codec.reg[ES8311_SDPIN_REG09] & SDP_IN_MUTE);
+	CHECK(codec.reg[ES8311_SYSTEM_REG13] & HPSW);
+
+	reads = codec.reads;
+	writes = codec.writes;
+	CHECK(ES8311_dac_mute(true));
+	CHECK(ES8311_hp_enable(true));
+	CHECK_EQ(codec.reads, reads + CACHED(0, 2));
+	CHECK_EQ(codec.writes, writes + CACHED(0, 2));
+}
+
+/**
+ * Una escritura que fallo deja el registro en un estado desconocido: la
+ * misma escritura despues vuelve a salir y una lectura va al bus.
+ */
+static void test_failed_write(void)
+{
+	uint8_t before;
+	uint8_t value;
+	uint8_t read;
+	uint32_t mark;
+
+	CHECK(codec_init());
+	before = codec.reg[ES8311_ADC_REG17];
+	value = before ^ 0x20;
+
+	/* Nadie contesta en el bus */
+	sim_i2c_attach(NULL);
+	CHECK(!ES8311_I2C_write(ES8311_ADC_REG17, value));
+	sim_es8311_attach(&codec);
+	CHECK_EQ(codec.reg[ES8311_ADC_REG17], before);
+
+	mark = transfers();
+	CHECK(ES8311_I2C_write(ES8311_ADC_REG17, value));
+	CHECK_EQ(transfers(), mark + 1);
+	CHECK_EQ(codec.reg[ES8311_ADC_REG17], value);
+
+	sim_i2c_attach(NULL);
+	CHECK(!ES8311_I2C_write(ES8311_ADC_REG17, before));
+	sim_es8311_attach(&codec);
+
+	mark = transfers();
+	CHECK(ES8311_I2C_read(ES8311_ADC_REG17, &read));
+	CHECK_EQ(transfers(), mark + 1);
+	CHECK_EQ(read, value);
+}
+
+int main(void)
+{
+	test_transfers();
+	test_write_skip();
+	test_read_hit();
+	test_update();
+	test_failed_write();
+
+	TEST_END();
+}
@@ -0,0 +1,264 @@
+/**
+ * @file test_capture.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief audio_capture into a pseudo terminal, Tools/capture_wav on the other end.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include "audio_capture.h"
+#include "audio_codec.h"
+#include "test.h"
+#include <fcntl.h>
+#include <libgen.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define CAPTURE_RATE		22050
+#define CAPTURE_FRAMES		12			//<--- Frames generated per format
+#define CAPTURE_CORRUPT		3			//<--- Goes out with a byte changed, the CRC has to reject it
+#define CAPTURE_LOST		7			//<--- The sink has no room for it, a hole in the sequence
+#define CAPTURE_PERIOD		32			//<--- Frames per RX period, as in main.c
+
+/**
+ * La placa escribe en el master del pty como en la UART y capture_wav lee
+ * el slave como si fuera el puerto serie (lo pone en raw a 921600). Cada
+ * frame que sale se decodifica aca con audio_codec para saber que tiene
+ * que quedar en el WAV; los que no llegan quedan en silencio (-g).
+ */
+typedef struct
+{
+	int master;
+	uint32_t frame;				//<--- Frames seen by the sink
+	int16_t expected[CAPTURE_FRAMES * AUDIO_CAPTURE_FRAME_SAMPLES];
+} capture_test_t;
+
+static capture_test_t ct;
+
+static bool write_all(int fd, const void *data, size_t len)
+{
+	const char *p = data;
+
+	while (len > 0)
+	{
+		ssize_t n = write(fd, p, len);
+
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= (size_t)n;
+	}
+	return true;
+}
+
+/**
+ * @brief What the WAV has to hold for one frame, from the firmware decoders.
+ */
+static void expect_frame(uint32_t index, const uint8_t *frame)
+{
+	const uint8_t *payload = frame + AUDIO_CAPTURE_HEADER_BYTES;
+	uint32_t samples = frame[8] | (frame[9] << 8);
+	int16_t *dst = &ct.expected[index * AUDIO_CAPTURE_FRAME_SAMPLES];
+
+	switch (frame[2])
+	{
+	case AUDIO_CAPTURE_ADPCM:
+		audio_codec_adpcm_decode_block(dst, payload, samples);
+		break;
+	case AUDIO_CAPTURE_ALAW:
+		audio_codec_alaw_decode(dst, payload, samples);
+		break;
+	case AUDIO_CAPTURE_ULAW:
+		audio_codec_ulaw_decode(dst, payload, samples);
+		break;
+	default:
+		for (uint32_t i = 0; i < samples; i++)
+			dst[i] = (int16_t)(payload[2 * i] | (payload[2 * i + 1] << 8));
+		break;
+	}
+}
+
+static bool capture_sink(const char *data, uint32_t len)
+{
+	static const char text[] = "es8311: printf in between frames\r\n";
+	char frame[AUDIO_CAPTURE_HEADER_BYTES + 2 * AUDIO_CAPTURE_FRAME_SAMPLES + AUDIO_CAPTURE_CRC_BYTES];
+	uint32_t index = ct.frame++;
+
+	if (index == CAPTURE_LOST)
+		return false;
+
+	memcpy(frame, data, len);
+	if (index == CAPTURE_CORRUPT)
+		frame[AUDIO_CAPTURE_HEADER_BYTES + 5] ^= 0x10;
+	else
+		expect_frame(index, (const uint8_t *)data);
+
+	return write_all(ct.master, frame, len) && (index % 4 != 1 || write_all(ct.master, text, sizeof(text) - 1));
+}
+
+/**
+ * @brief Wait until capture_wav put the slave in raw mode and flushed it.
+ */
+static bool wait_raw(int master)
+{
+	struct termios tio;
+
+	for (int i = 0; i < 200; i++)
+	{
+		if (tcgetattr(master, &tio) == 0 && cfgetispeed(&tio) == B921600 && !(tio.c_lflag & ICANON))
+		{
+			usleep(50000);
+			return true;
+		}
+		usleep(10000);
+	}
+	return false;
+}
+
+static bool wait_child(pid_t pid, int *status)
+{
+	for (int i = 0; i < 500; i++)
+	{
+		if (waitpid(pid, status, WNOHANG) == pid)
+			return true;
+		usleep(10000);
+	}
+
+	kill(pid, SIGKILL);
+	waitpid(pid, status, 0);
+	return false;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+	return (uint32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static unsigned long report_value(const char *report, const char *key)
+{
+	const char *p = strstr(report, key);
+
+	return p != NULL ? strtoul(p + strlen(key), NULL, 10) : ~0UL;
+}
+
+static void test_capture(const char *tool, audio_capture_format_t format)
+{
+	static uint16_t rx[2 * CAPTURE_PERIOD];
+	static uint8_t wav[44 + sizeof(ct.expected) + 1];
+	char wav_path[] = "/tmp/test_capture_XXXXXX";
+	char report_path[] = "/tmp/test_capture_XXXXXX";
+	char seconds[32];
+	char report[1024] = { 0 };
+	uint32_t samples = CAPTURE_FRAMES * AUDIO_CAPTURE_FRAME_SAMPLES;
+	int wav_fd = mkstemp(wav_path);
+	int report_fd = mkstemp(report_path);
+	size_t wav_len;
+	pid_t pid;
+	int status = -1;
+	FILE *fp;
+
+	CHECK(wav_fd >= 0 && report_fd >= 0);
+	memset(&ct, 0, sizeof(ct));
+
+	ct.master = posix_openpt(O_RDWR | O_NOCTTY);
+	CHECK(ct.master >= 0);
+	CHECK(grantpt(ct.master) == 0 && unlockpt(ct.master) == 0);
+
+	/* Frena justo despues del ultimo frame, con los perdidos en silencio */
+	snprintf(seconds, sizeof(seconds), "%.9f", (samples - 0.5) / CAPTURE_RATE);
+	pid = fork();
+	if (pid == 0)
+	{
+		dup2(report_fd, STDOUT_FILENO);
+		dup2(report_fd, STDERR_FILENO);
+		execl(tool, tool, "-g", "-s", seconds, ptsname(ct.master), wav_path, (char *)NULL);
+		_exit(127);
+	}
+	CHECK(pid > 0);
+	CHECK(wait_raw(ct.master));
+
+	/* Canal izquierdo: rampa con signo alternado, el derecho no tiene que aparecer */
+	audio_capture_init(CAPTURE_RATE, 1, format, capture_sink);
+	for (uint32_t n = 0; n < samples / CAPTURE_PERIOD; n++)
+	{
+		for (uint32_t i = 0; i < CAPTURE_PERIOD; i++)
+		{
+			int32_t v = (int32_t)((n * CAPTURE_PERIOD + i) * 37) % 30000;
+
+			rx[2 * i] = (uint16_t)(int16_t)((i & 1) ? -v : v);
+			rx[2 * i + 1] = 0x7FFF;
+		}
+		audio_capture_period(rx, CAPTURE_PERIOD);
+	}
+
+	CHECK(wait_child(pid, &status));
+	close(ct.master);
+	close(wav_fd);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	CHECK_EQ(audio_capture_stats()->frames, CAPTURE_FRAMES - 1);
+	CHECK_EQ(audio_capture_stats()->dropped, 1);
+
+	/* Lo que informa capture_wav: el corrupto por CRC, los dos como hueco de secuencia */
+	lseek(report_fd, 0, SEEK_SET);
+	fp = fdopen(report_fd, "r");
+	CHECK(fp != NULL && fread(report, 1, sizeof(report) - 1, fp) > 0);
+	CHECK_EQ(report_value(report, "frames      "), CAPTURE_FRAMES - 2);
+	CHECK_EQ(report_value(report, "dropped     "), 2);
+	CHECK(report_value(report, "crc_errors  ") >= 1);
+	CHECK(strstr(report, "# 1 frames lost before 4") != NULL);
+	CHECK(strstr(report, "# 1 frames lost before 8") != NULL);
+	fclose(fp);
+
+	fp = fopen(wav_path, "rb");
+	CHECK(fp != NULL);
+	wav_len = fp != NULL ? fread(wav, 1, sizeof(wav), fp) : 0;
+	if (fp != NULL)
+		fclose(fp);
+
+	CHECK_EQ(wav_len, 44 + 2 * samples);
+	CHECK(memcmp(wav, "RIFF", 4) == 0 && memcmp(wav + 8, "WAVEfmt ", 8) == 0 && memcmp(wav + 36, "data", 4) == 0);
+	CHECK_EQ(wav[20] | (wav[21] << 8), 1);
+	CHECK_EQ(wav[22] | (wav[23] << 8), 1);
+	CHECK_EQ(le32(wav + 24), CAPTURE_RATE);
+	CHECK_EQ(wav[34] | (wav[35] << 8), 16);
+	CHECK_EQ(le32(wav + 40), 2 * samples);
+	CHECK_EQ(le32(wav + 4), 36 + 2 * samples);
+
+	if (wav_len == 44 + 2 * samples)
+	{
+		uint32_t diff = 0;
+
+		for (uint32_t i = 0; i < samples; i++)
+			diff += (int16_t)(wav[44 + 2 * i] | (wav[45 + 2 * i] << 8)) != ct.expected[i];
+		CHECK_EQ(diff, 0);
+	}
+
+	unlink(wav_path);
+	unlink(report_path);
+}
+
+int main(int argc, char **argv)
+{
+	char tool[4096];
+
+	(void)argc;
+	snprintf(tool, sizeof(tool), "%s/capture_wav", dirname(strdup(argv[0])));
+	audio_codec_init();
+
+	test_capture(tool, AUDIO_CAPTURE_PCM16);
+	test_capture(tool, AUDIO_CAPTURE_ADPCM);
+	test_capture(tool, AUDIO_CAPTURE_ALAW);
+	test_capture(tool, AUDIO_CAPTURE_ULAW);
+
+	TEST_END();
+}
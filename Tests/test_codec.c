@@ -0,0 +1,657 @@
+/**
+ * @file test_codec.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief ES8311_init against the register model: transactions, bus time and failure paths.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_loop.h"
+#include "es8311.h"
+#include "sim.h"
+#include "sim_es8311.h"
+#include "test.h"
+#include <math.h>
+#include <string.h>
+
+#define ARRAY_LEN(a)	(sizeof(a) / sizeof((a)[0]))
+
+static sim_es8311_t codec;
+
+/**
+ * @brief Power on the board with the codec in reset state and run ES8311_init.
+ *
+ * @param bus bus usage of ES8311_init as the driver counts it
+ */
+static bool codec_init(uint32_t max_scl_hz, es8311_bus_usage_t *bus)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+	es8311_bus_usage_t mark;
+	bool ok;
+
+	sim_reset();
+	sim_es8311_init(&codec);
+	codec.max_scl_hz = max_scl_hz;
+	sim_es8311_attach(&codec);
+
+	ES8311_bus_usage(&mark);
+	ok = ES8311_init(&config);
+	ES8311_bus_usage_since(&mark, bus);
+
+	return ok;
+}
+
+static void codec_report(const char *name, const es8311_bus_usage_t *bus)
+{
+	printf("%s: ES8311_init at %lu Hz SCL, %lu transfers (%lu bytes, %lu errors), %lu us of bus"
+			" (sim: %lu transfers, %llu us)\n", name, (unsigned long)ES8311_I2C_clock_hz(),
+			(unsigned long)bus->transfers, (unsigned long)bus->bytes, (unsigned long)bus->errors,
+			(unsigned long)bus->bus_us, (unsigned long)sim_stats()->i2c_transfers,
+			(unsigned long long)(sim_stats()->i2c_bus_ns / 1000));
+}
+
+/**
+ * El codec contesta a 400 kHz: el driver queda en fast mode y el tiempo
+ * de bus que cuenta coincide con el del simulador (redondea para arriba
+ * cada transaccion a us).
+ */
+static void test_init_fast(void)
+{
+	es8311_bus_usage_t bus;
+	uint64_t sim_us;
+
+	CHECK(codec_init(0, &bus));
+	codec_report("fast", &bus);
+
+	CHECK_EQ(sim_i2c_scl_hz(), ES8311_I2C_FAST_HZ);
+	CHECK_EQ(ES8311_I2C_clock_hz(), ES8311_I2C_FAST_HZ);
+	CHECK_EQ(bus.transfers, sim_stats()->i2c_transfers);
+	CHECK_EQ(bus.errors, 0);
+	CHECK_EQ(sim_stats()->i2c_nacks, 0);
+
+	sim_us = sim_stats()->i2c_bus_ns / 1000;
+	CHECK(bus.bus_us >= sim_us);
+	CHECK(bus.bus_us <= sim_us + bus.transfers);
+
+	/* Reset, CSM encendida y lo que escribieron las secuencias */
+	CHECK_EQ(codec.resets, 1);
+	CHECK_EQ(codec.ignored, 0);
+	CHECK(codec.reg[ES8311_RESET_REG00] & CSM_ON);
+	CHECK_EQ(codec.reg[ES8311_SDPIN_REG09], SDP_IN_WL_16BIT);
+	CHECK_EQ(codec.reg[ES8311_SDPOUT_REG0A], SDP_OUT_WL_16BIT);
+	CHECK_EQ(codec.reg[ES8311_DAC_REG32], DAC_VOL_HALF_DB(ES8311_DAC_VOL_INIT_HALF_DB));
+	CHECK_EQ(codec.reg[ES8311_CHIP_ID1], ES8311_DEFAULT_ID1);
+	CHECK_EQ(codec.reg[ES8311_CHIP_ID2], ES8311_DEFAULT_ID2);
+}
+
+/**
+ * Bus lento: la prueba de los ID a 400 kHz falla y el driver vuelve a
+ * 100 kHz, el init termina bien con un error en la cuenta.
+ */
+static void test_init_standard(void)
+{
+	es8311_bus_usage_t bus;
+	uint64_t sim_us;
+
+	CHECK(codec_init(ES8311_I2C_STD_HZ, &bus));
+	codec_report("standard", &bus);
+
+	CHECK_EQ(sim_i2c_scl_hz(), ES8311_I2C_STD_HZ);
+	CHECK_EQ(ES8311_I2C_clock_hz(), ES8311_I2C_STD_HZ);
+	CHECK_EQ(bus.transfers, sim_stats()->i2c_transfers);
+	CHECK_EQ(bus.errors, 1);
+	CHECK_EQ(sim_stats()->i2c_nacks, 1);
+
+	/* El NACK de la prueba dura menos en el bus que la lectura que cuenta el driver */
+	sim_us = sim_stats()->i2c_bus_ns / 1000;
+	CHECK(bus.bus_us >= sim_us);
+	CHECK(codec.reg[ES8311_RESET_REG00] & CSM_ON);
+}
+
+static void test_init_errors(void)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+
+	/* Nada en el bus */
+	sim_reset();
+	CHECK(!ES8311_init(&config));
+	CHECK(sim_stats()->i2c_transfers > 0);
+	CHECK_EQ(sim_stats()->i2c_nacks, sim_stats()->i2c_transfers);
+
+	/* Otro chip en la direccion del codec */
+	sim_reset();
+	sim_es8311_init(&codec);
+	codec.reg[ES8311_CHIP_ID2] = 0x10;
+	sim_es8311_attach(&codec);
+	CHECK(!ES8311_init(&config));
+	CHECK_EQ(codec.resets, 0);
+
+	/* Configuracion invalida: no se toca el bus */
+	config.period_count = 0;
+	sim_reset();
+	CHECK(!ES8311_init(&config));
+	CHECK_EQ(sim_stats()->i2c_transfers, 0);
+
+	/* Un prefill que no entra en el ring tampoco */
+	config.period_count = ES8311_PERIOD_COUNT_MAX + 1;
+	sim_reset();
+	CHECK(!ES8311_init(&config));
+	CHECK_EQ(sim_stats()->i2c_transfers, 0);
+}
+
+typedef struct
+{
+	uint8_t value;
+	bool ok;
+} read_result_t;
+
+static void read_done(uint8_t reg, uint8_t value, bool ok, void *ctx)
+{
+	read_result_t *result = ctx;
+
+	(void)reg;
+	result->value = value;
+	result->ok = ok;
+}
+
+/**
+ * Una lectura que fallo queda en el log con valor 0, no con lo que habia
+ * en el buffer de destino (bloqueante) o de la lectura anterior (cola).
+ */
+static void test_read_error(void)
+{
+	es8311_bus_usage_t bus;
+	const es8311_bus_log_t *log = ES8311_bus_log();
+	read_result_t result = { 0 };
+	uint8_t value = 0xA5;
+
+	CHECK(codec_init(0, &bus));
+	CHECK(ES8311_async_read(ES8311_RESET_REG00, read_done, &result));
+	CHECK(ES8311_async_wait(10));
+	CHECK(result.ok);
+	CHECK(result.value != 0);
+
+	ES8311_bus_log_clear();
+	sim_i2c_attach(NULL);
+	CHECK(!ES8311_I2C_read(ES8311_RESET_REG00, &value));
+	CHECK(ES8311_async_read(ES8311_RESET_REG00, read_done, &result));
+	CHECK(ES8311_async_wait(10));
+	sim_es8311_attach(&codec);
+
+	CHECK(!result.ok);
+	CHECK_EQ(log->transfers, 2);
+	CHECK_EQ(log->errors, 2);
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		CHECK(log->xfer[i].read);
+		CHECK(!log->xfer[i].ok);
+		CHECK_EQ(log->xfer[i].reg, ES8311_RESET_REG00);
+		CHECK_EQ(log->xfer[i].value, 0);
+	}
+}
+
+/**
+ * Los limites de la configuracion y el cambio de palabra: el buffer del
+ * DMA no cambia, con dos medias palabras por muestra entran la mitad de
+ * los frames.
+ */
+static void test_config(void)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+	uint16_t length = ES8311_config_buffer_length(&config);
+
+	CHECK(ES8311_config_valid(&config));
+	config.period_count = 1;
+	CHECK(!ES8311_config_valid(&config));
+	config.period_count = ES8311_PERIOD_COUNT_MAX;
+	CHECK(ES8311_config_valid(&config));
+	config.period_count = ES8311_PERIOD_COUNT_MAX + 1;
+	CHECK(!ES8311_config_valid(&config));
+
+	config.period_count = ES8311_PERIOD_COUNT_MAX;
+	sim_reset();
+	sim_es8311_init(&codec);
+	sim_es8311_attach(&codec);
+	CHECK(ES8311_init(&config));
+	CHECK(audio_loop_start(&config, NULL, NULL));
+
+	ES8311_config_word_length(&config, ES8311_WORD_32);
+	CHECK_EQ(config.word_length, ES8311_WORD_32);
+	CHECK_EQ(config.period_frames, BUFFER_LENGHT / 4 / ES8311_I2S_CHANNELS);
+	CHECK_EQ(ES8311_config_buffer_length(&config), length);
+	CHECK(ES8311_config_valid(&config));
+
+	ES8311_config_word_length(&config, ES8311_WORD_24);
+	CHECK_EQ(config.period_frames, BUFFER_LENGHT / 4 / ES8311_I2S_CHANNELS);
+	ES8311_config_word_length(&config, ES8311_WORD_16);
+	CHECK_EQ(config.period_frames, BUFFER_LENGHT / 2 / ES8311_I2S_CHANNELS);
+	CHECK_EQ(ES8311_config_buffer_length(&config), length);
+}
+
+static void async_done(uint8_t reg, uint8_t value, bool ok, void *ctx)
+{
+	uint32_t *calls = ctx;
+
+	(void)reg;
+	(void)value;
+	if (ok)
+		(*calls)++;
+}
+
+/**
+ * La cola por interrupcion termina cuando el simulador entrega la IRQ
+ * del I2C (desde HAL_GetTick mientras ES8311_async_wait espera).
+ */
+static void test_async(void)
+{
+	es8311_bus_usage_t bus;
+	uint32_t calls = 0;
+	uint32_t transfers;
+
+	CHECK(codec_init(0, &bus));
+	transfers = sim_stats()->i2c_transfers;
+
+	CHECK(ES8311_async_write(ES8311_DAC_REG32, 0x80, async_done, &calls));
+	CHECK(ES8311_async_write(ES8311_ADC_REG17, 0x90, async_done, &calls));
+	CHECK_EQ(codec.reg[ES8311_DAC_REG32], DAC_VOL_HALF_DB(ES8311_DAC_VOL_INIT_HALF_DB));
+	CHECK(ES8311_async_wait(10));
+
+	CHECK_EQ(calls, 2);
+	CHECK_EQ(ES8311_async_pending(), 0);
+	CHECK_EQ(codec.reg[ES8311_DAC_REG32], 0x80);
+	CHECK_EQ(codec.reg[ES8311_ADC_REG17], 0x90);
+	CHECK_EQ(sim_stats()->i2c_transfers, transfers + 2);
+}
+
+/**
+ * Lo que llega a los callbacks de la cola, en orden.
+ */
+typedef struct
+{
+	uint32_t count;
+	uint8_t reg[ES8311_ASYNC_QUEUE_SIZE];
+	uint8_t value[ES8311_ASYNC_QUEUE_SIZE];
+	bool ok[ES8311_ASYNC_QUEUE_SIZE];
+} async_calls_t;
+
+static void async_record(uint8_t reg, uint8_t value, bool ok, void *ctx)
+{
+	async_calls_t *calls = ctx;
+
+	if (calls->count < ES8311_ASYNC_QUEUE_SIZE)
+	{
+		calls->reg[calls->count] = reg;
+		calls->value[calls->count] = value;
+		calls->ok[calls->count] = ok;
+	}
+	calls->count++;
+}
+
+/**
+ * @brief Codec ready and bus log empty.
+ *
+ * @param busy put a write of B on the bus first, the next writes wait in the queue.
+ */
+static void async_start(async_calls_t *calls, bool busy)
+{
+	es8311_bus_usage_t bus;
+
+	CHECK(codec_init(0, &bus));
+	memset(calls, 0, sizeof(*calls));
+	ES8311_bus_log_clear();
+	if (busy)
+		CHECK(ES8311_async_write(ES8311_ADC_REG17, 0x90, NULL, NULL));
+}
+
+static void check_xfer(uint32_t i, uint8_t reg, uint8_t value)
+{
+	const es8311_bus_xfer_t *xfer = &ES8311_bus_log()->xfer[i];
+
+	CHECK_EQ(xfer->reg, reg);
+	CHECK_EQ(xfer->value, value);
+	CHECK(!xfer->read);
+	CHECK(xfer->ok);
+}
+
+/**
+ * Solo se junta una escritura con la ultima encolada que todavia no salio
+ * al bus, y la cola nunca cambia de orden.
+ */
+static void test_async_coalesce(void)
+{
+	const uint8_t a = ES8311_DAC_REG32;
+	const uint8_t b = ES8311_ADC_REG17;
+	async_calls_t calls;
+	es8311_async_stats_t before;
+
+	/* A=1, A=2 esperando: una sola transferencia con el ultimo valor */
+	async_start(&calls, true);
+	before = *ES8311_async_stats();
+	CHECK(ES8311_async_write(a, 0x81, async_record, &calls));
+	CHECK(ES8311_async_write(a, 0x82, async_record, &calls));
+	CHECK_EQ(ES8311_async_stats()->coalesced, before.coalesced + 1);
+	CHECK(ES8311_async_wait(10));
+	CHECK_EQ(ES8311_bus_log()->transfers, 2);
+	check_xfer(0, b, 0x90);
+	check_xfer(1, a, 0x82);
+	CHECK_EQ(codec.reg[a], 0x82);
+	CHECK_EQ(calls.count, 1);
+	CHECK_EQ(calls.value[0], 0x82);
+	CHECK(calls.ok[0]);
+
+	/* A, B, A: la segunda A no salta por encima de B */
+	async_start(&calls, false);
+	CHECK(ES8311_async_write(a, 0x81, async_record, &calls));
+	CHECK(ES8311_async_write(b, 0x91, async_record, &calls));
+	CHECK(ES8311_async_write(a, 0x83, async_record, &calls));
+	CHECK(ES8311_async_wait(10));
+	CHECK_EQ(ES8311_bus_log()->transfers, 3);
+	check_xfer(0, a, 0x81);
+	check_xfer(1, b, 0x91);
+	check_xfer(2, a, 0x83);
+	CHECK_EQ(codec.reg[a], 0x83);
+	CHECK_EQ(calls.count, 3);
+	CHECK_EQ(calls.reg[0], a);
+	CHECK_EQ(calls.reg[1], b);
+	CHECK_EQ(calls.reg[2], a);
+
+	/* A en el bus: la siguiente A no se junta, salen las dos */
+	async_start(&calls, false);
+	CHECK(ES8311_async_write(a, 0x84, async_record, &calls));
+	CHECK_EQ(ES8311_async_pending(), 1);
+	before = *ES8311_async_stats();
+	CHECK(ES8311_async_write(a, 0x85, async_record, &calls));
+	CHECK_EQ(ES8311_async_stats()->coalesced, before.coalesced);
+	CHECK(ES8311_async_wait(10));
+	CHECK_EQ(ES8311_bus_log()->transfers, 2);
+	check_xfer(0, a, 0x84);
+	check_xfer(1, a, 0x85);
+	CHECK_EQ(codec.reg[a], 0x85);
+	CHECK_EQ(calls.count, 2);
+
+	/* El valor que ya tiene, cola vacia: no sale al bus, el callback llega en el momento */
+	async_start(&calls, false);
+	CHECK(ES8311_async_write(a, 0x86, async_record, &calls));
+	CHECK(ES8311_async_wait(10));
+	ES8311_bus_log_clear();
+	memset(&calls, 0, sizeof(calls));
+	CHECK(ES8311_async_write(a, 0x86, async_record, &calls));
+	CHECK_EQ(ES8311_async_pending(), 0);
+	CHECK_EQ(ES8311_bus_log()->transfers, CONFIG_ES8311_REG_CACHE ? 0 : 1);
+	CHECK(ES8311_async_wait(10));
+	CHECK_EQ(calls.count, 1);
+	CHECK_EQ(calls.value[0], 0x86);
+	CHECK(calls.ok[0]);
+
+	/* Cola llena, alternando registros para que nada se junte */
+	async_start(&calls, false);
+	before = *ES8311_async_stats();
+	for (uint32_t i = 0; i < ES8311_ASYNC_QUEUE_SIZE; i++)
+		CHECK(ES8311_async_write((i & 1) ? b : a, (uint8_t)(0x40 + i), NULL, NULL));
+	CHECK_EQ(ES8311_async_pending(), ES8311_ASYNC_QUEUE_SIZE);
+	CHECK(!ES8311_async_write(a, 0x20, async_record, &calls));
+	CHECK_EQ(ES8311_async_stats()->rejected, before.rejected + 1);
+	CHECK_EQ(ES8311_async_stats()->queued, before.queued + ES8311_ASYNC_QUEUE_SIZE);
+	CHECK(ES8311_async_wait(100));
+	CHECK_EQ(ES8311_bus_log()->transfers, ES8311_ASYNC_QUEUE_SIZE);
+	CHECK_EQ(calls.count, 0);
+	CHECK_EQ(codec.reg[a], 0x40 + ES8311_ASYNC_QUEUE_SIZE - 2);
+}
+
+/**
+ * @brief Error in ppm of the rate the simulated I2S produces.
+ */
+static double rate_error_ppm(uint32_t sample_hz)
+{
+	return (sim_i2s_rate_hz() - sample_hz) * 1e6 / sample_hz;
+}
+
+/**
+ * La mejor solucion posible, buscada con la cuenta del HAL: cada N / R
+ * valido en PLLI2SCFGR y HAL_I2S_Init (del simulador, con la misma
+ * aritmetica entera) calcula el prescaler.
+ */
+static double best_error_ppm(uint32_t sample_hz, uint32_t data_format)
+{
+	double best = INFINITY;
+
+	hi2s2.Init.DataFormat = data_format;
+	hi2s2.Init.AudioFreq = sample_hz;
+	for (uint32_t r = ES8311_PLLI2SR_MIN; r <= ES8311_PLLI2SR_MAX; r++)
+	{
+		for (uint32_t n = ES8311_PLLI2SN_MIN; n <= ES8311_PLLI2SN_MAX; n++)
+		{
+			uint64_t vco = (uint64_t)(HSE_VALUE / (RCC->PLLCFGR & RCC_PLLCFGR_PLLM)) * n;
+
+			if (vco < ES8311_PLLI2S_VCO_MIN || vco > ES8311_PLLI2S_VCO_MAX)
+				continue;
+
+			RCC->PLLI2SCFGR = (n << 6) | (r << 28);
+			if (HAL_I2S_Init(&hi2s2) == HAL_OK && fabs(rate_error_ppm(sample_hz)) < fabs(best))
+				best = rate_error_ppm(sample_hz);
+		}
+	}
+
+	return best;
+}
+
+/**
+ * Cada frecuencia y largo de palabra por ES8311_init: lo que quedo en
+ * PLLI2SCFGR e I2SPR tiene que ser lo que informa el solver, la frecuencia
+ * que sale del I2S la que dice rate_hz / error_ppm, y ninguna otra
+ * combinacion de N / R tiene que dar menos error.
+ */
+static void test_i2s_clock(void)
+{
+	static const es8311_word_length_t words[] = { ES8311_WORD_16, ES8311_WORD_24, ES8311_WORD_32 };
+	es8311_i2s_clock_t clock;
+
+	for (sampling_options_t s = SAMPLING_8K; s <= SAMPLING_48K; s++)
+	{
+		uint32_t sample_hz = ES8311_sampling_hz(s);
+
+		for (uint32_t w = 0; w < ARRAY_LEN(words); w++)
+		{
+			es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+			const es8311_i2s_clock_t *solved;
+			double rate;
+			double err;
+
+			config.sampling = s;
+			ES8311_config_word_length(&config, words[w]);
+
+			sim_reset();
+			sim_es8311_init(&codec);
+			sim_es8311_attach(&codec);
+			CHECK(ES8311_init(&config));
+
+			solved = ES8311_i2s_clock();
+			rate = sim_i2s_rate_hz();
+			err = rate_error_ppm(sample_hz);
+
+			CHECK_EQ((RCC->PLLI2SCFGR & RCC_PLLI2SCFGR_PLLI2SN) >> 6, solved->plli2sn);
+			CHECK_EQ((RCC->PLLI2SCFGR & RCC_PLLI2SCFGR_PLLI2SR) >> 28, solved->plli2sr);
+			CHECK_EQ(2 * (SPI2->I2SPR & SPI_I2SPR_I2SDIV) + ((SPI2->I2SPR & SPI_I2SPR_ODD) ? 1 : 0),
+					solved->i2s_div);
+			CHECK_EQ(solved->rate_hz, (uint32_t)rate);
+			CHECK(fabs(err - solved->error_ppm) < 1.0);
+
+			if (w == 0)
+				printf("%5lu Hz: PLLI2SN %3u R %u, div %3u -> %.3f Hz (%+ld ppm)\n", (unsigned long)sample_hz,
+						solved->plli2sn, solved->plli2sr, solved->i2s_div, rate, (long)solved->error_ppm);
+
+			/* Contra todas las combinaciones de N / R, con el mismo formato */
+			CHECK(fabs(err) <= fabs(best_error_ppm(sample_hz, hi2s2.Init.DataFormat)) + 1.0);
+		}
+	}
+
+	/**
+	 * Deinit y otra vez init: HAL_I2S_MspInit (handle en RESET) no tiene que
+	 * dejar el PLLI2S de CubeMX debajo del prescaler calculado.
+	 */
+	{
+		es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+
+		config.sampling = SAMPLING_48K;
+		ES8311_deinit();
+		CHECK(ES8311_init(&config));
+		CHECK_EQ(ES8311_i2s_clock()->rate_hz, 48000);
+		CHECK(fabs(rate_error_ppm(48000)) < 1.0);
+	}
+
+	/* Sin solucion */
+	CHECK(!ES8311_i2s_clock_solve(0, 2000000, 64, &clock));
+	CHECK(!ES8311_i2s_clock_solve(48000, 2000000, 0, &clock));
+	CHECK(!ES8311_i2s_clock_solve(1000000, 2000000, 64, &clock));
+}
+
+/**
+ * Reparto de la ganancia: el PGA toma los pasos de 3 dB hasta 30 dB, el
+ * volumen del ADC el resto. Los bordes y despues todo el rango.
+ */
+static void test_mic_gain_split(void)
+{
+	static const struct
+	{
+		int16_t half_db;
+		uint8_t pga;
+		uint8_t adc_vol;
+	} cases[] =
+	{
+		{ INT16_MIN, 0, 0x00 },
+		{ ES8311_MIC_GAIN_MIN_HALF_DB - 1, 0, 0x00 },
+		{ ES8311_MIC_GAIN_MIN_HALF_DB, 0, 0x00 },
+		{ ES8311_MIC_GAIN_MIN_HALF_DB + 1, 0, 0x01 },
+		{ -1, 0, ADC_VOLUME_0DB - 1 },
+		{ 0, 0, ADC_VOLUME_0DB },
+		{ 1, 0, ADC_VOLUME_0DB + 1 },
+		{ PGAGAIN_STEP_HALF_DB - 1, 0, ADC_VOLUME_0DB + PGAGAIN_STEP_HALF_DB - 1 },
+		{ PGAGAIN_STEP_HALF_DB, 1, ADC_VOLUME_0DB },
+		{ PGAGAIN_STEP_HALF_DB + 1, 1, ADC_VOLUME_0DB + 1 },
+		{ 59, 9, ADC_VOLUME_0DB + 5 },
+		{ 60, PGAGAIN_30DB, ADC_VOLUME_0DB },				//<--- PGA full
+		{ 61, PGAGAIN_30DB, ADC_VOLUME_0DB + 1 },
+		{ ES8311_MIC_GAIN_MAX_HALF_DB - 1, PGAGAIN_30DB, 0xFE },
+		{ ES8311_MIC_GAIN_MAX_HALF_DB, PGAGAIN_30DB, 0xFF },
+		{ ES8311_MIC_GAIN_MAX_HALF_DB + 1, PGAGAIN_30DB, 0xFF },
+		{ INT16_MAX, PGAGAIN_30DB, 0xFF },
+	};
+	uint32_t wrong = 0;
+	uint8_t pga;
+	uint8_t adc_vol;
+
+	for (uint32_t i = 0; i < ARRAY_LEN(cases); i++)
+	{
+		ES8311_mic_gain_split(cases[i].half_db, &pga, &adc_vol);
+		CHECK_EQ(pga, cases[i].pga);
+		CHECK_EQ(adc_vol, cases[i].adc_vol);
+	}
+
+	/* Todo el rango: la suma da lo pedido y el ADC solo agrega cuando el PGA no puede */
+	for (int32_t half_db = ES8311_MIC_GAIN_MIN_HALF_DB; half_db <= ES8311_MIC_GAIN_MAX_HALF_DB; half_db++)
+	{
+		int32_t adc_half_db;
+
+		ES8311_mic_gain_split((int16_t)half_db, &pga, &adc_vol);
+		adc_half_db = (int32_t)adc_vol - ADC_VOLUME_0DB;
+
+		wrong += pga * PGAGAIN_STEP_HALF_DB + adc_half_db != half_db;
+		wrong += pga > PGAGAIN_30DB;
+		wrong += pga < PGAGAIN_30DB && adc_half_db >= PGAGAIN_STEP_HALF_DB;
+		wrong += adc_half_db < 0 && pga != 0;
+	}
+	CHECK_EQ(wrong, 0);
+
+	/* Por el driver hasta el codec */
+	sim_reset();
+	sim_es8311_init(&codec);
+	sim_es8311_attach(&codec);
+	{
+		es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+
+		CHECK(ES8311_init(&config));
+	}
+	CHECK(ES8311_mic_gain_half_db(61));
+	CHECK(ES8311_async_wait(10));
+	CHECK_EQ(codec.reg[ES8311_SYSTEM_REG14], LINSEL | PGAGAIN_30DB);
+	CHECK_EQ(codec.reg[ES8311_ADC_REG17], ADC_VOLUME_0DB + 1);
+	CHECK(ES8311_mic_gain_half_db(-20));
+	CHECK(ES8311_async_wait(10));
+	CHECK_EQ(codec.reg[ES8311_SYSTEM_REG14], LINSEL);
+	CHECK_EQ(codec.reg[ES8311_ADC_REG17], ADC_VOLUME_0DB - 20);
+}
+
+/**
+ * ALC y DRC del codec: los codigos llegan a REG18..REG1B y REG34..35, y
+ * la compuerta de ruido solo toca los bits altos de REG1B, el filtro
+ * pasaaltos del ADC que comparte el byte queda como estaba.
+ */
+static void test_dynamics(void)
+{
+	es8311_bus_usage_t bus;
+	const es8311_alc_config_t alc = { true, 0x3, 0xB, 0x8, true, 0x2, 0x5, 5 };
+	const es8311_alc_config_t alc_bad = { true, ALC_WINSIZE_MASK + 1, 0xB, 0x8, false, 0, 0, 0 };
+	const es8311_drc_config_t drc = { true, 2, 14, 10 };
+	const es8311_drc_config_t drc_bad = { true, 2, 0x10, 10 };
+	const uint8_t hpf = 0x0A;				//<--- ADC HPF stage 1, not the reset value
+	uint8_t reg1c;
+	uint32_t writes;
+
+	CHECK(codec_init(0, &bus));
+	CHECK(ES8311_I2C_write(ES8311_ADC_REG1B, (1 << ADC_AUTOMUTE_VOL_SHIFT) | hpf));
+	reg1c = codec.reg[ES8311_ADC_REG1C];
+
+	CHECK(ES8311_alc_config(&alc));
+	CHECK_EQ(codec.reg[ES8311_ADC_REG18], ALC_EN | ADC_AUTOMUTE_EN | 0x3);
+	CHECK_EQ(codec.reg[ES8311_ADC_REG19], (0xB << ALC_MAXLEVEL_SHIFT) | 0x8);
+	CHECK_EQ(codec.reg[ES8311_ADC_REG1A], (0x2 << ADC_AUTOMUTE_WS_SHIFT) | 0x5);
+	CHECK_EQ(codec.reg[ES8311_ADC_REG1B], (5 << ADC_AUTOMUTE_VOL_SHIFT) | hpf);
+	CHECK_EQ(codec.reg[ES8311_ADC_REG1C], reg1c);
+
+	CHECK(ES8311_drc_config(&drc));
+	CHECK_EQ(codec.reg[ES8311_DAC_REG34], DRC_EN | 2);
+	CHECK_EQ(codec.reg[ES8311_DAC_REG35], (14 << DRC_MAXLEVEL_SHIFT) | 10);
+
+	/* Fuera de rango no escribe nada */
+	writes = codec.writes;
+	CHECK(!ES8311_alc_config(&alc_bad));
+	CHECK(!ES8311_drc_config(&drc_bad));
+	CHECK_EQ(codec.writes, writes);
+
+	/* Apagar deja los niveles y el filtro */
+	{
+		es8311_alc_config_t off = alc;
+		es8311_drc_config_t drc_off = drc;
+
+		off.enable = false;
+		off.noise_gate = false;
+		off.gate_vol = 0;
+		drc_off.enable = false;
+		CHECK(ES8311_alc_config(&off));
+		CHECK(ES8311_drc_config(&drc_off));
+	}
+	CHECK_EQ(codec.reg[ES8311_ADC_REG18], 0x3);
+	CHECK_EQ(codec.reg[ES8311_ADC_REG19], (0xB << ALC_MAXLEVEL_SHIFT) | 0x8);
+	CHECK_EQ(codec.reg[ES8311_ADC_REG1B], hpf);
+	CHECK_EQ(codec.reg[ES8311_DAC_REG34], 2);
+	CHECK_EQ(codec.reg[ES8311_DAC_REG35], (14 << DRC_MAXLEVEL_SHIFT) | 10);
+}
+
+int main(void)
+{
+	test_init_fast();
+	test_init_standard();
+	test_init_errors();
+	test_config();
+	test_read_error();
+	test_async();
+	test_async_coalesce();
+	test_i2s_clock();
+	test_mic_gain_split();
+	test_dynamics();
+
+	TEST_END();
+}
@@ -0,0 +1,415 @@
+/**
+ * @file test_dsp.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief audio_dsp kernels against their _ref, random and edge inputs, bit exact.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_dsp.h"
+#include "test.h"
+#include <string.h>
+
+#define ARRAY_LEN(a)	(sizeof(a) / sizeof((a)[0]))
+
+/**
+ * Se compila dos veces (Makefile): test_dsp con el camino en C portable y
+ * test_dsp_simd con AUDIO_DSP_SIMD_HOST, el de las instrucciones del M4
+ * emuladas en sim/stm32f4xx.h. En los dos casos cada kernel tiene que dar
+ * lo mismo que su _ref, incluido el estado que queda para el bloque
+ * siguiente.
+ */
+#define FRAMES			300				//<--- More than AUDIO_DSP_MAX_FRAMES, not a multiple of it
+#define SAMPLES			(FRAMES * AUDIO_DSP_CHANNELS)
+
+static int16_t in[SAMPLES + 2];
+static int16_t in_b[SAMPLES + 2];
+static int16_t out_fast[SAMPLES + 2];
+static int16_t out_ref[SAMPLES + 2];
+
+static uint32_t seed = 12345;
+
+static uint32_t rnd(void)
+{
+	seed = seed * 1664525U + 1013904223U;
+	return seed;
+}
+
+/**
+ * Los primeros frames con los extremos (INT16_MIN, fondo de escala, ceros,
+ * cambios de signo de punta a punta), el resto ruido en todo el rango con
+ * tramos de fondo de escala.
+ */
+static void make_input(int16_t *buf, uint32_t samples)
+{
+	static const int16_t edge[] =
+	{
+		INT16_MIN, INT16_MAX, 0, -1, 1, INT16_MIN, INT16_MIN, INT16_MAX, INT16_MAX, INT16_MIN,
+		-16384, 16384, INT16_MIN + 1, INT16_MAX - 1, 0, 0, INT16_MAX, INT16_MAX, INT16_MIN, INT16_MIN,
+	};
+
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		if (i < ARRAY_LEN(edge))
+			buf[i] = edge[i];
+		else if ((i / 32) % 5 == 3)
+			buf[i] = (rnd() & 0x100) ? INT16_MAX : INT16_MIN;
+		else
+			buf[i] = (int16_t)(rnd() >> 16);
+	}
+}
+
+static bool same16(const int16_t *a, const int16_t *b, uint32_t samples)
+{
+	return memcmp(a, b, samples * sizeof(int16_t)) == 0;
+}
+
+/******************************************************************************
+ * 								GAIN / MIX
+ *****************************************************************************/
+
+static const int32_t gains_q16[] =
+{
+	0, 1, -1, AUDIO_DSP_Q16_ONE, -AUDIO_DSP_Q16_ONE, AUDIO_DSP_Q16_ONE / 2, 3 * AUDIO_DSP_Q16_ONE / 7,
+	4 * AUDIO_DSP_Q16_ONE, 1000 * AUDIO_DSP_Q16_ONE, INT32_MAX, INT32_MIN, INT32_MIN + 1,
+};
+
+static void test_gain(void)
+{
+	for (uint32_t g = 0; g < ARRAY_LEN(gains_q16); g++)
+	{
+		/* Par, impar y desalineado a media palabra */
+		audio_dsp_gain(out_fast, in, SAMPLES, gains_q16[g]);
+		audio_dsp_gain_ref(out_ref, in, SAMPLES, gains_q16[g]);
+		CHECK(same16(out_fast, out_ref, SAMPLES));
+
+		audio_dsp_gain(out_fast + 1, in + 1, SAMPLES - 1, gains_q16[g]);
+		audio_dsp_gain_ref(out_ref + 1, in + 1, SAMPLES - 1, gains_q16[g]);
+		CHECK(same16(out_fast + 1, out_ref + 1, SAMPLES - 1));
+
+		/* En el lugar */
+		memcpy(out_fast, in, sizeof(in));
+		audio_dsp_gain(out_fast, out_fast, SAMPLES, gains_q16[g]);
+		audio_dsp_gain_ref(out_ref, in, SAMPLES, gains_q16[g]);
+		CHECK(same16(out_fast, out_ref, SAMPLES));
+	}
+}
+
+static void test_ramp(void)
+{
+	static const uint32_t lengths[] = { 0, 1, 7, 64, 299, 1000 };
+	static const uint32_t blocks[] = { 1, 13, 64, FRAMES };
+	audio_dsp_ramp_t fast;
+	audio_dsp_ramp_t ref;
+
+	for (uint32_t g = 0; g + 1 < ARRAY_LEN(gains_q16); g++)
+	{
+		for (uint32_t l = 0; l < ARRAY_LEN(lengths); l++)
+		{
+			uint32_t block = blocks[(g + l) % ARRAY_LEN(blocks)];
+			bool same = true;
+
+			audio_dsp_ramp_init(&fast, gains_q16[g]);
+			audio_dsp_ramp_init(&ref, gains_q16[g]);
+			audio_dsp_ramp_set(&fast, gains_q16[g + 1], lengths[l]);
+			audio_dsp_ramp_set(&ref, gains_q16[g + 1], lengths[l]);
+
+			/* La rampa termina en medio de un bloque */
+			for (uint32_t n = 0; n + block <= FRAMES; n += block)
+			{
+				const int16_t *src = in + n * AUDIO_DSP_CHANNELS;
+
+				audio_dsp_ramp(&fast, out_fast, src, block);
+				audio_dsp_ramp_ref(&ref, out_ref, src, block);
+				same = same && same16(out_fast, out_ref, block * AUDIO_DSP_CHANNELS);
+			}
+
+			CHECK(same);
+			CHECK_EQ(fast.gain_q16, ref.gain_q16);
+			CHECK_EQ(fast.step_q16, ref.step_q16);
+		}
+	}
+}
+
+static void test_comp(void)
+{
+	static const struct
+	{
+		int16_t threshold;
+		uint16_t ratio;
+		uint32_t attack_ms;
+		uint32_t release_ms;
+		int32_t makeup_q16;
+	} cases[] =
+	{
+		{ 16384, 4, 1, 100, AUDIO_DSP_Q16_ONE },
+		{ 8000, 0, 0, 50, 2 * AUDIO_DSP_Q16_ONE },			//<--- Limiter, instant attack
+		{ 1, 2, 5, 5, AUDIO_DSP_Q16_ONE / 3 },
+		{ INT16_MAX, 20, 10, 500, 8 * AUDIO_DSP_Q16_ONE },
+	};
+	audio_dsp_comp_t fast;
+	audio_dsp_comp_t ref;
+
+	for (uint32_t c = 0; c < ARRAY_LEN(cases); c++)
+	{
+		int32_t attack = audio_dsp_comp_coef(cases[c].attack_ms, 48000);
+		int32_t release = audio_dsp_comp_coef(cases[c].release_ms, 48000);
+
+		audio_dsp_comp_init(&fast, cases[c].threshold, cases[c].ratio, attack, release, cases[c].makeup_q16);
+		audio_dsp_comp_init(&ref, cases[c].threshold, cases[c].ratio, attack, release, cases[c].makeup_q16);
+
+		for (uint32_t n = 0; n < 3; n++)
+		{
+			audio_dsp_comp(&fast, out_fast, in, FRAMES);
+			audio_dsp_comp_ref(&ref, out_ref, in, FRAMES);
+			CHECK(same16(out_fast, out_ref, SAMPLES));
+		}
+		CHECK_EQ(fast.env_q15, ref.env_q15);
+		CHECK_EQ(fast.gain_q16, ref.gain_q16);
+	}
+}
+
+static void test_mix(void)
+{
+	static const int16_t gains_q15[] = { 0, 1, -1, 16384, AUDIO_DSP_Q15_MAX, -AUDIO_DSP_Q15_MAX, INT16_MIN };
+
+	audio_dsp_add_sat(out_fast, in, in_b, SAMPLES);
+	audio_dsp_add_sat_ref(out_ref, in, in_b, SAMPLES);
+	CHECK(same16(out_fast, out_ref, SAMPLES));
+
+	audio_dsp_add_sat(out_fast + 1, in + 1, in, SAMPLES - 1);
+	audio_dsp_add_sat_ref(out_ref + 1, in + 1, in, SAMPLES - 1);
+	CHECK(same16(out_fast + 1, out_ref + 1, SAMPLES - 1));
+
+	/* Satura en los dos sentidos */
+	audio_dsp_add_sat(out_fast, in, in, SAMPLES);
+	audio_dsp_add_sat_ref(out_ref, in, in, SAMPLES);
+	CHECK(same16(out_fast, out_ref, SAMPLES));
+
+	for (uint32_t a = 0; a < ARRAY_LEN(gains_q15); a++)
+	{
+		for (uint32_t b = 0; b < ARRAY_LEN(gains_q15); b++)
+		{
+			audio_dsp_mix(out_fast, in, in_b, SAMPLES, gains_q15[a], gains_q15[b]);
+			audio_dsp_mix_ref(out_ref, in, in_b, SAMPLES, gains_q15[a], gains_q15[b]);
+			CHECK(same16(out_fast, out_ref, SAMPLES));
+		}
+	}
+}
+
+/******************************************************************************
+ * 								FILTERS
+ *****************************************************************************/
+
+static void test_dc(void)
+{
+	static const int16_t poles[] = { 32604, 32767, 0, -32768, 16384 };
+	audio_dsp_dc_t fast;
+	audio_dsp_dc_t ref;
+
+	for (uint32_t p = 0; p < ARRAY_LEN(poles); p++)
+	{
+		audio_dsp_dc_init(&fast, poles[p]);
+		audio_dsp_dc_init(&ref, poles[p]);
+
+		/* Dos bloques seguidos, el segundo en el lugar */
+		audio_dsp_dc_remove(&fast, out_fast, in, FRAMES / 2);
+		audio_dsp_dc_remove_ref(&ref, out_ref, in, FRAMES / 2);
+		CHECK(same16(out_fast, out_ref, SAMPLES / 2));
+
+		memcpy(out_fast, in_b, sizeof(in_b));
+		memcpy(out_ref, in_b, sizeof(in_b));
+		audio_dsp_dc_remove(&fast, out_fast, out_fast, FRAMES);
+		audio_dsp_dc_remove_ref(&ref, out_ref, out_ref, FRAMES);
+		CHECK(same16(out_fast, out_ref, SAMPLES));
+		CHECK(memcmp(&fast, &ref, sizeof(fast)) == 0);
+	}
+}
+
+static void test_biquad(void)
+{
+	static const audio_dsp_biquad_coef_t coef[] =
+	{
+		{ 16384, -32000, 15700, -31900, 15600 },			//<--- Resonant low frequency
+		{ INT16_MAX, INT16_MIN, INT16_MAX, INT16_MIN, INT16_MAX },	//<--- Extremes, overflows the accumulator
+		{ 8192, 16384, 8192, -8000, 3000 },
+		{ -16384, 0, 0, 0, 0 },
+		{ 20000, -20000, 5000, -26000, 12000 },
+	};
+	static const uint32_t blocks[] = { 1, 7, 64, FRAMES };
+	audio_dsp_biquad_t fast;
+	audio_dsp_biquad_t ref;
+
+	for (uint8_t stages = 1; stages <= ARRAY_LEN(coef); stages++)
+	{
+		for (uint32_t b = 0; b < ARRAY_LEN(blocks); b++)
+		{
+			bool same = true;
+
+			CHECK(audio_dsp_biquad_init(&fast, coef, stages));
+			CHECK(audio_dsp_biquad_init(&ref, coef, stages));
+
+			for (uint32_t n = 0; n + blocks[b] <= FRAMES; n += blocks[b])
+			{
+				const int16_t *src = in + n * AUDIO_DSP_CHANNELS;
+
+				audio_dsp_biquad(&fast, out_fast, src, blocks[b]);
+				audio_dsp_biquad_ref(&ref, out_ref, src, blocks[b]);
+				same = same && same16(out_fast, out_ref, blocks[b] * AUDIO_DSP_CHANNELS);
+			}
+
+			CHECK(same);
+			CHECK(memcmp(fast.x12, ref.x12, sizeof(fast.x12)) == 0);
+			CHECK(memcmp(fast.y12, ref.y12, sizeof(fast.y12)) == 0);
+		}
+	}
+
+	/* En el lugar */
+	audio_dsp_biquad_init(&fast, coef, ARRAY_LEN(coef));
+	audio_dsp_biquad_init(&ref, coef, ARRAY_LEN(coef));
+	memcpy(out_fast, in, sizeof(in));
+	audio_dsp_biquad(&fast, out_fast, out_fast, FRAMES);
+	audio_dsp_biquad_ref(&ref, out_ref, in, FRAMES);
+	CHECK(same16(out_fast, out_ref, SAMPLES));
+}
+
+static void test_fir(void)
+{
+	static const uint16_t taps[] = { 1, 2, 5, 16, 31, AUDIO_DSP_FIR_MAX_TAPS };
+	int16_t coef[AUDIO_DSP_FIR_MAX_TAPS];
+	audio_dsp_fir_t fast;
+	audio_dsp_fir_t ref;
+
+	for (uint32_t t = 0; t < ARRAY_LEN(taps); t++)
+	{
+		/* Extremos en las puntas, el resto al azar */
+		for (uint32_t k = 0; k < taps[t]; k++)
+			coef[k] = (int16_t)(rnd() >> 16);
+		coef[0] = INT16_MIN;
+		coef[taps[t] - 1] = INT16_MAX;
+
+		CHECK(audio_dsp_fir_init(&fast, coef, taps[t]));
+		CHECK(audio_dsp_fir_init(&ref, coef, taps[t]));
+
+		/* Bloques mas largos que AUDIO_DSP_MAX_FRAMES y uno corto */
+		audio_dsp_fir(&fast, out_fast, in, FRAMES);
+		audio_dsp_fir_ref(&ref, out_ref, in, FRAMES);
+		CHECK(same16(out_fast, out_ref, SAMPLES));
+
+		audio_dsp_fir(&fast, out_fast, in_b, 3);
+		audio_dsp_fir_ref(&ref, out_ref, in_b, 3);
+		CHECK(same16(out_fast, out_ref, 3 * AUDIO_DSP_CHANNELS));
+		CHECK(memcmp(fast.delay, ref.delay, sizeof(fast.delay)) == 0);
+	}
+
+	CHECK(!audio_dsp_fir_init(&fast, coef, AUDIO_DSP_FIR_MAX_TAPS + 1));
+}
+
+/******************************************************************************
+ * 								FORMAT CONVERSION
+ *****************************************************************************/
+
+static int32_t q31[SAMPLES + 1];
+static int32_t q31_fast[SAMPLES + 1];
+static int32_t q31_ref[SAMPLES + 1];
+static uint16_t wire_fast[2 * SAMPLES + 2];
+static uint16_t wire_ref[2 * SAMPLES + 2];
+static uint8_t packed_fast[3 * SAMPLES + 1];
+static uint8_t packed_ref[3 * SAMPLES + 1];
+
+static void make_q31(void)
+{
+	static const int32_t edge[] =
+	{
+		INT32_MIN, INT32_MAX, 0, -1, 1, 0x7FFF7FFF, 0x7FFF8000, 0x7FFFFF7F, 0x7FFFFF80,
+		(int32_t)0x80008000, (int32_t)0x8000007F, (int32_t)0x80000080, 0x00007FFF, 0x00008000, -0x8000, -0x80,
+	};
+
+	for (uint32_t i = 0; i < ARRAY_LEN(q31); i++)
+		q31[i] = (i < ARRAY_LEN(edge)) ? edge[i] : (int32_t)rnd();
+}
+
+static void test_convert(void)
+{
+	static const uint32_t counts[] = { SAMPLES, SAMPLES - 1, 7, 4, 3, 1 };
+	uint32_t n;
+
+	make_q31();
+
+	for (uint32_t c = 0; c < ARRAY_LEN(counts); c++)
+	{
+		n = counts[c];
+
+		audio_dsp_q31_to_s16(out_fast, q31, n);
+		audio_dsp_q31_to_s16_ref(out_ref, q31, n);
+		CHECK(same16(out_fast, out_ref, n));
+
+		audio_dsp_q31_to_s24(q31_fast, q31, n);
+		audio_dsp_q31_to_s24_ref(q31_ref, q31, n);
+		CHECK(memcmp(q31_fast, q31_ref, n * sizeof(int32_t)) == 0);
+
+		/* Buffer del DMA desalineado a media palabra, como un canal del periodo */
+		audio_dsp_q31_to_wire(wire_fast + 1, q31, n);
+		audio_dsp_q31_to_wire_ref(wire_ref + 1, q31, n);
+		CHECK(memcmp(wire_fast + 1, wire_ref + 1, 2 * n * sizeof(uint16_t)) == 0);
+
+		audio_dsp_wire_to_q31(q31_fast, wire_fast + 1, n);
+		audio_dsp_wire_to_q31_ref(q31_ref, wire_ref + 1, n);
+		CHECK(memcmp(q31_fast, q31_ref, n * sizeof(int32_t)) == 0);
+		CHECK(memcmp(q31_fast, q31, n * sizeof(int32_t)) == 0);
+
+		/* Empaquetado a partir de un byte impar */
+		audio_dsp_q31_to_s24p(packed_fast + 1, q31, n);
+		audio_dsp_q31_to_s24p_ref(packed_ref + 1, q31, n);
+		CHECK(memcmp(packed_fast + 1, packed_ref + 1, 3 * n) == 0);
+
+		audio_dsp_s24p_to_q31(q31_fast, packed_fast + 1, n);
+		audio_dsp_s24p_to_q31_ref(q31_ref, packed_ref + 1, n);
+		CHECK(memcmp(q31_fast, q31_ref, n * sizeof(int32_t)) == 0);
+	}
+
+	/* Ida y vuelta sin perdida */
+	audio_dsp_s16_to_q31(q31_fast, in, SAMPLES);
+	audio_dsp_q31_to_s16(out_fast, q31_fast, SAMPLES);
+	CHECK(same16(out_fast, in, SAMPLES));
+
+	audio_dsp_q31_to_s24(q31_ref, q31, SAMPLES);
+	audio_dsp_s24_to_q31(q31_fast, q31_ref, SAMPLES);
+	audio_dsp_q31_to_s24p(packed_fast, q31_fast, SAMPLES);
+	audio_dsp_s24p_to_q31(q31_ref, packed_fast, SAMPLES);
+	CHECK(memcmp(q31_fast, q31_ref, SAMPLES * sizeof(int32_t)) == 0);
+
+	/* Los extremos: +1.0 satura, -1.0 queda */
+	audio_dsp_q31_to_s16(out_fast, q31, 2);
+	CHECK_EQ(out_fast[0], INT16_MIN);
+	CHECK_EQ(out_fast[1], INT16_MAX);
+	audio_dsp_q31_to_s24(q31_fast, q31, 2);
+	CHECK_EQ(q31_fast[0], -0x800000);
+	CHECK_EQ(q31_fast[1], 0x7FFFFF);
+}
+
+int main(void)
+{
+	make_input(in, ARRAY_LEN(in));
+	make_input(in_b, ARRAY_LEN(in_b));
+
+#ifdef AUDIO_DSP_SIMD_HOST
+	printf("test_dsp: M4 SIMD path, intrinsics emulated\n");
+#else
+	printf("test_dsp: portable C path\n");
+#endif
+
+	test_gain();
+	test_ramp();
+	test_comp();
+	test_mix();
+	test_dc();
+	test_biquad();
+	test_fir();
+	test_convert();
+
+	TEST_END();
+}
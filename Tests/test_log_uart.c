@@ -0,0 +1,197 @@
+/**
+ * @file test_log_uart.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Ring of log_uart: whole-message drops, counters and wraparound, drained into a pty.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include "log_ring.h"
+#include "test.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+static log_ring_t ring;
+
+static void fill(char *buf, uint32_t len, char first)
+{
+	for (uint32_t i = 0; i < len; i++)
+		buf[i] = (char)(first + i % 26);
+}
+
+/**
+ * @brief What the TXE interrupt would send, up to len bytes.
+ */
+static uint32_t drain(char *out, uint32_t len)
+{
+	uint32_t n = 0;
+
+	while (n < len && log_ring_read(&ring, &out[n]))
+		n++;
+	return n;
+}
+
+/**
+ * Un mensaje que no entra no deja nada en el ring: ni una parte, ni
+ * cambia head. Se cuentan los bytes y el mensaje.
+ */
+static void test_drop_whole(void)
+{
+	static char msg[LOG_RING_BYTES + 1];
+	static char out[LOG_RING_BYTES];
+
+	log_ring_init(&ring);
+	fill(msg, sizeof(msg), 'a');
+
+	CHECK(log_ring_write(&ring, msg, LOG_RING_BYTES - 10));
+	CHECK_EQ(log_ring_pending(&ring), LOG_RING_BYTES - 10);
+
+	/* Faltan 11 bytes de lugar para 21: se pierde entero */
+	CHECK(!log_ring_write(&ring, "0123456789abcdefghij\n", 21));
+	CHECK_EQ(log_ring_pending(&ring), LOG_RING_BYTES - 10);
+	CHECK_EQ(ring.stats.dropped, 21);
+	CHECK_EQ(ring.stats.dropped_writes, 1);
+
+	/* El que entra justo se acepta y llena el ring */
+	CHECK(log_ring_write(&ring, "0123456789", 10));
+	CHECK_EQ(log_ring_pending(&ring), LOG_RING_BYTES);
+	CHECK(!log_ring_write(&ring, "x", 1));
+	CHECK_EQ(ring.stats.dropped, 22);
+	CHECK_EQ(ring.stats.dropped_writes, 2);
+
+	/* Mas grande que el ring, aun vacio */
+	CHECK_EQ(drain(out, sizeof(out)), LOG_RING_BYTES);
+	CHECK(!log_ring_write(&ring, msg, LOG_RING_BYTES + 1));
+	CHECK_EQ(log_ring_pending(&ring), 0);
+	CHECK_EQ(ring.stats.dropped, 22 + LOG_RING_BYTES + 1);
+	CHECK_EQ(ring.stats.dropped_writes, 3);
+
+	/* Sale lo aceptado, sin restos del mensaje descartado */
+	CHECK_EQ(memcmp(out, msg, LOG_RING_BYTES - 10), 0);
+	CHECK_EQ(memcmp(out + LOG_RING_BYTES - 10, "0123456789", 10), 0);
+
+	CHECK_EQ(ring.stats.bytes, LOG_RING_BYTES);
+	CHECK_EQ(ring.stats.sent, LOG_RING_BYTES);
+	CHECK_EQ(ring.stats.max_used, LOG_RING_BYTES);
+
+	/* Un mensaje vacio siempre entra */
+	CHECK(log_ring_write(&ring, msg, 0));
+	CHECK_EQ(log_ring_pending(&ring), 0);
+}
+
+/**
+ * Mensajes que cruzan el final del buffer, y head / tail pasando por
+ * 2^32: pending y el contenido tienen que seguir bien.
+ */
+static void test_wraparound(void)
+{
+	char msg[97];
+	char out[97];
+	uint32_t bad = 0;
+
+	log_ring_init(&ring);
+	ring.head = ring.tail = UINT32_MAX - 3 * sizeof(msg);
+
+	for (uint32_t n = 0; n < 200; n++)
+	{
+		fill(msg, sizeof(msg), (char)('A' + n % 7));
+		CHECK(log_ring_write(&ring, msg, sizeof(msg)));
+		CHECK_EQ(log_ring_pending(&ring), sizeof(msg));
+		CHECK_EQ(drain(out, sizeof(out)), sizeof(out));
+		bad += memcmp(out, msg, sizeof(msg)) != 0;
+	}
+	CHECK_EQ(bad, 0);
+	CHECK(ring.head < 200 * sizeof(msg));
+	CHECK_EQ(ring.stats.bytes, 200 * sizeof(msg));
+	CHECK_EQ(ring.stats.sent, 200 * sizeof(msg));
+	CHECK_EQ(ring.stats.dropped_writes, 0);
+	CHECK_EQ(ring.stats.max_used, sizeof(msg));
+
+	/* Lleno a traves del final: uno mas no entra, el primero sale intacto */
+	for (uint32_t n = 0; n < LOG_RING_BYTES / sizeof(msg); n++)
+		CHECK(log_ring_write(&ring, msg, sizeof(msg)));
+	CHECK(!log_ring_write(&ring, msg, sizeof(msg)));
+	CHECK_EQ(ring.stats.dropped_writes, 1);
+	CHECK_EQ(drain(out, sizeof(out)), sizeof(out));
+	CHECK_EQ(memcmp(out, msg, sizeof(msg)), 0);
+}
+
+/**
+ * Lo que haria la interrupcion de TXE contra USART3: cada byte al master
+ * de un pty y del slave (raw, como el VCP) sale el texto de los mensajes
+ * aceptados, en orden y sin partes de los descartados.
+ */
+static void test_pty(void)
+{
+	static const char *lines[] = { "boot\r\n", "es8311: init ok\r\n", "xrun 3\r\n", "restart\r\n" };
+	char expected[256] = { 0 };
+	char got[256] = { 0 };
+	char big[LOG_RING_BYTES];
+	struct termios tio;
+	uint32_t len = 0;
+	uint32_t n = 0;
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	int slave = -1;
+	char c;
+
+	CHECK(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0);
+	if (master >= 0)
+		slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	CHECK(slave >= 0);
+	if (slave < 0)
+		return;
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	log_ring_init(&ring);
+	fill(big, sizeof(big), 'a');
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		CHECK(log_ring_write(&ring, lines[i], (uint32_t)strlen(lines[i])));
+		strcat(expected, lines[i]);
+
+		/* Con lo anterior todavia en el ring no entra */
+		CHECK(!log_ring_write(&ring, big, sizeof(big)));
+
+		/* La UART saca la mitad antes del siguiente mensaje */
+		for (uint32_t k = log_ring_pending(&ring) / 2; k > 0 && log_ring_read(&ring, &c); k--)
+			CHECK(write(master, &c, 1) == 1);
+	}
+	while (log_ring_read(&ring, &c))
+		CHECK(write(master, &c, 1) == 1);
+
+	len = (uint32_t)strlen(expected);
+	while (n < len)
+	{
+		ssize_t r = read(slave, got + n, len - n);
+
+		if (r <= 0)
+			break;
+		n += (uint32_t)r;
+	}
+	CHECK_EQ(n, len);
+	CHECK(strcmp(got, expected) == 0);
+	CHECK_EQ(ring.stats.dropped_writes, 4);
+	CHECK_EQ(ring.stats.sent, len);
+
+	close(slave);
+	close(master);
+}
+
+int main(void)
+{
+	test_drop_whole();
+	test_wraparound();
+	test_pty();
+
+	TEST_END();
+}
@@ -0,0 +1,161 @@
+/**
+ * @file test_move.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief audio_move: when the CPU takes a copy instead of DMA2, case by case.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_move.h"
+#include "sim.h"
+#include "test.h"
+#include <string.h>
+
+#define ARRAY_LEN(a)	(sizeof(a) / sizeof((a)[0]))
+
+#define MOVE_MAX		(AUDIO_MOVE_QUEUE_SIZE + 2)
+#define MOVE_LONG		(2 * 0x10000)			//<--- One halfword more than NDTR can count
+
+/**
+ * Cada caso encola moves copias seguidas (sin entregar interrupciones),
+ * cuenta cuantas terminaron antes de volver (CPU) y despues corre las
+ * interrupciones. Al final una copia normal dice si el DMA sigue en uso.
+ */
+typedef struct
+{
+	const char *name;
+	bool fail_init;				//<--- HAL_DMA_Init fails
+	uint32_t fail_start;		//<--- HAL_DMA_Start_IT fails for the first n moves
+	uint32_t fail_restart;		//<--- Set once the first move started: the next starts fail
+	uint32_t fail_transfer;		//<--- Transfers that end with TE
+	bool hold;					//<--- The DMA does not finish until the moves are queued
+	uint32_t moves;
+	uint32_t bytes;
+	uint32_t dst_offset;
+	uint32_t src_offset;
+	/* Expected */
+	uint32_t sync;				//<--- Callbacks before audio_move_copy returned
+	uint32_t dma;
+	uint32_t cpu;
+	uint32_t errors;
+	bool dma_after;				//<--- A valid move after the case still goes to the DMA
+} move_case_t;
+
+static const move_case_t cases[] =
+{
+	{ "dma", false, 0, 0, 0, false, 3, 256, 0, 0,
+			0, 3, 0, 0, true },
+	{ "dma init failed", true, 0, 0, 0, false, 3, 256, 0, 0,
+			3, 0, 3, 0, false },
+	{ "short", false, 0, 0, 0, false, 3, AUDIO_MOVE_DMA_MIN_BYTES - 2, 0, 0,
+			3, 0, 3, 0, true },
+	{ "shortest dma", false, 0, 0, 0, false, 2, AUDIO_MOVE_DMA_MIN_BYTES, 0, 0,
+			0, 2, 0, 0, true },
+	{ "odd length", false, 0, 0, 0, false, 2, 257, 0, 0,
+			2, 0, 2, 0, true },
+	{ "odd dst", false, 0, 0, 0, false, 2, 256, 1, 0,
+			2, 0, 2, 0, true },
+	{ "odd src", false, 0, 0, 0, false, 2, 256, 0, 1,
+			2, 0, 2, 0, true },
+	{ "too long", false, 0, 0, 0, false, 1, MOVE_LONG, 0, 0,
+			1, 0, 1, 0, true },
+	{ "longest dma", false, 0, 0, 0, false, 1, MOVE_LONG - 2, 0, 0,
+			0, 1, 0, 0, true },
+	{ "queue full", false, 0, 0, 0, true, AUDIO_MOVE_QUEUE_SIZE + 2, 256, 0, 0,
+			2, AUDIO_MOVE_QUEUE_SIZE, 2, 0, true },
+	{ "start fails", false, 1, 0, 0, false, 3, 256, 0, 0,
+			3, 0, 3, 1, false },
+	{ "restart fails", false, 0, 1, 0, false, 3, 256, 0, 0,
+			0, 1, 2, 2, false },
+	{ "transfer error", false, 0, 0, 1, false, 3, 256, 0, 0,
+			0, 0, 3, 3, false },
+};
+
+static uint8_t src_mem[MOVE_MAX * 512 + MOVE_LONG + 4] __attribute__((aligned(4)));
+static uint8_t dst_mem[MOVE_MAX * 512 + MOVE_LONG + 4] __attribute__((aligned(4)));
+static uint32_t called[MOVE_MAX];
+
+static void move_done(void *ctx)
+{
+	called[(uintptr_t)ctx]++;
+}
+
+static uint32_t calls(uint32_t moves)
+{
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < moves; i++)
+		n += called[i];
+	return n;
+}
+
+static void run_case(const move_case_t *c)
+{
+	uint32_t stride = (c->bytes + 4) & ~3UL;
+	uint32_t bad = 0;
+	uint32_t sync;
+
+	sim_reset();
+	sim_dma_fail_init(c->fail_init);
+	CHECK_EQ(audio_move_init(), !c->fail_init);
+
+	memset(called, 0, sizeof(called));
+	memset(dst_mem, 0, sizeof(dst_mem));
+	for (uint32_t i = 0; i < sizeof(src_mem); i++)
+		src_mem[i] = (uint8_t)(i * 7 + i / 251 + 1);
+
+	sim_dma_hold(c->hold);
+	sim_dma_fail_start(c->fail_start);
+	sim_dma_fail_transfer(c->fail_transfer);
+
+	for (uint32_t i = 0; i < c->moves; i++)
+	{
+		audio_move_copy(dst_mem + i * stride + c->dst_offset, src_mem + i * stride + c->src_offset, c->bytes,
+				move_done, (void *)(uintptr_t)i);
+		if (i == 0 && c->fail_restart)
+			sim_dma_fail_start(c->fail_restart);
+	}
+
+	sync = calls(c->moves);
+	sim_dma_hold(false);
+	sim_irq_run();
+
+	/* Todas las copias una vez, con los datos correctos, termine quien termine */
+	for (uint32_t i = 0; i < c->moves; i++)
+	{
+		bad += called[i] != 1;
+		bad += memcmp(dst_mem + i * stride + c->dst_offset, src_mem + i * stride + c->src_offset, c->bytes) != 0;
+	}
+
+	printf("%-16s sync %lu, dma %lu, cpu %lu, errors %lu, max queued %lu\n", c->name, (unsigned long)sync,
+			(unsigned long)audio_move_stats()->dma_moves, (unsigned long)audio_move_stats()->cpu_moves,
+			(unsigned long)audio_move_stats()->errors, (unsigned long)audio_move_stats()->max_queued);
+
+	CHECK_EQ(bad, 0);
+	CHECK_EQ(sync, c->sync);
+	CHECK_EQ(audio_move_stats()->dma_moves, c->dma);
+	CHECK_EQ(audio_move_stats()->cpu_moves, c->cpu);
+	CHECK_EQ(audio_move_stats()->errors, c->errors);
+	CHECK_EQ(audio_move_pending(), 0);
+	if (c->hold)
+		CHECK_EQ(audio_move_stats()->max_queued, AUDIO_MOVE_QUEUE_SIZE);
+
+	/* Despues de un error el DMA no se vuelve a usar hasta audio_move_init */
+	memset(called, 0, sizeof(called));
+	audio_move_copy(dst_mem, src_mem + 2, 256, move_done, (void *)0);
+	CHECK_EQ(called[0], c->dma_after ? 0 : 1);
+	sim_irq_run();
+	CHECK_EQ(called[0], 1);
+	CHECK_EQ(audio_move_stats()->dma_moves, c->dma + (c->dma_after ? 1 : 0));
+}
+
+int main(void)
+{
+	for (uint32_t i = 0; i < ARRAY_LEN(cases); i++)
+		run_case(&cases[i]);
+
+	TEST_END();
+}
@@ -0,0 +1,184 @@
+/**
+ * @file test_prof.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief audio_prof on the simulator clock: min, max, mean and histogram for known cycle counts.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_loop.h"
+#include "audio_prof.h"
+#include "sim.h"
+#include "test.h"
+#include <string.h>
+
+#define ARRAY_LEN(a)	(sizeof(a) / sizeof((a)[0]))
+
+/**
+ * Cada medicion con el bucket que le toca: floor(log2) - AUDIO_PROF_HIST_SHIFT,
+ * recortado a los extremos del histograma.
+ */
+typedef struct
+{
+	uint32_t cycles;
+	uint32_t bucket;
+} prof_case_t;
+
+static const prof_case_t cases[] =
+{
+	{ 0, 0 },
+	{ 50, 0 },
+	{ 127, 0 },
+	{ 128, 1 },
+	{ 1000, 3 },
+	{ 5000, 6 },
+	{ 100000, 10 },
+	{ 168000, 11 },			//<--- One tick of the simulator
+	{ 10000000, 15 },		//<--- Clamped to the last bucket
+};
+
+static void check_stat(audio_prof_id_t id, const prof_case_t *c, uint32_t n)
+{
+	const audio_prof_stat_t *stat = audio_prof_get(id);
+	uint32_t hist[AUDIO_PROF_HIST_BUCKETS] = { 0 };
+	uint32_t min = UINT32_MAX;
+	uint32_t max = 0;
+	uint64_t sum = 0;
+
+	for (uint32_t i = 0; i < n; i++)
+	{
+		hist[c[i].bucket]++;
+		sum += c[i].cycles;
+		if (c[i].cycles < min)
+			min = c[i].cycles;
+		if (c[i].cycles > max)
+			max = c[i].cycles;
+	}
+
+	CHECK_EQ(stat->count, n);
+	CHECK_EQ(stat->min, min);
+	CHECK_EQ(stat->max, max);
+	CHECK_EQ(stat->sum, sum);
+	CHECK_EQ(audio_prof_mean(id), sum / n);
+	for (uint32_t b = 0; b < AUDIO_PROF_HIST_BUCKETS; b++)
+		CHECK_EQ(stat->hist[b], hist[b]);
+}
+
+/**
+ * Cada caso pasa su cuenta de ciclos en el reloj del simulador entre
+ * audio_prof_start y audio_prof_stop.
+ */
+static void test_known(void)
+{
+	sim_reset();
+	audio_prof_init();
+
+	for (uint32_t i = 0; i < ARRAY_LEN(cases); i++)
+	{
+		uint32_t start = audio_prof_start();
+
+		sim_advance_cycles(cases[i].cycles);
+		CHECK_EQ(audio_prof_stop(PROF_PROCESS, start), cases[i].cycles);
+	}
+
+	check_stat(PROF_PROCESS, cases, ARRAY_LEN(cases));
+	CHECK_EQ(audio_prof_get(PROF_I2S_HALF_CB)->count, 0);
+	CHECK_EQ(audio_prof_mean(PROF_I2S_HALF_CB), 0);
+
+	audio_prof_reset();
+	CHECK_EQ(audio_prof_get(PROF_PROCESS)->count, 0);
+	CHECK_EQ(audio_prof_get(PROF_PROCESS)->min, UINT32_MAX);
+}
+
+/**
+ * El tick y el contador avanzan juntos, tambien por HAL_Delay y
+ * HAL_GetTick (sin interrupciones pendientes gasta un ms), y la resta
+ * sobrevive a la vuelta del contador de 32 bits.
+ */
+static void test_clock(void)
+{
+	uint32_t per_ms = SystemCoreClock / 1000U;
+	uint32_t start;
+	uint32_t tick;
+
+	sim_reset();
+	audio_prof_init();
+
+	tick = HAL_GetTick();
+	start = audio_prof_start();
+	sim_advance_cycles(per_ms + per_ms / 2);
+	CHECK_EQ(HAL_GetTick(), tick + 2);
+	sim_advance_cycles(per_ms / 2);
+	CHECK_EQ(HAL_GetTick(), tick + 4);
+	CHECK_EQ(audio_prof_start() - start, 4 * per_ms);		//<--- Each HAL_GetTick spent one more
+	CHECK_EQ(DWT->CYCCNT, audio_prof_start());
+
+	start = audio_prof_start();
+	HAL_Delay(5);
+	CHECK_EQ(audio_prof_stop(PROF_DMA1_S3_IRQ, start), 5 * per_ms);
+
+	audio_prof_mock_advance(UINT32_MAX - audio_prof_start() - 99);
+	start = audio_prof_start();
+	sim_advance_cycles(1000);
+	CHECK(audio_prof_start() < start);
+	CHECK_EQ(audio_prof_stop(PROF_DMA1_S4_IRQ, start), 1000);
+}
+
+/**
+ * audio_loop mide el proceso de cada periodo como main.c: el callback
+ * gasta una cuenta conocida. Los callbacks del DMA solo gastan el ms del
+ * HAL_GetTick de ES8311_I2S_check.
+ */
+static void process(int16_t *out, const int16_t *in, uint32_t frames, void *ctx)
+{
+	uint32_t *calls = ctx;
+
+	memcpy(out, in, sizeof(int16_t) * frames * ES8311_I2S_CHANNELS);
+	sim_advance_cycles(cases[*calls % ARRAY_LEN(cases)].cycles);
+	(*calls)++;
+}
+
+static void test_loop(void)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+	prof_case_t expected[4 * ARRAY_LEN(cases)];
+	uint32_t halves = ARRAY_LEN(expected);
+	uint32_t calls = 0;
+
+	sim_reset();
+	CHECK(audio_loop_start(&config, process, &calls));
+
+	for (uint32_t i = 0; i < halves; i++)
+	{
+		sim_i2s_half();
+		sim_irq_run();
+		audio_loop_run();
+	}
+
+	for (uint32_t i = 0; i < calls; i++)
+		expected[i] = cases[i % ARRAY_LEN(cases)];
+
+	CHECK_EQ(calls, halves);
+	check_stat(PROF_PROCESS, expected, calls);
+	CHECK_EQ(audio_prof_get(PROF_I2S_HALF_CB)->count, halves / 2);
+	CHECK_EQ(audio_prof_get(PROF_I2S_CPLT_CB)->count, halves / 2);
+	CHECK_EQ(audio_prof_get(PROF_I2S_HALF_CB)->min, SystemCoreClock / 1000U);
+	CHECK_EQ(audio_prof_get(PROF_I2S_HALF_CB)->max, SystemCoreClock / 1000U);
+	CHECK_EQ(audio_prof_get(PROF_I2S_CPLT_CB)->hist[11], halves / 2);
+
+	printf("process: %lu calls, min %lu, max %lu, mean %lu cycles\n", (unsigned long)calls,
+			(unsigned long)audio_prof_get(PROF_PROCESS)->min, (unsigned long)audio_prof_get(PROF_PROCESS)->max,
+			(unsigned long)audio_prof_mean(PROF_PROCESS));
+}
+
+int main(void)
+{
+	test_known();
+	test_clock();
+	test_loop();
+
+	TEST_END();
+}
@@ -0,0 +1,201 @@
+/**
+ * @file test_recover.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Stream errors on the HAL simulator: counters, restart and what comes out after it.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_loop.h"
+#include "audio_move.h"
+#include "sim.h"
+#include "test.h"
+#include <string.h>
+
+#define ARRAY_LEN(a)	(sizeof(a) / sizeof((a)[0]))
+
+typedef enum
+{
+	FAULT_OVR,					//<--- OVR on I2S2ext, seen by ES8311_I2S_check
+	FAULT_UDR,					//<--- UDR on SPI2, seen by ES8311_I2S_check
+	FAULT_TX_DMA,				//<--- DMA error on the TX stream, HAL_I2S_ErrorCallback
+	FAULT_RX_DMA,				//<--- DMA error on the RX stream, HAL_I2S_ErrorCallback
+	FAULT_STALL,				//<--- No blocks for ES8311_I2S_STALL_MS
+} fault_t;
+
+/**
+ * Cada caso deja el stream con periodos viejos en los rings (el main loop
+ * se atraso dos mitades) y, si moving, con copias de DMA2 sin terminar.
+ * Despues del error el main loop reinicia: los rings tienen que quedar
+ * como recien arrancados y la salida tiene que ser solo silencio y lo
+ * recibido despues del reinicio.
+ */
+typedef struct
+{
+	const char *name;
+	fault_t fault;
+	uint32_t dma_error;			//<--- HAL_DMA_ERROR_xx for the DMA faults
+	uint32_t fail_start;		//<--- Restarts that fail before the good one
+	bool moving;				//<--- Block moves still queued at the fault
+	es8311_i2s_stats_t expected;	//<--- Counters added by the case (recover_us not compared)
+} recover_case_t;
+
+static const recover_case_t cases[] =
+{
+	{ "rx overrun", FAULT_OVR, 0, 0, false, { .rx.xrun = 1, .recoveries = 1 } },
+	{ "tx underrun", FAULT_UDR, 0, 0, false, { .tx.xrun = 1, .recoveries = 1 } },
+	{ "tx transfer", FAULT_TX_DMA, HAL_DMA_ERROR_TE, 0, false, { .tx.dma_te = 1, .recoveries = 1 } },
+	{ "rx fifo", FAULT_RX_DMA, HAL_DMA_ERROR_FE, 0, false, { .rx.dma_fe = 1, .recoveries = 1 } },
+	{ "rx direct mode", FAULT_RX_DMA, HAL_DMA_ERROR_DME, 0, false, { .rx.dma_dme = 1, .recoveries = 1 } },
+	{ "stall", FAULT_STALL, 0, 0, false, { .stalls = 1, .recoveries = 1 } },
+	{ "overrun, moving", FAULT_OVR, 0, 0, true, { .rx.xrun = 1, .recoveries = 1 } },
+	{ "transfer, moving", FAULT_TX_DMA, HAL_DMA_ERROR_TE, 0, true, { .tx.dma_te = 1, .recoveries = 1 } },
+	{ "restart fails", FAULT_RX_DMA, HAL_DMA_ERROR_TE, 2, false, { .rx.dma_te = 1, .recoveries = 1, .failed = 2 } },
+	{ "underrun, fails", FAULT_UDR, 0, 1, true, { .tx.xrun = 1, .recoveries = 1, .failed = 1 } },
+	{ "stall, fails", FAULT_STALL, 0, 1, false, { .stalls = 1, .recoveries = 1, .failed = 1 } },
+};
+
+static void stream_step(bool run)
+{
+	sim_i2s_half();
+	sim_irq_run();
+	if (run)
+		audio_loop_run();
+}
+
+static void fault(const recover_case_t *c)
+{
+	switch (c->fault)
+	{
+	case FAULT_OVR:
+	case FAULT_UDR:
+		/* La mitad que trae el flag se descarta, el DMA sigue hasta el reinicio */
+		sim_i2s_xrun(c->fault == FAULT_OVR, c->fault == FAULT_UDR);
+		sim_i2s_half();
+		CHECK_EQ(audio_loop_stats()->dropped, 1);
+		CHECK(ES8311_I2S_recovery_pending());
+		break;
+	case FAULT_TX_DMA:
+	case FAULT_RX_DMA:
+		sim_i2s_dma_error(c->fault == FAULT_RX_DMA, c->dma_error);
+		CHECK(!sim_i2s_running());
+		CHECK(ES8311_I2S_recovery_pending());
+		break;
+	case FAULT_STALL:
+		/* Lo detecta ES8311_I2S_recover, no hay callbacks */
+		sim_advance_ms(ES8311_I2S_STALL_MS + 1);
+		CHECK(!ES8311_I2S_recovery_pending());
+		break;
+	}
+}
+
+static void check_stats(const es8311_i2s_stats_t *before, const es8311_i2s_stats_t *expected)
+{
+	const es8311_i2s_stats_t *now = ES8311_I2S_stats();
+
+	CHECK_EQ(now->tx.xrun - before->tx.xrun, expected->tx.xrun);
+	CHECK_EQ(now->tx.dma_te - before->tx.dma_te, expected->tx.dma_te);
+	CHECK_EQ(now->tx.dma_fe - before->tx.dma_fe, expected->tx.dma_fe);
+	CHECK_EQ(now->tx.dma_dme - before->tx.dma_dme, expected->tx.dma_dme);
+	CHECK_EQ(now->rx.xrun - before->rx.xrun, expected->rx.xrun);
+	CHECK_EQ(now->rx.dma_te - before->rx.dma_te, expected->rx.dma_te);
+	CHECK_EQ(now->rx.dma_fe - before->rx.dma_fe, expected->rx.dma_fe);
+	CHECK_EQ(now->rx.dma_dme - before->rx.dma_dme, expected->rx.dma_dme);
+	CHECK_EQ(now->stalls - before->stalls, expected->stalls);
+	CHECK_EQ(now->recoveries - before->recoveries, expected->recoveries);
+	CHECK_EQ(now->failed - before->failed, expected->failed);
+}
+
+static void run_case(const recover_case_t *c)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+	uint32_t prefill = config.period_count - 2;
+	audio_loopback_t lb = { .latency = config.period_count };
+	es8311_i2s_stats_t before;
+	uint32_t overrun;
+	uint32_t underrun;
+	uint32_t starts;
+
+	sim_reset();
+	sim_i2s_io(audio_loop_source, audio_loop_sink, &lb);
+	CHECK(audio_loop_start(&config, NULL, NULL));
+	before = *ES8311_I2S_stats();
+
+	for (uint32_t i = 0; i < 8; i++)
+		stream_step(true);
+
+	/* El main loop se atrasa: quedan periodos del stream viejo */
+	sim_dma_hold(c->moving);
+	stream_step(false);
+	stream_step(false);
+	CHECK(audio_ring_count(&loopStream.rx) != 0 || audio_move_pending() != 0);
+
+	fault(c);
+	sim_i2s_fail_start(c->fail_start);
+	starts = sim_stats()->starts;
+
+	/* Cada intento fallido espera ES8311_I2S_RETRY_MS para el siguiente */
+	for (uint32_t i = 0; i < c->fail_start; i++)
+	{
+		audio_loop_run();
+		CHECK(!sim_i2s_running());
+		CHECK(ES8311_I2S_recovery_pending());
+		CHECK_EQ(ES8311_I2S_stats()->failed - before.failed, i + 1);
+
+		audio_loop_run();
+		CHECK_EQ(ES8311_I2S_stats()->failed - before.failed, i + 1);
+
+		sim_advance_ms(ES8311_I2S_RETRY_MS);
+	}
+
+	audio_loop_run();
+	CHECK(sim_i2s_running());
+	CHECK(!ES8311_I2S_recovery_pending());
+	CHECK_EQ(sim_stats()->starts - starts, 1);
+	check_stats(&before, &c->expected);
+	if (c->fail_start != 0)
+		CHECK(ES8311_I2S_stats()->recover_us >= c->fail_start * ES8311_I2S_RETRY_MS * 1000U);
+
+	/* Como recien arrancado: rx vacio, el prefill en tx y ninguna copia pendiente */
+	CHECK_EQ(audio_ring_count(&loopStream.rx), 0);
+	CHECK_EQ(audio_ring_count(&loopStream.tx), prefill);
+	CHECK_EQ(audio_move_pending(), 0);
+	CHECK(!loopStream.rx_moving);
+	CHECK(!loopStream.tx_moving);
+
+	/* Las copias descartadas no terminan despues sobre los rings nuevos */
+	sim_dma_hold(false);
+	sim_irq_run();
+	CHECK_EQ(audio_ring_count(&loopStream.rx), 0);
+	CHECK_EQ(audio_ring_count(&loopStream.tx), prefill);
+
+	/* Sale el silencio del arranque y despues lo recibido, nada del stream viejo */
+	memset(&lb, 0, sizeof(lb));
+	lb.latency = config.period_count;
+	overrun = loopStream.rx.overrun;
+	underrun = loopStream.tx.underrun;
+
+	for (uint32_t i = 0; i < 32; i++)
+		stream_step(true);
+
+	printf("%-16s silent %lu, wrong %lu, recover %lu us\n", c->name, (unsigned long)lb.silent,
+			(unsigned long)lb.wrong, (unsigned long)ES8311_I2S_stats()->recover_us);
+
+	CHECK_EQ(lb.sent, 32);
+	CHECK_EQ(lb.silent, config.period_count);
+	CHECK_EQ(lb.wrong, 0);
+	CHECK_EQ(loopStream.rx.overrun, overrun);
+	CHECK_EQ(loopStream.tx.underrun, underrun);
+	CHECK_EQ(ES8311_I2S_stats()->recoveries - before.recoveries, 1);
+}
+
+int main(void)
+{
+	for (uint32_t i = 0; i < ARRAY_LEN(cases); i++)
+		run_case(&cases[i]);
+
+	TEST_END();
+}
@@ -0,0 +1,295 @@
+/**
+ * @file test_stream.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Full duplex stream on the HAL simulator: latency, underrun / overrun and block moves.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_loop.h"
+#include "audio_move.h"
+#include "sim.h"
+#include "test.h"
+#include <string.h>
+
+#define STRESS_HALVES		2048
+#define STRESS_MAX_DELAY	(AUDIO_RING_PERIODS + 3)	//<--- Longer than the prefill and the ring, both errors happen
+#define STRESS_SILENT		(-1)
+#define STRESS_WRONG		(-2)
+
+static void stream_step(bool run)
+{
+	sim_i2s_half();
+	sim_irq_run();
+	if (run)
+		audio_loop_run();
+}
+
+/**
+ * Lo recibido sale period_count periodos despues: 2 del buffer del DMA y
+ * los de silencio precargados en tx. Igual por DMA2 que por CPU.
+ */
+static void test_latency(bool dma)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+	audio_loopback_t lb = { .latency = config.period_count };
+	uint32_t halves = 64;
+
+	sim_reset();
+	sim_dma_fail_init(!dma);
+	sim_i2s_io(audio_loop_source, audio_loop_sink, &lb);
+	CHECK(audio_loop_start(&config, NULL, NULL));
+
+	for (uint32_t i = 0; i < halves; i++)
+		stream_step(true);
+
+	CHECK_EQ(lb.sent, halves);
+	CHECK_EQ(lb.silent, config.period_count);
+	CHECK_EQ(lb.wrong, 0);
+	CHECK_EQ(loopStream.rx.overrun, 0);
+	CHECK_EQ(loopStream.tx.underrun, 0);
+	CHECK_EQ(audio_loop_stats()->dropped, 0);
+	CHECK_EQ(audio_loop_stats()->processed, halves);
+	CHECK_EQ(ES8311_config_latency_us(&config),
+			((uint64_t)lb.latency * config.period_frames * 1000000ULL) / ES8311_sampling_hz(config.sampling));
+
+	if (dma)
+	{
+		CHECK_EQ(sim_stats()->dma_moves, 2 * halves);
+		CHECK_EQ(audio_move_stats()->cpu_moves, 0);
+	}
+	else
+	{
+		CHECK_EQ(sim_stats()->dma_moves, 0);
+		CHECK_EQ(audio_move_stats()->cpu_moves, 2 * halves);
+	}
+}
+
+/**
+ * El main loop se atrasa: primero se acaba el prefill (underrun, sale
+ * silencio) y despues se llena rx (overrun). El DMA nunca pierde el
+ * sincronismo y al volver el loop no hay mas errores.
+ */
+static void test_stall(void)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+	uint32_t prefill = config.period_count - 2;
+	uint32_t stall = AUDIO_RING_PERIODS + 2;
+
+	sim_reset();
+	CHECK(audio_loop_start(&config, NULL, NULL));
+
+	for (uint32_t i = 0; i < stall; i++)
+		stream_step(false);
+
+	CHECK_EQ(loopStream.tx.underrun, stall - prefill);
+	CHECK_EQ(loopStream.rx.overrun, stall - AUDIO_RING_PERIODS);
+	CHECK_EQ(audio_ring_count(&loopStream.rx), AUDIO_RING_PERIODS);
+
+	/* La mitad que llega antes de que el loop vuelva todavia falla */
+	stream_step(true);
+	CHECK_EQ(loopStream.tx.underrun, stall - prefill + 1);
+	CHECK_EQ(loopStream.rx.overrun, stall - AUDIO_RING_PERIODS + 1);
+
+	for (uint32_t i = 0; i < 32; i++)
+		stream_step(true);
+
+	CHECK_EQ(loopStream.tx.underrun, stall - prefill + 1);
+	CHECK_EQ(loopStream.rx.overrun, stall - AUDIO_RING_PERIODS + 1);
+	CHECK(sim_i2s_running());
+	CHECK_EQ(sim_stats()->starts, 1);
+}
+
+/**
+ * Una copia que no termino a tiempo deja su slot tomado: el bloque
+ * siguiente no la pisa, cuenta overrun / underrun y manda silencio.
+ */
+static void test_move_late(void)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+
+	sim_reset();
+	CHECK(audio_loop_start(&config, NULL, NULL));
+
+	sim_dma_hold(true);
+	sim_i2s_half();
+	CHECK(loopStream.rx_moving);
+	CHECK(loopStream.tx_moving);
+	sim_i2s_half();
+	CHECK_EQ(loopStream.rx.overrun, 1);
+	CHECK_EQ(loopStream.tx.underrun, 1);
+
+	sim_dma_hold(false);
+	sim_irq_run();
+	CHECK(!loopStream.rx_moving);
+	CHECK(!loopStream.tx_moving);
+	CHECK_EQ(audio_move_pending(), 0);
+	CHECK_EQ(audio_ring_count(&loopStream.rx), 1);
+}
+
+/**
+ * El stress: la fuente es la del loopback y el sink anota que periodo
+ * salio en cada mitad (STRESS_SILENT, o STRESS_WRONG si no es ninguno
+ * entero). El modelo repite los rings con colas de numeros de periodo.
+ */
+typedef struct
+{
+	audio_loopback_t lb;		//<--- First, audio_loop_source takes the same ctx
+	int32_t out[STRESS_HALVES];
+} stress_t;
+
+typedef struct
+{
+	int32_t rx[AUDIO_RING_PERIODS];
+	int32_t tx[AUDIO_RING_PERIODS];
+	uint32_t rx_count;
+	uint32_t tx_count;
+	uint32_t overrun;
+	uint32_t underrun;
+} stress_model_t;
+
+static void stress_sink(uint16_t *data, uint32_t halfwords, void *ctx)
+{
+	stress_t *st = ctx;
+	int32_t period = (data[0] >> 8) - 1;
+	bool silent = true;
+	bool match = period >= 0;
+
+	for (uint32_t i = 0; i < halfwords; i++)
+	{
+		silent = silent && data[i] == 0;
+		match = match && data[i] == audio_loop_tag((uint32_t)period, i);
+	}
+
+	if (st->lb.sent < STRESS_HALVES)
+		st->out[st->lb.sent] = silent ? STRESS_SILENT : (match ? period : STRESS_WRONG);
+	st->lb.sent++;
+}
+
+static uint32_t stress_rand(uint32_t *seed)
+{
+	*seed = *seed * 1664525U + 1013904223U;
+	return *seed >> 16;
+}
+
+static void model_push(int32_t *queue, uint32_t *count, int32_t period)
+{
+	queue[(*count)++] = period;
+}
+
+static int32_t model_pop(int32_t *queue, uint32_t *count)
+{
+	int32_t period = queue[0];
+
+	memmove(queue, queue + 1, sizeof(queue[0]) * --(*count));
+	return period;
+}
+
+/**
+ * Una mitad en audio_stream_block: rx entra si hay lugar, tx sale si hay
+ * algo. Devuelve lo que el callback puso en el buffer de salida.
+ */
+static int32_t model_half(stress_model_t *m, uint32_t half)
+{
+	if (m->rx_count < AUDIO_RING_PERIODS)
+		model_push(m->rx, &m->rx_count, (int32_t)(half & 0x7F));
+	else
+		m->overrun++;
+
+	if (m->tx_count > 0)
+		return model_pop(m->tx, &m->tx_count);
+
+	m->underrun++;
+	return STRESS_SILENT;
+}
+
+static void model_run(stress_model_t *m)
+{
+	while (m->rx_count > 0 && m->tx_count < AUDIO_RING_PERIODS)
+		model_push(m->tx, &m->tx_count, model_pop(m->rx, &m->rx_count));
+}
+
+/**
+ * El main loop corre despues de 0 a STRESS_MAX_DELAY mitades al azar
+ * (semilla fija): los contadores tienen que ser los de los atrasos que
+ * pasaron el prefill o llenaron rx, y cada mitad con audio tiene que ser
+ * el periodo recibido que el modelo dice, 2 mitades despues (el buffer
+ * del DMA).
+ */
+static void test_stress(uint32_t seed)
+{
+	static stress_t st;
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+	stress_model_t model = { .tx_count = config.period_count - 2 };
+	int32_t expected[STRESS_HALVES];
+	uint32_t half = 0;
+	uint32_t wrong = 0;
+	uint32_t silent = 0;
+	uint32_t runs = 0;
+	uint32_t rng = seed;
+
+	memset(&st, 0, sizeof(st));
+	for (uint32_t i = 0; i < model.tx_count; i++)
+		model.tx[i] = STRESS_SILENT;
+
+	sim_reset();
+	sim_i2s_io(audio_loop_source, stress_sink, &st);
+	CHECK(audio_loop_start(&config, NULL, NULL));
+
+	while (half < STRESS_HALVES)
+	{
+		uint32_t delay = stress_rand(&rng) % (STRESS_MAX_DELAY + 1);
+
+		for (uint32_t i = 0; i < delay && half < STRESS_HALVES; i++, half++)
+		{
+			int32_t cb_out = model_half(&model, half);
+
+			if (half + 2 < STRESS_HALVES)
+				expected[half + 2] = cb_out;
+			stream_step(false);
+		}
+
+		model_run(&model);
+		audio_loop_run();
+		runs++;
+	}
+
+	expected[0] = STRESS_SILENT;
+	expected[1] = STRESS_SILENT;
+	for (uint32_t i = 0; i < STRESS_HALVES; i++)
+	{
+		wrong += st.out[i] != expected[i];
+		silent += st.out[i] == STRESS_SILENT;
+	}
+
+	printf("stress %08lx: %lu runs, %lu silent, overrun %lu, underrun %lu\n", (unsigned long)seed, (unsigned long)runs,
+			(unsigned long)silent, (unsigned long)loopStream.rx.overrun, (unsigned long)loopStream.tx.underrun);
+
+	CHECK_EQ(st.lb.sent, STRESS_HALVES);
+	CHECK_EQ(wrong, 0);
+	CHECK_EQ(loopStream.rx.overrun, model.overrun);
+	CHECK_EQ(loopStream.tx.underrun, model.underrun);
+	CHECK(model.overrun > 0);
+	CHECK(model.underrun > 0);
+	CHECK_EQ(audio_loop_stats()->dropped, 0);
+	CHECK_EQ(audio_ring_count(&loopStream.rx), model.rx_count);
+	CHECK_EQ(audio_ring_count(&loopStream.tx), model.tx_count);
+	CHECK(sim_i2s_running());
+	CHECK_EQ(sim_stats()->starts, 1);
+}
+
+int main(void)
+{
+	test_latency(true);
+	test_latency(false);
+	test_stall();
+	test_move_late();
+	test_stress(1);
+	test_stress(0x5eed);
+	test_stress(0xC0FFEE);
+
+	TEST_END();
+}
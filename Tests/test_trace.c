@@ -0,0 +1,186 @@
+/**
+ * @file test_trace.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief audio_trace of the simulated stream decoded by Tools/trace_decode: period mean and jitter.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_loop.h"
+#include "audio_trace.h"
+#include "sim.h"
+#include "test.h"
+#include <libgen.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HALVES			64			//<--- About 5 records each, the ring does not wrap
+#define JITTER_CYCLES	20000		//<--- Each half arrives up to this early or late
+#define PREEMPT_HALF	(HALVES / 2)
+#define TOL_US			0.01		//<--- trace_decode prints two decimals
+
+typedef struct
+{
+	uint32_t n;
+	double mean;
+	double min;
+	double max;
+	double jitter;
+} period_t;
+
+static uint32_t prng = 12345;
+
+static int32_t jitter(void)
+{
+	prng = prng * 1103515245U + 12345U;
+	return (int32_t)((prng >> 8) % (2 * JITTER_CYCLES + 1)) - JITTER_CYCLES;
+}
+
+/**
+ * Lo que tiene que dar trace_decode: la diferencia entre las marcas de
+ * cada callback, en us.
+ */
+static period_t expected_period(const uint32_t *stamps, uint32_t n)
+{
+	period_t p = { .n = n - 1, .min = INFINITY, .max = -INFINITY };
+	double sum = 0;
+
+	for (uint32_t i = 1; i < n; i++)
+	{
+		double us = (double)(stamps[i] - stamps[i - 1]) * 1e6 / SystemCoreClock;
+
+		sum += us;
+		p.min = fmin(p.min, us);
+		p.max = fmax(p.max, us);
+	}
+
+	p.mean = sum / p.n;
+	p.jitter = p.max - p.min;
+	return p;
+}
+
+static bool decode(const char *tool, const char *dump, period_t *p)
+{
+	char cmd[8192];
+	char line[256];
+	bool found = false;
+	FILE *out;
+
+	snprintf(cmd, sizeof(cmd), "%s -q %s", tool, dump);
+	out = popen(cmd, "r");
+	if (out == NULL)
+		return false;
+
+	while (fgets(line, sizeof(line), out) != NULL)
+	{
+		printf("%s", line);
+		if (sscanf(line, "period n=%u mean=%lf us min=%lf max=%lf jitter=%lf",
+				&p->n, &p->mean, &p->min, &p->max, &p->jitter) == 5)
+			found = true;
+	}
+
+	return pclose(out) == 0 && found;
+}
+
+/**
+ * Cada mitad llega un periodo despues de la anterior mas un jitter
+ * conocido, el resto del tiempo lo gasta el simulador (HAL_GetTick). A
+ * mitad de camino el loop reserva un slot y la interrupcion lo adelanta:
+ * su registro queda antes con una marca posterior.
+ */
+static void test_period(const char *tool)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+	char dump[] = "/tmp/test_trace_XXXXXX";
+	uint32_t stamps[HALVES];
+	uint32_t period_cycles;
+	uint32_t late = 0;
+	uint32_t next;
+	period_t want;
+	period_t got = { 0 };
+	FILE *fp;
+	int fd;
+
+	config.sampling = SAMPLING_8K;
+	period_cycles = (uint32_t)((uint64_t)config.period_frames * SystemCoreClock / ES8311_sampling_hz(config.sampling));
+
+	sim_reset();
+	CHECK(audio_loop_start(&config, NULL, NULL));
+	next = AUDIO_TRACE_CYCLES() + period_cycles;
+
+	for (uint32_t i = 0; i < HALVES; i++)
+	{
+		uint32_t target = next + (uint32_t)jitter();
+		uint32_t slot = audio_trace_ring.head;
+
+		/* El firmware no llega a la proxima mitad si el jitter no deja lugar */
+		if ((int32_t)(target - AUDIO_TRACE_CYCLES()) < 0)
+			late++;
+		else
+			sim_advance_cycles(target - AUDIO_TRACE_CYCLES());
+		next += period_cycles;
+
+		if (i == PREEMPT_HALF)
+			audio_trace_ring.head++;
+
+		stamps[i] = AUDIO_TRACE_CYCLES();
+		sim_i2s_half();
+		sim_irq_run();
+
+		if (i == PREEMPT_HALF)
+		{
+			audio_trace_rec_t *preempted = &audio_trace_ring.rec[slot];
+			audio_trace_rec_t *isr = &audio_trace_ring.rec[slot + 1];
+
+			sim_advance_cycles(1000);
+			preempted->cycles = AUDIO_TRACE_CYCLES();
+			preempted->event = TRACE_MARK;
+			CHECK(isr->event == TRACE_I2S_HALF || isr->event == TRACE_I2S_CPLT);
+			CHECK((int32_t)(isr->cycles - preempted->cycles) < 0);
+		}
+
+		audio_loop_run();
+	}
+
+	CHECK_EQ(late, 0);
+	CHECK(audio_trace_ring.head <= AUDIO_TRACE_RECORDS);
+	CHECK_EQ(audio_loop_stats()->processed, HALVES);
+
+	fd = mkstemp(dump);
+	CHECK(fd >= 0);
+	fp = fdopen(fd, "wb");
+	CHECK(fp != NULL && fwrite(&audio_trace_ring, sizeof(audio_trace_ring), 1, fp) == 1);
+	fclose(fp);
+
+	want = expected_period(stamps, HALVES);
+	CHECK(decode(tool, dump, &got));
+	unlink(dump);
+
+	printf("period: %u, mean %.2f us, jitter %.2f us (expected %u, %.2f us, %.2f us)\n", got.n, got.mean, got.jitter,
+			want.n, want.mean, want.jitter);
+
+	CHECK_EQ(got.n, want.n);
+	CHECK(fabs(got.mean - want.mean) < TOL_US);
+	CHECK(fabs(got.min - want.min) < TOL_US);
+	CHECK(fabs(got.max - want.max) < TOL_US);
+	CHECK(fabs(got.jitter - want.jitter) < TOL_US);
+	CHECK(fabs(want.mean - period_cycles * 1e6 / SystemCoreClock) < 2.0 * JITTER_CYCLES * 1e6 / SystemCoreClock / HALVES);
+	CHECK(want.jitter <= 4.0 * JITTER_CYCLES * 1e6 / SystemCoreClock);
+}
+
+int main(int argc, char **argv)
+{
+	char tool[4096];
+
+	(void)argc;
+	snprintf(tool, sizeof(tool), "%s/trace_decode", dirname(strdup(argv[0])));
+
+	test_period(tool);
+
+	TEST_END();
+}
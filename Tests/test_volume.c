@@ -0,0 +1,178 @@
+/**
+ * @file test_volume.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief audio_volume fades through the codec ramp and the digital gain: monotonic, no jumps.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "audio_volume.h"
+#include "sim.h"
+#include "sim_es8311.h"
+#include "test.h"
+#include <math.h>
+
+#define ARRAY_LEN(a)	(sizeof(a) / sizeof((a)[0]))
+
+#define INPUT			4096		//<--- Constant input, +12 dB of digital gain still fits
+#define BLOCK_FRAMES	64
+#define MAX_STEP		0.06		//<--- Largest level change between two frames, relative
+#define MONOTONIC_TOL	0.005		//<--- Rounding of the digital gain, relative to the furthest level reached
+
+/**
+ * Cada paso pide un volumen con un modo. Entre ellos hay cambios que
+ * dejan ganancia digital y despues un fade HW que tiene que devolverla.
+ */
+typedef struct
+{
+	const char *name;
+	int16_t half_db;
+	uint32_t fade_ms;
+	audio_volume_ramp_t mode;
+} volume_step_t;
+
+static const volume_step_t steps[] =
+{
+	{ "dsp down", -7, 40, AUDIO_VOLUME_DSP },
+	{ "hw to codec", ES8311_DAC_VOL_INIT_HALF_DB, 20, AUDIO_VOLUME_HW },	//<--- Only the digital gain moves
+	{ "dsp 0 ms", 25, 0, AUDIO_VOLUME_DSP },
+	{ "hw down", -20, 30, AUDIO_VOLUME_HW },
+	{ "dsp -10 dB", -40, 40, AUDIO_VOLUME_DSP },
+	{ "hw -1 dB", -42, 30, AUDIO_VOLUME_HW },		//<--- Codec down, digital gain must not come back up
+	{ "auto 0 ms", 0, 0, AUDIO_VOLUME_AUTO },
+	{ "auto short", 10, 3, AUDIO_VOLUME_AUTO },
+	{ "dsp up", 30, 15, AUDIO_VOLUME_DSP },
+	{ "hw min", ES8311_DAC_VOL_MIN_HALF_DB, 100, AUDIO_VOLUME_HW },
+	{ "auto back", 0, 10, AUDIO_VOLUME_AUTO },
+};
+
+static sim_es8311_t codec;
+static audio_volume_t vol;
+
+/**
+ * El DAC del codec: cada 2^(rate+1) LRCK se mueve 0.25 dB hacia REG32,
+ * con rate de REG37 (0 salta directo).
+ */
+typedef struct
+{
+	int32_t quarter_db;
+	uint32_t lrck;
+} dac_t;
+
+static void dac_frame(dac_t *dac)
+{
+	int32_t target = 2 * ((int32_t)codec.reg[ES8311_DAC_REG32] - DAC_VOLUME_0DB);
+	uint32_t rate = codec.reg[ES8311_DAC_REG37] >> DAC_RAMPRATE_SHIFT;
+
+	if (rate == 0 || dac->quarter_db == target)
+	{
+		dac->quarter_db = target;
+		dac->lrck = 0;
+		return;
+	}
+
+	if (++dac->lrck < (1UL << (rate + 1)))
+		return;
+
+	dac->lrck = 0;
+	dac->quarter_db += (target > dac->quarter_db) ? 1 : -1;
+}
+
+static bool dac_settled(const dac_t *dac)
+{
+	return dac->quarter_db == 2 * ((int32_t)codec.reg[ES8311_DAC_REG32] - DAC_VOLUME_0DB);
+}
+
+/**
+ * Nivel a la salida relativo a la entrada: lo que dejo audio_volume_process
+ * por la ganancia del DAC en ese momento.
+ */
+static double level(const dac_t *dac, int16_t sample)
+{
+	return ((double)sample / INPUT) * pow(10.0, dac->quarter_db / 80.0);
+}
+
+static void run_step(const volume_step_t *s, dac_t *dac)
+{
+	int16_t block[BLOCK_FRAMES * AUDIO_DSP_CHANNELS];
+	double prev;
+	double now;
+	double reached;				//<--- Furthest level in the direction of the fade
+	double worst_step = 0;
+	uint32_t backwards = 0;
+	uint32_t jumps = 0;
+	uint32_t frames = 0;
+	int32_t dir = (s->half_db > audio_volume_get(&vol)) ? 1 : -1;
+
+	/* Nivel del ultimo frame antes del cambio */
+	for (uint32_t i = 0; i < ARRAY_LEN(block); i++)
+		block[i] = INPUT;
+	audio_volume_process(&vol, block, block, 1);
+	prev = level(dac, block[0]);
+	reached = prev;
+
+	CHECK(audio_volume_set(&vol, s->half_db, s->fade_ms, s->mode));
+	CHECK(ES8311_async_wait(10));
+	CHECK_EQ(audio_volume_get(&vol), s->half_db);
+
+	/* Hasta que el codec y la rampa digital llegan, con un limite de 2 s */
+	while (frames < 2 * vol.sample_rate &&
+			(!dac_settled(dac) || vol.ramp.gain_q16 != vol.ramp.target_q16 || frames == 0))
+	{
+		for (uint32_t i = 0; i < ARRAY_LEN(block); i++)
+			block[i] = INPUT;
+		audio_volume_process(&vol, block, block, BLOCK_FRAMES);
+
+		for (uint32_t f = 0; f < BLOCK_FRAMES; f++)
+		{
+			dac_frame(dac);
+			now = level(dac, block[f * AUDIO_DSP_CHANNELS]);
+
+			/* Contra lo mas lejos que llego, una subida lenta a mitad del fade tambien cuenta */
+			if (dir * (now - reached) < -MONOTONIC_TOL * fmax(now, reached))
+				backwards++;
+			if (dir * (now - reached) > 0)
+				reached = now;
+			if (fabs(now - prev) / fmax(now, prev) > worst_step)
+				worst_step = fabs(now - prev) / fmax(now, prev);
+			if (fabs(now - prev) > MAX_STEP * fmax(now, prev))
+				jumps++;
+			prev = now;
+		}
+		frames += BLOCK_FRAMES;
+	}
+
+	printf("%-12s %+6.1f dB in %4lu ms: codec %+6.1f dB, dsp %+5.1f dB, worst step %.2f%%\n", s->name,
+			s->half_db / 2.0, (unsigned long)(frames * 1000ULL / vol.sample_rate), vol.codec_half_db / 2.0,
+			vol.dsp_half_db / 2.0, worst_step * 100);
+
+	CHECK(dac_settled(dac));
+	CHECK_EQ(vol.ramp.gain_q16, vol.ramp.target_q16);
+	CHECK_EQ(backwards, 0);
+	CHECK_EQ(jumps, 0);
+	CHECK(fabs(20 * log10(prev) - s->half_db / 2.0) < 0.1);
+	CHECK(vol.dsp_half_db <= AUDIO_VOLUME_DSP_MAX_HALF_DB);
+}
+
+int main(void)
+{
+	es8311_audio_config_t config = ES8311_AUDIO_CONFIG_DEFAULT;
+	dac_t dac;
+
+	sim_reset();
+	sim_es8311_init(&codec);
+	sim_es8311_attach(&codec);
+	CHECK(ES8311_init(&config));
+
+	audio_volume_init(&vol, ES8311_sampling_hz(config.sampling), ES8311_DAC_VOL_INIT_HALF_DB);
+	dac.quarter_db = 2 * ES8311_DAC_VOL_INIT_HALF_DB;
+	dac.lrck = 0;
+
+	for (uint32_t i = 0; i < ARRAY_LEN(steps); i++)
+		run_step(&steps[i], &dac);
+
+	TEST_END();
+}
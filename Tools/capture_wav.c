@@ -0,0 +1,486 @@
+/**
+ * @file capture_wav.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Host side of audio_capture: framed UART stream to a WAV file.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Compilar en la PC:   cc -O2 -o capture_wav capture_wav.c
+ * Grabar:              ./capture_wav [-b baud] [-s segundos] [-g] /dev/ttyACM0 mic.wav
+ * Desde un archivo:    ./capture_wav dump.bin mic.wav   (o "-" para stdin)
+ *
+ * Si la entrada es una terminal se pone en modo raw a la velocidad pedida
+ * (por defecto AUDIO_CAPTURE_BAUD de main.c). Termina con Ctrl+C, al final
+ * de la entrada o a los -s segundos de audio. -g rellena con silencio los
+ * frames perdidos para que el WAV conserve la duracion real.
+ *
+ * Los frames en ADPCM o G.711 se decodifican, el WAV es siempre PCM 16 bits.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* Tiene que seguir a audio_capture.h */
+#define CAPTURE_SYNC0		0xA5
+#define CAPTURE_SYNC1		0x5A
+#define CAPTURE_HEADER		12
+#define CAPTURE_CRC			2
+#define CAPTURE_MAX_BYTES	4096		//<--- Larger payloads are taken as a false sync
+#define CAPTURE_MAX_SAMPLES	(2 * CAPTURE_MAX_BYTES)
+
+/* audio_capture_format_t */
+enum
+{
+	CAPTURE_PCM16,
+	CAPTURE_ADPCM,
+	CAPTURE_ALAW,
+	CAPTURE_ULAW,
+	CAPTURE_FORMATS
+};
+
+static const char *format_names[CAPTURE_FORMATS] = { "pcm16", "ima-adpcm", "a-law", "u-law" };
+
+/* Tiene que seguir a audio_codec.c */
+#define ADPCM_HEADER		4
+#define ADPCM_MAX_INDEX		88
+#define ULAW_BIAS			0x84
+
+#define WAV_HEADER			44
+
+typedef struct
+{
+	uint64_t frames;
+	uint64_t dropped;			//<--- Frames missing from the sequence
+	uint64_t crc_errors;
+	uint64_t skipped;			//<--- Bytes outside frames (printf text, noise)
+	uint64_t samples;			//<--- Samples written, silence included
+	uint64_t silence;
+} capture_stats_t;
+
+static const int16_t adpcm_steps[ADPCM_MAX_INDEX + 1] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t adpcm_index_adjust[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static uint16_t crc16(uint16_t crc, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		crc ^= (uint16_t)(data[i] << 8);
+		for (int b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * @brief Payload length for a format, 0 if the format is unknown.
+ */
+static uint32_t payload_bytes(uint8_t format, uint32_t samples)
+{
+	switch (format)
+	{
+	case CAPTURE_PCM16:	return 2 * samples;
+	case CAPTURE_ADPCM:	return ADPCM_HEADER + (samples + 1) / 2;
+	case CAPTURE_ALAW:
+	case CAPTURE_ULAW:	return samples;
+	default:			return 0;
+	}
+}
+
+static int16_t alaw_decode(uint8_t code)
+{
+	int32_t t;
+	uint32_t seg;
+
+	code ^= 0x55;
+	t = (code & 0x0F) << 4;
+	seg = (code & 0x70) >> 4;
+	if (seg == 0)
+		t += 8;
+	else
+		t = (t + 0x108) << (seg - 1);
+
+	return (int16_t)((code & 0x80) ? t : -t);
+}
+
+static int16_t ulaw_decode(uint8_t code)
+{
+	int32_t t;
+
+	code = (uint8_t)~code;
+	t = (((code & 0x0F) << 3) + ULAW_BIAS) << ((code & 0x70) >> 4);
+
+	return (int16_t)((code & 0x80) ? (ULAW_BIAS - t) : (t - ULAW_BIAS));
+}
+
+static bool adpcm_decode(int16_t *dst, const uint8_t *src, uint32_t samples)
+{
+	int32_t predictor = (int16_t)le16(src);
+	int32_t index = src[2];
+
+	if (index > ADPCM_MAX_INDEX || src[3] != 0)
+		return false;
+	src += ADPCM_HEADER;
+
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		uint32_t nibble = (i & 1) ? (src[i >> 1] >> 4) : (src[i >> 1] & 0x0F);
+		int32_t step = adpcm_steps[index];
+		int32_t vpdiff = step >> 3;
+
+		if (nibble & 4)
+			vpdiff += step;
+		if (nibble & 2)
+			vpdiff += step >> 1;
+		if (nibble & 1)
+			vpdiff += step >> 2;
+
+		predictor += (nibble & 8) ? -vpdiff : vpdiff;
+		if (predictor > INT16_MAX)
+			predictor = INT16_MAX;
+		else if (predictor < INT16_MIN)
+			predictor = INT16_MIN;
+		dst[i] = (int16_t)predictor;
+
+		index += adpcm_index_adjust[nibble & 7];
+		if (index < 0)
+			index = 0;
+		else if (index > ADPCM_MAX_INDEX)
+			index = ADPCM_MAX_INDEX;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Payload to 16 bit little endian samples, as they go in the WAV.
+ */
+static bool decode(uint8_t *dst, uint8_t format, const uint8_t *payload, uint32_t samples)
+{
+	static int16_t pcm[CAPTURE_MAX_SAMPLES];
+
+	switch (format)
+	{
+	case CAPTURE_PCM16:
+		memcpy(dst, payload, 2 * samples);
+		return true;
+	case CAPTURE_ADPCM:
+		if (!adpcm_decode(pcm, payload, samples))
+			return false;
+		break;
+	case CAPTURE_ALAW:
+		for (uint32_t i = 0; i < samples; i++)
+			pcm[i] = alaw_decode(payload[i]);
+		break;
+	case CAPTURE_ULAW:
+		for (uint32_t i = 0; i < samples; i++)
+			pcm[i] = ulaw_decode(payload[i]);
+		break;
+	default:
+		return false;
+	}
+
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		dst[2 * i] = (uint8_t)pcm[i];
+		dst[2 * i + 1] = (uint8_t)((uint16_t)pcm[i] >> 8);
+	}
+	return true;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, (uint16_t)v);
+	put16(p + 2, (uint16_t)(v >> 16));
+}
+
+/**
+ * @brief Write (or rewrite at the end) a 16 bit mono PCM header.
+ */
+static bool wav_header(FILE *fp, uint32_t rate, uint64_t samples)
+{
+	uint8_t h[WAV_HEADER];
+	uint64_t data = samples * 2;
+
+	if (data > UINT32_MAX - WAV_HEADER)
+		data = UINT32_MAX - WAV_HEADER;
+
+	memcpy(h, "RIFF", 4);
+	put32(h + 4, (uint32_t)(data + WAV_HEADER - 8));
+	memcpy(h + 8, "WAVEfmt ", 8);
+	put32(h + 16, 16);
+	put16(h + 20, 1);					//PCM
+	put16(h + 22, 1);					//mono
+	put32(h + 24, rate);
+	put32(h + 28, rate * 2);
+	put16(h + 32, 2);
+	put16(h + 34, 16);
+	memcpy(h + 36, "data", 4);
+	put32(h + 40, (uint32_t)data);
+
+	return fseek(fp, 0, SEEK_SET) == 0 && fwrite(h, 1, sizeof(h), fp) == sizeof(h) &&
+			fseek(fp, 0, SEEK_END) == 0;
+}
+
+static speed_t tty_speed(unsigned long baud)
+{
+	switch (baud)
+	{
+	case 115200:	return B115200;
+	case 230400:	return B230400;
+	case 460800:	return B460800;
+	case 921600:	return B921600;
+	case 1000000:	return B1000000;
+	case 1500000:	return B1500000;
+	case 2000000:	return B2000000;
+	default:		return B0;
+	}
+}
+
+static bool tty_raw(int fd, unsigned long baud)
+{
+	struct termios tio;
+	speed_t speed = tty_speed(baud);
+
+	if (speed == B0)
+	{
+		fprintf(stderr, "unsupported baud rate %lu\n", baud);
+		return false;
+	}
+	if (tcgetattr(fd, &tio) != 0)
+		return false;
+
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+
+	return tcsetattr(fd, TCSANOW, &tio) == 0 && tcflush(fd, TCIFLUSH) == 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-b baud] [-s seconds] [-g] input|- out.wav\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	const char *in_path = NULL;
+	const char *out_path = NULL;
+	unsigned long baud = 921600;
+	double seconds = 0.0;
+	bool fill_gaps = false;
+	capture_stats_t stats = { 0 };
+	static uint8_t buf[2 * (CAPTURE_HEADER + CAPTURE_MAX_BYTES + CAPTURE_CRC)];
+	static uint8_t zeros[2 * CAPTURE_MAX_SAMPLES];
+	static uint8_t samples_le[2 * CAPTURE_MAX_SAMPLES];
+	size_t used = 0;
+	uint32_t rate = 0;
+	int format = -1;
+	uint16_t expected = 0;
+	int fd;
+	FILE *out;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+			baud = strtoul(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			seconds = strtod(argv[++i], NULL);
+		else if (strcmp(argv[i], "-g") == 0)
+			fill_gaps = true;
+		else if (in_path == NULL)
+			in_path = argv[i];
+		else if (out_path == NULL)
+			out_path = argv[i];
+		else
+		{
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (in_path == NULL || out_path == NULL)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	fd = strcmp(in_path, "-") == 0 ? STDIN_FILENO : open(in_path, O_RDONLY | O_NOCTTY);
+	if (fd < 0)
+	{
+		perror(in_path);
+		return 1;
+	}
+	if (isatty(fd) && !tty_raw(fd, baud))
+	{
+		fprintf(stderr, "%s: can not configure the port\n", in_path);
+		return 1;
+	}
+
+	out = fopen(out_path, "w+b");
+	if (out == NULL || !wav_header(out, 8000, 0))
+	{
+		perror(out_path);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	while (!stop)
+	{
+		ssize_t n = read(fd, buf + used, sizeof(buf) - used);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		used += (size_t)n;
+
+		/**
+		 * Buscar sync, validar el header y esperar el frame completo. Si el
+		 * CRC no da se avanza un byte, el sync podia ser parte del texto.
+		 */
+		size_t pos = 0;
+		while (used - pos >= CAPTURE_HEADER)
+		{
+			const uint8_t *f = buf + pos;
+			uint16_t bytes = le16(f + 10);
+			uint16_t samples = le16(f + 8);
+
+			if (f[0] != CAPTURE_SYNC0 || f[1] != CAPTURE_SYNC1 || f[3] != 1 || bytes > CAPTURE_MAX_BYTES ||
+					samples == 0 || bytes != payload_bytes(f[2], samples) || le16(f + 6) == 0)
+			{
+				pos++;
+				stats.skipped++;
+				continue;
+			}
+			if (used - pos < CAPTURE_HEADER + (size_t)bytes + CAPTURE_CRC)
+				break;
+			if (crc16(0xFFFF, f, CAPTURE_HEADER + bytes) != le16(f + CAPTURE_HEADER + bytes) ||
+					!decode(samples_le, f[2], f + CAPTURE_HEADER, samples))
+			{
+				pos++;
+				stats.skipped++;
+				stats.crc_errors++;
+				continue;
+			}
+
+			uint16_t sequence = le16(f + 4);
+			uint32_t frame_rate = le16(f + 6);
+
+			if (rate == 0)
+			{
+				rate = frame_rate;
+				fprintf(stderr, "# %u Hz, first frame %u\n", rate, sequence);
+			}
+			else
+			{
+				uint16_t gap = (uint16_t)(sequence - expected);
+
+				if (gap != 0)
+				{
+					fprintf(stderr, "# %u frames lost before %u\n", gap, sequence);
+					stats.dropped += gap;
+					for (uint32_t g = 0; fill_gaps && g < gap; g++)
+					{
+						fwrite(zeros, 2, samples, out);
+						stats.samples += samples;
+						stats.silence += samples;
+					}
+				}
+				if (frame_rate != rate)
+					fprintf(stderr, "# rate changed to %u Hz, the WAV keeps %u\n", frame_rate, rate);
+			}
+			if (format != f[2])
+			{
+				format = f[2];
+				fprintf(stderr, "# %s frames\n", format_names[format]);
+			}
+			expected = (uint16_t)(sequence + 1);
+
+			if (fwrite(samples_le, 2, samples, out) != samples)
+			{
+				perror(out_path);
+				stop = 1;
+				break;
+			}
+			stats.frames++;
+			stats.samples += samples;
+			pos += CAPTURE_HEADER + bytes + CAPTURE_CRC;
+
+			if (seconds > 0.0 && stats.samples >= seconds * rate)
+			{
+				stop = 1;
+				break;
+			}
+		}
+
+		memmove(buf, buf + pos, used - pos);
+		used -= pos;
+	}
+
+	stats.skipped += used;
+	if (!wav_header(out, rate ? rate : 8000, stats.samples) || fclose(out) != 0)
+	{
+		perror(out_path);
+		return 1;
+	}
+
+	printf("frames      %llu\n", (unsigned long long)stats.frames);
+	printf("dropped     %llu", (unsigned long long)stats.dropped);
+	if (stats.frames + stats.dropped != 0)
+		printf(" (%.2f%%)", 100.0 * stats.dropped / (stats.frames + stats.dropped));
+	printf("\n");
+	printf("crc_errors  %llu\n", (unsigned long long)stats.crc_errors);
+	printf("skipped     %llu bytes\n", (unsigned long long)stats.skipped);
+	printf("audio       %.3f s", rate ? (double)stats.samples / rate : 0.0);
+	if (stats.silence != 0)
+		printf(" (%.3f s of silence for lost frames)", (double)stats.silence / rate);
+	printf("\n");
+
+	return stats.frames != 0 ? 0 : 1;
+}
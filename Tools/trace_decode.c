@@ -0,0 +1,305 @@
+/**
+ * @file trace_decode.c
+ * @author Gonzalo E. Sanchez (gonzalo.e.sds@gmail.com)
+ * @brief Host decoder of the audio_trace ring: timeline and period jitter.
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Compilar en la PC:   cc -O2 -o trace_decode trace_decode.c -lm
+ * Bajar el ring:       (gdb) dump binary value trace.bin audio_trace_ring
+ * Usar:                ./trace_decode [-q] [-f hclk_hz] trace.bin
+ *
+ * El dump puede ser de una region mas grande de RAM, se busca el "TRC1".
+ * -q muestra solo las estadisticas, -f fuerza el clock de los timestamps.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Tiene que seguir a audio_trace.h */
+#define TRACE_MAGIC			0x31435254UL
+#define TRACE_HEADER_BYTES	16
+#define TRACE_RECORD_BYTES	8
+
+enum
+{
+	TRACE_NONE,
+	TRACE_I2S_HALF,
+	TRACE_I2S_CPLT,
+	TRACE_RX_PUSH,
+	TRACE_TX_POP,
+	TRACE_OVERRUN,
+	TRACE_UNDERRUN,
+	TRACE_PROCESS_START,
+	TRACE_PROCESS_END,
+	TRACE_I2C,
+	TRACE_I2S_ERROR,
+	TRACE_I2S_RECOVER,
+	TRACE_SLEEP,
+	TRACE_WAKE,
+	TRACE_CLOCK,
+	TRACE_MARK,
+	TRACE_EVENTS
+};
+
+static const char *event_names[TRACE_EVENTS] =
+{
+	"none", "i2s_half", "i2s_cplt", "rx_push", "tx_pop", "overrun", "underrun",
+	"process_start", "process_end", "i2c", "i2s_error", "i2s_recover",
+	"sleep", "wake", "clock", "mark",
+};
+
+typedef struct
+{
+	uint32_t count;
+	double sum;
+	double sum_sq;
+	double min;
+	double max;
+} stat_t;
+
+static void stat_add(stat_t *s, double x)
+{
+	if (s->count == 0 || x < s->min)
+		s->min = x;
+	if (s->count == 0 || x > s->max)
+		s->max = x;
+	s->count++;
+	s->sum += x;
+	s->sum_sq += x * x;
+}
+
+static void stat_print(const char *name, const stat_t *s)
+{
+	double mean;
+	double var;
+
+	if (s->count == 0)
+	{
+		printf("%-16s no samples\n", name);
+		return;
+	}
+
+	mean = s->sum / s->count;
+	var = s->sum_sq / s->count - mean * mean;
+	printf("%-16s n=%-5u mean=%9.2f us  min=%9.2f  max=%9.2f  jitter=%8.2f  stddev=%7.2f\n",
+			name, s->count, mean, s->min, s->max, s->max - s->min, sqrt(var > 0 ? var : 0));
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-q] [-f hclk_hz] dump.bin\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = NULL;
+	bool quiet = false;
+	uint32_t force_hz = 0;
+	uint8_t *dump;
+	long size;
+	long offset = -1;
+	FILE *fp;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-q") == 0)
+			quiet = true;
+		else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+			force_hz = (uint32_t)strtoul(argv[++i], NULL, 0);
+		else if (path == NULL)
+			path = argv[i];
+		else
+		{
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (path == NULL)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	fp = fopen(path, "rb");
+	if (fp == NULL)
+	{
+		perror(path);
+		return 1;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	dump = malloc(size > 0 ? (size_t)size : 1);
+	if (dump == NULL || fread(dump, 1, (size_t)size, fp) != (size_t)size)
+	{
+		fprintf(stderr, "%s: read error\n", path);
+		return 1;
+	}
+	fclose(fp);
+
+	/* El ring esta alineado a 4 */
+	for (long i = 0; i + TRACE_HEADER_BYTES <= size; i += 4)
+	{
+		if (le32(dump + i) == TRACE_MAGIC)
+		{
+			offset = i;
+			break;
+		}
+	}
+	if (offset < 0)
+	{
+		fprintf(stderr, "%s: no trace ring found\n", path);
+		return 1;
+	}
+
+	const uint8_t *hdr = dump + offset;
+	uint32_t records = le32(hdr + 4);
+	uint32_t head = le32(hdr + 8);
+	uint32_t hz = force_hz ? force_hz : le32(hdr + 12);
+	uint32_t valid = head < records ? head : records;
+
+	if (records == 0 || (records & (records - 1)) != 0 || hz == 0 ||
+			offset + TRACE_HEADER_BYTES + (long)records * TRACE_RECORD_BYTES > size)
+	{
+		fprintf(stderr, "%s: bad header (records %u, hclk %u)\n", path, records, hz);
+		return 1;
+	}
+
+	printf("# %u records of %u, %u lost, hclk %u Hz\n", valid, records, head - valid, hz);
+
+	uint32_t counts[TRACE_EVENTS + 1] = { 0 };
+	uint32_t i2c_errors = 0;
+	stat_t period = { 0 };
+	stat_t wake = { 0 };
+	stat_t process = { 0 };
+	double t = 0.0;
+	double last_cb = -1.0;
+	double last_start = -1.0;
+	bool cb_pending = false;
+	uint32_t prev_cycles = 0;
+
+	for (uint32_t n = 0; n < valid; n++)
+	{
+		const uint8_t *rec = hdr + TRACE_HEADER_BYTES +
+				((head - valid + n) & (records - 1)) * TRACE_RECORD_BYTES;
+		uint32_t cycles = le32(rec);
+		uint8_t event = rec[4];
+		uint8_t arg8 = rec[5];
+		uint16_t arg16 = le16(rec + 6);
+		double dt = 0.0;
+
+		/**
+		 * Diferencias en 32 bits, el CYCCNT da la vuelta cada ~25 s a 168 MHz.
+		 * Con signo: una interrupcion entre la reserva del slot y la lectura
+		 * del CYCCNT deja su registro despues con una marca anterior.
+		 */
+		if (n > 0)
+			dt = (double)(int32_t)(cycles - prev_cycles) * 1e6 / hz;
+		prev_cycles = cycles;
+		t += dt;
+
+		counts[event < TRACE_EVENTS ? event : TRACE_EVENTS]++;
+
+		switch (event)
+		{
+		case TRACE_I2S_HALF:
+		case TRACE_I2S_CPLT:
+			if (last_cb >= 0)
+				stat_add(&period, t - last_cb);
+			last_cb = t;
+			cb_pending = true;
+			break;
+		case TRACE_PROCESS_START:
+			if (cb_pending)
+				stat_add(&wake, t - last_cb);
+			cb_pending = false;
+			last_start = t;
+			break;
+		case TRACE_PROCESS_END:
+			if (last_start >= 0)
+				stat_add(&process, t - last_start);
+			last_start = -1.0;
+			break;
+		case TRACE_I2C:
+			if (!(arg16 & 0x8000))
+				i2c_errors++;
+			break;
+		case TRACE_CLOCK:
+			/* Los timestamps siguientes cuentan al clock nuevo */
+			if (!force_hz && arg16 != 0)
+				hz = (uint32_t)arg16 * 1000000UL;
+			break;
+		default:
+			break;
+		}
+
+		if (quiet)
+			continue;
+
+		printf("%12.2f  %+9.2f  %-14s", t, dt, event < TRACE_EVENTS ? event_names[event] : "?");
+		switch (event)
+		{
+		case TRACE_I2S_HALF:
+		case TRACE_I2S_CPLT:
+			printf("  block %u", arg16);
+			break;
+		case TRACE_RX_PUSH:
+		case TRACE_TX_POP:
+			printf("  ring %u", arg8);
+			break;
+		case TRACE_OVERRUN:
+		case TRACE_UNDERRUN:
+			printf("  total %u", arg16);
+			break;
+		case TRACE_I2C:
+			printf("  %s reg 0x%02X = 0x%02X len %u %s", (arg16 & 0x4000) ? "rd" : "wr",
+					arg8, arg16 & 0xFF, (arg16 >> 8) & 0x3F, (arg16 & 0x8000) ? "ok" : "FAIL");
+			break;
+		case TRACE_I2S_RECOVER:
+			printf("  %u us", arg16);
+			break;
+		case TRACE_CLOCK:
+			printf("  %u MHz", arg16);
+			break;
+		case TRACE_MARK:
+			printf("  %u %u", arg8, arg16);
+			break;
+		default:
+			break;
+		}
+		printf("\n");
+	}
+
+	printf("\n# events\n");
+	for (uint32_t e = 1; e <= TRACE_EVENTS; e++)
+		if (counts[e] != 0)
+			printf("%-16s %u\n", e < TRACE_EVENTS ? event_names[e] : "unknown", counts[e]);
+	if (counts[TRACE_I2C] != 0)
+		printf("%-16s %u\n", "i2c_errors", i2c_errors);
+
+	printf("\n# timing\n");
+	stat_print("period", &period);
+	stat_print("wake_latency", &wake);
+	stat_print("process", &process);
+
+	free(dump);
+	return 0;
+}